@@ -115,6 +115,7 @@ TPCC_RECOVERY_DIR = "../results/tpcc/recovery/"
 
 TEST_NVM_DIR = "../results/test/nvm/"
 BTREE_DIR = "../results/btree/"
+SCALING_DIR = "../results/scaling/"
 ISE_DIR = "../results/ise/"
 NVM_BW_DIR = "../results/nvm_bw/"
 
@@ -126,6 +127,11 @@ BTREE_NODE_SIZE_DEFAULT = "512"
 BTREE_HEADER_FILE = "../src/common/pbtree.h"
 
 COW_BTREE_NODE_SIZE_DEFAULT = "4096"
+
+# XXX This should match the default value in "pbtree.h"
+# Runs with the scalar search go to BTREE_SCALAR_DIR
+BTREE_SIMD_DEFAULT = "1"
+BTREE_SCALAR_DIR = "../results/btree-scalar/"
 COW_BTREE_HEADER_FILE = "../src/common/cow_pbtree.h"
 
 # XXX These should match default values in "libpm.h"
@@ -141,6 +147,11 @@ ISE_HEADER_FILE = "../src/common/libpm.h"
 LABELS = ("InP", "CoW", "Log", "NVM-InP", "NVM-CoW", "NVM-Log")
 
 TPCC_TXNS = 1000000
+
+SCALING_EXECUTORS = [1, 2, 4, 8, 16, 32, 64]
+SCALING_MODES = {"partitioned" : [], "shared" : ['-S'], "two_pl" : ['-C'],
+                 "mvcc" : ['-M']}
+SCALING_SKEW = 0.5
 TEST_TXNS = 500000
 
 # SET FONT
@@ -1365,10 +1376,16 @@ def btree_plot(log_name):
     log_file.write('Start :: %s \n' % datetime.datetime.now())
 
     latency_list = MISC_LATENCIES
-    result_dir = BTREE_DIR
-    
-    # Go over all engines
-    for sy in SYSTEMS:    
+
+    # SIMD search, and the scalar search if it was evaluated
+    result_dirs = [(BTREE_DIR, "")]
+    if os.path.exists(BTREE_SCALAR_DIR):
+        result_dirs.append((BTREE_SCALAR_DIR, "-scalar"))
+
+    for result_dir, search in result_dirs:
+
+      # Go over all engines
+      for sy in SYSTEMS:    
         
         for lat in latency_list:
             datasets = {}
@@ -1386,7 +1403,7 @@ def btree_plot(log_name):
             print(datasets)                                        
             fig = create_btree_line_chart(datasets, sy)
                         
-            fileName = "btree-%s-%s.pdf" % (sy, lat)
+            fileName = "btree%s-%s-%s.pdf" % (search, sy, lat)
             saveGraph(fig, fileName, width= OPT_GRAPH_WIDTH, height=OPT_GRAPH_HEIGHT/1.5)
             
             
@@ -2060,6 +2077,54 @@ def ycsb_recovery_eval(log_name):
             result_file.close()    
 
 
+# SCALING -- EVAL
+def scaling_eval(log_name):
+    subprocess.call(['rm', '-rf', SCALING_DIR])
+
+    benchmarks = {"ycsb" : ['-y', '-x', str(YCSB_TXNS), '-k', str(YCSB_KEYS),
+                            '-p', str(0.5), '-q', str(SCALING_SKEW)],
+                  "tpcc" : ['-t', '-x', str(TPCC_TXNS)]}
+
+    # LOG RESULTS
+    log_file = open(log_name, 'w')
+
+    for bench, bench_flags in benchmarks.items():
+        for mode, mode_flags in SCALING_MODES.items():
+            for executors in SCALING_EXECUTORS:
+                ostr = ("SCALING :: %s %s %d \n" % (bench, mode, executors))
+                print (ostr, end="")
+                log_file.write(ostr)
+                log_file.flush()
+
+                cleanup(log_file)
+                subprocess.call([NSTORE, '-w', '-e', str(executors)] + bench_flags + mode_flags,
+                                stdout=log_file, stderr=log_file)
+
+    log_file.close()
+    log_file = open(log_name, "r")
+
+    for line in log_file:
+        if "SCALING" in line:
+            entry = line.strip().split(' ');
+            bench = entry[2]
+            mode = entry[3]
+            executors = entry[4]
+
+        if "Throughput" in line:
+            entry = line.strip().split(':');
+            val = float(entry[4]);
+
+            print(bench + ", " + mode + ", " + executors + " :: " + str(val))
+
+            result_directory = SCALING_DIR + bench + "/" + mode + "/";
+            if not os.path.exists(result_directory):
+                os.makedirs(result_directory)
+
+            result_file = open(result_directory + "scaling.csv", "a")
+            result_file.write(executors + " , " + str(val) + "\n")
+            result_file.close()
+
+
 # TPCC PERF -- EVAL
 def tpcc_perf_eval(enable_sdv, enable_trials, log_name):        
     dram_latency = 100
@@ -2539,6 +2604,7 @@ def test_nvm_eval(log_name):
 # BTREE -- EVAL
 def btree_eval(log_name):            
     subprocess.call(['rm', '-rf', BTREE_DIR])          
+    subprocess.call(['rm', '-rf', BTREE_SCALAR_DIR])          
 
     engines = ENGINES   
 
@@ -2572,6 +2638,18 @@ def btree_eval(log_name):
         btree_subdir = BTREE_DIR + btree_size + "/";
 
         ycsb_perf_eval(False, False, log_name, btree_subdir, MISC_LATENCIES)      
+
+        # Same size with the scalar search
+        simd_cmd = 's/BTREE_SIMD ' + BTREE_SIMD_DEFAULT + '/BTREE_SIMD 0/g';
+        subprocess.call(['sed', '-i', simd_cmd, BTREE_HEADER_FILE], stdout=log_file)
+        subprocess.call(['make', '-j'], stdout=log_file)
+
+        btree_subdir = BTREE_SCALAR_DIR + btree_size + "/";
+
+        ycsb_perf_eval(False, False, log_name, btree_subdir, MISC_LATENCIES)      
+
+        simd_cmd = 's/BTREE_SIMD 0/BTREE_SIMD ' + BTREE_SIMD_DEFAULT + '/g';
+        subprocess.call(['sed', '-i', simd_cmd, BTREE_HEADER_FILE], stdout=log_file)
         
         # Next iteration
         itr_count += 1;
@@ -2705,6 +2783,8 @@ if __name__ == '__main__':
 
     #parser.add_argument("-j", "--ise_eval", help='ise_eval', action='store_true')
     parser.add_argument("-p", "--ise_plot", help='ise_plot', action='store_true')
+
+    parser.add_argument("-v", "--scaling_eval", help='scaling_eval', action='store_true')
     
     args = parser.parse_args()
     
@@ -2731,6 +2811,7 @@ if __name__ == '__main__':
     test_nvm_log_name = "test_nvm.log"
     btree_log_name = "btree.log"
     ise_log_name = "ise.log"
+    scaling_log_name = "scaling.log"
             
     ################################ YCSB
     
@@ -2747,7 +2828,10 @@ if __name__ == '__main__':
         ycsb_recovery_eval(ycsb_recovery_log_name);             
 
     if args.ycsb_stack_eval:
-        ycsb_stack_eval(ycsb_stack_log_name);                    
+        ycsb_stack_eval(ycsb_stack_log_name);
+
+    if args.scaling_eval:
+        scaling_eval(scaling_log_name);                    
                           
     if args.ycsb_perf_plot:      
         ycsb_perf_plot(YCSB_PERF_DIR, LATENCIES, "");
@@ -0,0 +1,158 @@
+// Allocation latency of the pmem pool against heap fill level
+//
+// g++ -std=gnu++11 -O3 -I../../src/common alloc_test.cpp ../../src/libpm.a \
+//     -lrt -pthread -o alloc_test
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "libpm.h"
+#include "timer.h"
+
+using namespace std;
+using namespace storage;
+
+static void usage_exit(FILE *out) {
+  fprintf(
+      out,
+      "Command line options : alloc_test <options> \n"
+      "   -h --help              :  Print help message \n"
+      "   -p --pool-size         :  Pool size (MB) \n"
+      "   -o --ops               :  Timed reserve/free pairs per fill level \n"
+      "   -m --max-size          :  Max allocation size (bytes) \n");
+  exit(EXIT_FAILURE);
+}
+
+static struct option opts[] = { { "pool-size", optional_argument, NULL, 'p' },
+    { "ops", optional_argument, NULL, 'o' }, { "max-size", optional_argument,
+    NULL, 'm' }, { "help", no_argument, NULL, 'h' }, { NULL, 0, NULL, 0 } };
+
+class alloc_config {
+ public:
+
+  size_t pool_size;
+  size_t max_size;
+  unsigned int ops;
+
+  std::string path;
+};
+
+static void parse_arguments(int argc, char* argv[], alloc_config& state) {
+
+  // Default Values
+  state.pool_size = 1024UL * 1024 * 1024;
+  state.max_size = 8192;
+  state.ops = 16 * 1024;
+  state.path = "/dev/shm/alloc_test";
+
+  // Parse args
+  while (1) {
+    int idx = 0;
+    int c = getopt_long(argc, argv, "p:o:m:h", opts, &idx);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+      case 'p':
+        state.pool_size = atol(optarg) * 1024 * 1024;
+        cerr << "pool_size : " << state.pool_size << endl;
+        break;
+
+      case 'o':
+        state.ops = atoi(optarg);
+        cerr << "ops : " << state.ops << endl;
+        break;
+
+      case 'm':
+        state.max_size = atol(optarg);
+        cerr << "max_size : " << state.max_size << endl;
+        break;
+
+      case 'h':
+        usage_exit(stderr);
+        break;
+      default:
+        fprintf(stderr, "\nUnknown option: -%c-\n", c);
+        usage_exit(stderr);
+    }
+  }
+
+}
+
+struct block {
+  void* ptr;
+  size_t size;
+};
+
+int main(int argc, char **argv) {
+
+  alloc_config state;
+  parse_arguments(argc, argv, state);
+
+  unlink(state.path.c_str());
+  if ((pmp = pmemalloc_init(state.path.c_str(), state.pool_size)) == NULL) {
+    perror("pmemalloc_init");
+    exit(EXIT_FAILURE);
+  }
+
+  std::vector<block> live;
+  std::vector<block> timed(state.ops);
+  size_t live_bytes = 0;
+  size_t max_size = state.max_size;
+  unsigned int seed = 0;
+
+  // leave room for the timed allocations
+  size_t capacity = state.pool_size - state.ops * (max_size + 128);
+
+  printf("%8s %12s %12s\n", "fill(%)", "reserve(ns)", "free(ns)");
+
+  for (int fill = 0; fill <= 90; fill += 10) {
+    size_t target = capacity / 100 * fill;
+
+    // grow the heap, freeing a random block now and then to fragment it
+    while (live_bytes < target) {
+      block b;
+      b.size = 1 + rand_r(&seed) % max_size;
+      b.ptr = pmemalloc_reserve(b.size);
+      live.push_back(b);
+      live_bytes += b.size;
+
+      if (rand_r(&seed) % 3 == 0) {
+        size_t victim = rand_r(&seed) % live.size();
+        pmemalloc_free(live[victim].ptr);
+        live_bytes -= live[victim].size;
+        live[victim] = live.back();
+        live.pop_back();
+      }
+    }
+
+    timer reserve_tm, free_tm;
+
+    for (unsigned int itr = 0; itr < state.ops; itr++)
+      timed[itr].size = 1 + rand_r(&seed) % max_size;
+
+    reserve_tm.start();
+    for (unsigned int itr = 0; itr < state.ops; itr++)
+      timed[itr].ptr = pmemalloc_reserve(timed[itr].size);
+    reserve_tm.end();
+
+    free_tm.start();
+    for (unsigned int itr = 0; itr < state.ops; itr++)
+      pmemalloc_free(timed[itr].ptr);
+    free_tm.end();
+
+    printf("%8d %12.1f %12.1f\n", fill,
+           reserve_tm.duration() * 1000 * 1000 / state.ops,
+           free_tm.duration() * 1000 * 1000 / state.ops);
+  }
+
+  unlink(state.path.c_str());
+
+  return 0;
+}
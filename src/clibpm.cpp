@@ -1,5 +1,8 @@
 // clibpm
 
+#include <algorithm>
+#include <cpuid.h>
+
 #include "clibpm.h"
 
 std::mutex pmp_mutex;
@@ -47,18 +50,59 @@ void operator delete[](void *p) throw () {
 }
 
 void* pmalloc(size_t sz) {
+  // Small sizes are served by the thread arena
+  void* ret = storage::pmemalloc_arena_reserve(sz);
+  if (ret != NULL)
+    return ret;
+
   pmp_mutex.lock();
-  void* ret = storage::pmemalloc_reserve(sz);
+  ret = storage::pmemalloc_reserve(sz);
   pmp_mutex.unlock();
   return ret;
 }
 
 void pfree(void *p) {
+  // Freed before its batch ended, must not be activated
+  if (storage::pmem_tx_batch != NULL)
+    storage::pmemalloc_batch_forget(p);
+
+  if (storage::pmemalloc_arena_free(p))
+    return;
+
   pmp_mutex.lock();
   storage::pmemalloc_free(p);
   pmp_mutex.unlock();
 }
 
+// Frees num objects taking the pool mutex once, overwrites ptrs
+void pfree_batch(void **ptrs, size_t num) {
+  size_t num_locked = 0;
+
+  for (size_t itr = 0; itr < num; itr++) {
+    void* p = ptrs[itr];
+
+    if (!(LIBPM <= (unsigned long long) p
+        && (unsigned long long) p <= LIBPM + PMSIZE)) {
+      free(p);
+      continue;
+    }
+
+    if (storage::pmem_tx_batch != NULL)
+      storage::pmemalloc_batch_forget(p);
+
+    if (!storage::pmemalloc_arena_free(p))
+      ptrs[num_locked++] = p;
+  }
+
+  if (num_locked == 0)
+    return;
+
+  pmp_mutex.lock();
+  for (size_t itr = 0; itr < num_locked; itr++)
+    storage::pmemalloc_free(ptrs[itr]);
+  pmp_mutex.unlock();
+}
+
 namespace storage {
 
 unsigned int get_next_pp() {
@@ -126,12 +170,58 @@ struct clump {
 struct pool_header {
   char signature[16]; /* must be PMEM_SIGNATURE */
   size_t totalsize; /* total file size */
-  char padding[4096 - 16 - sizeof(size_t)];
+  struct pmem_batch* batches[PMEM_NUM_BATCHES]; /* activation batches */
+  char padding[4096 - 16 - sizeof(size_t)
+      - PMEM_NUM_BATCHES * sizeof(struct pmem_batch*)];
 };
 
 // Global memory pool
 void* pmp;
 
+// FLUSH PRIMITIVES
+
+// pmem_flush_supported -- does the cpu implement this flush mode
+static bool pmem_flush_supported(int mode) {
+  unsigned int eax, ebx, ecx, edx;
+
+  if (mode == PMEM_FLUSH_CLFLUSH)
+    return true;
+
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0)
+    return false;
+
+  if (mode == PMEM_FLUSH_CLFLUSHOPT)
+    return (ebx & bit_CLFLUSHOPT) != 0;
+  if (mode == PMEM_FLUSH_CLWB)
+    return (ebx & bit_CLWB) != 0;
+
+  return false;
+}
+
+// pmem_detect_flush_mode -- weakest flush the cpu supports
+int pmem_detect_flush_mode() {
+  if (pmem_flush_supported(PMEM_FLUSH_CLWB))
+    return PMEM_FLUSH_CLWB;
+  if (pmem_flush_supported(PMEM_FLUSH_CLFLUSHOPT))
+    return PMEM_FLUSH_CLFLUSHOPT;
+
+  return PMEM_FLUSH_CLFLUSH;
+}
+
+// pmem_set_flush_mode -- force a flush mode, false if the cpu lacks it
+bool pmem_set_flush_mode(int mode) {
+  if (mode == PMEM_FLUSH_AUTO)
+    mode = pmem_detect_flush_mode();
+
+  if (!pmem_flush_supported(mode))
+    return false;
+
+  pmem_flush_mode = mode;
+  return true;
+}
+
+int pmem_flush_mode = pmem_detect_flush_mode();
+
 // display pmem pool
 void pmemalloc_display() {
   struct clump* clp;
@@ -205,6 +295,96 @@ void check() {
 
 }
 
+// FREE SPACE INDEX
+
+static struct clump* free_bins[PMEM_NUM_BINS];
+static uint64_t free_bins_map;  // bit b is set iff bin b is not empty
+
+#define FREE_NEXT(clp) (*((struct clump **) &(clp)->ons[0].ptr_))
+#define FREE_PREV(clp) (*((struct clump **) &(clp)->ons[1].ptr_))
+
+// pmemalloc_bin -- bin of a clump of size sz
+static inline unsigned int pmemalloc_bin(size_t sz) {
+  return 63 - __builtin_clzl(sz);
+}
+
+// pmemalloc_index_insert -- add a FREE clump to the index
+static void pmemalloc_index_insert(struct clump *clp) {
+  unsigned int bin = pmemalloc_bin(clp->size & ~PMEM_STATE_MASK);
+
+  FREE_PREV(clp) = NULL;
+  FREE_NEXT(clp) = free_bins[bin];
+  if (free_bins[bin] != NULL)
+    FREE_PREV(free_bins[bin]) = clp;
+
+  free_bins[bin] = clp;
+  free_bins_map |= (1UL << bin);
+}
+
+// pmemalloc_index_remove -- drop a FREE clump before its size changes
+static void pmemalloc_index_remove(struct clump *clp) {
+  unsigned int bin = pmemalloc_bin(clp->size & ~PMEM_STATE_MASK);
+
+  if (FREE_PREV(clp) != NULL)
+    FREE_NEXT(FREE_PREV(clp)) = FREE_NEXT(clp);
+  else
+    free_bins[bin] = FREE_NEXT(clp);
+
+  if (FREE_NEXT(clp) != NULL)
+    FREE_PREV(FREE_NEXT(clp)) = FREE_PREV(clp);
+
+  if (free_bins[bin] == NULL)
+    free_bins_map &= ~(1UL << bin);
+}
+
+// pmemalloc_index_find -- FREE clump of at least nsize bytes, NULL if none
+static struct clump* pmemalloc_index_find(size_t nsize) {
+  unsigned int bin = pmemalloc_bin(nsize);
+  unsigned int itr = 0;
+  struct clump *clp;
+  uint64_t larger;
+
+  // good fit : first few clumps of the exact bin
+  for (clp = free_bins[bin]; clp != NULL && itr < PMEM_BIN_SCAN;
+      clp = FREE_NEXT(clp), itr++) {
+    if ((clp->size & ~PMEM_STATE_MASK) >= nsize)
+      return clp;
+  }
+
+  // any clump in a larger bin fits
+  larger = (bin + 1 < PMEM_NUM_BINS) ? (free_bins_map & (~0UL << (bin + 1))) : 0;
+  if (larger)
+    return free_bins[__builtin_ctzl(larger)];
+
+  // rest of the exact bin
+  for (; clp != NULL; clp = FREE_NEXT(clp)) {
+    if ((clp->size & ~PMEM_STATE_MASK) >= nsize)
+      return clp;
+  }
+
+  return NULL;
+}
+
+// pmemalloc_index_build -- index all FREE clumps of the pool
+static void pmemalloc_index_build(void* pmp) {
+  struct clump *clp;
+
+  for (unsigned int bin = 0; bin < PMEM_NUM_BINS; bin++)
+    free_bins[bin] = NULL;
+  free_bins_map = 0;
+
+  clp = ABS_PTR((struct clump *) PMEM_CLUMP_OFFSET);
+
+  while (clp->size) {
+    size_t sz = clp->size & ~PMEM_STATE_MASK;
+
+    if ((clp->size & PMEM_STATE_MASK) == PMEM_STATE_FREE)
+      pmemalloc_index_insert(clp);
+
+    clp = (struct clump *) ((uintptr_t) clp + sz);
+  }
+}
+
 // pmemalloc_recover -- recover after a possible crash
 static void pmemalloc_recover(void* pmp) {
 
@@ -232,6 +412,37 @@ static void pmemalloc_recover(void* pmp) {
   }
 }
 
+// pmemalloc_batch_recover -- activate objects of interrupted batches
+static void pmemalloc_batch_recover(void* pmp) {
+  struct pool_header *hdrp;
+  struct pmem_batch *batch;
+  struct clump *clp;
+
+  hdrp = ABS_PTR((struct pool_header *) PMEM_HDR_OFFSET);
+
+  for (unsigned int slot = 0; slot < PMEM_NUM_BATCHES; slot++) {
+    batch = hdrp->batches[slot];
+    if (batch == NULL)
+      continue;
+
+    for (size_t itr = 0; itr < PMEM_BATCH_SIZE; itr++) {
+      if (batch->ptrs[itr] == NULL)
+        continue;
+
+      clp = (struct clump *) ((uintptr_t) batch->ptrs[itr] - PMEM_CHUNK_SIZE);
+
+      if ((clp->size & PMEM_STATE_MASK) == PMEM_STATE_RESERVED) {
+        clp->size = (clp->size & ~PMEM_STATE_MASK) | PMEM_STATE_ACTIVE;
+        pmem_persist(clp, sizeof(*clp), 0);
+      }
+
+      batch->ptrs[itr] = NULL;
+    }
+
+    pmem_persist(batch->ptrs, sizeof(batch->ptrs), 0);
+  }
+}
+
 // pmemalloc_coalesce -- find adjacent free blocks and coalesce across pool
 static void pmemalloc_coalesce(void* pmp) {
   struct clump *clp;
@@ -260,6 +471,8 @@ static void pmemalloc_coalesce(void* pmp) {
     } else if (firstfree != NULL && lastfree != NULL) {
       firstfree->size = csize | PMEM_STATE_FREE;
       pmem_persist(firstfree, sizeof(*firstfree), 0);
+      clp->prevsize = csize;
+      pmem_persist(clp, sizeof(*clp), 0);
       firstfree = lastfree = NULL;
       csize = 0;
     } else {
@@ -274,6 +487,8 @@ static void pmemalloc_coalesce(void* pmp) {
   if (firstfree != NULL && lastfree != NULL) {
     firstfree->size = csize | PMEM_STATE_FREE;
     pmem_persist(firstfree, sizeof(*firstfree), 0);
+    clp->prevsize = csize;
+    pmem_persist(clp, sizeof(*clp), 0);
   }
 
 }
@@ -366,9 +581,13 @@ void *pmemalloc_init(const char *path, size_t size) {
    *  3. ACTIVATING clumps that need to be ACTIVE
    *  4. FREEING clumps that need to be freed
    *  5. adjacent free clumps that need to be coalesced
+   * interrupted activation batches are completed first, and then the free
+   * clumps are indexed.
    */
+  pmemalloc_batch_recover(pmp);
   pmemalloc_recover(pmp);
   pmemalloc_coalesce(pmp);
+  pmemalloc_index_build(pmp);
 
   return pmp;
 
@@ -386,115 +605,93 @@ void *pmemalloc_static_area() {
   return ABS_PTR((void *) PMEM_STATIC_OFFSET);
 }
 
-// ROTATING FIRST FIT
-struct clump* prev_clp = NULL;
+// SEGREGATED FIT
+
+// clump size (header included) used to satisfy a request of size bytes
+static inline size_t pmemalloc_clump_size(size_t size) {
+  if (size <= 64)
+    return 128;
+
+  return 64 + ((size + 63) & ~size_t(63));
+}
 
 // pmemalloc_reserve -- allocate memory, volatile until pmemalloc_activate()
 void *pmemalloc_reserve(size_t size) {
-  size_t nsize;
-
-  if (size <= 64) {
-    nsize = 128;
-  } else {
-    nsize = 64 + ((size + 63) & ~size_t(63));
-  }
+  size_t nsize = pmemalloc_clump_size(size);
 
   //cerr<<"size :: "<<size<<" nsize :: "<<nsize<<endl;
   struct clump *clp;
   struct clump* next_clp;
-  bool loop = false;
   DEBUG("size= %zu", nsize);
 
-  if (prev_clp != NULL) {
-    clp = prev_clp;
-  } else {
-    clp = ABS_PTR((struct clump *) PMEM_CLUMP_OFFSET);
+  clp = pmemalloc_index_find(nsize);
+
+  if (clp == NULL) {
+    printf("no free memory of size %lu available \n", nsize);
+    die();
+    //display();
+    errno = ENOMEM;
+    exit(EXIT_FAILURE);
+    return NULL;
   }
 
   DEBUG("clp= %p", clp);
 
-  /* first fit */
-  check:  //unsigned int itr = 0;
-  while (clp->size) {
-    DEBUG("************** itr :: %lu ", itr++);
-    size_t sz = clp->size & ~PMEM_STATE_MASK;
-    int state = clp->size & PMEM_STATE_MASK;
-    DEBUG("size : %lu state : %d", sz, state);
-
-    if (nsize <= sz) {
-      if (state == PMEM_STATE_FREE) {
-        void *ptr = (void *) (uintptr_t) clp + PMEM_CHUNK_SIZE
-            - (uintptr_t) pmp;
-        size_t leftover = sz - nsize;
-
-        DEBUG("fit found ptr 0x%lx, leftover %lu bytes", ptr, leftover);
-        if (leftover >= PMEM_CHUNK_SIZE * 2) {
-          struct clump *newclp;
-          newclp = (struct clump *) ((uintptr_t) clp + nsize);
-
-          DEBUG("splitting: [0x%lx] new clump", REL_PTR(newclp));
-          /*
-           * can go ahead and start fiddling with
-           * this freely since it is in the middle
-           * of a free clump until we change fields
-           * in *clp.  order here is important:
-           *  1. initialize new clump
-           *  2. persist new clump
-           *  3. initialize existing clump do list
-           *  4. persist existing clump
-           *  5. set new clump size, RESERVED
-           *  6. persist existing clump
-           */
-          PM_EQU((newclp->size), (leftover | PMEM_STATE_FREE));
-          PM_EQU((newclp->prevsize), (nsize));
-          pmem_persist(newclp, sizeof(*newclp), 0);
-
-          next_clp = (struct clump *) ((uintptr_t) newclp + leftover);
-          PM_EQU((next_clp->prevsize), (leftover));
-          pmem_persist(next_clp, sizeof(*next_clp), 0);
-
-          PM_EQU((clp->size), (nsize | PMEM_STATE_RESERVED));
-          pmem_persist(clp, sizeof(*clp), 0);
-
-          //DEBUG("validate new clump %p", REL_PTR(newclp));
-          //DEBUG("validate orig clump %p", REL_PTR(clp));
-          //DEBUG("validate next clump %p", REL_PTR(next_clp));
-        } else {
-          DEBUG("no split required");
-
-          PM_EQU((clp->size), (sz | PMEM_STATE_RESERVED));
-          pmem_persist(clp, sizeof(*clp), 0);
-
-          next_clp = (struct clump *) ((uintptr_t) clp + sz);
-          PM_EQU((next_clp->prevsize), (sz));
-          pmem_persist(next_clp, sizeof(*next_clp), 0);
-
-          //DEBUG("validate orig clump %p", REL_PTR(clp));
-          //DEBUG("validate next clump %p", REL_PTR(next_clp));
-        }
-
-        prev_clp = clp;
-        return ABS_PTR(ptr);
-      }
-    }
+  size_t sz = clp->size & ~PMEM_STATE_MASK;
+  void *ptr = (void *) (uintptr_t) clp + PMEM_CHUNK_SIZE - (uintptr_t) pmp;
+  size_t leftover = sz - nsize;
 
-    clp = (struct clump *) ((uintptr_t) clp + sz);
-    DEBUG("next clump :: [0x%lx]", REL_PTR(clp));
-  }
+  pmemalloc_index_remove(clp);
+
+  DEBUG("fit found ptr 0x%lx, leftover %lu bytes", ptr, leftover);
+  if (leftover >= PMEM_CHUNK_SIZE * 2) {
+    struct clump *newclp;
+    newclp = (struct clump *) ((uintptr_t) clp + nsize);
+
+    DEBUG("splitting: [0x%lx] new clump", REL_PTR(newclp));
+    /*
+     * can go ahead and start fiddling with
+     * this freely since it is in the middle
+     * of a free clump until we change fields
+     * in *clp.  order here is important:
+     *  1. initialize new clump
+     *  2. persist new clump
+     *  3. initialize existing clump do list
+     *  4. persist existing clump
+     *  5. set new clump size, RESERVED
+     *  6. persist existing clump
+     */
+    PM_EQU((newclp->size), (leftover | PMEM_STATE_FREE));
+    PM_EQU((newclp->prevsize), (nsize));
+    pmem_persist(newclp, sizeof(*newclp), 0);
+
+    next_clp = (struct clump *) ((uintptr_t) newclp + leftover);
+    PM_EQU((next_clp->prevsize), (leftover));
+    pmem_persist(next_clp, sizeof(*next_clp), 0);
+
+    PM_EQU((clp->size), (nsize | PMEM_STATE_RESERVED));
+    pmem_persist(clp, sizeof(*clp), 0);
+
+    pmemalloc_index_insert(newclp);
+
+    //DEBUG("validate new clump %p", REL_PTR(newclp));
+    //DEBUG("validate orig clump %p", REL_PTR(clp));
+    //DEBUG("validate next clump %p", REL_PTR(next_clp));
+  } else {
+    DEBUG("no split required");
+
+    PM_EQU((clp->size), (sz | PMEM_STATE_RESERVED));
+    pmem_persist(clp, sizeof(*clp), 0);
+
+    next_clp = (struct clump *) ((uintptr_t) clp + sz);
+    PM_EQU((next_clp->prevsize), (sz));
+    pmem_persist(next_clp, sizeof(*next_clp), 0);
 
-  if (loop == false) {
-    DEBUG("LOOP ");
-    loop = true;
-    clp = ABS_PTR((struct clump *) PMEM_CLUMP_OFFSET);
-    goto check;
+    //DEBUG("validate orig clump %p", REL_PTR(clp));
+    //DEBUG("validate next clump %p", REL_PTR(next_clp));
   }
 
-  printf("no free memory of size %lu available \n", nsize);
-  die();
-  //display();
-  errno = ENOMEM;
-  exit(EXIT_FAILURE);
-  return NULL;
+  return ABS_PTR(ptr);
 }
 
 // pmemalloc_activate -- atomically persist memory, mark in-use, store pointers
@@ -544,7 +741,8 @@ void pmemalloc_free(void *abs_ptr_) {
 
   lastfree = (struct clump *) ((uintptr_t) clp + sz);
   //DEBUG("validate lastfree %p", REL_PTR(lastfree));
-  if ((lastfree->size & PMEM_STATE_MASK) != PMEM_STATE_FREE)
+  if (lastfree->size == 0
+      || ((lastfree->size & PMEM_STATE_MASK) != PMEM_STATE_FREE))
     last = false;
 
   firstfree = (struct clump *) ((uintptr_t) clp - clp->prevsize);
@@ -559,6 +757,9 @@ void pmemalloc_free(void *abs_ptr_) {
     size_t first_sz = firstfree->size & ~PMEM_STATE_MASK;
     size_t last_sz = lastfree->size & ~PMEM_STATE_MASK;
     csize = first_sz + sz + last_sz;
+    pmemalloc_index_remove(firstfree);
+    pmemalloc_index_remove(lastfree);
+
     PM_EQU((firstfree->size), (csize | PMEM_STATE_FREE));
     pmem_persist(firstfree, sizeof(*firstfree), 0);
 
@@ -566,7 +767,7 @@ void pmemalloc_free(void *abs_ptr_) {
     PM_EQU((next_clp->prevsize), (csize));
     pmem_persist(next_clp, sizeof(*next_clp), 0);
 
-    prev_clp = firstfree;
+    pmemalloc_index_insert(firstfree);
 
     //DEBUG("validate firstfree %p", REL_PTR(firstfree));
   } else if (first) {
@@ -574,6 +775,8 @@ void pmemalloc_free(void *abs_ptr_) {
 
     size_t first_sz = firstfree->size & ~PMEM_STATE_MASK;
     csize = first_sz + sz;
+    pmemalloc_index_remove(firstfree);
+
     PM_EQU((firstfree->size), (csize | PMEM_STATE_FREE));
     pmem_persist(firstfree, sizeof(*firstfree), 0);
 
@@ -581,7 +784,7 @@ void pmemalloc_free(void *abs_ptr_) {
     PM_EQU((next_clp->prevsize), (csize));
     pmem_persist(next_clp, sizeof(*next_clp), 0);
 
-    prev_clp = firstfree;
+    pmemalloc_index_insert(firstfree);
 
     //DEBUG("validate firstfree %p", REL_PTR(firstfree));
     //DEBUG("validate lastfree %p", REL_PTR(firstfree));
@@ -590,6 +793,8 @@ void pmemalloc_free(void *abs_ptr_) {
     size_t last_sz = lastfree->size & ~PMEM_STATE_MASK;
 
     csize = sz + last_sz;
+    pmemalloc_index_remove(lastfree);
+
     PM_EQU((clp->size), (csize | PMEM_STATE_FREE));
     pmem_persist(clp, sizeof(*clp), 0);
 
@@ -597,7 +802,7 @@ void pmemalloc_free(void *abs_ptr_) {
     PM_EQU((next_clp->prevsize), (csize));
     pmem_persist(next_clp, sizeof(*next_clp), 0);
 
-    prev_clp = clp;
+    pmemalloc_index_insert(clp);
 
     //DEBUG("validate firstfree %p", REL_PTR(firstfree));
     //DEBUG("validate clump %p", REL_PTR(clp));
@@ -608,11 +813,331 @@ void pmemalloc_free(void *abs_ptr_) {
     PM_EQU((clp->size), (csize | PMEM_STATE_FREE));
     pmem_persist(clp, sizeof(*clp), 0);
 
+    pmemalloc_index_insert(clp);
+
     //DEBUG("validate clump %p", REL_PTR(clp));
   }
 
 }
 
+// ACTIVATION BATCHES
+
+thread_local struct pmem_batch* pmem_tx_batch = NULL;
+
+// Batch slots claimed by live threads
+static bool batch_claimed[PMEM_NUM_BATCHES];
+
+// Persistent batch owned by one thread, its slot is released on thread exit.
+// The number of logged objects is volatile, they fill the first slots.
+struct pmem_batch_owner {
+  pmem_batch_owner()
+      : batch(NULL),
+        slot(-1),
+        count(0) {
+  }
+
+  ~pmem_batch_owner() {
+    if (slot < 0)
+      return;
+
+    pmp_mutex.lock();
+    batch_claimed[slot] = false;
+    pmp_mutex.unlock();
+  }
+
+  struct pmem_batch* batch;
+  int slot;
+  size_t count;
+};
+
+static thread_local pmem_batch_owner batch_owner;
+
+// pmemalloc_batch_claim -- find a batch slot for this thread
+static void pmemalloc_batch_claim() {
+  struct pool_header *hdrp;
+  struct pmem_batch *batch;
+
+  hdrp = ABS_PTR((struct pool_header *) PMEM_HDR_OFFSET);
+
+  pmp_mutex.lock();
+  for (int slot = 0; slot < PMEM_NUM_BATCHES; slot++) {
+    if (batch_claimed[slot])
+      continue;
+
+    batch = hdrp->batches[slot];
+    if (batch == NULL) {
+      batch = (struct pmem_batch *) pmemalloc_reserve(sizeof(*batch));
+      PM_MEMSET((batch->ptrs), (0), (sizeof(batch->ptrs)));
+      pmemalloc_activate_helper(batch);
+
+      PM_EQU((hdrp->batches[slot]), (batch));
+      pmem_persist(&hdrp->batches[slot], sizeof(batch), 0);
+    }
+
+    batch_claimed[slot] = true;
+    batch_owner.batch = batch;
+    batch_owner.slot = slot;
+    batch_owner.count = 0;
+    break;
+  }
+  pmp_mutex.unlock();
+}
+
+// pmemalloc_batch_flush -- flip logged clumps to ACTIVE, one fence
+static void pmemalloc_batch_flush(struct pmem_batch *batch) {
+  struct clump *clp;
+  size_t count = batch_owner.count;
+
+  if (count == 0)
+    return;
+
+  for (size_t itr = 0; itr < count; itr++) {
+    clp = (struct clump *) ((uintptr_t) batch->ptrs[itr] - PMEM_CHUNK_SIZE);
+
+    if ((clp->size & PMEM_STATE_MASK) == PMEM_STATE_RESERVED) {
+      PM_EQU((clp->size), ((clp->size & ~PMEM_STATE_MASK) | PMEM_STATE_ACTIVE));
+      pmem_flush_cache(clp, sizeof(*clp), 0);
+    }
+  }
+  pmem_drain();
+  PM_FENCE();
+
+  // the next drain orders the cleared slots, a stale slot only activates
+  // the same clump again on recovery
+  for (size_t itr = 0; itr < count; itr++)
+    PM_EQU((batch->ptrs[itr]), (NULL));
+  pmem_flush_cache(batch->ptrs, count * sizeof(void*), 0);
+  batch_owner.count = 0;
+}
+
+// pmemalloc_batch_begin -- defer activations of this thread
+void pmemalloc_batch_begin() {
+  if (batch_owner.batch == NULL)
+    pmemalloc_batch_claim();
+
+  // out of slots, activate right away
+  pmem_tx_batch = batch_owner.batch;
+}
+
+// pmemalloc_batch_add -- flush object and log it for activation
+void pmemalloc_batch_add(void *abs_ptr_) {
+  struct pmem_batch *batch = pmem_tx_batch;
+  struct clump *clp;
+
+  clp = (struct clump *) ((uintptr_t) abs_ptr_ - PMEM_CHUNK_SIZE);
+  pmem_flush_cache(abs_ptr_, (clp->size & ~PMEM_STATE_MASK) - PMEM_CHUNK_SIZE,
+                   0);
+
+  if (batch_owner.count == PMEM_BATCH_SIZE)
+    pmemalloc_batch_flush(batch);
+
+  // the object may be linked as soon as we return, log it before. weak
+  // flushes are unordered with the stores that link the object, so one
+  // drain covers both the object and its slot.
+  PM_EQU((batch->ptrs[batch_owner.count]), (abs_ptr_));
+  pmem_flush_cache(&batch->ptrs[batch_owner.count], sizeof(void*), 0);
+  pmem_drain();
+  batch_owner.count++;
+}
+
+// pmemalloc_batch_forget -- drop an object freed before its batch ended
+void pmemalloc_batch_forget(void *abs_ptr_) {
+  struct pmem_batch *batch = pmem_tx_batch;
+
+  for (size_t itr = batch_owner.count; itr-- > 0;) {
+    if (batch->ptrs[itr] != abs_ptr_)
+      continue;
+
+    // move the last object into the slot before clearing its own
+    size_t last = --batch_owner.count;
+    PM_EQU((batch->ptrs[itr]), (batch->ptrs[last]));
+    pmem_flush_cache(&batch->ptrs[itr], sizeof(void*), 0);
+    pmem_drain();
+    PM_EQU((batch->ptrs[last]), (NULL));
+    pmem_flush_cache(&batch->ptrs[last], sizeof(void*), 0);
+  }
+}
+
+// pmemalloc_batch_end -- activate all objects logged since begin
+void pmemalloc_batch_end() {
+  if (pmem_tx_batch == NULL)
+    return;
+
+  pmemalloc_batch_flush(pmem_tx_batch);
+  pmem_tx_batch = NULL;
+}
+
+// THREAD ARENAS
+
+// pmemalloc_arena_class -- size class of a clump, -1 if not cached
+static inline int pmemalloc_arena_class(size_t clump_sz) {
+  if (clump_sz < PMEM_ARENA_MIN_CLUMP || clump_sz > PMEM_ARENA_MAX_CLUMP)
+    return -1;
+
+  return (clump_sz - PMEM_ARENA_MIN_CLUMP) / PMEM_CHUNK_SIZE;
+}
+
+// Free clumps of one thread, kept RESERVED in the pool.
+// The free lists are volatile, they are linked through the first word of
+// each cached clump's payload and are simply dropped on a crash.
+struct pmem_arena {
+  pmem_arena()
+      : free_list(),
+        count() {
+  }
+
+  ~pmem_arena() {
+    for (int cls = 0; cls < PMEM_ARENA_NUM_CLASSES; cls++)
+      drain(cls, count[cls]);
+  }
+
+  inline void push(int cls, void* abs_ptr) {
+    *((void**) abs_ptr) = free_list[cls];
+    free_list[cls] = abs_ptr;
+    count[cls]++;
+  }
+
+  inline void* pop(int cls) {
+    void* abs_ptr = free_list[cls];
+    free_list[cls] = *((void**) abs_ptr);
+    count[cls]--;
+    return abs_ptr;
+  }
+
+  // return clumps to the global pool
+  void drain(int cls, unsigned int num) {
+    if (num == 0)
+      return;
+
+    pmp_mutex.lock();
+    while (num-- > 0 && free_list[cls] != NULL)
+      pmemalloc_free(pop(cls));
+    pmp_mutex.unlock();
+  }
+
+  void refill(int cls);
+
+  void* free_list[PMEM_ARENA_NUM_CLASSES];
+  unsigned int count[PMEM_ARENA_NUM_CLASSES];
+};
+
+static thread_local pmem_arena arena;
+
+// pmem_arena::refill -- carve one large clump into clumps of class cls
+void pmem_arena::refill(int cls) {
+  struct clump *clp, *piece, *next_clp;
+  size_t csz = PMEM_ARENA_MIN_CLUMP + cls * PMEM_CHUNK_SIZE;
+  size_t num = PMEM_ARENA_REFILL_SIZE / csz;
+  size_t total, last_sz, pieces, itr;
+
+  if (num < PMEM_ARENA_MIN_REFILL)
+    num = PMEM_ARENA_MIN_REFILL;
+
+  pmp_mutex.lock();
+
+  void* abs_ptr = pmemalloc_reserve(num * csz - PMEM_CHUNK_SIZE);
+  if (abs_ptr == NULL) {
+    pmp_mutex.unlock();
+    return;
+  }
+
+  clp = (struct clump *) ((uintptr_t) abs_ptr - PMEM_CHUNK_SIZE);
+  total = clp->size & ~PMEM_STATE_MASK;
+  pieces = total / csz;
+  last_sz = total - (pieces - 1) * csz;
+
+  /*
+   * order here is important:
+   *  1. initialize all inner clumps as RESERVED, persist them
+   *  2. shrink the first clump, persist it
+   *  3. fix up prevsize of the clump after the last piece
+   * a crash before 2 frees the whole clump, a crash before 3 leaves a
+   * stale prevsize that coalescing at init rewrites.
+   */
+  for (itr = 1; itr < pieces; itr++) {
+    piece = (struct clump *) ((uintptr_t) clp + itr * csz);
+    PM_EQU((piece->size),
+           (((itr == pieces - 1) ? last_sz : csz) | PMEM_STATE_RESERVED));
+    PM_EQU((piece->prevsize), (csz));
+    pmem_flush_cache(piece, sizeof(*piece), 0);
+  }
+  pmem_drain();
+  PM_FENCE();
+
+  PM_EQU((clp->size), (csz | PMEM_STATE_RESERVED));
+  pmem_persist(clp, sizeof(*clp), 0);
+
+  next_clp = (struct clump *) ((uintptr_t) clp + total);
+  PM_EQU((next_clp->prevsize), (last_sz));
+  pmem_persist(next_clp, sizeof(*next_clp), 0);
+
+  // last piece absorbs the split leftover, it may not fit any class
+  piece = (struct clump *) ((uintptr_t) clp + (pieces - 1) * csz);
+  if (pmemalloc_arena_class(last_sz) < 0)
+    pmemalloc_free((void *) ((uintptr_t) piece + PMEM_CHUNK_SIZE));
+
+  pmp_mutex.unlock();
+
+  // hand out clumps in address order
+  if (pmemalloc_arena_class(last_sz) >= 0)
+    push(pmemalloc_arena_class(last_sz),
+         (void *) ((uintptr_t) piece + PMEM_CHUNK_SIZE));
+
+  for (itr = pieces - 1; itr-- > 0;) {
+    piece = (struct clump *) ((uintptr_t) clp + itr * csz);
+    push(cls, (void *) ((uintptr_t) piece + PMEM_CHUNK_SIZE));
+  }
+}
+
+// pmemalloc_arena_reserve -- allocate from the thread arena, NULL if too big
+void *pmemalloc_arena_reserve(size_t size) {
+  int cls = pmemalloc_arena_class(pmemalloc_clump_size(size));
+
+  if (cls < 0)
+    return NULL;
+
+  if (arena.free_list[cls] == NULL)
+    arena.refill(cls);
+
+  // pool exhausted
+  if (arena.free_list[cls] == NULL)
+    return NULL;
+
+  return arena.pop(cls);
+}
+
+// pmemalloc_arena_free -- cache a clump in the thread arena if it fits a class
+bool pmemalloc_arena_free(void *abs_ptr_) {
+  struct clump *clp;
+  size_t sz;
+  int cls;
+
+  if (abs_ptr_ == NULL)
+    return true;
+
+  clp = (struct clump *) ((uintptr_t) abs_ptr_ - PMEM_CHUNK_SIZE);
+  sz = clp->size & ~PMEM_STATE_MASK;
+  cls = pmemalloc_arena_class(sz);
+
+  if (cls < 0)
+    return false;
+
+  // back to RESERVED, recovery frees it if we crash before reuse
+  PM_EQU((clp->size), (sz | PMEM_STATE_RESERVED));
+  pmem_persist(clp, sizeof(*clp), 0);
+
+  arena.push(cls, abs_ptr_);
+
+  // too many cached clumps, give half of them back
+  size_t cache_max = PMEM_ARENA_CACHE_RATIO
+      * std::max((size_t) PMEM_ARENA_MIN_REFILL,
+                 (size_t) PMEM_ARENA_REFILL_SIZE / sz);
+  if (arena.count[cls] > cache_max)
+    arena.drain(cls, arena.count[cls] / 2);
+
+  return true;
+}
+
 //  pmemalloc_check -- check the consistency of a pmem pool
 void pmemalloc_check(const char *path) {
   void *pmp;
@@ -6,6 +6,8 @@
 #include "engine.h"
 #include "timer.h"
 #include "database.h"
+#include "status.h"
+#include "txn_stats.h"
 
 namespace storage {
 
@@ -20,9 +22,21 @@ class benchmark {
   }
 
   virtual void load() = 0;
-  virtual void execute() = 0;
   virtual void sim_crash() = 0;
 
+  // Runs all txns of the partition on the calling thread
+  void execute() {
+    execute_begin();
+    execute_txns(0, num_txns);
+    execute_end();
+  }
+
+  // A scheduler runs txns [begin, end) of the partition in batches between
+  // execute_begin() and execute_end(), on one thread at a time
+  virtual void execute_begin() = 0;
+  virtual void execute_txns(unsigned int begin, unsigned int end) = 0;
+  virtual void execute_end() = 0;
+
   virtual ~benchmark() {
   }
 
@@ -30,6 +44,14 @@ class benchmark {
   timer* tm;
   database* db;
   struct static_info* sp;
+
+  // Txns of the partition, the engine that runs them and the progress
+  unsigned int num_txns = 0;
+  engine* ee = NULL;
+  status progress;
+
+  // Commits and aborts per transaction type
+  txn_stats stats;
 };
 
 }
@@ -78,6 +78,41 @@ namespace storage {
 #define PMEM_STATE_ACTIVE 2 /* active (allocated) clump */
 #define PMEM_STATE_UNUSED 3 /* must be highest value + 1 */
 
+/*
+ * per-thread arenas : small clumps are cached in size classes (one class
+ * per 64B step) and carved out of one large reserved clump on refill.
+ * cached clumps stay RESERVED, so the first fit search and coalescing never
+ * touch them and recovery returns them to the FREE pool after a crash.
+ */
+#define PMEM_ARENA_MIN_CLUMP 128  /* smallest clump handed out by reserve */
+#define PMEM_ARENA_MAX_CLUMP 1088 /* 1KB payload + clump header */
+#define PMEM_ARENA_NUM_CLASSES \
+  ((PMEM_ARENA_MAX_CLUMP - PMEM_ARENA_MIN_CLUMP) / PMEM_CHUNK_SIZE + 1)
+#define PMEM_ARENA_REFILL_SIZE (16 * 1024) /* bytes carved per refill */
+#define PMEM_ARENA_MIN_REFILL 4 /* clumps carved per refill, at least */
+#define PMEM_ARENA_CACHE_RATIO 2 /* cached clumps / refill before draining */
+
+/*
+ * free space index : FREE clumps are kept in power-of-two bins, bin b holds
+ * clumps of size [2^b, 2^(b+1)). it is volatile and rebuilt at init, the
+ * links are stored in the unused ons[] of the free clump headers.
+ */
+#define PMEM_NUM_BINS 64
+#define PMEM_BIN_SCAN 8  /* clumps tried in the exact bin before a larger bin */
+
+/*
+ * activation batches : between pmemalloc_batch_begin() and
+ * pmemalloc_batch_end() pmemalloc_activate only flushes the object and logs
+ * it in a slot of the thread's persistent batch, with one drain. the clump
+ * states are flipped to ACTIVE at the end of the batch, followed by a single
+ * drain. the non-NULL slots are the log, there is no persistent count.
+ * batches hang off the pool header and pmemalloc_init activates whatever a
+ * crashed batch still holds, as if each object had been activated on its
+ * own.
+ */
+#define PMEM_NUM_BATCHES 64 /* threads that can hold a batch at once */
+#define PMEM_BATCH_SIZE 504 /* objects per batch, one 4KB clump */
+
 /* latency in ns */
 #define PCOMMIT_LATENCY 100
 
@@ -105,6 +140,13 @@ struct clump {
   } ons[PMEM_NUM_ON];
 };
 
+struct pmem_batch {
+  void* ptrs[PMEM_BATCH_SIZE];  // objects waiting for activation, or NULL
+};
+
+// batch of the current transaction, NULL when activating right away
+extern thread_local struct pmem_batch* pmem_tx_batch;
+
 
 #define ABS_PTR(p) ((decltype(p))(pmp + (uintptr_t)p))
 #define REL_PTR(p) ((decltype(p))((uintptr_t)p - (uintptr_t)pmp))
@@ -127,6 +169,18 @@ pmem_map(int fd, size_t len) {
   return base;
 }
 
+/*
+ * cache line flush primitive used by pmem_flush_cache, picked at startup
+ * with cpuid : clwb keeps the line cached, clflushopt evicts it but is not
+ * serializing, clflush is both. the weaker two need an sfence to drain.
+ */
+#define PMEM_FLUSH_AUTO -1
+#define PMEM_FLUSH_CLFLUSH 0
+#define PMEM_FLUSH_CLFLUSHOPT 1
+#define PMEM_FLUSH_CLWB 2
+
+extern int pmem_flush_mode;
+
 static inline void __pmem_flush_cache(void *addr, size_t len,
                                     __attribute((unused)) int flags) {
   uintptr_t uptr = (uintptr_t) addr & ~(ALIGN - 1);
@@ -150,12 +204,33 @@ static inline void __pmem_persist(void *addr, size_t len, int flags) {
   		uintptr_t uptr = (uintptr_t) addr & ~(ALIGN - 1);		\
   		uintptr_t end = (uintptr_t) addr + len;				\
 		uintptr_t *paddr;						\
-  		for (; uptr < end; uptr += ALIGN) {				\
-			paddr = (uintptr_t *) uptr;				\
-		        __asm__ __volatile__ ("clflush %0" : : 			\
+		switch (pmem_flush_mode) {					\
+		case PMEM_FLUSH_CLWB:						\
+  			for (; uptr < end; uptr += ALIGN) {			\
+				paddr = (uintptr_t *) uptr;			\
+				__asm__ __volatile__ ("clwb %0" : "+m"(*(paddr)));	\
+			}							\
+			break;							\
+		case PMEM_FLUSH_CLFLUSHOPT:					\
+  			for (; uptr < end; uptr += ALIGN) {			\
+				paddr = (uintptr_t *) uptr;			\
+				__asm__ __volatile__ ("clflushopt %0" : "+m"(*(paddr)));	\
+			}							\
+			break;							\
+		default:							\
+  			for (; uptr < end; uptr += ALIGN) {			\
+				paddr = (uintptr_t *) uptr;			\
+			        __asm__ __volatile__ ("clflush %0" : : 		\
 							  "m"(*(paddr)));  	\
-			/*PM_FLUSHOPT(((void*)uptr), ALIGN, ALIGN);*/		\
-  		}								\
+				/*PM_FLUSHOPT(((void*)uptr), ALIGN, ALIGN);*/	\
+			}							\
+			break;							\
+		}								\
+	})
+#define pmem_drain()								\
+	({									\
+		if (pmem_flush_mode != PMEM_FLUSH_CLFLUSH)			\
+			__builtin_ia32_sfence();				\
 	})
 #define pmem_persist(addr, len, flags)						\
 	({/*									\
@@ -182,6 +257,7 @@ static inline void __pmem_persist(void *addr, size_t len, int flags) {
 			(unsigned long long) (addr+len) <= LIBPM + PMSIZE);	\
 		} */								\
   		pmem_flush_cache(addr, len, flags);				\
+		pmem_drain();							\
 		PM_FENCE();							\
 	})
 		
@@ -212,18 +288,31 @@ static inline void __pmem_persist(void *addr, size_t len, int flags) {
 		pmem_persist(clp, sizeof(*clp), 0);				\
 	})
 
-#define pmemalloc_activate(abs_ptr)		\
-	pmemalloc_activate_helper(abs_ptr)
+#define pmemalloc_activate(abs_ptr)					\
+	({								\
+		if (pmem_tx_batch != NULL)				\
+			pmemalloc_batch_add(abs_ptr);			\
+		else							\
+			pmemalloc_activate_helper(abs_ptr);		\
+	})
 
 void debug(const char *file, int line, const char *func, const char *fmt, ...);
 void fatal(int err, const char *file, int line, const char *func,
            const char *fmt, ...);
 
+int pmem_detect_flush_mode();
+bool pmem_set_flush_mode(int mode);
 void *pmemalloc_init(const char *path, size_t size);
 void *pmemalloc_static_area();
 void *pmemalloc_reserve(size_t size);
 // void pmemalloc_activate(void *abs_ptr_);
 void pmemalloc_free(void *abs_ptr_);
+void pmemalloc_batch_begin();
+void pmemalloc_batch_add(void *abs_ptr_);
+void pmemalloc_batch_forget(void *abs_ptr_);
+void pmemalloc_batch_end();
+void *pmemalloc_arena_reserve(size_t size);
+bool pmemalloc_arena_free(void *abs_ptr_);
 void pmemalloc_check(const char *path);
 unsigned int get_next_pp();
 
@@ -32,6 +32,12 @@ enum engine_type {
   OPT_LSM
 };
 
+enum cc_type {
+  CC_NONE,
+  CC_2PL,
+  CC_MVCC
+};
+
 enum benchmark_type {
   BH_INVALID,
   TEST,
@@ -40,6 +46,7 @@ enum benchmark_type {
 };
 
 class benchmark;
+class shared_logger;
 
 class config {
  public:
@@ -54,6 +61,12 @@ class config {
   bool single;
   int num_executors;
 
+  // Worker threads that steal batches of the executors' txns, 0 for one
+  // thread per executor. Threads may be pinned to cores.
+  int num_workers;
+  int steal_batch_size;
+  bool pin_executors;
+
   bool read_only;
 
   double ycsb_per_writes;
@@ -68,6 +81,12 @@ class config {
 
   int gc_interval;
 
+  bool shared_log;
+  bool shared_db;
+  cc_type cc;
+  bool io_uring;
+  shared_logger* slog;
+
   int merge_interval;
   double merge_ratio;
 
@@ -80,6 +99,11 @@ class config {
 
   int test_benchmark_mode;
 
+  int flush_mode;
+
+  // Varchars of at most this many bytes, NUL included, live in their record
+  int inline_threshold;
+
   engine_type etype;
   benchmark_type btype;
 };
@@ -10,6 +10,8 @@
 #include "utils.h"
 #include "database.h"
 #include "libpm.h"
+#include "shared_logger.h"
+#include "scheduler.h"
 
 #include "test_benchmark.h"
 #include "ycsb_benchmark.h"
@@ -36,7 +38,10 @@ class coordinator {
     }
   }
 
-  void execute_bh(benchmark* bh) {
+  void execute_bh(benchmark* bh, bool pin) {
+    if (pin)
+      scheduler::pin_to_core(bh->tid);
+
     // Execute
     bh->execute();
   }
@@ -47,13 +52,18 @@ class coordinator {
   }
 
 
-  void eval(const config conf) {
+  void eval(config conf) {
+    if (conf.shared_log)
+      conf.slog = new shared_logger(conf.fs_path + "shared_log",
+                                    conf.gc_interval, conf.io_uring);
+
     if (!conf.recovery) {
       execute(conf);
     } else {
       recover(conf);
     }
 
+    delete conf.slog;
   }
 
   void execute(const config conf) {
@@ -61,8 +71,15 @@ class coordinator {
     std::vector<std::thread> loaders;
     benchmark** partitions = new benchmark*[num_executors]; // volatile
 
+    // One database for all executors, or one partition each
+    database* shared_db = NULL;
+    if (conf.shared_db)
+      shared_db = new database(conf, sp, 0); // volatile
+
     for (unsigned int i = 0; i < num_executors; i++) {
-      database* db = new database(conf, sp, i); // volatile
+      database* db = shared_db;
+      if (db == NULL)
+        db = new database(conf, sp, i); // volatile
       partitions[i] = get_benchmark(conf, i, db);
     }
 
@@ -84,22 +101,53 @@ class coordinator {
 	    mtm_enable_trace = conf.is_trace_enabled;
     }
     std::cerr << "EXECUTING..." << std::endl;
+    num_log_syncs = 0;
 
-    for (unsigned int i = 0; i < num_executors; i++)
-      executors.push_back(
-          std::thread(&coordinator::execute_bh, this, partitions[i]));
+    // Durations of the threads that ran the txns
+    std::vector<double> durations;
 
-    for (unsigned int i = 0; i < num_executors; i++)
-      executors[i].join();
+    if (conf.num_workers) {
+      for (unsigned int i = 0; i < num_executors; i++)
+        partitions[i]->execute_begin();
+
+      scheduler sched(partitions, num_executors, conf.num_workers,
+                      conf.steal_batch_size, conf.pin_executors);
+      sched.run(durations);
+
+      for (unsigned int i = 0; i < num_executors; i++)
+        partitions[i]->execute_end();
+
+      std::cerr << "Stolen batches : " << sched.steals() << std::endl;
+    } else {
+      for (unsigned int i = 0; i < num_executors; i++)
+        executors.push_back(
+            std::thread(&coordinator::execute_bh, this, partitions[i],
+                        conf.pin_executors));
+
+      for (unsigned int i = 0; i < num_executors; i++)
+        executors[i].join();
+
+      for (unsigned int i = 0; i < num_executors; i++)
+        durations.push_back(tms[i].duration());
+    }
 
     double max_dur = 0;
-    for (unsigned int i = 0; i < num_executors; i++) {
-      std::cerr << "dur :" << i << " :: " << tms[i].duration() << std::endl;
-      max_dur = std::max(max_dur, tms[i].duration());
+    for (unsigned int i = 0; i < durations.size(); i++) {
+      std::cerr << "dur :" << i << " :: " << durations[i] << std::endl;
+      max_dur = std::max(max_dur, durations[i]);
     }
     std::cerr << "max dur :" << max_dur << std::endl;
     display_stats(conf.etype, max_dur, num_txns);
 
+    txn_stats stats = partitions[0]->stats;
+    for (unsigned int i = 1; i < num_executors; i++)
+      stats.merge(partitions[i]->stats);
+    if (!stats.empty())
+      stats.display(max_dur);
+
+    std::cerr << "Log syncs : " << num_log_syncs << " Syncs/s : "
+              << (num_log_syncs * 1000.0) / max_dur << std::endl;
+
   }
 
   void recover(const config conf) {
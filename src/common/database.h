@@ -2,8 +2,12 @@
 
 #include "config.h"
 #include "table.h"
-#include "plist.h"
+#include "pvector.h"
 #include "cow_pbtree.h"
+#include "latch_table.h"
+#include "lock_manager.h"
+#include "version_manager.h"
+#include "epoch_manager.h"
 #include <set>
 
 namespace storage {
@@ -12,20 +16,46 @@ class database {
  public:
   database(config conf, struct static_info* sp, unsigned int tid)
       : tables(NULL),
-        log(NULL),
-        dirs(NULL) {
+        logs(NULL),
+        dirs(NULL),
+        latches(NULL),
+        locks(NULL),
+        versions(NULL),
+        epochs(NULL) {
 
     PM_EQU((sp->itr), (sp->itr + 1));
 
     // TABLES
-    plist<table*>* _tables = new ((plist<table*>*) pmalloc(sizeof(plist<table*>))) plist<table*>(&sp->ptrs[get_next_pp()],
-                                               					&sp->ptrs[get_next_pp()]);
+    pvector<table*>* _tables = new ((pvector<table*>*) pmalloc(sizeof(pvector<table*>))) pvector<table*>();
     pmemalloc_activate(_tables);
     tables = _tables;
 
-    // LOG
-    log = new ((plist<char*>*) pmalloc(sizeof(plist<char*>))) plist<char*>(&sp->ptrs[get_next_pp()], &sp->ptrs[get_next_pp()]);
-    pmemalloc_activate(log);
+    // LOGS, one per executor sharing the database
+    logs = new ((pvector<pvector<char*>*>*) pmalloc(sizeof(pvector<pvector<char*>*>))) pvector<pvector<char*>*>();
+    pmemalloc_activate(logs);
+
+    int num_logs = conf.shared_db ? conf.num_executors : 1;
+    for (int itr = 0; itr < num_logs; itr++) {
+      pvector<char*>* log = new ((pvector<char*>*) pmalloc(sizeof(pvector<char*>))) pvector<char*>();
+      pmemalloc_activate(log);
+      logs->push_back(log);
+    }
+
+    // LATCHES
+    if (conf.shared_db)
+      latches = new latch_table(); // volatile
+
+    // EPOCHS, reclamation behind concurrent readers
+    if (conf.shared_db)
+      epochs = global_epochs();
+
+    // LOCKS, two-phase locking across executors
+    if (conf.cc != cc_type::CC_NONE)
+      locks = new lock_manager(); // volatile
+
+    // VERSIONS, snapshots for read-only txns
+    if (conf.cc == cc_type::CC_MVCC)
+      versions = new version_manager(conf.num_executors); // volatile
 
     // DIRS
     if (conf.etype == engine_type::SP) {
@@ -45,12 +75,27 @@ class database {
 
   ~database() {
     // clean up tables
-    std::vector<table*> table_vec = tables->get_data();
-    for (table* table : table_vec)
+    for (table* table : *tables)
       delete table;
 
     delete tables;
-    delete[] log;
+
+    for (pvector<char*>* log : *logs)
+      delete log;
+    delete logs;
+
+    delete latches;
+    delete locks;
+    delete versions;
+
+    // Executors are gone, nothing is pinned
+    if (epochs != NULL)
+      epochs->drain();
+  }
+
+  // Undo log of an executor
+  pvector<char*>* get_log(unsigned int tid) {
+    return logs->at(tid % logs->size());
   }
 
   void reset(config& conf, unsigned int tid) {
@@ -64,25 +109,32 @@ class database {
 
     // Clear all table data and indices
     if (conf.etype == engine_type::WAL || conf.etype == engine_type::LSM) {
-      std::vector<table*> tab_vec = tables->get_data();
-
-      for (table* tab : tab_vec) {
+      for (table* tab : *tables) {
         tab->pm_data->clear();
-        std::vector<table_index*> indices = tab->indices->get_data();
-        for (table_index* index : indices) {
+        for (table_index* index : *tab->indices) {
           index->pm_map->clear();
           index->off_map->clear();
         }
       }
+    } else {
+      // Rebuild the heap state that is not persisted
+      for (table* tab : *tables)
+        tab->pm_data->recover();
     }
 
   }
 
-  plist<table*>* tables;
-  plist<char*>* log;
+  pvector<table*>* tables;
+  pvector<pvector<char*>*>* logs;
 
   // SP and OPT_SP
   cow_pbtree* dirs;
+
+  // Shared database
+  latch_table* latches;
+  lock_manager* locks;
+  version_manager* versions;
+  epoch_manager* epochs;
 };
 
 }
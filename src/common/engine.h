@@ -8,6 +8,7 @@
 #include "opt_wal_engine.h"
 #include "opt_sp_engine.h"
 #include "opt_lsm_engine.h"
+#include "two_pl_engine.h"
 
 namespace storage {
 
@@ -15,11 +16,15 @@ class engine {
  public:
   engine()
       : etype(engine_type::WAL),
-        de(NULL) {
+        de(NULL),
+        cc(NULL),
+        committed(true) {
   }
 
   engine(const config& conf, unsigned int tid, database* db, bool read_only)
-      : etype(conf.etype) {
+      : etype(conf.etype),
+        cc(NULL),
+        committed(true) {
 
     switch (conf.etype) {
       case engine_type::WAL:
@@ -30,7 +35,6 @@ class engine {
         de = new sp_engine(conf, db, read_only, tid);
         break;
       case engine_type::LSM:
-	die();
         de = new lsm_engine(conf, db, read_only, tid);
         break;
       case engine_type::OPT_WAL:
@@ -41,7 +45,6 @@ class engine {
         de = new opt_sp_engine(conf, db, read_only, tid);
         break;
       case engine_type::OPT_LSM:
-	die();
         de = new opt_lsm_engine(conf, db, read_only, tid);
         break;
       default:
@@ -50,6 +53,12 @@ class engine {
         break;
     }
 
+    // Concurrency control between executors sharing the database
+    if (conf.cc != cc_type::CC_NONE) {
+      cc = new two_pl_engine(db, de);
+      de = cc;
+    }
+
   }
 
   virtual ~engine() {
@@ -60,6 +69,10 @@ class engine {
     return (de->select(st));
   }
 
+  virtual bool select(const statement& st, record_view& view) {
+    return (de->select(st, view));
+  }
+
   virtual int insert(const statement& st) {
     return (de->insert(st));
   }
@@ -84,7 +97,13 @@ class engine {
     de->txn_begin();
   }
 
+  // A txn that only selects, it may read a snapshot
+  virtual void txn_begin_read_only() {
+    de->txn_begin_read_only();
+  }
+
   virtual void txn_end(bool commit) {
+    committed = commit && (cc == NULL || !cc->conflict());
     de->txn_end(commit);
   }
 
@@ -94,6 +113,10 @@ class engine {
 
   engine_type etype;
   engine_api* de;
+  two_pl_engine* cc;
+
+  // Outcome of the last transaction
+  bool committed;
 };
 
 }
@@ -2,6 +2,8 @@
 
 #include <string>
 #include "statement.h"
+#include "record_view.h"
+#include "serializer.h"
 
 namespace storage {
 
@@ -10,6 +12,22 @@ class engine_api {
   virtual ~engine_api() {}
 
   virtual std::string select(const statement& st) = 0;
+
+  // Select into a view, false if the key is not found. Engines that keep
+  // records in memory lend them, the others parse the selected text.
+  virtual bool select(const statement& st, record_view& view) {
+    schema* projection = st.projection;
+    std::string val = select(st);
+
+    if (val.empty()) {
+      view.reset();
+      return false;
+    }
+
+    serializer sr;
+    view.own(sr.deserialize(val, projection), true);
+    return true;
+  }
   virtual int insert(const statement& st) = 0;
   virtual int remove(const statement& st) = 0;
   virtual int update(const statement& st) = 0;
@@ -17,6 +35,9 @@ class engine_api {
   virtual void load(const statement& st) = 0;
 
   virtual void txn_begin() = 0;
+  virtual void txn_begin_read_only() {
+    txn_begin();
+  }
   virtual void txn_end(bool commit) = 0;
 
   virtual void recovery() = 0;
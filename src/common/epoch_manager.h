@@ -0,0 +1,217 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+
+#include "utils.h"
+
+namespace storage {
+
+// EPOCH MANAGER
+//
+// Safe reclamation for objects that other executors may still be reading,
+// like index nodes and records unlinked by a commit. A thread pins the
+// global epoch while it holds pointers into shared structures, and an
+// object it unlinks goes to its limbo list tagged with the epoch at that
+// time. The epoch moves on once every pinned thread has seen it, so an
+// object is freed two epochs after it was retired, when no thread that
+// could have reached it is still pinned.
+//
+// Pins nest, and only the outermost one publishes the epoch. Objects are
+// raw memory, persistent or volatile: a thread frees what expired in its
+// limbo list with one pfree_batch(), so the pool mutex is taken once per
+// batch instead of once per object.
+//
+// Threads get a dense id on first use that returns to the pool when they
+// exit. One epoch manager serves the whole process, see global_epochs().
+
+#define EPOCH_MAX_THREADS 256
+#define EPOCH_GC_BATCH 64
+
+// Dense id of the calling thread, reused once the thread exits
+inline unsigned int epoch_thread_id() {
+  static std::atomic<bool> in_use[EPOCH_MAX_THREADS];
+
+  struct thread_slot {
+    int id = -1;
+
+    ~thread_slot() {
+      if (id >= 0)
+        in_use[id].store(false, std::memory_order_release);
+    }
+  };
+
+  static thread_local thread_slot slot;
+
+  if (slot.id < 0) {
+    for (int itr = 0; itr < EPOCH_MAX_THREADS; itr++) {
+      bool expected = false;
+      if (!in_use[itr].load(std::memory_order_relaxed)
+          && in_use[itr].compare_exchange_strong(expected, true)) {
+        slot.id = itr;
+        break;
+      }
+    }
+
+    // More live threads than slots
+    assert(slot.id >= 0);
+  }
+
+  return slot.id;
+}
+
+class epoch_manager {
+ public:
+  epoch_manager()
+      : global_epoch(EPOCH_START),
+        num_threads(0) {
+    threads = new thread_state[EPOCH_MAX_THREADS];
+    for (unsigned int itr = 0; itr < EPOCH_MAX_THREADS; itr++) {
+      threads[itr].local_epoch.store(0);
+      threads[itr].depth = 0;
+    }
+  }
+
+  ~epoch_manager() {
+    drain();
+    delete[] threads;
+  }
+
+  // Pins the current epoch for the calling thread
+  void enter() {
+    thread_state& ts = state();
+
+    if (ts.depth++ > 0)
+      return;
+
+    // Publish before reading anything shared
+    ts.local_epoch.store(global_epoch.load() | ACTIVE);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  void exit() {
+    thread_state& ts = state();
+
+    if (--ts.depth > 0)
+      return;
+
+    ts.local_epoch.store(0, std::memory_order_release);
+  }
+
+  // Frees ptr once no pinned thread can reach it. The caller has unlinked
+  // it from every shared structure.
+  void retire(void* ptr) {
+    thread_state& ts = state();
+
+    ts.limbo.push_back({ptr, global_epoch.load()});
+    if (ts.limbo.size() % EPOCH_GC_BATCH == 0)
+      collect(ts);
+  }
+
+  // Frees everything retired, only when no thread is pinned
+  void drain() {
+    unsigned int max_threads = num_threads.load();
+
+    for (unsigned int itr = 0; itr < max_threads; itr++) {
+      std::vector<void*> batch;
+      for (const retired& item : threads[itr].limbo)
+        batch.push_back(item.ptr);
+
+      pfree_batch(batch.data(), batch.size());
+      threads[itr].limbo.clear();
+    }
+  }
+
+ private:
+  // Epochs move in steps of two, the low bit marks a pinned thread
+  static const uint64_t ACTIVE = 1;
+  static const uint64_t EPOCH_START = 2;
+  static const uint64_t EPOCH_STEP = 2;
+
+  struct retired {
+    void* ptr;
+    uint64_t epoch;
+  };
+
+  struct thread_state {
+    std::atomic<uint64_t> local_epoch;
+    unsigned int depth;
+    std::deque<retired> limbo;
+    char padding[64];
+  };
+
+  thread_state& state() {
+    unsigned int id = epoch_thread_id();
+
+    // Bound the scans to the ids in use
+    unsigned int cur = num_threads.load(std::memory_order_relaxed);
+    while (cur <= id && !num_threads.compare_exchange_weak(cur, id + 1))
+      ;
+
+    return threads[id];
+  }
+
+  // Moves the epoch on if every pinned thread has seen it
+  void try_advance() {
+    uint64_t epoch = global_epoch.load();
+    unsigned int max_threads = num_threads.load();
+
+    for (unsigned int itr = 0; itr < max_threads; itr++) {
+      uint64_t local = threads[itr].local_epoch.load();
+      if ((local & ACTIVE) && (local & ~ACTIVE) != epoch)
+        return;
+    }
+
+    global_epoch.compare_exchange_strong(epoch, epoch + EPOCH_STEP);
+  }
+
+  // Frees the objects of ts retired two or more epochs ago
+  void collect(thread_state& ts) {
+    try_advance();
+
+    uint64_t epoch = global_epoch.load();
+    std::vector<void*> batch;
+
+    while (!ts.limbo.empty()
+        && ts.limbo.front().epoch + 2 * EPOCH_STEP <= epoch) {
+      batch.push_back(ts.limbo.front().ptr);
+      ts.limbo.pop_front();
+    }
+
+    pfree_batch(batch.data(), batch.size());
+  }
+
+  std::atomic<uint64_t> global_epoch;
+  std::atomic<unsigned int> num_threads;
+  thread_state* threads;
+};
+
+// The epoch manager of the process. It is never destroyed, as its limbo
+// lists may hold persistent objects; databases drain() it on teardown.
+inline epoch_manager* global_epochs() {
+  static epoch_manager* epochs = new epoch_manager();
+  return epochs;
+}
+
+// Pins the epoch for a scope, a no-op without an epoch manager
+class epoch_guard {
+ public:
+  epoch_guard(epoch_manager* _epochs)
+      : epochs(_epochs) {
+    if (epochs != NULL)
+      epochs->enter();
+  }
+
+  ~epoch_guard() {
+    if (epochs != NULL)
+      epochs->exit();
+  }
+
+ private:
+  epoch_manager* epochs;
+};
+
+}
@@ -7,6 +7,9 @@
 
 namespace storage {
 
+// Default for config::inline_threshold
+#define VARCHAR_INLINE_THRESHOLD 128
+
 enum field_type {
   FD_INVALID,
   INTEGER,
@@ -21,7 +24,8 @@ struct field_info {
         deser_len(0),
         type(field_type::FD_INVALID),
         inlined(1),
-        enabled(1) {
+        enabled(1),
+        codec_offset(0) {
   }
 
   field_info(off_t _offset, size_t _ser_len, size_t _deser_len, field_type _type,
@@ -31,8 +35,12 @@ struct field_info {
         deser_len(_deser_len+1),
         type(_type),
         inlined(_inlined),
-        enabled(_enabled) {
+        enabled(_enabled),
+        codec_offset(0) {
 
+    // An inlined varchar keeps its chars and the NUL in its slot
+    if (type == field_type::VARCHAR && inlined)
+      ser_len = deser_len;
   }
 
   off_t offset;
@@ -41,7 +49,16 @@ struct field_info {
   field_type type;
   bool inlined;
   bool enabled;
+
+  // Offset in the binary encoding, set by the schema
+  off_t codec_offset;
 };
 
+// Whether a varchar of up to len chars is inlined in record::data. Longer
+// ones live in their own allocation that the slot points to.
+inline bool varchar_inlined(size_t len, int inline_threshold) {
+  return (inline_threshold > 0 && len + 1 <= (size_t) inline_threshold);
+}
+
 }
 
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING
+#endif
+#endif
+
+namespace storage {
+
+// IO RING
+//
+// A minimal io_uring with one submitter, used through raw syscalls. A write
+// and the fdatasync after it go out as linked entries in one
+// io_uring_enter. setup() returns false when the kernel or the headers do
+// not have io_uring, and callers then use pwrite and fdatasync.
+
+class io_ring {
+ public:
+  io_ring()
+      : ring_fd(-1) {
+  }
+
+  ~io_ring() {
+    close();
+  }
+
+#ifdef HAVE_IO_URING
+  bool setup(unsigned int entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring_fd < 0)
+      return false;
+
+    sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      sq_len = cq_len = std::max(sq_len, cq_len);
+
+    sq_ptr = (char*) mmap(NULL, sq_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd,
+                          IORING_OFF_SQ_RING);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      cq_ptr = sq_ptr;
+    else
+      cq_ptr = (char*) mmap(NULL, cq_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd,
+                            IORING_OFF_CQ_RING);
+
+    sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*) mmap(NULL, sqes_len, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring_fd,
+                                IORING_OFF_SQES);
+
+    if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+      ::close(ring_fd);
+      ring_fd = -1;
+      return false;
+    }
+
+    sq_tail = (unsigned*) (sq_ptr + params.sq_off.tail);
+    sq_mask = *(unsigned*) (sq_ptr + params.sq_off.ring_mask);
+    sq_array = (unsigned*) (sq_ptr + params.sq_off.array);
+
+    cq_head = (unsigned*) (cq_ptr + params.cq_off.head);
+    cq_tail = (unsigned*) (cq_ptr + params.cq_off.tail);
+    cq_mask = *(unsigned*) (cq_ptr + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*) (cq_ptr + params.cq_off.cqes);
+
+    return true;
+  }
+
+  // Write iov at offset, then fdatasync, and wait for both. Returns the
+  // bytes written, or -errno.
+  int write_sync(int fd, const struct iovec* iov, int iovcnt, off_t offset) {
+    size_t len = 0;
+    for (int itr = 0; itr < iovcnt; itr++)
+      len += iov[itr].iov_len;
+
+    io_uring_sqe* sqe = next_sqe();
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long) iov;
+    sqe->len = iovcnt;
+    sqe->off = offset;
+    sqe->user_data = 0;
+
+    sqe = next_sqe();
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->user_data = 1;
+
+    int ret = syscall(__NR_io_uring_enter, ring_fd, 2, 2,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0)
+      return -errno;
+
+    int write_res = 0, sync_res = 0;
+    reap(write_res, sync_res);
+
+    // A short write cancels the fsync, the caller finishes both
+    if (write_res >= 0 && (size_t) write_res == len && sync_res < 0)
+      return sync_res;
+
+    return write_res;
+  }
+
+  void close() {
+    if (ring_fd < 0)
+      return;
+
+    munmap(sqes, sqes_len);
+    if (cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_len);
+    munmap(sq_ptr, sq_len);
+    ::close(ring_fd);
+    ring_fd = -1;
+  }
+
+ private:
+  io_uring_sqe* next_sqe() {
+    unsigned tail = *sq_tail;
+    unsigned idx = tail & sq_mask;
+
+    io_uring_sqe* sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[idx] = idx;
+
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+  }
+
+  void reap(int& write_res, int& sync_res) {
+    unsigned head = *cq_head;
+
+    while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      io_uring_cqe* cqe = &cqes[head & cq_mask];
+
+      if (cqe->user_data == 0)
+        write_res = cqe->res;
+      else
+        sync_res = cqe->res;
+      head++;
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  char* sq_ptr;
+  char* cq_ptr;
+  size_t sq_len;
+  size_t cq_len;
+  size_t sqes_len;
+
+  unsigned* sq_tail;
+  unsigned sq_mask;
+  unsigned* sq_array;
+  io_uring_sqe* sqes;
+
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned cq_mask;
+  io_uring_cqe* cqes;
+#else
+  bool setup(__attribute__((unused)) unsigned int entries) {
+    return false;
+  }
+
+  int write_sync(__attribute__((unused)) int fd,
+                 __attribute__((unused)) const struct iovec* iov,
+                 __attribute__((unused)) int iovcnt,
+                 __attribute__((unused)) off_t offset) {
+    return -ENOSYS;
+  }
+
+  void close() {
+  }
+#endif
+
+ public:
+  bool enabled() const {
+    return ring_fd >= 0;
+  }
+
+  int ring_fd;
+};
+
+}
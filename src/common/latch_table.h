@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace storage {
+
+// LATCH TABLE
+//
+// Short-term latches for executors sharing a database, striped by table and
+// key. A write statement holds the latch of its key while it looks up and
+// changes the record, so two executors never modify one record or insert
+// one key at the same time. Readers take no latch.
+
+#define LATCH_TABLE_SIZE 4096
+#define LATCH_SPINS 128
+
+class latch_table {
+ public:
+  latch_table() {
+    for (unsigned int itr = 0; itr < LATCH_TABLE_SIZE; itr++)
+      latches[itr].locked.store(false);
+  }
+
+  void lock(unsigned int table_id, unsigned long key) {
+    std::atomic<bool>& locked = latches[stripe(table_id, key)].locked;
+
+    while (locked.exchange(true, std::memory_order_acquire)) {
+      // Spin a while, then let a preempted holder run
+      for (unsigned int spin = 0; locked.load(std::memory_order_relaxed);
+          spin++) {
+        if (spin < LATCH_SPINS) {
+#if defined(__x86_64__)
+          _mm_pause();
+#endif
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+  void unlock(unsigned int table_id, unsigned long key) {
+    latches[stripe(table_id, key)].locked.store(false,
+                                                std::memory_order_release);
+  }
+
+ private:
+  static unsigned int stripe(unsigned int table_id, unsigned long key) {
+    unsigned long h = (key ^ ((unsigned long) table_id << 56))
+        * 0x9E3779B97F4A7C15UL;
+    return (h >> 32) % LATCH_TABLE_SIZE;
+  }
+
+  // Padded to a cache line
+  struct latch {
+    std::atomic<bool> locked;
+    char padding[64 - sizeof(std::atomic<bool>)];
+  };
+
+  latch latches[LATCH_TABLE_SIZE];
+};
+
+// Holds a latch for one statement, no-op without a latch table
+class latch_guard {
+ public:
+  latch_guard(latch_table* _latches, unsigned int _table_id,
+              unsigned long _key)
+      : latches(_latches),
+        table_id(_table_id),
+        key(_key) {
+    if (latches != NULL)
+      latches->lock(table_id, key);
+  }
+
+  ~latch_guard() {
+    if (latches != NULL)
+      latches->unlock(table_id, key);
+  }
+
+ private:
+  latch_table* latches;
+  unsigned int table_id;
+  unsigned long key;
+};
+
+}
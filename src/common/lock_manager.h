@@ -1,80 +1,131 @@
 #pragma once
 
-#include  <map>
-#include "utils.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
 
 namespace storage {
 
-struct lock_t {
-  lock_t()
-      : locked(false),
-        writer(false),
-        readers(0) {
-  }
+// LOCK MANAGER
+//
+// A fixed-size table of lock words indexed by the tuple hash. Each word
+// holds a writer bit and a reader count and is changed with a
+// compare-and-swap, so lock traffic on different tuples never serializes
+// and no entry is ever allocated. Each word has its own cache line. Locks
+// are no-wait: a conflicting request fails at once and counts as an abort,
+// and the caller aborts its transaction. Tuples whose hashes share a slot
+// conflict with each other.
 
-  bool locked;
-  bool writer;
-  int readers;
-};
+#define LOCK_TABLE_SIZE (1 << 16)
 
 class lock_manager {
  public:
+  lock_manager(size_t _num_slots = LOCK_TABLE_SIZE)
+      : num_slots(_num_slots),
+        aborts(0) {
+    // num_slots is a power of two
+    mask = num_slots - 1;
+
+    lock_table = new lock_t[num_slots];
+    for (size_t itr = 0; itr < num_slots; itr++)
+      lock_table[itr].word.store(0);
+  }
+
+  ~lock_manager() {
+    delete[] lock_table;
+  }
 
   inline int tuple_rdlock(const unsigned long hash) {
+    std::atomic<uint64_t>& word = slot(hash);
+    uint64_t cur = word.load(std::memory_order_relaxed);
 
-    wrlock(&lock_table_rwlock);
-    if (!lock_table[hash].writer) {
-      lock_table[hash].readers++;
-      lock_table[hash].locked = true;
-      unlock(&lock_table_rwlock);
-      return 0;
-    }
-    unlock(&lock_table_rwlock);
+    do {
+      if (cur & WRITER) {
+        aborts.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+      }
+    } while (!word.compare_exchange_weak(cur, cur + 1,
+                                         std::memory_order_acquire));
 
-    //abort++;
-    return -1;
+    return 0;
   }
 
   inline int tuple_wrlock(const unsigned long hash) {
+    std::atomic<uint64_t>& word = slot(hash);
+    uint64_t cur = 0;
+
+    // Only a free tuple can be write locked
+    if (!word.compare_exchange_strong(cur, WRITER,
+                                      std::memory_order_acquire)) {
+      aborts.fetch_add(1, std::memory_order_relaxed);
+      return -1;
+    }
+
+    return 0;
+  }
+
+  // Turns the only read lock on a tuple into a write lock
+  inline int tuple_upgrade(const unsigned long hash) {
+    std::atomic<uint64_t>& word = slot(hash);
+    uint64_t cur = 1;
 
-    wrlock(&lock_table_rwlock);
-    if (lock_table[hash].readers == 0) {
-      lock_table[hash].writer = true;
-      lock_table[hash].locked = true;
-      unlock(&lock_table_rwlock);
-      return 0;
+    if (!word.compare_exchange_strong(cur, WRITER,
+                                      std::memory_order_acquire)) {
+      aborts.fetch_add(1, std::memory_order_relaxed);
+      return -1;
     }
-    unlock(&lock_table_rwlock);
 
-    //abort++;
-    return -1;
+    return 0;
   }
 
   inline int tuple_unlock(const unsigned long hash) {
+    std::atomic<uint64_t>& word = slot(hash);
+    uint64_t cur = word.load(std::memory_order_relaxed);
+    uint64_t next;
+
+    do {
+      if (cur & WRITER)
+        next = 0;
+      else if (cur != 0)
+        next = cur - 1;
+      else
+        return -1;
+    } while (!word.compare_exchange_weak(cur, next,
+                                         std::memory_order_release));
+
+    return 0;
+  }
 
-    wrlock(&lock_table_rwlock);
-    if (lock_table[hash].locked) {
-      if (lock_table[hash].readers != 0) {
-        lock_table[hash].readers--;
+  // Tuples with the same slot share one lock word
+  inline size_t slot_id(const unsigned long hash) const {
+    // Spread hashes that differ only in their high bits
+    unsigned long h = hash * 0x9E3779B97F4A7C15UL;
+    return (h >> 32) & mask;
+  }
 
-        if (lock_table[hash].readers == 0)
-          lock_table[hash].locked = false;
-      } else {
-        lock_table[hash].locked = false;
-        lock_table[hash].writer = false;
-      }
-      unlock(&lock_table_rwlock);
-      return 0;
-    }
-    unlock(&lock_table_rwlock);
+  // Requests that failed on a conflict
+  unsigned long num_aborts() const {
+    return aborts.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static const uint64_t WRITER = 1UL << 63;
+
+  // Padded to a cache line
+  struct lock_t {
+    std::atomic<uint64_t> word;
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+  };
 
-    return -1;
+  inline std::atomic<uint64_t>& slot(const unsigned long hash) {
+    return lock_table[slot_id(hash)].word;
   }
 
-  pthread_rwlock_t lock_table_rwlock = PTHREAD_RWLOCK_INITIALIZER;;
-  std::map<unsigned long, lock_t> lock_table;
+  lock_t* lock_table;
+  size_t num_slots;
+  size_t mask;
 
-  unsigned int abort = 0;
+  std::atomic<unsigned long> aborts;
 };
 
 }
@@ -4,9 +4,11 @@
 #include <unistd.h>
 #include <sstream>
 #include <string>
+#include <atomic>
 
 #include "record.h"
 #include "libpm.h"
+#include "utils.h"
 
 namespace storage {
 
@@ -37,11 +39,15 @@ class logger {
   }
 
   off_t push_back(std::string entry) {
+    return push_back(entry.c_str(), entry.size());
+  }
+
+  off_t push_back(const char* entry, size_t entry_len) {
     int ret = 0;
     off_t prev_offset;
 
     if (can_log) {
-      ret = fwrite(entry.c_str(), sizeof(char), entry.size(), log_file);
+      ret = fwrite(entry, sizeof(char), entry_len, log_file);
       if (ret < 0) {
         perror("fwrite failed");
         exit(EXIT_FAILURE);
@@ -67,6 +73,8 @@ class logger {
       exit(EXIT_FAILURE);
     }
 
+    num_log_syncs++;
+
     return ret;
   }
 
@@ -129,7 +137,7 @@ class logger {
   //private:
   FILE* log_file;
   int log_file_fd;
-  off_t log_offset;
+  std::atomic<off_t> log_offset;  // end of the log, also the next LSN
   bool can_log = true;
 
   std::string log_file_name;
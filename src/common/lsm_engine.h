@@ -16,15 +16,44 @@
 #include "logger.h"
 #include "timer.h"
 #include "serializer.h"
+#include "sorted_run.h"
 
 namespace storage {
 
+// LSM - FILE BASED
+//
+// Writes go to the log and to the memtable, the pm_map of every index. Every
+// merge_interval txns the memtable of each table is flushed as an immutable
+// sorted run into level 0. A background thread compacts the runs: once
+// level 0 holds LSM_L0_RUNS runs they are merged with level 1, and a deeper
+// level that outgrows its capacity is merged into the next one. Levels from
+// 1 on hold one run each, and each is LSM_LEVEL_RATIO times larger than the
+// one above it.
+//
+// A lookup checks the memtable, then level 0 from the newest run, then the
+// deeper levels, and stops at the first entry for the key. Bloom filters
+// skip the runs that do not hold it. Deletes leave a tombstone: a NULL
+// record in the memtable, and an entry without a tuple in a run. Tombstones
+// are dropped when a compaction writes the deepest level.
+//
+// Runs hold tuples in the binary encoding of serializer::encode(), so
+// selects project them without parsing, and are keyed by the primary key.
+// Once a tuple leaves the memtable, the off_map of each secondary index maps
+// its key to the primary key. Runs are derived from the log, which is never
+// truncated, so recovery rebuilds the memtable from the log and ignores the
+// run files.
+
+#define LSM_L0_RUNS 4
+#define LSM_LEVEL_BASE (4UL * 1024 * 1024)
+#define LSM_LEVEL_RATIO 10
+
 class lsm_engine : public engine_api {
  public:
   lsm_engine(const config& _conf, database* _db, bool _read_only, unsigned int _tid);
   ~lsm_engine();
 
   std::string select(const statement& st);
+  bool select(const statement& st, record_view& view);
   int update(const statement& st);
   int insert(const statement& t);
   int remove(const statement& t);
@@ -32,28 +61,54 @@ class lsm_engine : public engine_api {
   void load(const statement& st);
 
   void group_commit();
-  void merge(bool force);
-
   void merge_check();
+  void flush(unsigned int table_id);
+  void compaction();
+  bool compact(unsigned int table_id);
+
   void txn_begin();
   void txn_end(bool commit);
 
   void recovery();
 
   //private:
+  // Runs of a table, level 0 oldest first. levels[i] is level i + 1.
+  struct table_runs {
+    std::vector<sorted_run*> l0;
+    std::vector<sorted_run*> levels;
+  };
+
+  sorted_run::lookup_status lookup(unsigned int table_id, unsigned long key,
+                                   record*& mem_rec, std::string& tuple);
+  sorted_run::lookup_status select_lookup(const statement& st,
+                                          record*& mem_rec,
+                                          std::string& tuple);
+  void memtable_put(table_index* index, unsigned long key, record* rec);
+  sorted_run* merge_runs(const std::vector<sorted_run*>& inputs, bool bottom,
+                         const std::string& file_name, size_t num_entries);
+  std::string run_file_name(unsigned int table_id);
+
   const config& conf;
   database* db;
 
   logger fs_log;
-  std::hash<std::string> hash_fn;
   std::stringstream entry_stream;
   std::string entry_str;
   std::thread gc;
+  std::thread compactor;
   pthread_rwlock_t merge_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 
+  std::vector<table_runs> runs;
+  std::atomic<unsigned long> run_seq;
+
   std::atomic_bool ready;
   unsigned long merge_looper = 0;
 
+  // Flushes, compactions, and runs skipped by their bloom filter
+  std::atomic<unsigned long> num_flushes;
+  std::atomic<unsigned long> num_compactions;
+  unsigned long num_bloom_skips = 0;
+
   bool read_only = false;
   unsigned int tid;
 
@@ -61,4 +116,3 @@ class lsm_engine : public engine_api {
 };
 
 }
-
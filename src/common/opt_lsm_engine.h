@@ -6,6 +6,7 @@
 #include <sstream>
 #include <atomic>
 #include <fstream>
+#include <mutex>
 
 #include "engine_api.h"
 #include "config.h"
@@ -15,18 +16,36 @@
 #include "database.h"
 #include "pthread.h"
 #include "logger.h"
-#include "plist.h"
+#include "pvector.h"
 #include "timer.h"
 #include "serializer.h"
 
 namespace storage {
 
+// OPT LSM - PM BASED
+//
+// Every merge_interval txns the mem table (pm_map) of a table that outgrew
+// merge_ratio of its storage is frozen: it swaps places with the empty
+// frozen_map and a fresh mem table takes the writes. A background thread
+// merges the frozen mem table into storage, OPT_LSM_MERGE_BATCH tuples at a
+// time under merge_mutex, and paces itself to OPT_LSM_MERGE_RATE tuples per
+// second. Executors hold merge_mutex for each statement, so they wait for at
+// most one batch.
+//
+// Lookups check the mem table, then the frozen one, then storage. Updates
+// change the newest version in place. Removes of frozen tuples null out
+// their frozen entries, which the merge then skips.
+
+#define OPT_LSM_MERGE_BATCH 256
+#define OPT_LSM_MERGE_RATE 1000000
+
 class opt_lsm_engine : public engine_api {
  public:
   opt_lsm_engine(const config& _conf, database* _db, bool _read_only, unsigned int _tid);
   ~opt_lsm_engine();
 
   std::string select(const statement& st);
+  bool select(const statement& st, record_view& view);
   int update(const statement& st);
   int insert(const statement& t);
   int remove(const statement& t);
@@ -34,7 +53,9 @@ class opt_lsm_engine : public engine_api {
   void load(const statement& st);
   void group_commit();
 
-  void merge(bool force);
+  void freeze(bool force);
+  void merge();
+  void merger();
   void merge_check();
 
   void txn_begin();
@@ -43,12 +64,13 @@ class opt_lsm_engine : public engine_api {
   void recovery();
 
   //private:
+  record* frozen_at(table_index* index, unsigned long key);
+
   const config& conf;
   database* db;
   std::vector<std::thread> executors;
 
-  plist<char*>* pm_log;
-  std::hash<std::string> hash_fn;
+  pvector<char*>* pm_log;
 
   std::stringstream entry_stream;
   std::string entry_str;
@@ -58,6 +80,11 @@ class opt_lsm_engine : public engine_api {
   std::atomic_bool ready;
   unsigned long merge_looper = 0;
 
+  // Guards the frozen mem tables and storage against the merge thread
+  std::mutex merge_mutex;
+  std::thread merge_thread;
+  std::atomic_bool merge_pending;
+
   bool read_only = false;
   unsigned int tid;
 
@@ -24,6 +24,7 @@ class opt_sp_engine : public engine_api {
   ~opt_sp_engine();
 
   std::string select(const statement& st);
+  bool select(const statement& st, record_view& view);
   int update(const statement& st);
   int insert(const statement& t);
   int remove(const statement& t);
@@ -40,7 +41,6 @@ class opt_sp_engine : public engine_api {
   const config& conf;
   database* db;
 
-  std::hash<std::string> hash_fn;
 
   std::thread gc;
   pthread_rwlock_t gc_rwlock = PTHREAD_RWLOCK_INITIALIZER;
@@ -11,7 +11,7 @@
 #include "utils.h"
 #include "database.h"
 #include "pthread.h"
-#include "plist.h"
+#include "pvector.h"
 #include "timer.h"
 #include "serializer.h"
 
@@ -23,6 +23,7 @@ class opt_wal_engine : public engine_api {
   ~opt_wal_engine();
 
   std::string select(const statement& st);
+  bool select(const statement& st, record_view& view);
   int update(const statement& st);
   int insert(const statement& t);
   int remove(const statement& t);
@@ -31,20 +32,33 @@ class opt_wal_engine : public engine_api {
   void group_commit();
 
   void txn_begin();
+  void txn_begin_read_only();
   void txn_end(bool commit);
 
   void recovery();
+  void rollback();
+  void end_versions(bool commit);
+  void undo(char* entry);
 
   //private:
   const config& conf;
   database* db;
 
-  plist<char*>* pm_log;
-  std::hash<std::string> hash_fn;
+  pvector<char*>* pm_log;
 
   std::stringstream entry_stream;
   std::string entry_str;
   std::vector<void*> commit_free_list;
+
+  // Shared database with snapshots
+  version_manager* versions;
+  std::vector<record*> versioned;
+  std::vector<record*> inserted;
+  bool snapshot = false;
+  uint64_t snapshot_ts = 0;
+
+  // Shared database, frees wait for concurrent readers
+  epoch_manager* epochs;
   pthread_rwlock_t log_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 
   std::atomic_bool ready;
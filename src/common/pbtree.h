@@ -1,4223 +1,1337 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
-#include <istream>
-#include <ostream>
-#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 #include <assert.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "libpm.h"
+#include "epoch_manager.h"
 
 namespace storage {
 
-#define BTREE_NODE_SIZE 512
-
-/// Print out debug information to std::cerr if BTREE_DEBUG is defined.
-#define BTREE_PRINT(x)
+// PERSISTENT B+TREE
+//
+// Leaves live in NVM and form a singly linked list anchored in the root
+// slot. Entries in a leaf are unsorted: a bitmap marks the valid slots and a
+// one-byte fingerprint per slot filters the keys a lookup has to compare.
+// An insert writes a free slot and then sets its bit, so it persists one
+// entry and the header line instead of shifting the node. Inner nodes stay
+// in DRAM and recover() rebuilds them from the leaf chain.
+//
+// A leaf split persists the new leaf, links it, and then clears the moved
+// entries from the old leaf. A crash in between leaves them in both leaves,
+// and recover() drops the copies from the old one.
+//
+// Executors that share a tree synchronize by optimistic lock coupling. Every
+// node has a version word whose low bit is a write lock. A reader notes the
+// version, reads the node, and checks that the version did not move, so it
+// never writes to a node; if the version moved it starts over from the root.
+// A writer locks a leaf by a compare-and-swap from the version it read, and
+// locks the parent too when the leaf splits. Full inner nodes are split on
+// the way down, so a leaf split always finds room in its parent. An empty
+// leaf of a shared tree leaves the chain only if it has a left sibling under
+// the same parent, and goes to the epoch manager, which frees it once no
+// executor can still be reading it.
 
-/// Assertion only if BTREE_DEBUG is defined. This is not used in verify().
-#define BTREE_ASSERT(x)
+#define BTREE_NODE_SIZE 512
 
 /// The maximum of a and b. Used in some compile-time formulas.
 #define BTREE_MAX(a,b)          ((a) < (b) ? (b) : (a))
 
-#ifndef BTREE_FRIENDS
-/// The macro BTREE_FRIENDS can be used by outside class to access the B+
-/// tree internals. This was added for wxBTreeDemo to be able to draw the
-/// tree.
-#define BTREE_FRIENDS           friend class btree_friend;
-#endif
-
-/** Generates default traits for a B+ tree used as a set. It estimates leaf and
- * inner node sizes by assuming a cache line size of 256 bytes. */
-template<typename _Key>
-struct btree_default_set_traits {
-  /// If true, the tree will self verify it's invariants after each insert()
-  /// or erase(). The header must have been compiled with BTREE_DEBUG defined.
-  static const bool selfverify = false;
-
-  /// If true, the tree will print out debug information and a tree dump
-  /// during insert() or erase() operation. The header must have been
-  /// compiled with BTREE_DEBUG defined and key_type must be std::ostream
-  /// printable.
-  static const bool debug = false;
-
-  /// Number of slots in each leaf of the tree. Estimated so that each node
-  /// has a size of about 256 bytes.
-  static const int leafslots = BTREE_MAX(8, BTREE_NODE_SIZE / (sizeof(_Key)));
-
-  /// Number of slots in each inner node of the tree. Estimated so that each node
-  /// has a size of about 256 bytes.
-  static const int innerslots = BTREE_MAX(8,
-		  BTREE_NODE_SIZE / (sizeof(_Key) + sizeof(void*)));
-
-  /// As of stx-btree-0.9, the code does linear search in find_lower() and
-  /// find_upper() instead of binary_search, unless the node size is larger
-  /// than this threshold. See notes at
-  /// http://panthema.net/2013/0504-STX-B+Tree-Binary-vs-Linear-Search
-  static const size_t binsearch_threshold = BTREE_NODE_SIZE;
-};
-
-/** Generates default traits for a B+ tree used as a map. It estimates leaf and
- * inner node sizes by assuming a cache line size of 256 bytes. */
-template<typename _Key, typename _Data>
-struct btree_default_map_traits {
-  /// If true, the tree will self verify it's invariants after each insert()
-  /// or erase(). The header must have been compiled with BTREE_DEBUG defined.
-  static const bool selfverify = false;
-
-  /// If true, the tree will print out debug information and a tree dump
-  /// during insert() or erase() operation. The header must have been
-  /// compiled with BTREE_DEBUG defined and key_type must be std::ostream
-  /// printable.
-  static const bool debug = false;
-
-  /// Number of slots in each leaf of the tree. Estimated so that each node
-  /// has a size of about 256 bytes.
-  static const int leafslots = BTREE_MAX(8,
-		  BTREE_NODE_SIZE / (sizeof(_Key) + sizeof(_Data)));
-
-  /// Number of slots in each inner node of the tree. Estimated so that each node
-  /// has a size of about 256 bytes.
-  static const int innerslots = BTREE_MAX(8,
-		  BTREE_NODE_SIZE / (sizeof(_Key) + sizeof(void*)));
-
-  /// As of stx-btree-0.9, the code does linear search in find_lower() and
-  /// find_upper() instead of binary_search, unless the node size is larger
-  /// than this threshold. See notes at
-  /// http://panthema.net/2013/0504-STX-B+Tree-Binary-vs-Linear-Search
-  static const size_t binsearch_threshold = BTREE_NODE_SIZE;
-};
-
-/** @brief Basic class implementing a base B+ tree data structure in memory.
- *
- * The base implementation of a memory B+ tree. It is based on the
- * implementation in Cormen's Introduction into Algorithms, Jan Jannink's paper
- * and other algorithm resources. Almost all STL-required function calls are
- * implemented. The asymptotic time requirements of the STL are not always
- * fulfilled in theory, however in practice this B+ tree performs better than a
- * red-black tree by using more memory. The insertion function splits the nodes
- * on the recursion unroll. Erase is largely based on Jannink's ideas.
- *
- * This class is specialized into btree_set, btree_multiset, btree_map and
- * btree_multimap using default template parameters and facade functions.
- */
-template<typename _Key, typename _Data,
-    typename _Value = std::pair<_Key, _Data>,
-    typename _Compare = std::less<_Key>,
-    typename _Traits = btree_default_map_traits<_Key, _Data>, bool _Duplicates =
-        false, typename _Alloc = std::allocator<_Value>, bool _UsedAsSet = false>
-class btree {
- public:
-  // *** Template Parameter Types
+/// The minimum of a and b. Used in some compile-time formulas.
+#define BTREE_MIN(a,b)          ((a) < (b) ? (a) : (b))
 
-  /// First template parameter: The key type of the B+ tree. This is stored
-  /// in inner nodes and leaves
-  typedef _Key key_type;
+/// Maximum height of the volatile inner levels
+#define BTREE_MAX_DEPTH 16
 
-  /// Second template parameter: The data type associated with each
-  /// key. Stored in the B+ tree's leaves
-  typedef _Data data_type;
+/// Vectorized search in leaves and inner nodes, 0 for the scalar search
+#define BTREE_SIMD 1
 
-  /// Third template parameter: Composition pair of key and data types, this
-  /// is required by the STL standard. The B+ tree does not store key and
-  /// data together. If value_type == key_type then the B+ tree implements a
-  /// set.
-  typedef _Value value_type;
+#if BTREE_SIMD && defined(__x86_64__)
+#define BTREE_SIMD_SEARCH
+#endif
 
-  /// Fourth template parameter: Key comparison function object
-  typedef _Compare key_compare;
+/// Keys the vectorized inner node search compares as unsigned 64-bit
+/// integers. Other key types use the scalar binary search.
+template<typename _Key, typename _Compare>
+struct btree_simd_key {
+  static const bool value = false;
+};
 
-  /// Fifth template parameter: Traits object used to define more parameters
-  /// of the B+ tree
-  typedef _Traits traits;
+template<>
+struct btree_simd_key<unsigned long, std::less<unsigned long> > {
+  static const bool value = true;
+};
 
-  /// Sixth template parameter: Allow duplicate keys in the B+ tree. Used to
-  /// implement multiset and multimap.
-  static const bool allow_duplicates = _Duplicates;
+// SIMD SEARCH
+//
+// Leaves match the fingerprint byte against 16 slots at a time with SSE2.
+// Inner nodes count the keys not greater than the search key, which is the
+// child to descend into, 4 at a time with AVX2 or 8 at a time with
+// AVX-512. The instruction set is picked at runtime with cpuid.
 
-  /// Seventh template parameter: STL allocator for tree nodes
-  typedef _Alloc allocator_type;
+#define BTREE_SEARCH_SCALAR 0
+#define BTREE_SEARCH_AVX2 1
+#define BTREE_SEARCH_AVX512 2
 
-  /// Eighth template parameter: boolean indicator whether the btree is used
-  /// as a set. In this case all operations on the data arrays are
-  /// omitted. This flag is kind of hacky, but required because
-  /// sizeof(empty_struct) = 1 due to the C standard. Without the flag, lots
-  /// of superfluous copying would occur.
-  static const bool used_as_set = _UsedAsSet;
+#ifdef BTREE_SIMD_SEARCH
+/// Bitmask of the n bytes equal to byte, n is a multiple of 16
+static inline uint64_t btree_match_bytes(const uint8_t* bytes, unsigned int n,
+                                         uint8_t byte) {
+  __m128i needle = _mm_set1_epi8(byte);
+  uint64_t mask = 0;
 
-  // The macro BTREE_FRIENDS can be used by outside class to access the B+
-  // tree internals. This was added for wxBTreeDemo to be able to draw the
-  // tree.
-  BTREE_FRIENDS
+  for (unsigned int itr = 0; itr < n; itr += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*) (bytes + itr));
+    unsigned int eq = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    mask |= ((uint64_t) eq) << itr;
+  }
 
- public:
-  // *** Constructed Types
+  return mask;
+}
 
-  /// Typedef of our own type
-  typedef btree<key_type, data_type, value_type, key_compare, traits,
-      allow_duplicates, allocator_type, used_as_set> btree_self;
+__attribute__((target("avx2")))
+static inline unsigned int btree_upper_bound_avx2(const unsigned long* keys,
+                                                  unsigned int n,
+                                                  unsigned long key) {
+  // Unsigned order through the signed compare
+  const __m256i sign = _mm256_set1_epi64x(0x8000000000000000L);
+  __m256i needle = _mm256_xor_si256(_mm256_set1_epi64x(key), sign);
+  unsigned int greater = 0;
+  unsigned int itr = 0;
 
-  /// Size type used to count keys
-  typedef size_t size_type;
+  for (; itr + 4 <= n; itr += 4) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i*) (keys + itr));
+    __m256i gt = _mm256_cmpgt_epi64(_mm256_xor_si256(chunk, sign), needle);
+    greater += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(gt)));
+  }
 
-  /// The pair of key_type and data_type, this may be different from value_type.
-  typedef std::pair<key_type, data_type> pair_type;
+  for (; itr < n; itr++)
+    greater += (keys[itr] > key);
 
- public:
-  // *** Static Constant Options and Values of the B+ Tree
+  return n - greater;
+}
 
-  /// Base B+ tree parameter: The number of key/data slots in each leaf
-  static const unsigned short leafslotmax = traits::leafslots;
+__attribute__((target("avx512f")))
+static inline unsigned int btree_upper_bound_avx512(const unsigned long* keys,
+                                                    unsigned int n,
+                                                    unsigned long key) {
+  __m512i needle = _mm512_set1_epi64(key);
+  unsigned int not_greater = 0;
 
-  /// Base B+ tree parameter: The number of key slots in each inner node,
-  /// this can differ from slots in each leaf.
-  static const unsigned short innerslotmax = traits::innerslots;
+  for (unsigned int itr = 0; itr < n; itr += 8) {
+    __mmask8 valid = (n - itr >= 8) ? 0xFF : ((1U << (n - itr)) - 1);
+    __m512i chunk = _mm512_maskz_loadu_epi64(valid, keys + itr);
+    not_greater += __builtin_popcount(
+        _mm512_mask_cmple_epu64_mask(valid, chunk, needle));
+  }
 
-  /// Computed B+ tree parameter: The minimum number of key/data slots used
-  /// in a leaf. If fewer slots are used, the leaf will be merged or slots
-  /// shifted from it's siblings.
-  static const unsigned short minleafslots = (leafslotmax / 2);
+  return not_greater;
+}
 
-  /// Computed B+ tree parameter: The minimum number of key slots used
-  /// in an inner node. If fewer slots are used, the inner node will be
-  /// merged or slots shifted from it's siblings.
-  static const unsigned short mininnerslots = (innerslotmax / 2);
+static inline int btree_detect_search() {
+  __builtin_cpu_init();
 
-  /// Debug parameter: Enables expensive and thorough checking of the B+ tree
-  /// invariants after each insert/erase operation.
-  static const bool selfverify = traits::selfverify;
+  if (__builtin_cpu_supports("avx512f"))
+    return BTREE_SEARCH_AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return BTREE_SEARCH_AVX2;
 
-  /// Debug parameter: Prints out lots of debug information about how the
-  /// algorithms change the tree. Requires the header file to be compiled
-  /// with BTREE_DEBUG and the key type must be std::ostream printable.
-  static const bool debug = traits::debug;
+  return BTREE_SEARCH_SCALAR;
+}
 
- private:
-  // *** Node Classes for In-Memory Nodes
+/// Number of the n sorted keys not greater than key, or -1 without a
+/// vector unit
+static inline int btree_upper_bound_simd(const unsigned long* keys,
+                                         unsigned int n, unsigned long key) {
+  static const int search = btree_detect_search();
 
-  /// The header structure of each node in-memory. This structure is extended
-  /// by inner_node or leaf_node.
-  struct node {
-    /// Level in the b-tree, if level == 0 -> leaf node
-    unsigned short level;
+  switch (search) {
+    case BTREE_SEARCH_AVX512:
+      return btree_upper_bound_avx512(keys, n, key);
+    case BTREE_SEARCH_AVX2:
+      return btree_upper_bound_avx2(keys, n, key);
+    default:
+      return -1;
+  }
+}
+#endif
 
-    /// Number of key slotuse use, so number of valid children or data
-    /// pointers
-    unsigned short slotuse;
+/// Spins before a thread waiting on a locked node yields
+#define BTREE_SPINS 128
 
-    /// Delayed initialisation of constructed node
-    inline void initialize(const unsigned short l) {
-      PM_EQU((level), (l));
-      PM_EQU((slotuse), (0));
+/// Wait until a writer unlocks the node, yielding to a preempted one
+static inline void btree_wait_unlocked(const std::atomic<uint64_t>& version) {
+  for (unsigned int spin = 0; version.load(std::memory_order_relaxed) & 1;
+      spin++) {
+    if (spin < BTREE_SPINS) {
+#if defined(__x86_64__)
+      _mm_pause();
+#endif
+    } else {
+      std::this_thread::yield();
     }
+  }
+}
 
-    /// True if this is a leaf node
-    inline bool isleafnode() const {
-      return (level == 0);
-    }
-  };
+template<typename _Key, typename _Data, typename _Compare = std::less<_Key> >
+class pbtree {
+ public:
+  // *** Template Parameter Types
 
-  /// Extended structure of a inner node in-memory. Contains only keys and no
-  /// data items.
-  struct inner_node : public node {
-    /// Define an related allocator for the inner_node structs.
-    typedef typename _Alloc::template rebind<inner_node>::other alloc_type;
+  /// First template parameter: The key type of the B+ tree
+  typedef _Key key_type;
 
-    /// Keys of children or data pointers
-    key_type slotkey[innerslotmax];
+  /// Second template parameter: The data type associated with each key
+  typedef _Data data_type;
 
-    /// Pointers to children
-    node* childid[innerslotmax + 1];
+  /// Third template parameter: Key comparison function object
+  typedef _Compare key_compare;
 
-    /// Set variables to initial values
-    inline void initialize(const unsigned short l) {
-      node::initialize(l);
-    }
+  /// Composition pair of key and data types
+  typedef std::pair<key_type, data_type> value_type;
 
-    /// True if the node's slots are full
-    inline bool isfull() const {
-      return (node::slotuse == innerslotmax);
-    }
+  /// Size type used to count keys
+  typedef size_t size_type;
 
-    /// True if few used entries, less than half full
-    inline bool isfew() const {
-      return (node::slotuse <= mininnerslots);
-    }
+ private:
+  // *** Node Layout
 
-    /// True if node has too few entries
-    inline bool isunderflow() const {
-      return (node::slotuse < mininnerslots);
-    }
+  /// Key and data of one leaf slot, written and flushed together
+  struct leaf_entry {
+    key_type key;
+    data_type data;
   };
 
-  /// Extended structure of a leaf node in memory. Contains pairs of keys and
-  /// data items. Key and data slots are kept in separate arrays, because the
-  /// key array is traversed very often compared to accessing the data items.
-  struct leaf_node : public node {
-    /// Define an related allocator for the leaf_node structs.
-    typedef typename _Alloc::template rebind<leaf_node>::other alloc_type;
+ public:
+  /// Number of slots in each leaf, bounded by the bitmap width
+  static const unsigned short leafslotmax = BTREE_MAX(8,
+      BTREE_MIN(64, BTREE_NODE_SIZE / sizeof(leaf_entry)));
 
-    /// Double linked list pointers to traverse the leaves
-    leaf_node *prevleaf;
+  /// Number of keys in each inner node
+  static const unsigned short innerslotmax = BTREE_MAX(8,
+      BTREE_NODE_SIZE / (sizeof(key_type) + sizeof(void*)));
 
-    /// Double linked list pointers to traverse the leaves
-    leaf_node *nextleaf;
+  /// Fingerprint bytes, padded for 16-byte vector loads
+  static const unsigned short fingerprintmax = (leafslotmax + 15) & ~15;
 
-    /// Keys of children or data pointers
-    key_type slotkey[leafslotmax];
+ private:
+  /// Persistent leaf. The bitmap, the next pointer and the fingerprints
+  /// share the header, so an insert flushes the entry and then the header.
+  struct leaf_node {
+    /// Version and write lock, reset by recover()
+    std::atomic<uint64_t> version;
 
-    /// Array of data
-    data_type slotdata[used_as_set ? 1 : leafslotmax];
+    /// Valid slots
+    uint64_t bitmap;
 
-    /// Set variables to initial values
-    inline void initialize() {
-      node::initialize(0);
-      PM_EQU((prevleaf), (NULL));PM_EQU((nextleaf), (NULL));
-    }
+    /// Next leaf in key order
+    leaf_node* next;
 
-    /// True if the node's slots are full
-    inline bool isfull() const {
-      return (node::slotuse == leafslotmax);
-    }
+    /// Hash byte of the key in each slot
+    uint8_t fingerprint[fingerprintmax];
 
-    /// True if few used entries, less than half full
-    inline bool isfew() const {
-      return (node::slotuse <= minleafslots);
-    }
+    /// Unsorted key/data pairs
+    leaf_entry slot[leafslotmax];
+  };
 
-    /// True if node has too few entries
-    inline bool isunderflow() const {
-      return (node::slotuse < minleafslots);
-    }
+  /// Volatile inner node. Child i holds the keys in
+  /// [slotkey[i-1], slotkey[i]).
+  struct inner_node {
+    /// Version and write lock
+    std::atomic<uint64_t> version;
 
-    /// Set the (key,data) pair in slot. Overloaded function used by
-    /// bulk_load().
-    inline void set_slot(unsigned short slot, const pair_type& value) {
-      BTREE_ASSERT(used_as_set == false);BTREE_ASSERT(slot < node::slotuse);
-      slotkey[slot] = value.first;
-      slotdata[slot] = value.second;
-    }
+    /// Level above the leaves, 1 if the children are leaves
+    unsigned short level;
 
-    /// Set the key pair in slot. Overloaded function used by
-    /// bulk_load().
-    inline void set_slot(unsigned short slot, const key_type& key) {
-      BTREE_ASSERT(used_as_set == true);BTREE_ASSERT(slot < node::slotuse);
-      slotkey[slot] = key;
-    }
-  };
+    /// Number of keys, there is one more child
+    unsigned short slotuse;
 
- private:
-  // *** Template Magic to Convert a pair or key/data types to a value_type
-
-  /// For sets the second pair_type is an empty struct, so the value_type
-  /// should only be the first.
-  template<typename value_type, typename pair_type>
-  struct btree_pair_to_value {
-    /// Convert a fake pair type to just the first component
-    inline value_type operator()(pair_type& p) const {
-      return p.first;
-    }
-    /// Convert a fake pair type to just the first component
-    inline value_type operator()(const pair_type& p) const {
-      return p.first;
-    }
+    key_type slotkey[innerslotmax];
+
+    void* childid[innerslotmax + 1];
   };
 
-  /// For maps value_type is the same as the pair_type
-  template<typename value_type>
-  struct btree_pair_to_value<value_type, value_type> {
-    /// Identity "convert" a real pair type to just the first component
-    inline value_type operator()(pair_type& p) const {
-      return p;
-    }
-    /// Identity "convert" a real pair type to just the first component
-    inline value_type operator()(const pair_type& p) const {
-      return p;
-    }
+  /// A step on the way down from the root
+  struct path_entry {
+    inner_node* node;
+    unsigned short slot;
   };
 
-  /// Using template specialization select the correct converter used by the
-  /// iterators
-  typedef btree_pair_to_value<value_type, pair_type> pair_to_value_type;
+  static const uint64_t full_bitmap =
+      (leafslotmax == 64) ? ~0UL : ((1UL << leafslotmax) - 1);
 
  public:
-  // *** Iterators and Reverse Iterators
-
-  class iterator;
-  class const_iterator;
-  class reverse_iterator;
-  class const_reverse_iterator;
+  // *** Iterators
 
-  /// STL-like iterator object for B+ tree items. The iterator points to a
-  /// specific slot number in a leaf.
+  /// Iterator over the entries, leaf after leaf in key order and in slot
+  /// order within a leaf.
   class iterator {
    public:
-    // *** Types
-
-    /// The key type of the btree. Returned by key().
-    typedef typename btree::key_type key_type;
-
-    /// The data type of the btree. Returned by data().
-    typedef typename btree::data_type data_type;
-
-    /// The value type of the btree. Returned by operator*().
-    typedef typename btree::value_type value_type;
-
-    /// The pair type of the btree.
-    typedef typename btree::pair_type pair_type;
-
-    /// Reference to the value_type. STL required.
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename pbtree::value_type value_type;
     typedef value_type& reference;
-
-    /// Pointer to the value_type. STL required.
     typedef value_type* pointer;
-
-    /// STL-magic iterator category
-    typedef std::bidirectional_iterator_tag iterator_category;
-
-    /// STL-magic
     typedef ptrdiff_t difference_type;
 
-    /// Our own type
-    typedef iterator self;
-
-   private:
-    // *** Members
-
-    /// The currently referenced leaf node of the tree
-    typename btree::leaf_node* currnode;
-
-    /// Current key/data slot referenced
-    unsigned short currslot;
-
-    /// Friendly to the const_iterator, so it may access the two data items
-    /// directly.
-    friend class const_iterator;
-
-    /// Also friendly to the reverse_iterator, so it may access the two
-    /// data items directly.
-    friend class reverse_iterator;
-
-    /// Also friendly to the const_reverse_iterator, so it may access the
-    /// two data items directly.
-    friend class const_reverse_iterator;
-
-    /// Also friendly to the base btree class, because erase_iter() needs
-    /// to read the currnode and currslot values directly.
-    friend class btree<key_type, data_type, value_type, key_compare, traits,
-        allow_duplicates, allocator_type, used_as_set> ;
-
-    /// Evil! A temporary value_type to STL-correctly deliver operator* and
-    /// operator->
-    mutable value_type temp_value;
-
-    // The macro BTREE_FRIENDS can be used by outside class to access the B+
-    // tree internals. This was added for wxBTreeDemo to be able to draw the
-    // tree.
-    BTREE_FRIENDS
-
-   public:
-    // *** Methods
-
-    /// Default-Constructor of a mutable iterator
     inline iterator()
         : currnode(NULL),
           currslot(0) {
     }
 
-    /// Initializing-Constructor of a mutable iterator
-    inline iterator(typename btree::leaf_node *l, unsigned short s)
+    inline iterator(leaf_node* l, unsigned short s)
         : currnode(l),
           currslot(s) {
     }
 
-    /// Copy-constructor from a reverse iterator
-    inline iterator(const reverse_iterator &it)
-        : currnode(it.currnode),
-          currslot(it.currslot) {
-    }
-
-    /// Dereference the iterator, this is not a value_type& because key and
-    /// value are not stored together
+    /// Dereference the iterator, key and data are copied into a pair
     inline reference operator*() const {
-      temp_value = pair_to_value_type()(pair_type(key(), data()));
+      temp_value = value_type(key(), data());
       return temp_value;
     }
 
-    /// Dereference the iterator. Do not use this if possible, use key()
-    /// and data() instead. The B+ tree does not stored key and data
-    /// together.
     inline pointer operator->() const {
-      temp_value = pair_to_value_type()(pair_type(key(), data()));
+      temp_value = value_type(key(), data());
       return &temp_value;
     }
 
     /// Key of the current slot
     inline const key_type& key() const {
-      return currnode->slotkey[currslot];
+      return currnode->slot[currslot].key;
     }
 
-    /// Writable reference to the current data object
+    /// Data of the current slot
     inline data_type& data() const {
-      return currnode->slotdata[used_as_set ? 0 : currslot];
-    }
-
-    /// Prefix++ advance the iterator to the next slot
-    inline self& operator++() {
-      if (currslot + 1 < currnode->slotuse) {
-        ++currslot;
-      } else if (currnode->nextleaf != NULL) {
-        currnode = currnode->nextleaf;
-        currslot = 0;
-      } else {
-        // this is end()
-        currslot = currnode->slotuse;
-      }
-
-      return *this;
+      return currnode->slot[currslot].data;
     }
 
-    /// Postfix++ advance the iterator to the next slot
-    inline self operator++(int) {
-      self tmp = *this;   // copy ourselves
-
-      if (currslot + 1 < currnode->slotuse) {
-        ++currslot;
-      } else if (currnode->nextleaf != NULL) {
-        currnode = currnode->nextleaf;
-        currslot = 0;
-      } else {
-        // this is end()
-        currslot = currnode->slotuse;
-      }
-
-      return tmp;
-    }
+    /// Prefix++ advance the iterator to the next valid slot
+    inline iterator& operator++() {
+      uint64_t rest = (currslot + 1 < 64) ?
+          currnode->bitmap & (~0UL << (currslot + 1)) : 0;
 
-    /// Prefix-- backstep the iterator to the last slot
-    inline self& operator--() {
-      if (currslot > 0) {
-        --currslot;
-      } else if (currnode->prevleaf != NULL) {
-        currnode = currnode->prevleaf;
-        currslot = currnode->slotuse - 1;
-      } else {
-        // this is begin()
-        currslot = 0;
+      while (rest == 0) {
+        currnode = currnode->next;
+        if (currnode == NULL) {
+          currslot = 0;
+          return *this;
+        }
+        rest = currnode->bitmap;
       }
 
+      currslot = __builtin_ctzl(rest);
       return *this;
     }
 
-    /// Postfix-- backstep the iterator to the last slot
-    inline self operator--(int) {
-      self tmp = *this;   // copy ourselves
-
-      if (currslot > 0) {
-        --currslot;
-      } else if (currnode->prevleaf != NULL) {
-        currnode = currnode->prevleaf;
-        currslot = currnode->slotuse - 1;
-      } else {
-        // this is begin()
-        currslot = 0;
-      }
-
+    /// Postfix++ advance the iterator to the next valid slot
+    inline iterator operator++(int) {
+      iterator tmp = *this;
+      ++(*this);
       return tmp;
     }
 
-    /// Equality of iterators
-    inline bool operator==(const self& x) const {
+    inline bool operator==(const iterator& x) const {
       return (x.currnode == currnode) && (x.currslot == currslot);
     }
 
-    /// Inequality of iterators
-    inline bool operator!=(const self& x) const {
+    inline bool operator!=(const iterator& x) const {
       return (x.currnode != currnode) || (x.currslot != currslot);
     }
-  };
-
-  /// STL-like read-only iterator object for B+ tree items. The iterator
-  /// points to a specific slot number in a leaf.
-  class const_iterator {
-   public:
-    // *** Types
-
-    /// The key type of the btree. Returned by key().
-    typedef typename btree::key_type key_type;
-
-    /// The data type of the btree. Returned by data().
-    typedef typename btree::data_type data_type;
-
-    /// The value type of the btree. Returned by operator*().
-    typedef typename btree::value_type value_type;
-
-    /// The pair type of the btree.
-    typedef typename btree::pair_type pair_type;
-
-    /// Reference to the value_type. STL required.
-    typedef const value_type& reference;
-
-    /// Pointer to the value_type. STL required.
-    typedef const value_type* pointer;
-
-    /// STL-magic iterator category
-    typedef std::bidirectional_iterator_tag iterator_category;
-
-    /// STL-magic
-    typedef ptrdiff_t difference_type;
-
-    /// Our own type
-    typedef const_iterator self;
 
    private:
-    // *** Members
-
-    /// The currently referenced leaf node of the tree
-    const typename btree::leaf_node* currnode;
-
-    /// Current key/data slot referenced
+    leaf_node* currnode;
     unsigned short currslot;
 
-    /// Friendly to the reverse_const_iterator, so it may access the two
-    /// data items directly
-    friend class const_reverse_iterator;
-
-    /// Evil! A temporary value_type to STL-correctly deliver operator* and
-    /// operator->
+    /// A temporary value_type to deliver operator* and operator->
     mutable value_type temp_value;
-
-    // The macro BTREE_FRIENDS can be used by outside class to access the B+
-    // tree internals. This was added for wxBTreeDemo to be able to draw the
-    // tree.
-    BTREE_FRIENDS
-
-   public:
-    // *** Methods
-
-    /// Default-Constructor of a const iterator
-    inline const_iterator()
-        : currnode(NULL),
-          currslot(0) {
-    }
-
-    /// Initializing-Constructor of a const iterator
-    inline const_iterator(const typename btree::leaf_node *l, unsigned short s)
-        : currnode(l),
-          currslot(s) {
-    }
-
-    /// Copy-constructor from a mutable iterator
-    inline const_iterator(const iterator &it)
-        : currnode(it.currnode),
-          currslot(it.currslot) {
-    }
-
-    /// Copy-constructor from a mutable reverse iterator
-    inline const_iterator(const reverse_iterator &it)
-        : currnode(it.currnode),
-          currslot(it.currslot) {
-    }
-
-    /// Copy-constructor from a const reverse iterator
-    inline const_iterator(const const_reverse_iterator &it)
-        : currnode(it.currnode),
-          currslot(it.currslot) {
-    }
-
-    /// Dereference the iterator. Do not use this if possible, use key()
-    /// and data() instead. The B+ tree does not stored key and data
-    /// together.
-    inline reference operator*() const {
-      temp_value = pair_to_value_type()(pair_type(key(), data()));
-      return temp_value;
-    }
-
-    /// Dereference the iterator. Do not use this if possible, use key()
-    /// and data() instead. The B+ tree does not stored key and data
-    /// together.
-    inline pointer operator->() const {
-      temp_value = pair_to_value_type()(pair_type(key(), data()));
-      return &temp_value;
-    }
-
-    /// Key of the current slot
-    inline const key_type& key() const {
-      return currnode->slotkey[currslot];
-    }
-
-    /// Read-only reference to the current data object
-    inline const data_type& data() const {
-      return currnode->slotdata[used_as_set ? 0 : currslot];
-    }
-
-    /// Prefix++ advance the iterator to the next slot
-    inline self& operator++() {
-      if (currslot + 1 < currnode->slotuse) {
-        ++currslot;
-      } else if (currnode->nextleaf != NULL) {
-        currnode = currnode->nextleaf;
-        currslot = 0;
-      } else {
-        // this is end()
-        currslot = currnode->slotuse;
-      }
-
-      return *this;
-    }
-
-    /// Postfix++ advance the iterator to the next slot
-    inline self operator++(int) {
-      self tmp = *this;   // copy ourselves
-
-      if (currslot + 1 < currnode->slotuse) {
-        ++currslot;
-      } else if (currnode->nextleaf != NULL) {
-        currnode = currnode->nextleaf;
-        currslot = 0;
-      } else {
-        // this is end()
-        currslot = currnode->slotuse;
-      }
-
-      return tmp;
-    }
-
-    /// Prefix-- backstep the iterator to the last slot
-    inline self& operator--() {
-      if (currslot > 0) {
-        --currslot;
-      } else if (currnode->prevleaf != NULL) {
-        currnode = currnode->prevleaf;
-        currslot = currnode->slotuse - 1;
-      } else {
-        // this is begin()
-        currslot = 0;
-      }
-
-      return *this;
-    }
-
-    /// Postfix-- backstep the iterator to the last slot
-    inline self operator--(int) {
-      self tmp = *this;   // copy ourselves
-
-      if (currslot > 0) {
-        --currslot;
-      } else if (currnode->prevleaf != NULL) {
-        currnode = currnode->prevleaf;
-        currslot = currnode->slotuse - 1;
-      } else {
-        // this is begin()
-        currslot = 0;
-      }
-
-      return tmp;
-    }
-
-    /// Equality of iterators
-    inline bool operator==(const self& x) const {
-      return (x.currnode == currnode) && (x.currslot == currslot);
-    }
-
-    /// Inequality of iterators
-    inline bool operator!=(const self& x) const {
-      return (x.currnode != currnode) || (x.currslot != currslot);
-    }
   };
 
-  /// STL-like mutable reverse iterator object for B+ tree items. The
-  /// iterator points to a specific slot number in a leaf.
-  class reverse_iterator {
-   public:
-    // *** Types
-
-    /// The key type of the btree. Returned by key().
-    typedef typename btree::key_type key_type;
-
-    /// The data type of the btree. Returned by data().
-    typedef typename btree::data_type data_type;
-
-    /// The value type of the btree. Returned by operator*().
-    typedef typename btree::value_type value_type;
-
-    /// The pair type of the btree.
-    typedef typename btree::pair_type pair_type;
-
-    /// Reference to the value_type. STL required.
-    typedef value_type& reference;
-
-    /// Pointer to the value_type. STL required.
-    typedef value_type* pointer;
-
-    /// STL-magic iterator category
-    typedef std::bidirectional_iterator_tag iterator_category;
-
-    /// STL-magic
-    typedef ptrdiff_t difference_type;
-
-    /// Our own type
-    typedef reverse_iterator self;
-
-   private:
-    // *** Members
-
-    /// The currently referenced leaf node of the tree
-    typename btree::leaf_node* currnode;
+  /// Entries are not modified through iterators
+  typedef iterator const_iterator;
 
-    /// One slot past the current key/data slot referenced.
-    unsigned short currslot;
-
-    /// Friendly to the const_iterator, so it may access the two data items
-    /// directly
-    friend class iterator;
-
-    /// Also friendly to the const_iterator, so it may access the two data
-    /// items directly
-    friend class const_iterator;
-
-    /// Also friendly to the const_iterator, so it may access the two data
-    /// items directly
-    friend class const_reverse_iterator;
+ private:
+  // *** Tree Object Data Members
 
-    /// Evil! A temporary value_type to STL-correctly deliver operator* and
-    /// operator->
-    mutable value_type temp_value;
+  /// Root slot, holds the first leaf
+  leaf_node** m_head;
 
-    // The macro BTREE_FRIENDS can be used by outside class to access the B+
-    // tree internals. This was added for wxBTreeDemo to be able to draw the
-    // tree.
-    BTREE_FRIENDS
+  /// Volatile inner levels, NULL while the tree has no leaf
+  std::atomic<inner_node*> m_root;
 
-   public:
-    // *** Methods
+  /// Number of entries, recounted by recover()
+  std::atomic<size_type> m_size;
 
-    /// Default-Constructor of a reverse iterator
-    inline reverse_iterator()
-        : currnode(NULL),
-          currslot(0) {
-    }
+  /// Key comparison object
+  key_compare m_key_less;
 
-    /// Initializing-Constructor of a mutable reverse iterator
-    inline reverse_iterator(typename btree::leaf_node *l, unsigned short s)
-        : currnode(l),
-          currslot(s) {
-    }
+  // Persistence mode
+  bool persist = true;
 
-    /// Copy-constructor from a mutable iterator
-    inline reverse_iterator(const iterator &it)
-        : currnode(it.currnode),
-          currslot(it.currslot) {
-    }
+  // Shared by several executors
+  bool shared = false;
 
-    /// Dereference the iterator, this is not a value_type& because key and
-    /// value are not stored together
-    inline reference operator*() const {
-      BTREE_ASSERT(currslot > 0);
-      temp_value = pair_to_value_type()(pair_type(key(), data()));
-      return temp_value;
-    }
+  // Frees unlinked nodes of a shared tree
+  epoch_manager* epochs = NULL;
 
-    /// Dereference the iterator. Do not use this if possible, use key()
-    /// and data() instead. The B+ tree does not stored key and data
-    /// together.
-    inline pointer operator->() const {
-      BTREE_ASSERT(currslot > 0);
-      temp_value = pair_to_value_type()(pair_type(key(), data()));
-      return &temp_value;
-    }
+ public:
+  // *** Constructors and Destructor
 
-    /// Key of the current slot
-    inline const key_type& key() const {
-      BTREE_ASSERT(currslot > 0);
-      return currnode->slotkey[currslot - 1];
-    }
+  /// Tree anchored in the root slot _root, rebuilt if it holds leaves
+  explicit inline pbtree(void** _root)
+      : m_root(NULL),
+        m_size(0) {
+    PM_EQU((m_head), ((leaf_node**) _root));
 
-    /// Writable reference to the current data object
-    inline data_type& data() const {
-      BTREE_ASSERT(currslot > 0);
-      return currnode->slotdata[used_as_set ? 0 : currslot - 1];
-    }
+    if ((*m_head) != NULL)
+      recover();
+  }
 
-    /// Prefix++ advance the iterator to the next slot
-    inline self& operator++() {
-      if (currslot > 1) {
-        --currslot;
-      } else if (currnode->prevleaf != NULL) {
-        currnode = currnode->prevleaf;
-        currslot = currnode->slotuse;
-      } else {
-        // this is begin() == rend()
-        currslot = 0;
-      }
+  /// Frees up all leaves and inner nodes
+  inline ~pbtree() {
+    clear();
+  }
 
-      return *this;
-    }
-
-    /// Postfix++ advance the iterator to the next slot
-    inline self operator++(int) {
-      self tmp = *this;   // copy ourselves
-
-      if (currslot > 1) {
-        --currslot;
-      } else if (currnode->prevleaf != NULL) {
-        currnode = currnode->prevleaf;
-        currslot = currnode->slotuse;
-      } else {
-        // this is begin() == rend()
-        currslot = 0;
-      }
-
-      return tmp;
-    }
-
-    /// Prefix-- backstep the iterator to the last slot
-    inline self& operator--() {
-      if (currslot < currnode->slotuse) {
-        ++currslot;
-      } else if (currnode->nextleaf != NULL) {
-        currnode = currnode->nextleaf;
-        currslot = 1;
-      } else {
-        // this is end() == rbegin()
-        currslot = currnode->slotuse;
-      }
-
-      return *this;
-    }
-
-    /// Postfix-- backstep the iterator to the last slot
-    inline self operator--(int) {
-      self tmp = *this;   // copy ourselves
-
-      if (currslot < currnode->slotuse) {
-        ++currslot;
-      } else if (currnode->nextleaf != NULL) {
-        currnode = currnode->nextleaf;
-        currslot = 1;
-      } else {
-        // this is end() == rbegin()
-        currslot = currnode->slotuse;
-      }
-
-      return tmp;
-    }
-
-    /// Equality of iterators
-    inline bool operator==(const self& x) const {
-      return (x.currnode == currnode) && (x.currslot == currslot);
-    }
-
-    /// Inequality of iterators
-    inline bool operator!=(const self& x) const {
-      return (x.currnode != currnode) || (x.currslot != currslot);
-    }
-  };
-
-  /// STL-like read-only reverse iterator object for B+ tree items. The
-  /// iterator points to a specific slot number in a leaf.
-  class const_reverse_iterator {
-   public:
-    // *** Types
-
-    /// The key type of the btree. Returned by key().
-    typedef typename btree::key_type key_type;
-
-    /// The data type of the btree. Returned by data().
-    typedef typename btree::data_type data_type;
-
-    /// The value type of the btree. Returned by operator*().
-    typedef typename btree::value_type value_type;
-
-    /// The pair type of the btree.
-    typedef typename btree::pair_type pair_type;
-
-    /// Reference to the value_type. STL required.
-    typedef const value_type& reference;
-
-    /// Pointer to the value_type. STL required.
-    typedef const value_type* pointer;
-
-    /// STL-magic iterator category
-    typedef std::bidirectional_iterator_tag iterator_category;
-
-    /// STL-magic
-    typedef ptrdiff_t difference_type;
-
-    /// Our own type
-    typedef const_reverse_iterator self;
-
-   private:
-    // *** Members
-
-    /// The currently referenced leaf node of the tree
-    const typename btree::leaf_node* currnode;
-
-    /// One slot past the current key/data slot referenced.
-    unsigned short currslot;
-
-    /// Friendly to the const_iterator, so it may access the two data items
-    /// directly.
-    friend class reverse_iterator;
-
-    /// Evil! A temporary value_type to STL-correctly deliver operator* and
-    /// operator->
-    mutable value_type temp_value;
-
-    // The macro BTREE_FRIENDS can be used by outside class to access the B+
-    // tree internals. This was added for wxBTreeDemo to be able to draw the
-    // tree.
-    BTREE_FRIENDS
-
-   public:
-    // *** Methods
-
-    /// Default-Constructor of a const reverse iterator
-    inline const_reverse_iterator()
-        : currnode(NULL),
-          currslot(0) {
-    }
-
-    /// Initializing-Constructor of a const reverse iterator
-    inline const_reverse_iterator(const typename btree::leaf_node *l,
-                                  unsigned short s)
-        : currnode(l),
-          currslot(s) {
-    }
-
-    /// Copy-constructor from a mutable iterator
-    inline const_reverse_iterator(const iterator &it)
-        : currnode(it.currnode),
-          currslot(it.currslot) {
-    }
-
-    /// Copy-constructor from a const iterator
-    inline const_reverse_iterator(const const_iterator &it)
-        : currnode(it.currnode),
-          currslot(it.currslot) {
-    }
-
-    /// Copy-constructor from a mutable reverse iterator
-    inline const_reverse_iterator(const reverse_iterator &it)
-        : currnode(it.currnode),
-          currslot(it.currslot) {
-    }
-
-    /// Dereference the iterator. Do not use this if possible, use key()
-    /// and data() instead. The B+ tree does not stored key and data
-    /// together.
-    inline reference operator*() const {
-      BTREE_ASSERT(currslot > 0);
-      temp_value = pair_to_value_type()(pair_type(key(), data()));
-      return temp_value;
-    }
-
-    /// Dereference the iterator. Do not use this if possible, use key()
-    /// and data() instead. The B+ tree does not stored key and data
-    /// together.
-    inline pointer operator->() const {
-      BTREE_ASSERT(currslot > 0);
-      temp_value = pair_to_value_type()(pair_type(key(), data()));
-      return &temp_value;
-    }
-
-    /// Key of the current slot
-    inline const key_type& key() const {
-      BTREE_ASSERT(currslot > 0);
-      return currnode->slotkey[currslot - 1];
-    }
-
-    /// Read-only reference to the current data object
-    inline const data_type& data() const {
-      BTREE_ASSERT(currslot > 0);
-      return currnode->slotdata[used_as_set ? 0 : currslot - 1];
-    }
-
-    /// Prefix++ advance the iterator to the previous slot
-    inline self& operator++() {
-      if (currslot > 1) {
-        --currslot;
-      } else if (currnode->prevleaf != NULL) {
-        currnode = currnode->prevleaf;
-        currslot = currnode->slotuse;
-      } else {
-        // this is begin() == rend()
-        currslot = 0;
-      }
-
-      return *this;
-    }
-
-    /// Postfix++ advance the iterator to the previous slot
-    inline self operator++(int) {
-      self tmp = *this;   // copy ourselves
-
-      if (currslot > 1) {
-        --currslot;
-      } else if (currnode->prevleaf != NULL) {
-        currnode = currnode->prevleaf;
-        currslot = currnode->slotuse;
-      } else {
-        // this is begin() == rend()
-        currslot = 0;
-      }
-
-      return tmp;
-    }
-
-    /// Prefix-- backstep the iterator to the next slot
-    inline self& operator--() {
-      if (currslot < currnode->slotuse) {
-        ++currslot;
-      } else if (currnode->nextleaf != NULL) {
-        currnode = currnode->nextleaf;
-        currslot = 1;
-      } else {
-        // this is end() == rbegin()
-        currslot = currnode->slotuse;
-      }
-
-      return *this;
-    }
-
-    /// Postfix-- backstep the iterator to the next slot
-    inline self operator--(int) {
-      self tmp = *this;   // copy ourselves
-
-      if (currslot < currnode->slotuse) {
-        ++currslot;
-      } else if (currnode->nextleaf != NULL) {
-        currnode = currnode->nextleaf;
-        currslot = 1;
-      } else {
-        // this is end() == rbegin()
-        currslot = currnode->slotuse;
-      }
-
-      return tmp;
-    }
-
-    /// Equality of iterators
-    inline bool operator==(const self& x) const {
-      return (x.currnode == currnode) && (x.currslot == currslot);
-    }
-
-    /// Inequality of iterators
-    inline bool operator!=(const self& x) const {
-      return (x.currnode != currnode) || (x.currslot != currslot);
-    }
-  };
-
- public:
-  // *** Small Statistics Structure
-
-  /** A small struct containing basic statistics about the B+ tree. It can be
-   * fetched using get_stats(). */
-  struct tree_stats {
-    /// Number of items in the B+ tree
-    size_type itemcount;
-
-    /// Number of leaves in the B+ tree
-    size_type leaves;
-
-    /// Number of inner nodes in the B+ tree
-    size_type innernodes;
-
-    /// Base B+ tree parameter: The number of key/data slots in each leaf
-    static const unsigned short leafslots = btree_self::leafslotmax;
-
-    /// Base B+ tree parameter: The number of key slots in each inner node.
-    static const unsigned short innerslots = btree_self::innerslotmax;
-
-    /// Zero initialized
-    inline tree_stats() {
-        PM_EQU((itemcount), (0));
-        PM_EQU((leaves), (0));
-        PM_EQU((innernodes), (0));
-    }
-
-    /// Return the total number of nodes
-    inline size_type nodes() const {
-      return innernodes + leaves;
-    }
-
-    /// Return the average fill of leaves
-    inline double avgfill_leaves() const {
-      return static_cast<double>(itemcount) / (leaves * leafslots);
-    }
-  };
-
- private:
-  // *** Tree Object Data Members
-
-  /// Pointer to the B+ tree's root node, either leaf or inner node
-  node** m_root;
-
-  /// Pointer to first leaf in the double linked leaf chain
-  leaf_node *m_headleaf;
-
-  /// Pointer to last leaf in the double linked leaf chain
-  leaf_node *m_tailleaf;
-
-  /// Other small statistics about the B+ tree
-  tree_stats *m_stats;
-
-  /// Key comparison object. More comparison functions are generated from
-  /// this < relation.
-  key_compare m_key_less;
-
-  /// Memory allocator.
-  allocator_type m_allocator;
-
-  // Persistence mode
-  bool persist = true;
-
- public:
-  // *** Constructors and Destructor
-
-  /// Default constructor initializing an empty B+ tree with the standard key
-  /// comparison function
-  explicit inline btree(void** _root, const allocator_type &alloc =
-                            allocator_type()) {
-      PM_EQU((m_root), (((node**) _root)));
-      PM_EQU((m_headleaf), (NULL));
-      PM_EQU((m_tailleaf), (NULL));
-      PM_EQU((m_allocator), (alloc));
-      PM_EQU((m_stats), (new ((tree_stats*)pmalloc(sizeof(tree_stats))) tree_stats));
-
-    if (persist)
-      pmemalloc_activate(m_stats);
-  }
-
-  /// Constructor initializing an empty B+ tree with a special key
-  /// comparison object
-  explicit inline btree(const key_compare &kcf, const allocator_type &alloc =
-                            allocator_type())
-      : m_root(NULL),
-        m_headleaf(NULL),
-        m_tailleaf(NULL),
-        m_key_less(kcf),
-        m_allocator(alloc),
-        m_stats(NULL) {
-  }
-
-  /// Constructor initializing a B+ tree with the range [first,last). The
-  /// range need not be sorted. To create a B+ tree from a sorted range, use
-  /// bulk_load().
-  template<class InputIterator>
-  inline btree(InputIterator first, InputIterator last,
-               const allocator_type &alloc = allocator_type())
-      : m_root(NULL),
-        m_headleaf(NULL),
-        m_tailleaf(NULL),
-        m_allocator(alloc),
-        m_stats(NULL) {
-    insert(first, last);
-  }
-
-  /// Constructor initializing a B+ tree with the range [first,last) and a
-  /// special key comparison object.  The range need not be sorted. To create
-  /// a B+ tree from a sorted range, use bulk_load().
-  template<class InputIterator>
-  inline btree(InputIterator first, InputIterator last, const key_compare &kcf,
-               const allocator_type &alloc = allocator_type())
-      : m_root(NULL),
-        m_headleaf(NULL),
-        m_tailleaf(NULL),
-        m_key_less(kcf),
-        m_allocator(alloc),
-        m_stats(NULL) {
-    insert(first, last);
-  }
-
-  /// Frees up all used B+ tree memory pages
-  inline ~btree() {
-    clear();
-  }
-
-  /// Fast swapping of two identical B+ tree objects.
-  void swap(btree_self& from) {
-    std::swap(m_root, from.m_root);
-    std::swap(m_headleaf, from.m_headleaf);
-    std::swap(m_tailleaf, from.m_tailleaf);
-    std::swap(m_stats, from.m_stats);
-    std::swap(m_key_less, from.m_key_less);
-    std::swap(m_allocator, from.m_allocator);
-  }
-
- public:
-  // *** Key and Value Comparison Function Objects
-
-  /// Function class to compare value_type objects. Required by the STL
-  class value_compare {
-   protected:
-    /// Key comparison function from the template parameter
-    key_compare key_comp;
-
-    /// Constructor called from btree::value_comp()
-    inline value_compare(key_compare kc)
-        : key_comp(kc) {
-    }
-
-    /// Friendly to the btree class so it may call the constructor
-    friend class btree<key_type, data_type, value_type, key_compare, traits,
-        allow_duplicates, allocator_type, used_as_set> ;
-
-   public:
-    /// Function call "less"-operator resulting in true if x < y.
-    inline bool operator()(const value_type& x, const value_type& y) const {
-      return key_comp(x.first, y.first);
-    }
-  };
-
-  /// Constant access to the key comparison object sorting the B+ tree
-  inline key_compare key_comp() const {
-    return m_key_less;
-  }
-
-  /// Constant access to a constructed value_type comparison object. Required
-  /// by the STL
-  inline value_compare value_comp() const {
-    return value_compare(m_key_less);
-  }
-
- private:
-  // *** Convenient Key Comparison Functions Generated From key_less
-
-  /// True if a < b ? "constructed" from m_key_less()
-  inline bool key_less(const key_type &a, const key_type b) const {
-    return m_key_less(a, b);
-  }
-
-  /// True if a <= b ? constructed from key_less()
-  inline bool key_lessequal(const key_type &a, const key_type b) const {
-    return !m_key_less(b, a);
-  }
-
-  /// True if a > b ? constructed from key_less()
-  inline bool key_greater(const key_type &a, const key_type &b) const {
-    return m_key_less(b, a);
-  }
-
-  /// True if a >= b ? constructed from key_less()
-  inline bool key_greaterequal(const key_type &a, const key_type b) const {
-    return !m_key_less(a, b);
-  }
-
-  /// True if a == b ? constructed from key_less(). This requires the <
-  /// relation to be a total order, otherwise the B+ tree cannot be sorted.
-  inline bool key_equal(const key_type &a, const key_type &b) const {
-    return !m_key_less(a, b) && !m_key_less(b, a);
-  }
-
- public:
-  // *** Allocators
-
-  /// Return the base node allocator provided during construction.
-  allocator_type get_allocator() const {
-    return m_allocator;
-  }
-
- private:
-  // *** Node Object Allocation and Deallocation Functions
-
-  /// Return an allocator for leaf_node objects
-  typename leaf_node::alloc_type leaf_node_allocator() {
-    return typename leaf_node::alloc_type(m_allocator);
-  }
-
-  /// Return an allocator for inner_node objects
-  typename inner_node::alloc_type inner_node_allocator() {
-    return typename inner_node::alloc_type(m_allocator);
-  }
-
-  /// Allocate and initialize a leaf node
-  // Why do you care what the allocator is ? Simply use pmalloc with placement new ?
-  inline leaf_node* allocate_leaf() {
-    //leaf_node *n = new (leaf_node_allocator().allocate(1)) leaf_node;
-    leaf_node *n = new ((leaf_node*)pmalloc(sizeof(leaf_node))) leaf_node;
-    if (persist)
-      pmemalloc_activate(n);
-
-    n->initialize();
-    //m_stats->leaves++;
-    return n;
-  }
-
-  /// Allocate and initialize an inner node
-  inline inner_node* allocate_inner(unsigned short level) {
-    //inner_node *n = new (inner_node_allocator().allocate(1)) inner_node;
-    inner_node *n = new ((inner_node*)pmalloc(sizeof(inner_node))) inner_node;
-    if (persist)
-      pmemalloc_activate(n);
-
-    n->initialize(level);
-    PM_EQU((m_stats->innernodes), (m_stats->innernodes+1));
-    return n;
-  }
-
-  /// Correctly free either inner or leaf node, destructs all contained key
-  /// and value objects
-  inline void free_node(node *n) {
-    if (n->isleafnode()) {
-      leaf_node *ln = static_cast<leaf_node*>(n);
-      typename leaf_node::alloc_type a(leaf_node_allocator());
-      a.destroy(ln);
-      a.deallocate(ln, 1);
-      PM_EQU((m_stats->leaves), (m_stats->leaves-1));
-    } else {
-      inner_node *in = static_cast<inner_node*>(n);
-      typename inner_node::alloc_type a(inner_node_allocator());
-      a.destroy(in);
-      a.deallocate(in, 1);
-      PM_EQU((m_stats->innernodes), (m_stats->innernodes-1));
-    }
-  }
-
-  /// Convenient template function for conditional copying of slotdata. This
-  /// should be used instead of std::copy for all slotdata manipulations.
-  template<class InputIterator, class OutputIterator>
-  static OutputIterator data_copy(InputIterator first, InputIterator last,
-                                  OutputIterator result) {
-    if (used_as_set)
-      return result;  // no operation
-    else
-      return std::copy(first, last, result);
-  }
-
-  /// Convenient template function for conditional copying of slotdata. This
-  /// should be used instead of std::copy for all slotdata manipulations.
-  template<class InputIterator, class OutputIterator>
-  static OutputIterator data_copy_backward(InputIterator first,
-                                           InputIterator last,
-                                           OutputIterator result) {
-    if (used_as_set)
-      return result;  // no operation
-    else
-      return std::copy_backward(first, last, result);
-  }
-
- public:
-  // *** Fast Destruction of the B+ Tree
-
-  /// Frees all key/data pairs and all nodes of the tree
-  void clear() {
-    if ((*m_root)) {
-      clear_recursive((*m_root));
-      free_node((*m_root));
-
-      (*m_root) = NULL;
-      m_headleaf = m_tailleaf = NULL;
-    }
-
-    m_stats->itemcount = 0;
-    //assert(m_stats->itemcount == 0);
-  }
-
- private:
-  /// Recursively free up nodes
-  void clear_recursive(node *n) {
-    if (n->isleafnode()) {
-      leaf_node *leafnode = static_cast<leaf_node*>(n);
-
-      for (unsigned int slot = 0; slot < leafnode->slotuse; ++slot) {
-        // data objects are deleted by leaf_node's destructor
-      }
-    } else {
-      inner_node *innernode = static_cast<inner_node*>(n);
-
-      for (unsigned short slot = 0; slot < innernode->slotuse + 1; ++slot) {
-        clear_recursive(innernode->childid[slot]);
-        free_node(innernode->childid[slot]);
-      }
-    }
-  }
-
- public:
-  // *** STL Iterator Construction Functions
-
-  /// Constructs a read/data-write iterator that points to the first slot in
-  /// the first leaf of the B+ tree.
-  inline iterator begin() {
-    return iterator(m_headleaf, 0);
-  }
-
-  /// Constructs a read/data-write iterator that points to the first invalid
-  /// slot in the last leaf of the B+ tree.
-  inline iterator end() {
-    return iterator(m_tailleaf, m_tailleaf ? m_tailleaf->slotuse : 0);
-  }
-
-  /// Constructs a read-only constant iterator that points to the first slot
-  /// in the first leaf of the B+ tree.
-  inline const_iterator begin() const {
-    return const_iterator(m_headleaf, 0);
-  }
-
-  /// Constructs a read-only constant iterator that points to the first
-  /// invalid slot in the last leaf of the B+ tree.
-  inline const_iterator end() const {
-    return const_iterator(m_tailleaf, m_tailleaf ? m_tailleaf->slotuse : 0);
-  }
-
-  /// Constructs a read/data-write reverse iterator that points to the first
-  /// invalid slot in the last leaf of the B+ tree. Uses STL magic.
-  inline reverse_iterator rbegin() {
-    return reverse_iterator(end());
-  }
-
-  /// Constructs a read/data-write reverse iterator that points to the first
-  /// slot in the first leaf of the B+ tree. Uses STL magic.
-  inline reverse_iterator rend() {
-    return reverse_iterator(begin());
-  }
-
-  /// Constructs a read-only reverse iterator that points to the first
-  /// invalid slot in the last leaf of the B+ tree. Uses STL magic.
-  inline const_reverse_iterator rbegin() const {
-    return const_reverse_iterator(end());
-  }
-
-  /// Constructs a read-only reverse iterator that points to the first slot
-  /// in the first leaf of the B+ tree. Uses STL magic.
-  inline const_reverse_iterator rend() const {
-    return const_reverse_iterator(begin());
-  }
-
- private:
-  // *** B+ Tree Node Binary Search Functions
-
-  /// Searches for the first key in the node n greater or equal to key. Uses
-  /// binary search with an optional linear self-verification. This is a
-  /// template function, because the slotkey array is located at different
-  /// places in leaf_node and inner_node.
-  template<typename node_type>
-  inline int find_lower(const node_type *n, const key_type& key) const {
-    if (0 && sizeof(n->slotkey) > traits::binsearch_threshold) {
-      if (n->slotuse == 0)
-        return 0;
-
-      int lo = 0, hi = n->slotuse;
-
-      while (lo < hi) {
-        int mid = (lo + hi) >> 1;
-
-        if (key_lessequal(key, n->slotkey[mid])) {
-          hi = mid;  // key <= mid
-        } else {
-          lo = mid + 1;  // key > mid
-        }
-      }
-
-      BTREE_PRINT(
-          "btree::find_lower: on " << n << " key " << key << " -> " << lo << " / " << hi);
-
-      // verify result using simple linear search
-      if (selfverify) {
-        int i = 0;
-        while (i < n->slotuse && key_less(n->slotkey[i], key))
-          ++i;
-
-        BTREE_PRINT("btree::find_lower: testfind: " << i);BTREE_ASSERT(i == lo);
-      }
-
-      return lo;
-    } else  // for nodes <= binsearch_threshold do linear search.
-    {
-      int lo = 0;
-      while (lo < n->slotuse && key_less(n->slotkey[lo], key))
-        ++lo;
-      return lo;
-    }
-  }
-
-  /// Searches for the first key in the node n greater than key. Uses binary
-  /// search with an optional linear self-verification. This is a template
-  /// function, because the slotkey array is located at different places in
-  /// leaf_node and inner_node.
-  template<typename node_type>
-  inline int find_upper(const node_type *n, const key_type& key) const {
-    if (0 && sizeof(n->slotkey) > traits::binsearch_threshold) {
-      if (n->slotuse == 0)
-        return 0;
-
-      int lo = 0, hi = n->slotuse;
-
-      while (lo < hi) {
-        int mid = (lo + hi) >> 1;
-
-        if (key_less(key, n->slotkey[mid])) {
-          hi = mid;  // key < mid
-        } else {
-          lo = mid + 1;  // key >= mid
-        }
-      }
-
-      BTREE_PRINT(
-          "btree::find_upper: on " << n << " key " << key << " -> " << lo << " / " << hi);
-
-      // verify result using simple linear search
-      if (selfverify) {
-        int i = 0;
-        while (i < n->slotuse && key_lessequal(n->slotkey[i], key))
-          ++i;
-
-        BTREE_PRINT("btree::find_upper testfind: " << i);BTREE_ASSERT(i == hi);
-      }
-
-      return lo;
-    } else  // for nodes <= binsearch_threshold do linear search.
-    {
-      int lo = 0;
-      while (lo < n->slotuse && key_lessequal(n->slotkey[lo], key))
-        ++lo;
-      return lo;
-    }
-  }
-
- public:
-  // *** Access Functions to the Item Count
-
-  /// Return the number of key/data pairs in the B+ tree
-  inline size_type size() const {
-    return m_stats->itemcount;
-  }
-
-  /// Returns true if there is at least one key/data pair in the B+ tree
-  inline bool empty() const {
-    return (size() == size_type(0));
-  }
-
-  /// Returns the largest possible size of the B+ Tree. This is just a
-  /// function required by the STL standard, the B+ Tree can hold more items.
-  inline size_type max_size() const {
-    return size_type(-1);
-  }
-
-  /// Return a const reference to the current statistics.
-  inline const struct tree_stats& get_stats() const {
-    return m_stats;
-  }
-
- public:
-  // *** Standard Access Functions Querying the Tree by Descending to a Leaf
-
-  /// Non-STL function checking whether a key is in the B+ tree. The same as
-  /// (find(k) != end()) or (count() != 0).
-  bool exists(const key_type &key) const {
-    const node *n = (*m_root);
-    if (!n)
-      return false;
-
-    while (!n->isleafnode()) {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      int slot = find_lower(inner, key);
-
-      n = inner->childid[slot];
-    }
-
-    const leaf_node *leaf = static_cast<const leaf_node*>(n);
-
-    int slot = find_lower(leaf, key);
-    return (slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot]));
-  }
-
-  /// Tries to locate a key in the B+ tree and returns an iterator to the
-  /// key/data slot if found. If unsuccessful it returns end().
-  iterator find(const key_type &key) {
-    node *n = (*m_root);
-    if (!n)
-      return end();
-
-    while (!n->isleafnode()) {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      int slot = find_lower(inner, key);
-
-      n = inner->childid[slot];
-    }
-
-    leaf_node *leaf = static_cast<leaf_node*>(n);
-
-    int slot = find_lower(leaf, key);
-    return
-        (slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot])) ?
-            iterator(leaf, slot) : end();
-  }
-
-  /// Tries to locate a key in the B+ tree and returns an constant iterator
-  /// to the key/data slot if found. If unsuccessful it returns end().
-  const_iterator find(const key_type &key) const {
-    const node *n = (*m_root);
-    if (!n)
-      return end();
-
-    while (!n->isleafnode()) {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      int slot = find_lower(inner, key);
-
-      n = inner->childid[slot];
-    }
-
-    const leaf_node *leaf = static_cast<const leaf_node*>(n);
-
-    int slot = find_lower(leaf, key);
-    return
-        (slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot])) ?
-            const_iterator(leaf, slot) : end();
-  }
-
-  /// Tries to return value if key is found.
-  bool at(const key_type &key, data_type* val) const {
-    const_iterator itr = find(key);
-    bool found = false;
-
-    if (itr != end()) {
-      (*val) = itr.data();
-      found = true;
-    }
-
-    return found;
-  }
-
-  /// Tries to set value if key is found.
-  int update(const key_type &key, const data_type &val) {
-    iterator itr = find(key);
-    int ret = -1;
-
-    if (itr != end()) {
-      itr.data() = val;
-      ret = 0;
-    }
-
-    return ret;
-  }
-
-  // Disable persistence
-  void disable_persistence() {
-    persist = false;
-  }
-
-  /// Tries to locate a key in the B+ tree and returns the number of
-  /// identical key entries found.
-  size_type count(const key_type &key) const {
-    const node *n = (*m_root);
-    if (!n)
-      return 0;
-
-    while (!n->isleafnode()) {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      int slot = find_lower(inner, key);
-
-      n = inner->childid[slot];
-    }
-
-    const leaf_node *leaf = static_cast<const leaf_node*>(n);
-
-    int slot = find_lower(leaf, key);
-    size_type num = 0;
-
-    while (leaf && slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot])) {
-      ++num;
-      if (++slot >= leaf->slotuse) {
-        leaf = leaf->nextleaf;
-        slot = 0;
-      }
-    }
-
-    return num;
-  }
-
-  /// Searches the B+ tree and returns an iterator to the first pair
-  /// equal to or greater than key, or end() if all keys are smaller.
-  iterator lower_bound(const key_type& key) {
-    node *n = (*m_root);
-    if (!n)
-      return end();
-
-    while (!n->isleafnode()) {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      int slot = find_lower(inner, key);
-
-      n = inner->childid[slot];
-    }
-
-    leaf_node *leaf = static_cast<leaf_node*>(n);
-
-    int slot = find_lower(leaf, key);
-    return iterator(leaf, slot);
-  }
-
-  /// Searches the B+ tree and returns a constant iterator to the
-  /// first pair equal to or greater than key, or end() if all keys
-  /// are smaller.
-  const_iterator lower_bound(const key_type& key) const {
-    const node *n = (*m_root);
-    if (!n)
-      return end();
-
-    while (!n->isleafnode()) {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      int slot = find_lower(inner, key);
-
-      n = inner->childid[slot];
-    }
-
-    const leaf_node *leaf = static_cast<const leaf_node*>(n);
-
-    int slot = find_lower(leaf, key);
-    return const_iterator(leaf, slot);
-  }
-
-  /// Searches the B+ tree and returns an iterator to the first pair
-  /// greater than key, or end() if all keys are smaller or equal.
-  iterator upper_bound(const key_type& key) {
-    node *n = (*m_root);
-    if (!n)
-      return end();
-
-    while (!n->isleafnode()) {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      int slot = find_upper(inner, key);
-
-      n = inner->childid[slot];
-    }
-
-    leaf_node *leaf = static_cast<leaf_node*>(n);
-
-    int slot = find_upper(leaf, key);
-    return iterator(leaf, slot);
-  }
-
-  /// Searches the B+ tree and returns a constant iterator to the
-  /// first pair greater than key, or end() if all keys are smaller
-  /// or equal.
-  const_iterator upper_bound(const key_type& key) const {
-    const node *n = (*m_root);
-    if (!n)
-      return end();
-
-    while (!n->isleafnode()) {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      int slot = find_upper(inner, key);
-
-      n = inner->childid[slot];
-    }
-
-    const leaf_node *leaf = static_cast<const leaf_node*>(n);
-
-    int slot = find_upper(leaf, key);
-    return const_iterator(leaf, slot);
-  }
-
-  /// Searches the B+ tree and returns both lower_bound() and upper_bound().
-  inline std::pair<iterator, iterator> equal_range(const key_type& key) {
-    return std::pair<iterator, iterator>(lower_bound(key), upper_bound(key));
-  }
-
-  /// Searches the B+ tree and returns both lower_bound() and upper_bound().
-  inline std::pair<const_iterator, const_iterator> equal_range(
-      const key_type& key) const {
-    return std::pair<const_iterator, const_iterator>(lower_bound(key),
-                                                     upper_bound(key));
-  }
-
- public:
-  // *** B+ Tree Object Comparison Functions
-
-  /// Equality relation of B+ trees of the same type. B+ trees of the same
-  /// size and equal elements (both key and data) are considered
-  /// equal. Beware of the random ordering of duplicate keys.
-  inline bool operator==(const btree_self &other) const {
-    return (size() == other.size()) && std::equal(begin(), end(), other.begin());
-  }
-
-  /// Inequality relation. Based on operator==.
-  inline bool operator!=(const btree_self &other) const {
-    return !(*this == other);
-  }
-
-  /// Total ordering relation of B+ trees of the same type. It uses
-  /// std::lexicographical_compare() for the actual comparison of elements.
-  inline bool operator<(const btree_self &other) const {
-    return std::lexicographical_compare(begin(), end(), other.begin(),
-                                        other.end());
-  }
-
-  /// Greater relation. Based on operator<.
-  inline bool operator>(const btree_self &other) const {
-    return other < *this;
-  }
-
-  /// Less-equal relation. Based on operator<.
-  inline bool operator<=(const btree_self &other) const {
-    return !(other < *this);
-  }
-
-  /// Greater-equal relation. Based on operator<.
-  inline bool operator>=(const btree_self &other) const {
-    return !(*this < other);
-  }
-
- public:
-  /// *** Fast Copy: Assign Operator and Copy Constructors
-
-  /// Assignment operator. All the key/data pairs are copied
-  inline btree_self& operator=(const btree_self &other) {
-    if (this != &other) {
-      clear();
-
-      m_key_less = other.key_comp();
-      m_allocator = other.get_allocator();
-
-      if (other.size() != 0) {
-        m_stats->leaves = m_stats->innernodes = 0;
-        if (other.m_root) {
-          m_root = copy_recursive(other.m_root);
-        }
-        m_stats = other.m_stats;
-      }
-
-      if (selfverify)
-        verify();
-    }
-    return *this;
-  }
-
-/// Copy constructor. The newly initialized B+ tree object will contain a
-/// copy of all key/data pairs.
-  inline btree(const btree_self &other)
-      : m_root(NULL),
-        m_headleaf(NULL),
-        m_tailleaf(NULL),
-        m_stats(other.m_stats),
-        m_key_less(other.key_comp()),
-        m_allocator(other.get_allocator()) {
-    if (size() > 0) {
-      m_stats->leaves = m_stats->innernodes = 0;
-      if (other.m_root) {
-        m_root = copy_recursive(other.m_root);
-      }
-      if (selfverify)
-        verify();
-    }
-  }
-
- private:
-/// Recursively copy nodes from another B+ tree object
-  struct node* copy_recursive(const node *n) {
-    if (n->isleafnode()) {
-      const leaf_node *leaf = static_cast<const leaf_node*>(n);
-      leaf_node *newleaf = allocate_leaf();
-
-      newleaf->slotuse = leaf->slotuse;
-      std::copy(leaf->slotkey, leaf->slotkey + leaf->slotuse, newleaf->slotkey);
-      data_copy(leaf->slotdata, leaf->slotdata + leaf->slotuse,
-                newleaf->slotdata);
-
-      if (m_headleaf == NULL) {
-        m_headleaf = m_tailleaf = newleaf;
-        newleaf->prevleaf = newleaf->nextleaf = NULL;
-      } else {
-        newleaf->prevleaf = m_tailleaf;
-        m_tailleaf->nextleaf = newleaf;
-        m_tailleaf = newleaf;
-      }
-
-      return newleaf;
-    } else {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      inner_node *newinner = allocate_inner(inner->level);
-
-      newinner->slotuse = inner->slotuse;
-      std::copy(inner->slotkey, inner->slotkey + inner->slotuse,
-                newinner->slotkey);
-
-      for (unsigned short slot = 0; slot <= inner->slotuse; ++slot) {
-        newinner->childid[slot] = copy_recursive(inner->childid[slot]);
-      }
-
-      return newinner;
-    }
-  }
-
- public:
-// *** Public Insertion Functions
-
-/// Attempt to insert a key/data pair into the B+ tree. If the tree does not
-/// allow duplicate keys, then the insert may fail if it is already
-/// present.
-  inline std::pair<iterator, bool> insert(const pair_type& x) {
-    return insert_start(x.first, x.second);
-  }
-
-/// Attempt to insert a key/data pair into the B+ tree. Beware that if
-/// key_type == data_type, then the template iterator insert() is called
-/// instead. If the tree does not allow duplicate keys, then the insert may
-/// fail if it is already present.
-  inline std::pair<iterator, bool> insert(const key_type& key,
-                                          const data_type& data) {
-    return insert_start(key, data);
-  }
-
-/// Attempt to insert a key/data pair into the B+ tree. This function is the
-/// same as the other insert, however if key_type == data_type then the
-/// non-template function cannot be called. If the tree does not allow
-/// duplicate keys, then the insert may fail if it is already present.
-  inline std::pair<iterator, bool> insert2(const key_type& key,
-                                           const data_type& data) {
-    return insert_start(key, data);
-  }
-
-/// Attempt to insert a key/data pair into the B+ tree. The iterator hint
-/// is currently ignored by the B+ tree insertion routine.
-  inline iterator insert(iterator /* hint */, const pair_type &x) {
-    return insert_start(x.first, x.second).first;
-  }
-
-/// Attempt to insert a key/data pair into the B+ tree. The iterator hint is
-/// currently ignored by the B+ tree insertion routine.
-  inline iterator insert2(iterator /* hint */, const key_type& key,
-                          const data_type& data) {
-    return insert_start(key, data).first;
-  }
-
-/// Attempt to insert the range [first,last) of value_type pairs into the
-/// B+ tree. Each key/data pair is inserted individually; to bulk load the
-/// tree, use a constructor with range.
-  template<typename InputIterator>
-  inline void insert(InputIterator first, InputIterator last) {
-    InputIterator iter = first;
-    while (iter != last) {
-      insert(*iter);
-      ++iter;
-    }
-  }
-
- private:
-// *** Private Insertion Functions
-
-/// Start the insertion descent at the current root and handle root
-/// splits. Returns true if the item was inserted
-  std::pair<iterator, bool> insert_start(const key_type& key,
-                                         const data_type& value) {
-    node *newchild = NULL;
-    key_type newkey = key_type();
-
-    if ((*m_root) == NULL) {
-      PM_EQU((m_tailleaf), (allocate_leaf()));PM_EQU((m_headleaf), (m_tailleaf));PM_EQU(((*m_root)), (m_headleaf));
-    }
-
-    std::pair<iterator, bool> r = insert_descend((*m_root), key, value, &newkey,
-                                                 &newchild);
-
-    if (newchild) {
-      inner_node *newroot = allocate_inner((*m_root)->level + 1);
-      PM_EQU((newroot->slotkey[0]), (newkey));
-
-      PM_EQU((newroot->childid[0]), ((*m_root)));
-      PM_EQU((newroot->childid[1]), (newchild));
-
-      PM_EQU((newroot->slotuse), (1));
-
-      PM_EQU(((*m_root)), (newroot));
-    }
-
-    // increment itemcount if the item was inserted
-    if (r.second)
-      PM_EQU((m_stats->itemcount), (m_stats->itemcount+1));
-
-#ifdef BTREE_DEBUG
-    if (debug) print(std::cerr);
-#endif
-
-    if (selfverify) {
-      verify();
-      BTREE_ASSERT(exists(key));
-    }
-
-    return r;
-  }
-
-  /**
-   * @brief Insert an item into the B+ tree.
-   *
-   * Descend down the nodes to a leaf, insert the key/data pair in a free
-   * slot. If the node overflows, then it must be split and the new split
-   * node inserted into the parent. Unroll / this splitting up to the root.
-   */
-  std::pair<iterator, bool> insert_descend(node* n, const key_type& key,
-                                           const data_type& value,
-                                           key_type* splitkey,
-                                           node** splitnode) {
-    if (!n->isleafnode()) {
-      inner_node *inner = static_cast<inner_node*>(n);
-
-      key_type newkey = key_type();
-      node *newchild = NULL;
-
-      int slot = find_lower(inner, key);
-
-      BTREE_PRINT("btree::insert_descend into " << inner->childid[slot]);
-
-      std::pair<iterator, bool> r = insert_descend(inner->childid[slot], key,
-                                                   value, &newkey, &newchild);
-
-      if (newchild) {
-        BTREE_PRINT(
-            "btree::insert_descend newchild with key " << newkey << " node " << newchild << " at slot " << slot);
-
-        if (inner->isfull()) {
-          split_inner_node(inner, splitkey, splitnode, slot);
-
-          BTREE_PRINT(
-              "btree::insert_descend done split_inner: putslot: " << slot << " putkey: " << newkey << " upkey: " << *splitkey);
-
-#ifdef BTREE_DEBUG
-          if (debug)
-          {
-            print_node(std::cerr, inner);
-            print_node(std::cerr, *splitnode);
-          }
-#endif
-
-          // check if insert slot is in the split sibling node
-          BTREE_PRINT(
-              "btree::insert_descend switch: " << slot << " > " << inner->slotuse+1);
-
-          if (slot == inner->slotuse + 1
-              && inner->slotuse < (*splitnode)->slotuse) {
-            // special case when the insert slot matches the split
-            // place between the two nodes, then the insert key
-            // becomes the split key.
-
-            BTREE_ASSERT(inner->slotuse + 1 < innerslotmax);
-
-            inner_node *splitinner = static_cast<inner_node*>(*splitnode);
-
-            // move the split key and it's datum into the left node
-            PM_EQU((inner->slotkey[inner->slotuse]), (*splitkey));
-            PM_EQU((inner->childid[inner->slotuse + 1]), (splitinner->childid[0]));
-            PM_EQU((inner->slotuse), (inner->slotuse+1));
-
-            // set new split key and move corresponding datum into right node
-            PM_EQU((splitinner->childid[0]), (newchild));
-            *splitkey = newkey;
-
-            return r;
-          } else if (slot >= inner->slotuse + 1) {
-            // in case the insert slot is in the newly create split
-            // node, we reuse the code below.
-
-            slot -= inner->slotuse + 1;
-            inner = static_cast<inner_node*>(*splitnode);
-            BTREE_PRINT(
-                "btree::insert_descend switching to splitted node " << inner << " slot " << slot);
-          }
-        }
-
-        // move items and put pointer to child node into correct slot
-        BTREE_ASSERT(slot >= 0 && slot <= inner->slotuse);
-
-	PM_RNGCPY((inner->slotkey + inner->slotuse + 1), ((inner->slotuse)-(slot)+1));
-        std::copy_backward(inner->slotkey + slot,
-                           inner->slotkey + inner->slotuse,
-                           inner->slotkey + inner->slotuse + 1);
-	PM_RNGCPY((inner->childid + inner->slotuse + 2), ((inner->slotuse+1)-(slot)));
-        std::copy_backward(inner->childid + slot,
-                           inner->childid + inner->slotuse + 1,
-                           inner->childid + inner->slotuse + 2);
-
-        PM_EQU((inner->slotkey[slot]), (newkey));
-        PM_EQU((inner->childid[slot + 1]), (newchild));
-        PM_EQU((inner->slotuse), (inner->slotuse+1));
-      }
-
-      return r;
-    } else  // n->isleafnode() == true
-    {
-      leaf_node *leaf = static_cast<leaf_node*>(n);
-
-      int slot = find_lower(leaf, key);
-
-      if (!allow_duplicates && slot < leaf->slotuse
-          && key_equal(key, leaf->slotkey[slot])) {
-        return std::pair<iterator, bool>(iterator(leaf, slot), false);
-      }
-
-      if (leaf->isfull()) {
-        split_leaf_node(leaf, splitkey, splitnode);
-
-        // check if insert slot is in the split sibling node
-        if (slot >= leaf->slotuse) {
-          slot -= leaf->slotuse;
-          leaf = static_cast<leaf_node*>(*splitnode);
-        }
-      }
-
-      // move items and put data item into correct data slot
-      BTREE_ASSERT(slot >= 0 && slot <= leaf->slotuse);
-
-      PM_RNGCPY((leaf->slotkey + leaf->slotuse + 1),((leaf->slotuse)-(slot)+1));
-      std::copy_backward(leaf->slotkey + slot, leaf->slotkey + leaf->slotuse,
-                         leaf->slotkey + leaf->slotuse + 1);
-      /*
-      fprintf(m_err, "%s:%d start=%p, len=%d, res=%d\n", __func__, __LINE__, (leaf->slotkey + leaf->slotuse + 1), \
-						((leaf->slotuse)-(slot)),
-						(LIBPM <= (unsigned long long)(leaf->slotdata + leaf->slotuse + 1) && \
-   						(unsigned long long )(((leaf->slotdata + leaf->slotuse + 1))+((leaf->slotuse)-(slot))) \
-						<= LIBPM + PMSIZE ? 1 : 0));
-      */
-
-      PM_RNGCPY((leaf->slotdata + leaf->slotuse + 1),((leaf->slotuse)-(slot)+1));
-      data_copy_backward(leaf->slotdata + slot, leaf->slotdata + leaf->slotuse,
-                         leaf->slotdata + leaf->slotuse + 1);
-      /*
-      fprintf(m_err, "%s:%d start=%p, len=%d, res=%d\n", __func__, __LINE__, (leaf->slotdata + leaf->slotuse + 1), \
-						((leaf->slotuse)-(slot)), \
-						(LIBPM <= (unsigned long long)(leaf->slotdata + leaf->slotuse + 1) && \
-   						(unsigned long long)(((leaf->slotdata + leaf->slotuse + 1))+((leaf->slotuse)-(slot))) \
-						<= LIBPM + PMSIZE ? 1 : 0));
-      */
-
-      PM_EQU((leaf->slotkey[slot]), (key));
-      if (!used_as_set)
-        PM_EQU((leaf->slotdata[slot]), (value));
-      PM_EQU((leaf->slotuse), (leaf->slotuse+1));
-
-      if (splitnode && leaf != *splitnode && slot == leaf->slotuse - 1) {
-        // special case: the node was split, and the insert is at the
-        // last slot of the old node. then the splitkey must be
-        // updated.
-        *splitkey = key;
-      }
-
-      return std::pair<iterator, bool>(iterator(leaf, slot), true);
-    }
-  }
-
-/// Split up a leaf node into two equally-filled sibling leaves. Returns
-/// the new nodes and it's insertion key in the two parameters.
-  void split_leaf_node(leaf_node* leaf, key_type* _newkey, node** _newleaf) {
-    BTREE_ASSERT(leaf->isfull());
-
-    unsigned int mid = (leaf->slotuse >> 1);
-
-    BTREE_PRINT("btree::split_leaf_node on " << leaf);
-
-    leaf_node *newleaf = allocate_leaf();
-
-    PM_EQU((newleaf->slotuse), (leaf->slotuse - mid));
-
-    PM_EQU((newleaf->nextleaf), (leaf->nextleaf));
-    if (newleaf->nextleaf == NULL) {
-      BTREE_ASSERT(leaf == m_tailleaf);
-      PM_EQU((m_tailleaf), (newleaf));
-    } else {
-      PM_EQU((newleaf->nextleaf->prevleaf), (newleaf));
-    }
-
-    PM_RNGCPY((newleaf->slotkey), (leaf->slotuse - mid + 1));
-    std::copy(leaf->slotkey + mid, leaf->slotkey + leaf->slotuse, newleaf->slotkey);
-    PM_RNGCPY((newleaf->slotdata), (leaf->slotuse - mid + 1));
-    data_copy(leaf->slotdata + mid, leaf->slotdata + leaf->slotuse, newleaf->slotdata);
-
-    PM_EQU((leaf->slotuse), (mid));
-    PM_EQU((leaf->nextleaf), (newleaf));
-    PM_EQU((newleaf->prevleaf), (leaf));
-
-    *_newkey = leaf->slotkey[leaf->slotuse - 1];
-    *_newleaf = newleaf;
-  }
-
-/// Split up an inner node into two equally-filled sibling nodes. Returns
-/// the new nodes and it's insertion key in the two parameters. Requires
-/// the slot of the item will be inserted, so the nodes will be the same
-/// size after the insert.
-  void split_inner_node(inner_node* inner, key_type* _newkey, node** _newinner,
-                        unsigned int addslot) {
-    BTREE_ASSERT(inner->isfull());
-
-    unsigned int mid = (inner->slotuse >> 1);
-
-    BTREE_PRINT("btree::split_inner: mid " << mid << " addslot " << addslot);
-
-    // if the split is uneven and the overflowing item will be put into the
-    // larger node, then the smaller split node may underflow
-    if (addslot <= mid && mid > inner->slotuse - (mid + 1))
-      mid--;
-
-    BTREE_PRINT("btree::split_inner: mid " << mid << " addslot " << addslot);
-
-    BTREE_PRINT(
-        "btree::split_inner_node on " << inner << " into two nodes " << mid << " and " << inner->slotuse - (mid + 1) << " sized");
-
-    inner_node *newinner = allocate_inner(inner->level);
-
-    PM_EQU((newinner->slotuse), (inner->slotuse - (mid + 1)));
-
-    PM_RNGCPY((newinner->slotkey), (inner->slotuse - mid));
-    std::copy(inner->slotkey + mid + 1, inner->slotkey + inner->slotuse, newinner->slotkey);
-    PM_RNGCPY((newinner->childid), (inner->slotuse - mid + 1));
-    std::copy(inner->childid + mid + 1, inner->childid + inner->slotuse + 1, newinner->childid);
-
-    PM_EQU((inner->slotuse), (mid));
-
-    *_newkey = inner->slotkey[mid];
-    *_newinner = newinner;
-  }
-
- public:
-
-// *** Bulk Loader - Construct Tree from Sorted Sequence
-
-/// Bulk load a sorted range. Loads items into leaves and constructs a
-/// B-tree above them. The tree must be empty when calling this function.
-  template<typename Iterator>
-  void bulk_load(Iterator ibegin, Iterator iend) {
-    BTREE_ASSERT(empty());
-
-    m_stats->itemcount = iend - ibegin;
-
-    // calculate number of leaves needed, round up.
-    size_t num_items = iend - ibegin;
-    size_t num_leaves = (num_items + leafslotmax - 1) / leafslotmax;
-
-    BTREE_PRINT(
-        "btree::bulk_load, level 0: " << m_stats->itemcount << " items into " << num_leaves << " leaves with up to " << ((iend - ibegin + num_leaves-1) / num_leaves) << " items per leaf.");
-
-    Iterator it = ibegin;
-    for (size_t i = 0; i < num_leaves; ++i) {
-      // allocate new leaf node
-      leaf_node* leaf = allocate_leaf();
-
-      // copy keys or (key,value) pairs into leaf nodes, uses template
-      // switch leaf->set_slot().
-      leaf->slotuse = static_cast<int>(num_items / (num_leaves - i));
-      for (size_t s = 0; s < leaf->slotuse; ++s, ++it)
-        leaf->set_slot(s, *it);
-
-      if (m_tailleaf != NULL) {
-        m_tailleaf->nextleaf = leaf;
-        leaf->prevleaf = m_tailleaf;
-      } else {
-        m_headleaf = leaf;
-      }
-      m_tailleaf = leaf;
-
-      num_items -= leaf->slotuse;
-    }
-
-    BTREE_ASSERT(it == iend && num_items == 0);
-
-    // if the btree is so small to fit into one leaf, then we're done.
-    if (m_headleaf == m_tailleaf) {
-      (*m_root) = m_headleaf;
-      return;
-    }
-
-    BTREE_ASSERT(m_stats->leaves == num_leaves);
-
-    // create first level of inner nodes, pointing to the leaves.
-    size_t num_parents = (num_leaves + (innerslotmax + 1) - 1)
-        / (innerslotmax + 1);
-
-    BTREE_PRINT(
-        "btree::bulk_load, level 1: " << num_leaves << " leaves in " << num_parents << " inner nodes with up to " << ((num_leaves + num_parents-1) / num_parents) << " leaves per inner node.");
-
-    // save inner nodes and maxkey for next level.
-    typedef std::pair<inner_node*, const key_type*> nextlevel_type;
-    nextlevel_type* nextlevel = new ((nextlevel_type*) pmalloc(num_parents*sizeof(nextlevel_type))) nextlevel_type[num_parents];
-    if (persist)
-      pmemalloc_activate(nextlevel);
-
-    leaf_node* leaf = m_headleaf;
-    for (size_t i = 0; i < num_parents; ++i) {
-      // allocate new inner node at level 1
-      inner_node* n = allocate_inner(1);
-
-      n->slotuse = static_cast<int>(num_leaves / (num_parents - i));
-      BTREE_ASSERT(n->slotuse > 0);
-      --n->slotuse;  // this counts keys, but an inner node has keys+1 children.
-
-      // copy last key from each leaf and set child
-      for (unsigned short s = 0; s < n->slotuse; ++s) {
-        n->slotkey[s] = leaf->slotkey[leaf->slotuse - 1];
-        n->childid[s] = leaf;
-        leaf = leaf->nextleaf;
-      }
-      n->childid[n->slotuse] = leaf;
-
-      // track max key of any descendant.
-      nextlevel[i].first = n;
-      nextlevel[i].second = &leaf->slotkey[leaf->slotuse - 1];
-
-      leaf = leaf->nextleaf;
-      num_leaves -= n->slotuse + 1;
-    }
-
-    BTREE_ASSERT(leaf == NULL && num_leaves == 0);
-
-    // recursively build inner nodes pointing to inner nodes.
-    for (int level = 2; num_parents != 1; ++level) {
-      size_t num_children = num_parents;
-      num_parents = (num_children + (innerslotmax + 1) - 1)
-          / (innerslotmax + 1);
-
-      BTREE_PRINT(
-          "btree::bulk_load, level " << level << ": " << num_children << " children in " << num_parents << " inner nodes with up to " << ((num_children + num_parents-1) / num_parents) << " children per inner node.");
-
-      size_t inner_index = 0;
-      for (size_t i = 0; i < num_parents; ++i) {
-        // allocate new inner node at level
-        inner_node* n = allocate_inner(level);
-
-        n->slotuse = static_cast<int>(num_children / (num_parents - i));
-        BTREE_ASSERT(n->slotuse > 0);
-        --n->slotuse;  // this counts keys, but an inner node has keys+1 children.
-
-        // copy children and maxkeys from nextlevel
-        for (unsigned short s = 0; s < n->slotuse; ++s) {
-          n->slotkey[s] = *nextlevel[inner_index].second;
-          n->childid[s] = nextlevel[inner_index].first;
-          ++inner_index;
-        }
-        n->childid[n->slotuse] = nextlevel[inner_index].first;
-
-        // reuse nextlevel array for parents, because we can overwrite
-        // slots we've already consumed.
-        nextlevel[i].first = n;
-        nextlevel[i].second = nextlevel[inner_index].second;
-
-        ++inner_index;
-        num_children -= n->slotuse + 1;
-      }
-
-      BTREE_ASSERT(num_children == 0);
-    }
-
-    (*m_root) = nextlevel[0].first;
-    delete[] nextlevel;
-
-    if (selfverify)
-      verify();
-  }
-
- private:
-// *** Support Class Encapsulating Deletion Results
-
-/// Result flags of recursive deletion.
-  enum result_flags_t {
-    /// Deletion successful and no fix-ups necessary.
-    btree_ok = 0,
-
-    /// Deletion not successful because key was not found.
-    btree_not_found = 1,
-
-    /// Deletion successful, the last key was updated so parent slotkeys
-    /// need updates.
-    btree_update_lastkey = 2,
-
-    /// Deletion successful, children nodes were merged and the parent
-    /// needs to remove the empty node.
-    btree_fixmerge = 4
-  };
-
-/// B+ tree recursive deletion has much information which is needs to be
-/// passed upward.
-  struct result_t {
-    /// Merged result flags
-    result_flags_t flags;
-
-    /// The key to be updated at the parent's slot
-    key_type lastkey;
-
-    /// Constructor of a result with a specific flag, this can also be used
-    /// as for implicit conversion.
-    inline result_t(result_flags_t f = btree_ok)
-        : flags(f),
-          lastkey() {
-    }
-
-    /// Constructor with a lastkey value.
-    inline result_t(result_flags_t f, const key_type &k)
-        : flags(f),
-          lastkey(k) {
-    }
-
-    /// Test if this result object has a given flag set.
-    inline bool has(result_flags_t f) const {
-      return (flags & f) != 0;
-    }
-
-    /// Merge two results OR-ing the result flags and overwriting lastkeys.
-    inline result_t& operator|=(const result_t &other) {
-      flags = result_flags_t(flags | other.flags);
-
-      // we overwrite existing lastkeys on purpose
-      if (other.has(btree_update_lastkey))
-        lastkey = other.lastkey;
-
-      return *this;
-    }
-  };
-
- public:
-// *** Public Erase Functions
-
-/// Erases one (the first) of the key/data pairs associated with the given
-/// key.
-  bool erase_one(const key_type &key) {
-    BTREE_PRINT("btree::erase_one(" << key << ") on btree size " << size());
-
-    if (selfverify)
-      verify();
-
-    if (!(*m_root))
-      return false;
-
-    result_t result = erase_one_descend(key, (*m_root), NULL, NULL, NULL, NULL,
-    NULL,
-                                        0);
-
-    if (!result.has(btree_not_found))
-      PM_EQU((m_stats->itemcount), (m_stats->itemcount-1));
-
-#ifdef BTREE_DEBUG
-    if (debug) print(std::cerr);
-#endif
-    if (selfverify)
-      verify();
-
-    return !result.has(btree_not_found);
-  }
-
-/// Erases all the key/data pairs associated with the given key. This is
-/// implemented using erase_one().
-  size_type erase(const key_type &key) {
-    size_type c = 0;
-
-    while (erase_one(key)) {
-      ++c;
-      if (!allow_duplicates)
-        break;
-    }
-
-    return c;
-  }
-
-/// Erase the key/data pair referenced by the iterator.
-  void erase(iterator iter) {
-    BTREE_PRINT(
-        "btree::erase_iter(" << iter.currnode << "," << iter.currslot << ") on btree size " << size());
-
-    if (selfverify)
-      verify();
-
-    if (!(*m_root))
-      return;
-
-    result_t result = erase_iter_descend(iter, (*m_root), NULL, NULL, NULL,
-    NULL,
-                                         NULL, 0);
-
-    if (!result.has(btree_not_found))
-      --m_stats->itemcount;
-
-#ifdef BTREE_DEBUG
-    if (debug) print(std::cerr);
-#endif
-    if (selfverify)
-      verify();
-  }
-
-#ifdef BTREE_TODO
-/// Erase all key/data pairs in the range [first,last). This function is
-/// currently not implemented by the B+ Tree.
-  void erase(iterator /* first */, iterator /* last */)
-  {
-    abort();
-  }
-#endif
-
- private:
-// *** Private Erase Functions
-
-  /** @brief Erase one (the first) key/data pair in the B+ tree matching key.
-   *
-   * Descends down the tree in search of key. During the descent the parent,
-   * left and right siblings and their parents are computed and passed
-   * down. Once the key/data pair is found, it is removed from the leaf. If
-   * the leaf underflows 6 different cases are handled. These cases resolve
-   * the underflow by shifting key/data pairs from adjacent sibling nodes,
-   * merging two sibling nodes or trimming the tree.
-   */
-  result_t erase_one_descend(const key_type& key, node *curr, node *left,
-                             node *right, inner_node *leftparent,
-                             inner_node *rightparent, inner_node *parent,
-                             unsigned int parentslot) {
-    if (curr->isleafnode()) {
-      leaf_node *leaf = static_cast<leaf_node*>(curr);
-      leaf_node *leftleaf = static_cast<leaf_node*>(left);
-      leaf_node *rightleaf = static_cast<leaf_node*>(right);
-
-      int slot = find_lower(leaf, key);
-
-      if (slot >= leaf->slotuse || !key_equal(key, leaf->slotkey[slot])) {
-        BTREE_PRINT("Could not find key " << key << " to erase.");
-
-        return btree_not_found;
-      }
-
-      BTREE_PRINT("Found key in leaf " << curr << " at slot " << slot);
-
-      PM_RNGCPY((leaf->slotkey + slot), (leaf->slotuse - slot));
-      std::copy(leaf->slotkey + slot + 1, leaf->slotkey + leaf->slotuse, leaf->slotkey + slot);
-      PM_RNGCPY((leaf->slotdata + slot), (leaf->slotuse - slot));
-      data_copy(leaf->slotdata + slot + 1, leaf->slotdata + leaf->slotuse, leaf->slotdata + slot);
-
-      PM_EQU((leaf->slotuse), (leaf->slotuse-1));
-
-      result_t myres = btree_ok;
-
-      // if the last key of the leaf was changed, the parent is notified
-      // and updates the key of this leaf
-      if (slot == leaf->slotuse) {
-        if (parent && parentslot < parent->slotuse) {
-          BTREE_ASSERT(parent->childid[parentslot] == curr);
-          PM_EQU((parent->slotkey[parentslot]), (leaf->slotkey[leaf->slotuse - 1]));
-        } else {
-          if (leaf->slotuse >= 1) {
-            BTREE_PRINT(
-                "Scheduling lastkeyupdate: key " << leaf->slotkey[leaf->slotuse - 1]);
-            myres |= result_t(btree_update_lastkey,
-                              leaf->slotkey[leaf->slotuse - 1]);
-          } else {
-            BTREE_ASSERT(leaf == (*m_root));
-          }
-        }
-      }
-
-      if (leaf->isunderflow() && !(leaf == (*m_root) && leaf->slotuse >= 1)) {
-        // determine what to do about the underflow
-
-        // case : if this empty leaf is the root, then delete all nodes
-        // and set root to NULL.
-        if (leftleaf == NULL && rightleaf == NULL) {
-          BTREE_ASSERT(leaf == (*m_root));BTREE_ASSERT(leaf->slotuse == 0);
-
-          free_node((*m_root));
-
-          (*m_root) = leaf = NULL;
-          PM_EQU((m_headleaf), (NULL)); PM_EQU((m_tailleaf), (NULL));
-
-          // will be decremented soon by insert_start()
-          BTREE_ASSERT(m_stats->itemcount == 1);BTREE_ASSERT(m_stats->leaves == 0);BTREE_ASSERT(m_stats->innernodes == 0);
-
-          return btree_ok;
-        }
-        // case : if both left and right leaves would underflow in case of
-        // a shift, then merging is necessary. choose the more local merger
-        // with our parent
-        else if ((leftleaf == NULL || leftleaf->isfew())
-            && (rightleaf == NULL || rightleaf->isfew())) {
-          if (leftparent == parent)
-            myres |= merge_leaves(leftleaf, leaf, leftparent);
-          else
-            myres |= merge_leaves(leaf, rightleaf, rightparent);
-        }
-        // case : the right leaf has extra data, so balance right with current
-        else if ((leftleaf != NULL && leftleaf->isfew())
-            && (rightleaf != NULL && !rightleaf->isfew())) {
-          if (rightparent == parent)
-            myres |= shift_left_leaf(leaf, rightleaf, rightparent, parentslot);
-          else
-            myres |= merge_leaves(leftleaf, leaf, leftparent);
-        }
-        // case : the left leaf has extra data, so balance left with current
-        else if ((leftleaf != NULL && !leftleaf->isfew())
-            && (rightleaf != NULL && rightleaf->isfew())) {
-          if (leftparent == parent)
-            shift_right_leaf(leftleaf, leaf, leftparent, parentslot - 1);
-          else
-            myres |= merge_leaves(leaf, rightleaf, rightparent);
-        }
-        // case : both the leaf and right leaves have extra data and our
-        // parent, choose the leaf with more data
-        else if (leftparent == rightparent) {
-          if (leftleaf->slotuse <= rightleaf->slotuse)
-            myres |= shift_left_leaf(leaf, rightleaf, rightparent, parentslot);
-          else
-            shift_right_leaf(leftleaf, leaf, leftparent, parentslot - 1);
-        } else {
-          if (leftparent == parent)
-            shift_right_leaf(leftleaf, leaf, leftparent, parentslot - 1);
-          else
-            myres |= shift_left_leaf(leaf, rightleaf, rightparent, parentslot);
-        }
-      }
-
-      return myres;
-    } else  // !curr->isleafnode()
-    {
-      inner_node *inner = static_cast<inner_node*>(curr);
-      inner_node *leftinner = static_cast<inner_node*>(left);
-      inner_node *rightinner = static_cast<inner_node*>(right);
-
-      node *myleft, *myright;
-      inner_node *myleftparent, *myrightparent;
-
-      int slot = find_lower(inner, key);
-
-      if (slot == 0) {
-        myleft =
-            (left == NULL) ?
-                NULL :
-                (static_cast<inner_node*>(left))->childid[left->slotuse - 1];
-        myleftparent = leftparent;
-      } else {
-        myleft = inner->childid[slot - 1];
-        myleftparent = inner;
-      }
-
-      if (slot == inner->slotuse) {
-        myright =
-            (right == NULL) ?
-            NULL :
-                              (static_cast<inner_node*>(right))->childid[0];
-        myrightparent = rightparent;
-      } else {
-        myright = inner->childid[slot + 1];
-        myrightparent = inner;
-      }
-
-      BTREE_PRINT("erase_one_descend into " << inner->childid[slot]);
-
-      result_t result = erase_one_descend(key, inner->childid[slot], myleft,
-                                          myright, myleftparent, myrightparent,
-                                          inner, slot);
-
-      result_t myres = btree_ok;
-
-      if (result.has(btree_not_found)) {
-        return result;
-      }
-
-      if (result.has(btree_update_lastkey)) {
-        if (parent && parentslot < parent->slotuse) {
-          BTREE_PRINT(
-              "Fixing lastkeyupdate: key " << result.lastkey << " into parent " << parent << " at parentslot " << parentslot);
-
-          BTREE_ASSERT(parent->childid[parentslot] == curr);
-          PM_EQU((parent->slotkey[parentslot]), (result.lastkey));
-        } else {
-          BTREE_PRINT("Forwarding lastkeyupdate: key " << result.lastkey);
-          myres |= result_t(btree_update_lastkey, result.lastkey);
-        }
-      }
-
-      if (result.has(btree_fixmerge)) {
-        // either the current node or the next is empty and should be removed
-        if (inner->childid[slot]->slotuse != 0)
-          slot++;
-
-        // this is the child slot invalidated by the merge
-        BTREE_ASSERT(inner->childid[slot]->slotuse == 0);
-
-        free_node(inner->childid[slot]);
-
-        PM_RNGCPY((inner->slotkey + slot - 1), (inner->slotuse - slot + 1));
-        std::copy(inner->slotkey + slot, inner->slotkey + inner->slotuse, inner->slotkey + slot - 1);
-        PM_RNGCPY((inner->childid + slot), (inner->slotuse - slot + 1));
-        std::copy(inner->childid + slot + 1, inner->childid + inner->slotuse + 1, inner->childid + slot);
-
-        PM_EQU((inner->slotuse), (inner->slotuse-1));
-
-        if (inner->level == 1) {
-          // fix split key for children leaves
-          slot--;
-          leaf_node *child = static_cast<leaf_node*>(inner->childid[slot]);
-          PM_EQU((inner->slotkey[slot]), (child->slotkey[child->slotuse - 1]));
-        }
-      }
-
-      if (inner->isunderflow()
-          && !(inner == (*m_root) && inner->slotuse >= 1)) {
-        // case: the inner node is the root and has just one child. that child becomes the new root
-        if (leftinner == NULL && rightinner == NULL) {
-          BTREE_ASSERT(inner == (*m_root));BTREE_ASSERT(inner->slotuse == 0);
-
-          PM_EQU((*m_root), (inner->childid[0]));
-
-          PM_EQU((inner->slotuse), (0));
-          free_node(inner);
-
-          return btree_ok;
-        }
-        // case : if both left and right leaves would underflow in case of
-        // a shift, then merging is necessary. choose the more local merger
-        // with our parent
-        else if ((leftinner == NULL || leftinner->isfew())
-            && (rightinner == NULL || rightinner->isfew())) {
-          if (leftparent == parent)
-            myres |= merge_inner(leftinner, inner, leftparent, parentslot - 1);
-          else
-            myres |= merge_inner(inner, rightinner, rightparent, parentslot);
-        }
-        // case : the right leaf has extra data, so balance right with current
-        else if ((leftinner != NULL && leftinner->isfew())
-            && (rightinner != NULL && !rightinner->isfew())) {
-          if (rightparent == parent)
-            shift_left_inner(inner, rightinner, rightparent, parentslot);
-          else
-            myres |= merge_inner(leftinner, inner, leftparent, parentslot - 1);
-        }
-        // case : the left leaf has extra data, so balance left with current
-        else if ((leftinner != NULL && !leftinner->isfew())
-            && (rightinner != NULL && rightinner->isfew())) {
-          if (leftparent == parent)
-            shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
-          else
-            myres |= merge_inner(inner, rightinner, rightparent, parentslot);
-        }
-        // case : both the leaf and right leaves have extra data and our
-        // parent, choose the leaf with more data
-        else if (leftparent == rightparent) {
-          if (leftinner->slotuse <= rightinner->slotuse)
-            shift_left_inner(inner, rightinner, rightparent, parentslot);
-          else
-            shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
-        } else {
-          if (leftparent == parent)
-            shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
-          else
-            shift_left_inner(inner, rightinner, rightparent, parentslot);
-        }
-      }
-
-      return myres;
-    }
-  }
-
-  /** @brief Erase one key/data pair referenced by an iterator in the B+
-   * tree.
-   *
-   * Descends down the tree in search of an iterator. During the descent the
-   * parent, left and right siblings and their parents are computed and
-   * passed down. The difficulty is that the iterator contains only a pointer
-   * to a leaf_node, which means that this function must do a recursive depth
-   * first search for that leaf node in the subtree containing all pairs of
-   * the same key. This subtree can be very large, even the whole tree,
-   * though in practice it would not make sense to have so many duplicate
-   * keys.
-   *
-   * Once the referenced key/data pair is found, it is removed from the leaf
-   * and the same underflow cases are handled as in erase_one_descend.
-   */
-  result_t erase_iter_descend(const iterator& iter, node *curr, node *left,
-                              node *right, inner_node *leftparent,
-                              inner_node *rightparent, inner_node *parent,
-                              unsigned int parentslot) {
-    if (curr->isleafnode()) {
-      leaf_node *leaf = static_cast<leaf_node*>(curr);
-      leaf_node *leftleaf = static_cast<leaf_node*>(left);
-      leaf_node *rightleaf = static_cast<leaf_node*>(right);
-
-      // if this is not the correct leaf, get next step in recursive
-      // search
-      if (leaf != iter.currnode) {
-        return btree_not_found;
-      }
-
-      if (iter.currslot >= leaf->slotuse) {
-        BTREE_PRINT(
-            "Could not find iterator (" << iter.currnode << "," << iter.currslot << ") to erase. Invalid leaf node?");
-
-        return btree_not_found;
-      }
-
-      int slot = iter.currslot;
-
-      BTREE_PRINT("Found iterator in leaf " << curr << " at slot " << slot);
-
-      PM_RNGCPY((leaf->slotkey + slot), (leaf->slotuse - slot));
-      std::copy(leaf->slotkey + slot + 1, leaf->slotkey + leaf->slotuse, leaf->slotkey + slot);
-      PM_RNGCPY((leaf->slotdata + slot), (leaf->slotuse - slot));
-      data_copy(leaf->slotdata + slot + 1, leaf->slotdata + leaf->slotuse, leaf->slotdata + slot);
-
-      PM_EQU((leaf->slotuse), (leaf->slotuse-1));
-
-      result_t myres = btree_ok;
-
-      // if the last key of the leaf was changed, the parent is notified
-      // and updates the key of this leaf
-      if (slot == leaf->slotuse) {
-        if (parent && parentslot < parent->slotuse) {
-          BTREE_ASSERT(parent->childid[parentslot] == curr);
-          PM_EQU((parent->slotkey[parentslot]), (leaf->slotkey[leaf->slotuse - 1]));
-        } else {
-          if (leaf->slotuse >= 1) {
-            BTREE_PRINT(
-                "Scheduling lastkeyupdate: key " << leaf->slotkey[leaf->slotuse - 1]);
-            myres |= result_t(btree_update_lastkey,
-                              leaf->slotkey[leaf->slotuse - 1]);
-          } else {
-            BTREE_ASSERT(leaf == (*m_root));
-          }
-        }
-      }
-
-      if (leaf->isunderflow() && !(leaf == (*m_root) && leaf->slotuse >= 1)) {
-        // determine what to do about the underflow
-
-        // case : if this empty leaf is the root, then delete all nodes
-        // and set root to NULL.
-        if (leftleaf == NULL && rightleaf == NULL) {
-          BTREE_ASSERT(leaf == (*m_root));BTREE_ASSERT(leaf->slotuse == 0);
-
-          free_node((*m_root));
-
-          (*m_root) = leaf = NULL;
-          PM_EQU((m_headleaf), (NULL)); PM_EQU((m_tailleaf), (NULL));
-
-          // will be decremented soon by insert_start()
-          BTREE_ASSERT(m_stats->itemcount == 1);BTREE_ASSERT(m_stats->leaves == 0);BTREE_ASSERT(m_stats->innernodes == 0);
-
-          return btree_ok;
-        }
-        // case : if both left and right leaves would underflow in case of
-        // a shift, then merging is necessary. choose the more local merger
-        // with our parent
-        else if ((leftleaf == NULL || leftleaf->isfew())
-            && (rightleaf == NULL || rightleaf->isfew())) {
-          if (leftparent == parent)
-            myres |= merge_leaves(leftleaf, leaf, leftparent);
-          else
-            myres |= merge_leaves(leaf, rightleaf, rightparent);
-        }
-        // case : the right leaf has extra data, so balance right with current
-        else if ((leftleaf != NULL && leftleaf->isfew())
-            && (rightleaf != NULL && !rightleaf->isfew())) {
-          if (rightparent == parent)
-            myres |= shift_left_leaf(leaf, rightleaf, rightparent, parentslot);
-          else
-            myres |= merge_leaves(leftleaf, leaf, leftparent);
-        }
-        // case : the left leaf has extra data, so balance left with current
-        else if ((leftleaf != NULL && !leftleaf->isfew())
-            && (rightleaf != NULL && rightleaf->isfew())) {
-          if (leftparent == parent)
-            shift_right_leaf(leftleaf, leaf, leftparent, parentslot - 1);
-          else
-            myres |= merge_leaves(leaf, rightleaf, rightparent);
-        }
-        // case : both the leaf and right leaves have extra data and our
-        // parent, choose the leaf with more data
-        else if (leftparent == rightparent) {
-          if (leftleaf->slotuse <= rightleaf->slotuse)
-            myres |= shift_left_leaf(leaf, rightleaf, rightparent, parentslot);
-          else
-            shift_right_leaf(leftleaf, leaf, leftparent, parentslot - 1);
-        } else {
-          if (leftparent == parent)
-            shift_right_leaf(leftleaf, leaf, leftparent, parentslot - 1);
-          else
-            myres |= shift_left_leaf(leaf, rightleaf, rightparent, parentslot);
-        }
-      }
-
-      return myres;
-    } else  // !curr->isleafnode()
-    {
-      inner_node *inner = static_cast<inner_node*>(curr);
-      inner_node *leftinner = static_cast<inner_node*>(left);
-      inner_node *rightinner = static_cast<inner_node*>(right);
-
-      // find first slot below which the searched iterator might be
-      // located.
-
-      result_t result;
-      int slot = find_lower(inner, iter.key());
-
-      while (slot <= inner->slotuse) {
-        node *myleft, *myright;
-        inner_node *myleftparent, *myrightparent;
-
-        if (slot == 0) {
-          myleft =
-              (left == NULL) ?
-                  NULL :
-                  (static_cast<inner_node*>(left))->childid[left->slotuse - 1];
-          myleftparent = leftparent;
-        } else {
-          myleft = inner->childid[slot - 1];
-          myleftparent = inner;
-        }
-
-        if (slot == inner->slotuse) {
-          myright =
-              (right == NULL) ?
-              NULL :
-                                (static_cast<inner_node*>(right))->childid[0];
-          myrightparent = rightparent;
-        } else {
-          myright = inner->childid[slot + 1];
-          myrightparent = inner;
-        }
-
-        BTREE_PRINT("erase_iter_descend into " << inner->childid[slot]);
-
-        result = erase_iter_descend(iter, inner->childid[slot], myleft, myright,
-                                    myleftparent, myrightparent, inner, slot);
-
-        if (!result.has(btree_not_found))
-          break;
-
-        // continue recursive search for leaf on next slot
-
-        if (slot < inner->slotuse && key_less(inner->slotkey[slot], iter.key()))
-          return btree_not_found;
-
-        ++slot;
-      }
-
-      if (slot > inner->slotuse)
-        return btree_not_found;
-
-      result_t myres = btree_ok;
-
-      if (result.has(btree_update_lastkey)) {
-        if (parent && parentslot < parent->slotuse) {
-          BTREE_PRINT(
-              "Fixing lastkeyupdate: key " << result.lastkey << " into parent " << parent << " at parentslot " << parentslot);
-
-          BTREE_ASSERT(parent->childid[parentslot] == curr);
-          PM_EQU((parent->slotkey[parentslot]), (result.lastkey));
-        } else {
-          BTREE_PRINT("Forwarding lastkeyupdate: key " << result.lastkey);
-          myres |= result_t(btree_update_lastkey, result.lastkey);
-        }
-      }
-
-      if (result.has(btree_fixmerge)) {
-        // either the current node or the next is empty and should be removed
-        if (inner->childid[slot]->slotuse != 0)
-          slot++;
-
-        // this is the child slot invalidated by the merge
-        BTREE_ASSERT(inner->childid[slot]->slotuse == 0);
-
-        free_node(inner->childid[slot]);
-
-        PM_RNGCPY((inner->slotkey + slot - 1), (inner->slotuse - slot + 1));
-        std::copy(inner->slotkey + slot, inner->slotkey + inner->slotuse, inner->slotkey + slot - 1);
-        PM_RNGCPY((inner->childid + slot), (inner->slotuse - slot + 1));
-        std::copy(inner->childid + slot + 1, inner->childid + inner->slotuse + 1, inner->childid + slot);
-
-        PM_EQU((inner->slotuse), (inner->slotuse-1));
-
-        if (inner->level == 1) {
-          // fix split key for children leaves
-          slot--;
-          leaf_node *child = static_cast<leaf_node*>(inner->childid[slot]);
-          PM_EQU((inner->slotkey[slot]), (child->slotkey[child->slotuse - 1]));
-        }
-      }
-
-      if (inner->isunderflow()
-          && !(inner == (*m_root) && inner->slotuse >= 1)) {
-        // case: the inner node is the root and has just one
-        // child. that child becomes the new root
-        if (leftinner == NULL && rightinner == NULL) {
-          BTREE_ASSERT(inner == (*m_root));BTREE_ASSERT(inner->slotuse == 0);
-
-          PM_EQU((*m_root), (inner->childid[0]));
-
-          PM_EQU((inner->slotuse), (0));
-          free_node(inner);
-
-          return btree_ok;
-        }
-        // case : if both left and right leaves would underflow in case of
-        // a shift, then merging is necessary. choose the more local merger
-        // with our parent
-        else if ((leftinner == NULL || leftinner->isfew())
-            && (rightinner == NULL || rightinner->isfew())) {
-          if (leftparent == parent)
-            myres |= merge_inner(leftinner, inner, leftparent, parentslot - 1);
-          else
-            myres |= merge_inner(inner, rightinner, rightparent, parentslot);
-        }
-        // case : the right leaf has extra data, so balance right with current
-        else if ((leftinner != NULL && leftinner->isfew())
-            && (rightinner != NULL && !rightinner->isfew())) {
-          if (rightparent == parent)
-            shift_left_inner(inner, rightinner, rightparent, parentslot);
-          else
-            myres |= merge_inner(leftinner, inner, leftparent, parentslot - 1);
-        }
-        // case : the left leaf has extra data, so balance left with current
-        else if ((leftinner != NULL && !leftinner->isfew())
-            && (rightinner != NULL && rightinner->isfew())) {
-          if (leftparent == parent)
-            shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
-          else
-            myres |= merge_inner(inner, rightinner, rightparent, parentslot);
-        }
-        // case : both the leaf and right leaves have extra data and our
-        // parent, choose the leaf with more data
-        else if (leftparent == rightparent) {
-          if (leftinner->slotuse <= rightinner->slotuse)
-            shift_left_inner(inner, rightinner, rightparent, parentslot);
-          else
-            shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
-        } else {
-          if (leftparent == parent)
-            shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
-          else
-            shift_left_inner(inner, rightinner, rightparent, parentslot);
-        }
-      }
-
-      return myres;
-    }
-  }
-
-/// Merge two leaf nodes. The function moves all key/data pairs from right
-/// to left and sets right's slotuse to zero. The right slot is then
-/// removed by the calling parent node.
-  result_t merge_leaves(leaf_node* left, leaf_node* right, inner_node* parent) {
-    BTREE_PRINT(
-        "Merge leaf nodes " << left << " and " << right << " with common parent " << parent << ".");
-    (void) parent;
-
-    BTREE_ASSERT(left->isleafnode() && right->isleafnode());BTREE_ASSERT(parent->level == 1);
-
-    BTREE_ASSERT(left->slotuse + right->slotuse < leafslotmax);
-
-    PM_RNGCPY((left->slotkey + left->slotuse), (right->slotuse + 1));
-    std::copy(right->slotkey, right->slotkey + right->slotuse, left->slotkey + left->slotuse);
-    PM_RNGCPY((left->slotdata + left->slotuse), (right->slotuse + 1));
-    data_copy(right->slotdata, right->slotdata + right->slotuse, left->slotdata + left->slotuse);
-
-    PM_EQU((left->slotuse),  (left->slotuse + right->slotuse));
-
-    PM_EQU((left->nextleaf), (right->nextleaf));
-    if (left->nextleaf)
-      PM_EQU((left->nextleaf->prevleaf), (left));
-    else
-      PM_EQU((m_tailleaf), (left));
-
-    PM_EQU((right->slotuse), (0));
-
-    return btree_fixmerge;
-  }
-
-/// Merge two inner nodes. The function moves all key/childid pairs from
-/// right to left and sets right's slotuse to zero. The right slot is then
-/// removed by the calling parent node.
-  static result_t merge_inner(inner_node* left, inner_node* right,
-                              inner_node* parent, unsigned int parentslot) {
-    BTREE_PRINT(
-        "Merge inner nodes " << left << " and " << right << " with common parent " << parent << ".");
-
-    BTREE_ASSERT(left->level == right->level);BTREE_ASSERT(parent->level == left->level + 1);
-
-    BTREE_ASSERT(parent->childid[parentslot] == left);
-
-    BTREE_ASSERT(left->slotuse + right->slotuse < innerslotmax);
-
-    if (selfverify) {
-      // find the left node's slot in the parent's children
-      unsigned int leftslot = 0;
-      while (leftslot <= parent->slotuse && parent->childid[leftslot] != left)
-        ++leftslot;
-
-      BTREE_ASSERT(leftslot < parent->slotuse);BTREE_ASSERT(parent->childid[leftslot] == left);BTREE_ASSERT(parent->childid[leftslot+1] == right);
-
-      BTREE_ASSERT(parentslot == leftslot);
-    }
-
-    // retrieve the decision key from parent
-    PM_EQU((left->slotkey[left->slotuse]), (parent->slotkey[parentslot]));
-    PM_EQU((left->slotuse), (left->slotuse+1));
-
-    // copy over keys and children from right
-    PM_RNGCPY((left->slotkey + left->slotuse), (right->slotuse + 1));
-    std::copy(right->slotkey, right->slotkey + right->slotuse, left->slotkey + left->slotuse);
-    PM_RNGCPY((left->childid + left->slotuse), (right->slotuse + 1 + 1));
-    std::copy(right->childid, right->childid + right->slotuse + 1, left->childid + left->slotuse);
-
-    PM_EQU((left->slotuse), (left->slotuse + right->slotuse));
-    PM_EQU((right->slotuse), (0));
-
-    return btree_fixmerge;
-  }
-
-/// Balance two leaf nodes. The function moves key/data pairs from right to
-/// left so that both nodes are equally filled. The parent node is updated
-/// if possible.
-  static result_t shift_left_leaf(leaf_node *left, leaf_node *right,
-                                  inner_node *parent, unsigned int parentslot) {
-    BTREE_ASSERT(left->isleafnode() && right->isleafnode());BTREE_ASSERT(parent->level == 1);
-
-    BTREE_ASSERT(left->nextleaf == right);BTREE_ASSERT(left == right->prevleaf);
-
-    BTREE_ASSERT(left->slotuse < right->slotuse);BTREE_ASSERT(parent->childid[parentslot] == left);
-
-    unsigned int shiftnum = (right->slotuse - left->slotuse) >> 1;
-
-    BTREE_PRINT(
-        "Shifting (leaf) " << shiftnum << " entries to left " << left << " from right " << right << " with common parent " << parent << ".");
-
-    BTREE_ASSERT(left->slotuse + shiftnum < leafslotmax);
-
-    // copy the first items from the right node to the last slot in the left node.
-
-    PM_RNGCPY((left->slotkey + left->slotuse), (shiftnum + 1));
-    std::copy(right->slotkey, right->slotkey + shiftnum, left->slotkey + left->slotuse);
-    PM_RNGCPY((left->slotdata + left->slotuse), (shiftnum + 1));
-    data_copy(right->slotdata, right->slotdata + shiftnum, left->slotdata + left->slotuse);
-
-    PM_EQU((left->slotuse),(left->slotuse + shiftnum));
-
-    // shift all slots in the right node to the left
-
-    PM_RNGCPY((right->slotkey), (right->slotuse - shiftnum + 1));
-    std::copy(right->slotkey + shiftnum, right->slotkey + right->slotuse, right->slotkey);
-    PM_RNGCPY((right->slotdata), (right->slotuse - shiftnum + 1));
-    data_copy(right->slotdata + shiftnum, right->slotdata + right->slotuse, right->slotdata);
-
-    PM_EQU((right->slotuse), (right->slotuse - shiftnum));
-
-    // fixup parent
-    if (parentslot < parent->slotuse) {
-      PM_EQU((parent->slotkey[parentslot]), (left->slotkey[left->slotuse - 1]));
-      return btree_ok;
-    } else {  // the update is further up the tree
-      return result_t(btree_update_lastkey, left->slotkey[left->slotuse - 1]);
-    }
-  }
-
-/// Balance two inner nodes. The function moves key/data pairs from right
-/// to left so that both nodes are equally filled. The parent node is
-/// updated if possible.
-  static void shift_left_inner(inner_node *left, inner_node *right,
-                               inner_node *parent, unsigned int parentslot) {
-    BTREE_ASSERT(left->level == right->level);BTREE_ASSERT(parent->level == left->level + 1);
-
-    BTREE_ASSERT(left->slotuse < right->slotuse);BTREE_ASSERT(parent->childid[parentslot] == left);
-
-    unsigned int shiftnum = (right->slotuse - left->slotuse) >> 1;
-
-    BTREE_PRINT(
-        "Shifting (inner) " << shiftnum << " entries to left " << left << " from right " << right << " with common parent " << parent << ".");
-
-    BTREE_ASSERT(left->slotuse + shiftnum < innerslotmax);
-
-    if (selfverify) {
-      // find the left node's slot in the parent's children and compare to parentslot
-
-      unsigned int leftslot = 0;
-      while (leftslot <= parent->slotuse && parent->childid[leftslot] != left)
-        ++leftslot;
-
-      BTREE_ASSERT(leftslot < parent->slotuse);BTREE_ASSERT(parent->childid[leftslot] == left);BTREE_ASSERT(parent->childid[leftslot+1] == right);
-
-      BTREE_ASSERT(leftslot == parentslot);
-    }
-
-    // copy the parent's decision slotkey and childid to the first new key on the left
-    PM_EQU((left->slotkey[left->slotuse]), (parent->slotkey[parentslot]));
-    PM_EQU((left->slotuse), (left->slotuse+1));
-
-    // copy the other items from the right node to the last slots in the left node.
-
-    PM_RNGCPY((left->slotkey + left->slotuse), (shiftnum));
-    std::copy(right->slotkey, right->slotkey + shiftnum - 1, left->slotkey + left->slotuse);
-    PM_RNGCPY((left->childid + left->slotuse), (shiftnum + 1));
-    std::copy(right->childid, right->childid + shiftnum, left->childid + left->slotuse);
-
-    PM_EQU((left->slotuse), (left->slotuse + shiftnum - 1));
-
-    // fixup parent
-    PM_EQU((parent->slotkey[parentslot]), (right->slotkey[shiftnum - 1]));
-
-    // shift all slots in the right node
-
-    PM_RNGCPY((right->slotkey), (right->slotuse - shiftnum + 1));
-    std::copy(right->slotkey + shiftnum, right->slotkey + right->slotuse, right->slotkey);
-    PM_RNGCPY((right->childid), (right->slotuse + 1 - shiftnum + 1));
-    std::copy(right->childid + shiftnum, right->childid + right->slotuse + 1, right->childid);
-
-    PM_EQU((right->slotuse), (right->slotuse - shiftnum));
-  }
-
-/// Balance two leaf nodes. The function moves key/data pairs from left to
-/// right so that both nodes are equally filled. The parent node is updated
-/// if possible.
-  static void shift_right_leaf(leaf_node *left, leaf_node *right,
-                               inner_node *parent, unsigned int parentslot) {
-    BTREE_ASSERT(left->isleafnode() && right->isleafnode());BTREE_ASSERT(parent->level == 1);
-
-    BTREE_ASSERT(left->nextleaf == right);BTREE_ASSERT(left == right->prevleaf);BTREE_ASSERT(parent->childid[parentslot] == left);
-
-    BTREE_ASSERT(left->slotuse > right->slotuse);
-
-    unsigned int shiftnum = (left->slotuse - right->slotuse) >> 1;
-
-    BTREE_PRINT(
-        "Shifting (leaf) " << shiftnum << " entries to right " << right << " from left " << left << " with common parent " << parent << ".");
-
-    if (selfverify) {
-      // find the left node's slot in the parent's children
-      unsigned int leftslot = 0;
-      while (leftslot <= parent->slotuse && parent->childid[leftslot] != left)
-        ++leftslot;
-
-      BTREE_ASSERT(leftslot < parent->slotuse);BTREE_ASSERT(parent->childid[leftslot] == left);BTREE_ASSERT(parent->childid[leftslot+1] == right);
-
-      BTREE_ASSERT(leftslot == parentslot);
-    }
-
-    // shift all slots in the right node
-
-    BTREE_ASSERT(right->slotuse + shiftnum < leafslotmax);
-
-    PM_RNGCPY((right->slotkey + right->slotuse + shiftnum),(right->slotuse + 1));
-    std::copy_backward(right->slotkey, right->slotkey + right->slotuse,
-                       right->slotkey + right->slotuse + shiftnum);
-    PM_RNGCPY((right->slotdata + right->slotuse + shiftnum),(right->slotuse + 1));
-    data_copy_backward(right->slotdata, right->slotdata + right->slotuse,
-                       right->slotdata + right->slotuse + shiftnum);
-
-    PM_EQU((right->slotuse), (right->slotuse + shiftnum));
-
-    // copy the last items from the left node to the first slot in the right node.
-    PM_RNGCPY((right->slotkey), (shiftnum + 1));
-    std::copy(left->slotkey + left->slotuse - shiftnum, left->slotkey + left->slotuse, right->slotkey);
-    PM_RNGCPY((right->slotdata), (shiftnum + 1));
-    data_copy(left->slotdata + left->slotuse - shiftnum, left->slotdata + left->slotuse, right->slotdata);
-
-    PM_EQU((left->slotuse), (left->slotuse - shiftnum));
-
-    PM_EQU((parent->slotkey[parentslot]), (left->slotkey[left->slotuse - 1]));
+  // Disable persistence
+  void disable_persistence() {
+    persist = false;
   }
 
-/// Balance two inner nodes. The function moves key/data pairs from left to
-/// right so that both nodes are equally filled. The parent node is updated
-/// if possible.
-  static void shift_right_inner(inner_node *left, inner_node *right,
-                                inner_node *parent, unsigned int parentslot) {
-    BTREE_ASSERT(left->level == right->level);BTREE_ASSERT(parent->level == left->level + 1);
-
-    BTREE_ASSERT(left->slotuse > right->slotuse);BTREE_ASSERT(parent->childid[parentslot] == left);
+  // Concurrent executors use the tree, unlinked leaves wait for readers
+  void enable_sharing() {
+    shared = true;
+    epochs = global_epochs();
+  }
 
-    unsigned int shiftnum = (left->slotuse - right->slotuse) >> 1;
+ public:
+  // *** Access Functions to the Item Count
 
-    BTREE_PRINT(
-        "Shifting (leaf) " << shiftnum << " entries to right " << right << " from left " << left << " with common parent " << parent << ".");
+  /// Return the number of key/data pairs in the B+ tree
+  inline size_type size() const {
+    return m_size;
+  }
 
-    if (selfverify) {
-      // find the left node's slot in the parent's children
-      unsigned int leftslot = 0;
-      while (leftslot <= parent->slotuse && parent->childid[leftslot] != left)
-        ++leftslot;
+  /// Returns true if there is at least one key/data pair in the B+ tree
+  inline bool empty() const {
+    return (m_size == 0);
+  }
 
-      BTREE_ASSERT(leftslot < parent->slotuse);BTREE_ASSERT(parent->childid[leftslot] == left);BTREE_ASSERT(parent->childid[leftslot+1] == right);
+ public:
+  // *** Iterator Construction Functions
 
-      BTREE_ASSERT(leftslot == parentslot);
+  /// Iterator at the first valid slot
+  inline iterator begin() const {
+    for (leaf_node* leaf = (*m_head); leaf != NULL; leaf = leaf->next) {
+      if (leaf->bitmap != 0)
+        return iterator(leaf, __builtin_ctzl(leaf->bitmap));
     }
 
-    // shift all slots in the right node
-
-    BTREE_ASSERT(right->slotuse + shiftnum < innerslotmax);
+    return end();
+  }
 
-    PM_RNGCPY((right->slotkey + right->slotuse + shiftnum), (right->slotuse + 1)),
-    std::copy_backward(right->slotkey, right->slotkey + right->slotuse,
-                       right->slotkey + right->slotuse + shiftnum);
-    PM_RNGCPY((right->childid + right->slotuse + 1 + shiftnum), (right->slotuse + 1 + 1)),
-    std::copy_backward(right->childid, right->childid + right->slotuse + 1,
-                       right->childid + right->slotuse + 1 + shiftnum);
+  /// Iterator past the last valid slot
+  inline iterator end() const {
+    return iterator();
+  }
 
-    PM_EQU((right->slotuse), (right->slotuse + shiftnum));
+ public:
+  // *** Lookup Functions
 
-    // copy the parent's decision slotkey and childid to the last new key on the right
-    PM_EQU((right->slotkey[shiftnum - 1]), (parent->slotkey[parentslot]));
+  /// Non-STL function checking whether a key is in the B+ tree
+  bool exists(const key_type &key) const {
+    epoch_guard guard(epochs);
 
-    // copy the remaining last items from the left node to the first slot in the right node.
-    PM_RNGCPY((right->slotkey), (shiftnum));
-    std::copy(left->slotkey + left->slotuse - shiftnum + 1, left->slotkey + left->slotuse, right->slotkey);
-    PM_RNGCPY((right->childid), (shiftnum + 1));
-    std::copy(left->childid + left->slotuse - shiftnum + 1, left->childid + left->slotuse + 1, right->childid);
+    while (true) {
+      bool restart = false;
+      uint64_t version;
 
-    // copy the first to-be-removed key from the left node to the parent's decision slot
-    PM_EQU((parent->slotkey[parentslot]), (left->slotkey[left->slotuse - shiftnum]));
+      leaf_node* leaf = find_leaf(key, version, restart);
+      if (restart)
+        continue;
+      if (leaf == NULL)
+        return false;
 
-    PM_EQU((left->slotuse), (left->slotuse - shiftnum));
+      int slot = find_slot(leaf, key);
+      read_unlock(leaf->version, version, restart);
+      if (!restart)
+        return (slot >= 0);
+    }
   }
 
- public:
-// *** Verification of B+ Tree Invariants
-
-/// Run a thorough verification of all B+ tree invariants. The program
-/// aborts via assert() if something is wrong.
-  void verify() const {
-    key_type minkey, maxkey;
-    tree_stats vstats;
+  /// Iterator at the slot holding key, or end()
+  iterator find(const key_type &key) const {
+    epoch_guard guard(epochs);
 
-    if ((*m_root)) {
-      verify_node((*m_root), &minkey, &maxkey, vstats);
+    while (true) {
+      bool restart = false;
+      uint64_t version;
 
-      assert(vstats.itemcount == m_stats->itemcount);
-      assert(vstats.leaves == m_stats->leaves);
-      assert(vstats.innernodes == m_stats->innernodes);
+      leaf_node* leaf = find_leaf(key, version, restart);
+      if (restart)
+        continue;
+      if (leaf == NULL)
+        return end();
 
-      verify_leaflinks();
+      int slot = find_slot(leaf, key);
+      read_unlock(leaf->version, version, restart);
+      if (!restart)
+        return (slot >= 0) ? iterator(leaf, slot) : end();
     }
   }
 
- private:
-
-/// Recursively descend down the tree and verify each node
-  void verify_node(const node* n, key_type* minkey, key_type* maxkey,
-                   tree_stats &vstats) const {
-    BTREE_PRINT("verifynode " << n);
+  /// Tries to return value if key is found.
+  bool at(const key_type &key, data_type* val) const {
+    epoch_guard guard(epochs);
 
-    if (n->isleafnode()) {
-      const leaf_node *leaf = static_cast<const leaf_node*>(n);
+    while (true) {
+      bool restart = false;
+      uint64_t version;
 
-      assert(leaf == (*m_root) || !leaf->isunderflow());
-      assert(leaf->slotuse > 0);
+      leaf_node* leaf = find_leaf(key, version, restart);
+      if (restart)
+        continue;
+      if (leaf == NULL)
+        return false;
 
-      for (unsigned short slot = 0; slot < leaf->slotuse - 1; ++slot) {
-        assert(key_lessequal(leaf->slotkey[slot], leaf->slotkey[slot + 1]));
-      }
+      int slot = find_slot(leaf, key);
+      data_type data = (slot >= 0) ? leaf->slot[slot].data : data_type();
 
-      *minkey = leaf->slotkey[0];
-      *maxkey = leaf->slotkey[leaf->slotuse - 1];
+      // The copy counts only if no writer touched the leaf meanwhile
+      read_unlock(leaf->version, version, restart);
+      if (restart)
+        continue;
 
-      vstats.leaves++;
-      vstats.itemcount += leaf->slotuse;
-    } else  // !n->isleafnode()
-    {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-      vstats.innernodes++;
+      if (slot < 0)
+        return false;
 
-      assert(inner == (*m_root) || !inner->isunderflow());
-      assert(inner->slotuse > 0);
+      (*val) = data;
+      return true;
+    }
+  }
 
-      for (unsigned short slot = 0; slot < inner->slotuse - 1; ++slot) {
-        assert(key_lessequal(inner->slotkey[slot], inner->slotkey[slot + 1]));
-      }
+  /// Tries to set value if key is found.
+  int update(const key_type &key, const data_type &val) {
+    epoch_guard guard(epochs);
+    leaf_node* leaf = lock_leaf(key);
+    if (leaf == NULL)
+      return -1;
 
-      for (unsigned short slot = 0; slot <= inner->slotuse; ++slot) {
-        const node *subnode = inner->childid[slot];
-        key_type subminkey = key_type();
-        key_type submaxkey = key_type();
-
-        assert(subnode->level + 1 == inner->level);
-        verify_node(subnode, &subminkey, &submaxkey, vstats);
-
-        BTREE_PRINT(
-            "verify subnode " << subnode << ": " << subminkey << " - " << submaxkey);
-
-        if (slot == 0)
-          *minkey = subminkey;
-        else
-          assert(key_greaterequal(subminkey, inner->slotkey[slot - 1]));
-
-        if (slot == inner->slotuse)
-          *maxkey = submaxkey;
-        else
-          assert(key_equal(inner->slotkey[slot], submaxkey));
-
-        if (inner->level == 1 && slot < inner->slotuse) {
-          // children are leaves and must be linked together in the
-          // correct order
-          const leaf_node *leafa =
-              static_cast<const leaf_node*>(inner->childid[slot]);
-          const leaf_node *leafb =
-              static_cast<const leaf_node*>(inner->childid[slot + 1]);
-
-          assert(leafa->nextleaf == leafb);
-          assert(leafa == leafb->prevleaf);
-          (void) leafa;
-          (void) leafb;
-        }
-        if (inner->level == 2 && slot < inner->slotuse) {
-          // verify leaf links between the adjacent inner nodes
-          const inner_node *parenta = static_cast<const inner_node*>(inner
-              ->childid[slot]);
-          const inner_node *parentb = static_cast<const inner_node*>(inner
-              ->childid[slot + 1]);
-
-          const leaf_node *leafa = static_cast<const leaf_node*>(parenta
-              ->childid[parenta->slotuse]);
-          const leaf_node *leafb = static_cast<const leaf_node*>(parentb
-              ->childid[0]);
-
-          assert(leafa->nextleaf == leafb);
-          assert(leafa == leafb->prevleaf);
-          (void) leafa;
-          (void) leafb;
-        }
-      }
+    int slot = find_slot(leaf, key);
+    if (slot >= 0) {
+      PM_EQU((leaf->slot[slot].data), (val));
+      persist_range(&leaf->slot[slot].data, sizeof(data_type));
     }
-  }
 
-/// Verify the double linked list of leaves.
-  void verify_leaflinks() const {
-    const leaf_node *n = m_headleaf;
+    write_unlock(leaf->version);
+    return (slot >= 0) ? 0 : -1;
+  }
 
-    assert(n->level == 0);
-    assert(!n || n->prevleaf == NULL);
+  /// Number of entries with this key, 0 or 1
+  size_type count(const key_type &key) const {
+    return exists(key) ? 1 : 0;
+  }
 
-    unsigned int testcount = 0;
+ public:
+  // *** Insertion Functions
+
+  /// Attempt to insert a key/data pair. Fails if the key is already present.
+  std::pair<iterator, bool> insert(const key_type& key,
+                                   const data_type& data) {
+    epoch_guard guard(epochs);
+    inner_node* parent;
+    uint64_t parent_version;
+    leaf_node* leaf;
+    int slot;
+
+    while (true) {
+      bool restart = false;
+
+      if (m_root.load(std::memory_order_acquire) == NULL)
+        create_root();
+
+      leaf = lock_leaf_for_insert(key, parent, parent_version, restart);
+      if (restart)
+        continue;
+
+      slot = find_slot(leaf, key);
+      if (slot >= 0) {
+        write_unlock(leaf->version);
+        return std::pair<iterator, bool>(iterator(leaf, slot), false);
+      }
 
-    while (n) {
-      assert(n->level == 0);
-      assert(n->slotuse > 0);
+      if (leaf->bitmap != full_bitmap)
+        break;
 
-      for (unsigned short slot = 0; slot < n->slotuse - 1; ++slot) {
-        assert(key_lessequal(n->slotkey[slot], n->slotkey[slot + 1]));
+      // The parent has room, it was not full on the way down
+      upgrade_lock(parent->version, parent_version, restart);
+      if (restart) {
+        write_unlock(leaf->version);
+        continue;
       }
 
-      testcount += n->slotuse;
+      key_type split_key;
+      leaf_node* new_leaf = split_leaf(leaf, split_key);
 
-      if (n->nextleaf) {
-        assert(
-            key_lessequal(n->slotkey[n->slotuse - 1], n->nextleaf->slotkey[0]));
+      insert_into_inner(parent, find_child(parent, key), split_key, new_leaf);
+      write_unlock(parent->version);
 
-        assert(n == n->nextleaf->prevleaf);
+      // Both halves stay locked until the entry is in
+      if (!m_key_less(key, split_key)) {
+        write_unlock(leaf->version);
+        leaf = new_leaf;
       } else {
-        assert(m_tailleaf == n);
+        write_unlock(new_leaf->version);
       }
-
-      n = n->nextleaf;
+      break;
     }
 
-    assert(testcount == size());
-  }
-
- private:
-// *** Dump and Restore of B+ Trees
-
-/// A header for the binary image containing the base properties of the B+
-/// tree. These properties have to match the current template
-/// instantiation.
-  struct dump_header {
-    /// "stx-btree", just to stop the restore() function from loading garbage
-    char signature[12];
-
-    /// Currently 0
-    unsigned short version;
-
-    /// sizeof(key_type)
-    unsigned short key_type_size;
-
-    /// sizeof(data_type)
-    unsigned short data_type_size;
-
-    /// Number of slots in the leaves
-    unsigned short leafslots;
-
-    /// Number of slots in the inner nodes
-    unsigned short innerslots;
-
-    /// Allow duplicates
-    bool allow_duplicates;
-
-    /// The item count of the tree
-    size_type itemcount;
-
-    /// Fill the struct with the current B+ tree's properties, itemcount is
-    /// not filled.
-    inline void fill() {
-      // don't want to include string.h just for this signature
-      signature[0] = 's';
-      signature[1] = 't';
-      signature[2] = 'x';
-      signature[3] = '-';
-      signature[4] = 'b';
-      signature[5] = 't';
-      signature[6] = 'r';
-      signature[7] = 'e';
-      signature[8] = 'e';
-      signature[9] = 0;
-      signature[10] = 0;
-      signature[11] = 0;
-
-      version = 0;
-      key_type_size = sizeof(typename btree_self::key_type);
-      data_type_size = sizeof(typename btree_self::data_type);
-      leafslots = btree_self::leafslotmax;
-      innerslots = btree_self::innerslotmax;
-      allow_duplicates = btree_self::allow_duplicates;
-    }
+    slot = __builtin_ctzl(~leaf->bitmap);
 
-    /// Returns true if the headers have the same vital properties
-    inline bool same(const struct dump_header &o) const {
-      return (signature[0] == 's' && signature[1] == 't' && signature[2] == 'x'
-          && signature[3] == '-' && signature[4] == 'b' && signature[5] == 't'
-          && signature[6] == 'r' && signature[7] == 'e' && signature[8] == 'e'
-          && signature[9] == 0 && signature[10] == 0 && signature[11] == 0)
-          && (version == o.version) && (key_type_size == o.key_type_size)
-          && (data_type_size == o.data_type_size) && (leafslots == o.leafslots)
-          && (innerslots == o.innerslots)
-          && (allow_duplicates == o.allow_duplicates);
-    }
-  };
+    PM_EQU((leaf->slot[slot].key), (key));
+    PM_EQU((leaf->slot[slot].data), (data));
+    persist_range(&leaf->slot[slot], sizeof(leaf_entry));
 
- public:
+    // Fingerprint and bit go out in one header flush
+    PM_EQU((leaf->fingerprint[slot]), (fingerprint(key)));
+    PM_EQU((leaf->bitmap), (leaf->bitmap | (1UL << slot)));
+    persist_range(&leaf->bitmap, sizeof(uint64_t) + sizeof(leaf_node*)
+                  + sizeof(leaf->fingerprint));
 
-/// Dump the contents of the B+ tree out onto an ostream as a binary
-/// image. The image contains memory pointers which will be fixed when the
-/// image is restored. For this to work your key_type and data_type must be
-/// integral types and contain no pointers or references.
-  void dump(std::ostream &os) const {
-    struct dump_header header;
-    header.fill();
-    header.itemcount = size();
+    write_unlock(leaf->version);
+    add_size(1);
+    return std::pair<iterator, bool>(iterator(leaf, slot), true);
+  }
 
-    os.write(reinterpret_cast<char*>(&header), sizeof(header));
+  /// Attempt to insert a key/data pair. Fails if the key is already present.
+  inline std::pair<iterator, bool> insert(const value_type& x) {
+    return insert(x.first, x.second);
+  }
 
-    if ((*m_root)) {
-      dump_node(os, (*m_root));
-    }
+  /// Same as insert(), kept for callers of the STL-style interface
+  inline std::pair<iterator, bool> insert2(const key_type& key,
+                                           const data_type& data) {
+    return insert(key, data);
   }
 
-/// Restore a binary image of a dumped B+ tree from an istream. The B+ tree
-/// pointers are fixed using the dump order. For dump and restore to work
-/// your key_type and data_type must be integral types and contain no
-/// pointers or references. Returns true if the restore was successful.
-  bool restore(std::istream &is) {
-    struct dump_header fileheader;
-    is.read(reinterpret_cast<char*>(&fileheader), sizeof(fileheader));
-    if (!is.good())
-      return false;
+ public:
+  // *** Erase Functions
 
-    struct dump_header myheader;
-    myheader.fill();
-    myheader.itemcount = fileheader.itemcount;
+  /// Erases the key/data pair with the given key
+  bool erase_one(const key_type &key) {
+    epoch_guard guard(epochs);
+    leaf_node* leaf = lock_leaf(key);
+    if (leaf == NULL)
+      return false;
 
-    if (!myheader.same(fileheader)) {
-      BTREE_PRINT(
-          "btree::restore: file header does not match instantiation signature.");
+    int slot = find_slot(leaf, key);
+    if (slot < 0) {
+      write_unlock(leaf->version);
       return false;
     }
 
-    clear();
-
-    if (fileheader.itemcount > 0) {
-      (*m_root) = restore_node(is);
-      if ((*m_root) == NULL)
-        return false;
+    PM_EQU((leaf->bitmap), (leaf->bitmap & ~(1UL << slot)));
+    persist_range(&leaf->bitmap, sizeof(uint64_t));
+    bool emptied = (leaf->bitmap == 0);
+    write_unlock(leaf->version);
+    add_size(-1);
 
-      m_stats->itemcount = fileheader.itemcount;
+    if (shared && emptied) {
+      remove_shared_leaf(key);
+      return true;
     }
 
-    if (selfverify)
-      verify();
+    // Empty leaves of a private tree leave the chain, the last one stays as
+    // the head
+    if (!shared && leaf->bitmap == 0
+        && !(leaf == (*m_head) && leaf->next == NULL)) {
+      path_entry path[BTREE_MAX_DEPTH];
+      unsigned int depth = 0;
+
+      find_leaf(key, path, depth);
+      remove_leaf(leaf, path, depth);
+    }
 
     return true;
   }
 
- private:
-
-/// Recursively descend down the tree and dump each node in a precise order
-  void dump_node(std::ostream &os, const node* n) const {
-    BTREE_PRINT("dump_node " << n << std::endl);
-
-    if (n->isleafnode()) {
-      const leaf_node *leaf = static_cast<const leaf_node*>(n);
-
-      os.write(reinterpret_cast<const char*>(leaf), sizeof(*leaf));
-    } else  // !n->isleafnode()
-    {
-      const inner_node *inner = static_cast<const inner_node*>(n);
-
-      os.write(reinterpret_cast<const char*>(inner), sizeof(*inner));
+  /// Erases the key/data pair with the given key, returns the number erased
+  size_type erase(const key_type &key) {
+    return erase_one(key) ? 1 : 0;
+  }
 
-      for (unsigned short slot = 0; slot <= inner->slotuse; ++slot) {
-        const node *subnode = inner->childid[slot];
+  /// Frees all key/data pairs and all nodes of the tree. Not safe against
+  /// concurrent executors.
+  void clear() {
+    leaf_node* leaf = (*m_head);
 
-        dump_node(os, subnode);
-      }
+    if (leaf != NULL) {
+      PM_EQU(((*m_head)), (NULL));
+      persist_range(m_head, sizeof(leaf_node*));
     }
-  }
-
-/// Read the dump image and construct a tree from the node order in the
-/// serialization.
-  node* restore_node(std::istream &is) {
-    union {
-      node top;
-      leaf_node leaf;
-      inner_node inner;
-    } nu;
-
-    // first read only the top of the node
-    is.read(reinterpret_cast<char*>(&nu.top), sizeof(nu.top));
-    if (!is.good())
-      return NULL;
 
-    if (nu.top.isleafnode()) {
-      // read remaining data of leaf node
-      is.read(reinterpret_cast<char*>(&nu.leaf) + sizeof(nu.top),
-              sizeof(nu.leaf) - sizeof(nu.top));
-      if (!is.good())
-        return NULL;
+    while (leaf != NULL) {
+      leaf_node* next = leaf->next;
+      delete leaf;
+      leaf = next;
+    }
 
-      leaf_node *newleaf = allocate_leaf();
+    free_inner(m_root);
+    m_root.store(NULL);
+    m_size.store(0);
+  }
 
-      // copy over all data, the leaf nodes contain only their double linked list pointers
-      *newleaf = nu.leaf;
+ public:
+  // *** Recovery
+
+  /// Rebuild the inner levels and the count from the leaf chain
+  void recover() {
+    free_inner(m_root);
+    m_root.store(NULL);
+    m_size.store(0);
+
+    std::vector<std::pair<void*, key_type> > level;
+    leaf_node* prev = NULL;
+    leaf_node* leaf = (*m_head);
+
+    while (leaf != NULL) {
+      leaf_node* next = leaf->next;
+
+      // Entries copied by a split that did not finish
+      if (next != NULL && next->bitmap != 0) {
+        key_type next_min = min_key(next);
+        uint64_t bitmap = leaf->bitmap;
+
+        for (uint64_t bits = bitmap; bits != 0; bits &= bits - 1) {
+          unsigned int slot = __builtin_ctzl(bits);
+          if (!m_key_less(leaf->slot[slot].key, next_min))
+            bitmap &= ~(1UL << slot);
+        }
 
-      // reconstruct the linked list from the order in the file
-      if (m_headleaf == NULL) {
-        BTREE_ASSERT(newleaf->prevleaf == NULL);
-        m_headleaf = m_tailleaf = newleaf;
-      } else {
-        newleaf->prevleaf = m_tailleaf;
-        m_tailleaf->nextleaf = newleaf;
-        m_tailleaf = newleaf;
+        if (bitmap != leaf->bitmap) {
+          PM_EQU((leaf->bitmap), (bitmap));
+          persist_range(&leaf->bitmap, sizeof(uint64_t));
+        }
       }
 
-      return newleaf;
-    } else {
-      // read remaining data of inner node
-      is.read(reinterpret_cast<char*>(&nu.inner) + sizeof(nu.top),
-              sizeof(nu.inner) - sizeof(nu.top));
-      if (!is.good())
-        return NULL;
-
-      inner_node *newinner = allocate_inner(0);
+      // Empty leaves left by an unfinished unlink
+      if (leaf->bitmap == 0 && (prev != NULL || next != NULL)) {
+        unlink_leaf(prev, leaf);
+        leaf = next;
+        continue;
+      }
 
-      // copy over all data, the inner nodes contain only pointers to their children
-      *newinner = nu.inner;
+      // A crash may have left the leaf locked
+      leaf->version.store(0);
+      m_size += __builtin_popcountl(leaf->bitmap);
+      level.push_back(
+          std::make_pair((void*) leaf,
+                         leaf->bitmap ? min_key(leaf) : key_type()));
+
+      prev = leaf;
+      leaf = next;
+    }
+
+    // Build the inner levels bottom up, children spread evenly. A single
+    // leaf still gets a root above it.
+    unsigned short height = 0;
+    while (level.size() > 1 || (height == 0 && !level.empty())) {
+      std::vector<std::pair<void*, key_type> > parents;
+      size_t max_children = innerslotmax + 1;
+      size_t num_parents = (level.size() + max_children - 1) / max_children;
+      size_t itr = 0;
+
+      height++;
+      for (size_t parent_itr = 0; parent_itr < num_parents; parent_itr++) {
+        size_t num_children = (level.size() - itr)
+            / (num_parents - parent_itr);
+        inner_node* inner = allocate_inner(height);
+
+        for (size_t child_itr = 0; child_itr < num_children; child_itr++) {
+          if (child_itr > 0)
+            inner->slotkey[child_itr - 1] = level[itr].second;
+          inner->childid[child_itr] = level[itr].first;
+          itr++;
+        }
+        inner->slotuse = num_children - 1;
 
-      for (unsigned short slot = 0; slot <= newinner->slotuse; ++slot) {
-        newinner->childid[slot] = restore_node(is);
+        parents.push_back(
+            std::make_pair((void*) inner, level[itr - num_children].second));
       }
 
-      return newinner;
+      level.swap(parents);
     }
-  }
-};
-
-/** \file btree_map.h
- * Contains the specialized B+ tree template class btree_map
- */
-
-/** @brief Specialized B+ tree template class implementing STL's map container.
- *
- * Implements the STL map using a B+ tree. It can be used as a drop-in
- * replacement for std::map. Not all asymptotic time requirements are met in
- * theory. The class has a traits class defining B+ tree properties like slots
- * and self-verification. Furthermore an allocator can be specified for tree
- * nodes.
- *
- * Most noteworthy difference to the default red-black implementation of
- * std::map is that the B+ tree does not hold key and data pair together in
- * memory. Instead each B+ tree node has two arrays of keys and data
- * values. This design directly generates many problems in implementing the
- * iterator's operator's which return value_type composition pairs.
- */
-template<typename _Key, typename _Data, typename _Compare = std::less<_Key>,
-    typename _Traits = btree_default_map_traits<_Key, _Data>,
-    typename _Alloc = std::allocator<std::pair<_Key, _Data> > >
-class pbtree {
- public:
-  // *** Template Parameter Types
 
-  /// First template parameter: The key type of the btree. This is stored in
-  /// inner nodes and leaves
-  typedef _Key key_type;
+    if (height > 0)
+      m_root.store((inner_node*) level[0].first);
+  }
 
-  /// Second template parameter: The data type associated with each
-  /// key. Stored in the B+ tree's leaves
-  typedef _Data data_type;
+ private:
+  // *** Node Helpers
 
-  /// Third template parameter: Key comparison function object
-  typedef _Compare key_compare;
+  inline void persist_range(void* addr, size_t len) {
+    if (persist)
+      pmem_persist(addr, len, 0);
+  }
 
-  /// Fourth template parameter: Traits object used to define more parameters
-  /// of the B+ tree
-  typedef _Traits traits;
+  /// Allocate an empty leaf
+  leaf_node* allocate_leaf() {
+    leaf_node* leaf = (leaf_node*) pmalloc(sizeof(leaf_node));
 
-  /// Fifth template parameter: STL allocator
-  typedef _Alloc allocator_type;
+    leaf->version.store(0);
+    PM_EQU((leaf->bitmap), (0));
+    PM_EQU((leaf->next), (NULL));
+    if (persist)
+      pmemalloc_activate(leaf);
 
-  // The macro BTREE_FRIENDS can be used by outside class to access the B+
-  // tree internals. This was added for wxBTreeDemo to be able to draw the
-  // tree.
-  BTREE_FRIENDS
+    return leaf;
+  }
 
- public:
-  // *** Constructed Types
+  /// Allocate a volatile inner node
+  inner_node* allocate_inner(unsigned short level) {
+    inner_node* inner = new inner_node;
 
-  /// Typedef of our own type
-  typedef pbtree<key_type, data_type, key_compare, traits, allocator_type> self;
+    inner->version.store(0);
+    inner->level = level;
+    inner->slotuse = 0;
+    return inner;
+  }
 
-  /// Construct the STL-required value_type as a composition pair of key and
-  /// data types
-  typedef std::pair<key_type, data_type> value_type;
+  void free_inner(inner_node* inner) {
+    if (inner == NULL)
+      return;
 
-  /// Implementation type of the btree_base
-  typedef btree<key_type, data_type, value_type, key_compare, traits, false,
-      allocator_type, false> btree_impl;
+    if (inner->level > 1) {
+      for (unsigned short itr = 0; itr <= inner->slotuse; itr++)
+        free_inner((inner_node*) inner->childid[itr]);
+    }
 
-  /// Function class comparing two value_type pairs.
-  typedef typename btree_impl::value_compare value_compare;
+    delete inner;
+  }
 
-  /// Size type used to count keys
-  typedef typename btree_impl::size_type size_type;
+  /// One byte hash of the key
+  static inline uint8_t fingerprint(const key_type& key) {
+    uint64_t h = std::hash<key_type>()(key);
+    return (uint8_t) ((h * 0x9E3779B97F4A7C15UL) >> 56);
+  }
 
-  /// Small structure containing statistics about the tree
-  typedef typename btree_impl::tree_stats tree_stats;
+  inline bool key_equal(const key_type& a, const key_type& b) const {
+    return !m_key_less(a, b) && !m_key_less(b, a);
+  }
 
- public:
-  // *** Static Constant Options and Values of the B+ Tree
+  /// Index of the first key greater than key, which is the child to take
+  inline unsigned short find_child(const inner_node* inner,
+                                   const key_type& key) const {
+    return find_child(
+        inner, key,
+        std::integral_constant<bool,
+            btree_simd_key<key_type, key_compare>::value>());
+  }
 
-  /// Base B+ tree parameter: The number of key/data slots in each leaf
-  static const unsigned short leafslotmax = btree_impl::leafslotmax;
+  inline unsigned short find_child(const inner_node* inner,
+                                   const key_type& key,
+                                   std::true_type) const {
+#ifdef BTREE_SIMD_SEARCH
+    int slot = btree_upper_bound_simd((const unsigned long*) inner->slotkey,
+                                      inner->slotuse, key);
+    if (slot >= 0)
+      return slot;
+#endif
 
-  /// Base B+ tree parameter: The number of key slots in each inner node,
-  /// this can differ from slots in each leaf.
-  static const unsigned short innerslotmax = btree_impl::innerslotmax;
+    return find_child(inner, key, std::false_type());
+  }
 
-  /// Computed B+ tree parameter: The minimum number of key/data slots used
-  /// in a leaf. If fewer slots are used, the leaf will be merged or slots
-  /// shifted from it's siblings.
-  static const unsigned short minleafslots = btree_impl::minleafslots;
+  inline unsigned short find_child(const inner_node* inner,
+                                   const key_type& key,
+                                   std::false_type) const {
+    unsigned short lo = 0, hi = inner->slotuse;
 
-  /// Computed B+ tree parameter: The minimum number of key slots used
-  /// in an inner node. If fewer slots are used, the inner node will be
-  /// merged or slots shifted from it's siblings.
-  static const unsigned short mininnerslots = btree_impl::mininnerslots;
+    while (lo < hi) {
+      unsigned short mid = (lo + hi) >> 1;
+      if (m_key_less(key, inner->slotkey[mid]))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
 
-  /// Debug parameter: Enables expensive and thorough checking of the B+ tree
-  /// invariants after each insert/erase operation.
-  static const bool selfverify = btree_impl::selfverify;
+    return lo;
+  }
 
-  /// Debug parameter: Prints out lots of debug information about how the
-  /// algorithms change the tree. Requires the header file to be compiled
-  /// with BTREE_DEBUG and the key type must be std::ostream printable.
-  static const bool debug = btree_impl::debug;
+  // *** Optimistic Lock Coupling
 
-  /// Operational parameter: Allow duplicate keys in the btree.
-  static const bool allow_duplicates = btree_impl::allow_duplicates;
+  /// Version of a node, restarts if a writer holds it
+  static inline uint64_t read_lock(const std::atomic<uint64_t>& version,
+                                   bool& restart) {
+    uint64_t v = version.load(std::memory_order_acquire);
+    if (v & 1) {
+      btree_wait_unlocked(version);
+      restart = true;
+    }
+    return v;
+  }
 
- public:
-  // *** Iterators and Reverse Iterators
+  /// Restarts if the node changed since its version was read
+  static inline void read_unlock(const std::atomic<uint64_t>& version,
+                                 uint64_t v, bool& restart) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (version.load(std::memory_order_relaxed) != v)
+      restart = true;
+  }
 
-  /// STL-like iterator object for B+ tree items. The iterator points to a
-  /// specific slot number in a leaf.
-  typedef typename btree_impl::iterator iterator;
+  /// Locks the node if it did not change since its version was read
+  static inline void upgrade_lock(std::atomic<uint64_t>& version, uint64_t v,
+                                  bool& restart) {
+    if (!version.compare_exchange_strong(v, v + 1, std::memory_order_acquire))
+      restart = true;
+  }
 
-  /// STL-like iterator object for B+ tree items. The iterator points to a
-  /// specific slot number in a leaf.
-  typedef typename btree_impl::const_iterator const_iterator;
+  /// Unlocks the node and moves its version on
+  static inline void write_unlock(std::atomic<uint64_t>& version) {
+    version.fetch_add(1, std::memory_order_release);
+  }
 
-  /// create mutable reverse iterator by using STL magic
-  typedef typename btree_impl::reverse_iterator reverse_iterator;
+  /// Private trees skip the locked add
+  inline void add_size(long delta) {
+    if (shared)
+      m_size.fetch_add(delta, std::memory_order_relaxed);
+    else
+      m_size.store(m_size.load(std::memory_order_relaxed) + delta,
+                   std::memory_order_relaxed);
+  }
+
+  /// Leaf that holds key, read at version. NULL without a restart if the
+  /// tree is empty. The parent, its version and the slot of the leaf in it
+  /// go to the optional outputs.
+  leaf_node* find_leaf(const key_type& key, uint64_t& version, bool& restart,
+                       inner_node** parent = NULL,
+                       uint64_t* parent_version = NULL,
+                       unsigned short* parent_slot = NULL) const {
+    inner_node* inner = m_root.load(std::memory_order_acquire);
+    if (inner == NULL)
+      return NULL;
 
-  /// create constant reverse iterator by using STL magic
-  typedef typename btree_impl::const_reverse_iterator const_reverse_iterator;
+    uint64_t v = read_lock(inner->version, restart);
+    if (restart || inner != m_root.load(std::memory_order_acquire)) {
+      restart = true;
+      return NULL;
+    }
 
- private:
-  // *** Tree Implementation Object
+    while (true) {
+      unsigned short slot = find_child(inner, key);
+      void* child = inner->childid[slot];
 
-  /// The contained implementation object
-  btree_impl tree;
+      // Check the child pointer before following it
+      read_unlock(inner->version, v, restart);
+      if (restart)
+        return NULL;
 
- public:
-  // *** Constructors and Destructor
+      if (inner->level == 1) {
+        leaf_node* leaf = (leaf_node*) child;
+        version = read_lock(leaf->version, restart);
+        read_unlock(inner->version, v, restart);
+        if (restart)
+          return NULL;
+
+        if (parent != NULL) {
+          *parent = inner;
+          *parent_version = v;
+          *parent_slot = slot;
+        }
+        return leaf;
+      }
 
-  /// Default constructor initializing an empty B+ tree with the standard key
-  /// comparison function
-  explicit inline pbtree(void** _root, const allocator_type &alloc =
-                             allocator_type())
-      : tree(_root, alloc) {
-  }
+      inner_node* next = (inner_node*) child;
+      uint64_t next_v = read_lock(next->version, restart);
+      read_unlock(inner->version, v, restart);
+      if (restart)
+        return NULL;
 
-  /// Constructor initializing an empty B+ tree with a special key
-  /// comparison object
-  explicit inline pbtree(const key_compare &kcf, const allocator_type &alloc =
-                             allocator_type())
-      : tree(kcf, alloc) {
+      inner = next;
+      v = next_v;
+    }
   }
 
-  /// Constructor initializing a B+ tree with the range [first,last)
-  template<class InputIterator>
-  inline pbtree(InputIterator first, InputIterator last,
-                const allocator_type &alloc = allocator_type())
-      : tree(first, last, alloc) {
-  }
+  /// Leaf that holds key, write locked, or NULL if the tree is empty
+  leaf_node* lock_leaf(const key_type& key) {
+    while (true) {
+      bool restart = false;
+      uint64_t version;
 
-  /// Constructor initializing a B+ tree with the range [first,last) and a
-  /// special key comparison object
-  template<class InputIterator>
-  inline pbtree(InputIterator first, InputIterator last, const key_compare &kcf,
-                const allocator_type &alloc = allocator_type())
-      : tree(first, last, kcf, alloc) {
+      leaf_node* leaf = find_leaf(key, version, restart);
+      if (!restart && leaf != NULL)
+        upgrade_lock(leaf->version, version, restart);
+      if (!restart)
+        return leaf;
+    }
   }
 
-  /// Frees up all used B+ tree memory pages
-  inline ~pbtree() {
-  }
+  /// Leaf that holds key, write locked, and its parent read at
+  /// parent_version. Full inner nodes on the way are split and the descent
+  /// restarts.
+  leaf_node* lock_leaf_for_insert(const key_type& key, inner_node*& parent,
+                                  uint64_t& parent_version, bool& restart) {
+    inner_node* inner = m_root.load(std::memory_order_acquire);
+    uint64_t v = read_lock(inner->version, restart);
+    if (restart || inner != m_root.load(std::memory_order_acquire)) {
+      restart = true;
+      return NULL;
+    }
 
-  /// Fast swapping of two identical B+ tree objects.
-  void swap(self& from) {
-    std::swap(tree, from.tree);
-  }
+    inner_node* above = NULL;
+    uint64_t above_v = 0;
 
- public:
-  // *** Key and Value Comparison Function Objects
+    while (true) {
+      if (inner->slotuse == innerslotmax) {
+        split_inner(above, above_v, inner, v);
+        restart = true;
+        return NULL;
+      }
 
-  /// Constant access to the key comparison object sorting the B+ tree
-  inline key_compare key_comp() const {
-    return tree.key_comp();
-  }
+      void* child = inner->childid[find_child(inner, key)];
+      read_unlock(inner->version, v, restart);
+      if (restart)
+        return NULL;
 
-  /// Constant access to a constructed value_type comparison object. required
-  /// by the STL
-  inline value_compare value_comp() const {
-    return tree.value_comp();
-  }
+      if (inner->level == 1) {
+        leaf_node* leaf = (leaf_node*) child;
+        uint64_t leaf_v = read_lock(leaf->version, restart);
+        if (!restart)
+          upgrade_lock(leaf->version, leaf_v, restart);
+        if (restart)
+          return NULL;
+
+        // The leaf is still the child for key
+        read_unlock(inner->version, v, restart);
+        if (restart) {
+          write_unlock(leaf->version);
+          return NULL;
+        }
 
- public:
-  // *** Allocators
+        parent = inner;
+        parent_version = v;
+        return leaf;
+      }
 
-  /// Return the base node allocator provided during construction.
-  allocator_type get_allocator() const {
-    return tree.get_allocator();
+      above = inner;
+      above_v = v;
+      inner = (inner_node*) child;
+      v = read_lock(inner->version, restart);
+      read_unlock(above->version, above_v, restart);
+      if (restart)
+        return NULL;
+    }
   }
 
- public:
-  // *** Fast Destruction of the B+ Tree
-
-  /// Frees all key/data pairs and all nodes of the tree
-  void clear() {
-    tree.clear();
-  }
+  /// First leaf and the root above it. Other inserts wait on the locked root
+  /// until the root slot holds the leaf.
+  void create_root() {
+    inner_node* root = allocate_inner(1);
+    leaf_node* leaf = allocate_leaf();
 
- public:
-  // *** STL Iterator Construction Functions
+    root->childid[0] = leaf;
+    root->version.store(1);
 
-  /// Constructs a read/data-write iterator that points to the first slot in
-  /// the first leaf of the B+ tree.
-  inline iterator begin() {
-    return tree.begin();
-  }
+    inner_node* expected = NULL;
+    if (!m_root.compare_exchange_strong(expected, root)) {
+      delete leaf;
+      delete root;
+      return;
+    }
 
-  /// Constructs a read/data-write iterator that points to the first invalid
-  /// slot in the last leaf of the B+ tree.
-  inline iterator end() {
-    return tree.end();
+    PM_EQU(((*m_head)), (leaf));
+    persist_range(m_head, sizeof(leaf_node*));
+    write_unlock(root->version);
   }
 
-  /// Constructs a read-only constant iterator that points to the first slot
-  /// in the first leaf of the B+ tree.
-  inline const_iterator begin() const {
-    return tree.begin();
-  }
+  /// Split a full inner node, its middle key moves up into the parent or
+  /// into a new root. Gives up if either node changed since it was read.
+  void split_inner(inner_node* parent, uint64_t parent_version,
+                   inner_node* inner, uint64_t version) {
+    bool restart = false;
 
-  /// Constructs a read-only constant iterator that points to the first
-  /// invalid slot in the last leaf of the B+ tree.
-  inline const_iterator end() const {
-    return tree.end();
-  }
+    if (parent != NULL) {
+      upgrade_lock(parent->version, parent_version, restart);
+      if (restart)
+        return;
+    }
 
-  /// Constructs a read/data-write reverse iterator that points to the first
-  /// invalid slot in the last leaf of the B+ tree. Uses STL magic.
-  inline reverse_iterator rbegin() {
-    return tree.rbegin();
-  }
+    upgrade_lock(inner->version, version, restart);
+    if (restart) {
+      if (parent != NULL)
+        write_unlock(parent->version);
+      return;
+    }
 
-  /// Constructs a read/data-write reverse iterator that points to the first
-  /// slot in the first leaf of the B+ tree. Uses STL magic.
-  inline reverse_iterator rend() {
-    return tree.rend();
-  }
+    inner_node* new_inner = allocate_inner(inner->level);
+    unsigned short mid = inner->slotuse / 2;
+    key_type up_key = inner->slotkey[mid];
 
-  /// Constructs a read-only reverse iterator that points to the first
-  /// invalid slot in the last leaf of the B+ tree. Uses STL magic.
-  inline const_reverse_iterator rbegin() const {
-    return tree.rbegin();
-  }
+    new_inner->slotuse = inner->slotuse - mid - 1;
+    std::copy(inner->slotkey + mid + 1, inner->slotkey + inner->slotuse,
+              new_inner->slotkey);
+    std::copy(inner->childid + mid + 1, inner->childid + inner->slotuse + 1,
+              new_inner->childid);
+    inner->slotuse = mid;
 
-  /// Constructs a read-only reverse iterator that points to the first slot
-  /// in the first leaf of the B+ tree. Uses STL magic.
-  inline const_reverse_iterator rend() const {
-    return tree.rend();
-  }
+    if (parent != NULL) {
+      // up_key falls in the range of inner, so it finds the slot of inner
+      insert_into_inner(parent, find_child(parent, up_key), up_key,
+                        new_inner);
+      write_unlock(parent->version);
+    } else {
+      inner_node* root = allocate_inner(inner->level + 1);
+      root->slotkey[0] = up_key;
+      root->childid[0] = inner;
+      root->childid[1] = new_inner;
+      root->slotuse = 1;
 
- public:
-  // *** Access Functions to the Item Count
+      m_root.store(root, std::memory_order_release);
+    }
 
-  /// Return the number of key/data pairs in the B+ tree
-  inline size_type size() const {
-    return tree.size();
+    write_unlock(inner->version);
   }
 
-  /// Returns true if there is at least one key/data pair in the B+ tree
-  inline bool empty() const {
-    return tree.empty();
-  }
+  /// Leaf that holds key, remembering the way down
+  leaf_node* find_leaf(const key_type& key, path_entry* path,
+                       unsigned int& depth) const {
+    inner_node* inner = m_root;
+    depth = 0;
 
-  /// Returns the largest possible size of the B+ Tree. This is just a
-  /// function required by the STL standard, the B+ Tree can hold more items.
-  inline size_type max_size() const {
-    return tree.max_size();
-  }
+    if (inner == NULL)
+      return (*m_head);
 
-  /// Return a const reference to the current statistics.
-  inline const tree_stats& get_stats() const {
-    return tree.get_stats();
-  }
+    while (true) {
+      unsigned short slot = find_child(inner, key);
 
- public:
-  // *** Standard Access Functions Querying the Tree by Descending to a Leaf
+      path[depth].node = inner;
+      path[depth].slot = slot;
+      depth++;
 
-  /// Non-STL function checking whether a key is in the B+ tree. The same as
-  /// (find(k) != end()) or (count() != 0).
-  bool exists(const key_type &key) const {
-    return tree.exists(key);
+      if (inner->level == 1)
+        return (leaf_node*) inner->childid[slot];
+      inner = (inner_node*) inner->childid[slot];
+    }
   }
 
-  /// Tries to locate a key in the B+ tree and returns an iterator to the
-  /// key/data slot if found. If unsuccessful it returns end().
-  iterator find(const key_type &key) {
-    return tree.find(key);
-  }
+  /// Slot of key in leaf, or -1. Only slots whose fingerprint matches are
+  /// compared.
+  int find_slot(const leaf_node* leaf, const key_type& key) const {
+    uint8_t fp = fingerprint(key);
 
-  /// Tries to locate a key in the B+ tree and returns an constant iterator
-  /// to the key/data slot if found. If unsuccessful it returns end().
-  const_iterator find(const key_type &key) const {
-    return tree.find(key);
-  }
+#ifdef BTREE_SIMD_SEARCH
+    uint64_t bits = leaf->bitmap
+        & btree_match_bytes(leaf->fingerprint, fingerprintmax, fp);
 
-  /// Tries to return value if key is found.
-  bool at(const key_type &key, data_type* val) {
-    return tree.at(key, val);
-  }
+    for (; bits != 0; bits &= bits - 1) {
+      unsigned int slot = __builtin_ctzl(bits);
+      if (key_equal(leaf->slot[slot].key, key))
+        return slot;
+    }
+#else
+    for (uint64_t bits = leaf->bitmap; bits != 0; bits &= bits - 1) {
+      unsigned int slot = __builtin_ctzl(bits);
+      if (leaf->fingerprint[slot] == fp && key_equal(leaf->slot[slot].key, key))
+        return slot;
+    }
+#endif
 
-  /// Tries to update value if key is found.
-  int update(const key_type &key, const data_type &val) {
-    return tree.update(key, val);
+    return -1;
   }
 
-  // Disable persistence
-  void disable_persistence() {
-    tree.disable_persistence();
-  }
+  key_type min_key(const leaf_node* leaf) const {
+    uint64_t bits = leaf->bitmap;
+    const key_type* min = &leaf->slot[__builtin_ctzl(bits)].key;
 
-  /// Tries to locate a key in the B+ tree and returns the number of
-  /// identical key entries found. Since this is a unique map, count()
-  /// returns either 0 or 1.
-  size_type count(const key_type &key) const {
-    return tree.count(key);
-  }
+    for (bits &= bits - 1; bits != 0; bits &= bits - 1) {
+      const key_type* cur = &leaf->slot[__builtin_ctzl(bits)].key;
+      if (m_key_less(*cur, *min))
+        min = cur;
+    }
 
-  /// Searches the B+ tree and returns an iterator to the first pair
-  /// equal to or greater than key, or end() if all keys are smaller.
-  iterator lower_bound(const key_type& key) {
-    return tree.lower_bound(key);
+    return *min;
   }
 
-  /// Searches the B+ tree and returns a constant iterator to the
-  /// first pair equal to or greater than key, or end() if all keys
-  /// are smaller.
-  const_iterator lower_bound(const key_type& key) const {
-    return tree.lower_bound(key);
-  }
+  /// Move the upper half of a full leaf into a new leaf after it. Returns
+  /// the new leaf, write locked, and its smallest key.
+  leaf_node* split_leaf(leaf_node* leaf, key_type& split_key) {
+    key_type keys[leafslotmax];
+    for (unsigned int slot = 0; slot < leafslotmax; slot++)
+      keys[slot] = leaf->slot[slot].key;
 
-  /// Searches the B+ tree and returns an iterator to the first pair
-  /// greater than key, or end() if all keys are smaller or equal.
-  iterator upper_bound(const key_type& key) {
-    return tree.upper_bound(key);
-  }
+    std::nth_element(keys, keys + leafslotmax / 2, keys + leafslotmax,
+                     m_key_less);
+    split_key = keys[leafslotmax / 2];
 
-  /// Searches the B+ tree and returns a constant iterator to the
-  /// first pair greater than key, or end() if all keys are smaller
-  /// or equal.
-  const_iterator upper_bound(const key_type& key) const {
-    return tree.upper_bound(key);
-  }
+    uint64_t upper = 0;
+    for (unsigned int slot = 0; slot < leafslotmax; slot++) {
+      if (!m_key_less(leaf->slot[slot].key, split_key))
+        upper |= (1UL << slot);
+    }
 
-  /// Searches the B+ tree and returns both lower_bound() and upper_bound().
-  inline std::pair<iterator, iterator> equal_range(const key_type& key) {
-    return tree.equal_range(key);
-  }
+    // Persist the new leaf before it becomes reachable
+    leaf_node* new_leaf = (leaf_node*) pmalloc(sizeof(leaf_node));
+    new_leaf->version.store(1);
+    PM_EQU((new_leaf->bitmap), (upper));
+    PM_EQU((new_leaf->next), (leaf->next));
+    PM_MEMCPY((new_leaf->fingerprint), (leaf->fingerprint),
+              (sizeof(leaf->fingerprint)));
+    PM_MEMCPY((new_leaf->slot), (leaf->slot), (sizeof(leaf->slot)));
+    if (persist)
+      pmemalloc_activate(new_leaf);
 
-  /// Searches the B+ tree and returns both lower_bound() and upper_bound().
-  inline std::pair<const_iterator, const_iterator> equal_range(
-      const key_type& key) const {
-    return tree.equal_range(key);
-  }
+    PM_EQU((leaf->next), (new_leaf));
+    persist_range(&leaf->next, sizeof(leaf_node*));
 
- public:
-  // *** B+ Tree Object Comparison Functions
+    PM_EQU((leaf->bitmap), (leaf->bitmap & ~upper));
+    persist_range(&leaf->bitmap, sizeof(uint64_t));
 
-  /// Equality relation of B+ trees of the same type. B+ trees of the same
-  /// size and equal elements (both key and data) are considered
-  /// equal.
-  inline bool operator==(const self &other) const {
-    return (tree == other.tree);
+    return new_leaf;
   }
 
-  /// Inequality relation. Based on operator==.
-  inline bool operator!=(const self &other) const {
-    return (tree != other.tree);
-  }
+  /// Put key and the child right of it after child slot
+  static void insert_into_inner(inner_node* inner, unsigned short slot,
+                                const key_type& key, void* child) {
+    std::copy_backward(inner->slotkey + slot, inner->slotkey + inner->slotuse,
+                       inner->slotkey + inner->slotuse + 1);
+    std::copy_backward(inner->childid + slot + 1,
+                       inner->childid + inner->slotuse + 1,
+                       inner->childid + inner->slotuse + 2);
 
-  /// Total ordering relation of B+ trees of the same type. It uses
-  /// std::lexicographical_compare() for the actual comparison of elements.
-  inline bool operator<(const self &other) const {
-    return (tree < other.tree);
+    inner->slotkey[slot] = key;
+    inner->childid[slot + 1] = child;
+    inner->slotuse++;
   }
 
-  /// Greater relation. Based on operator<.
-  inline bool operator>(const self &other) const {
-    return (tree > other.tree);
-  }
+  /// Unlink an empty leaf and drop it from the inner levels
+  void remove_leaf(leaf_node* leaf, path_entry* path, unsigned int depth) {
+    leaf_node* prev = NULL;
 
-  /// Less-equal relation. Based on operator<.
-  inline bool operator<=(const self &other) const {
-    return (tree <= other.tree);
-  }
+    // The previous leaf is the rightmost one left of the path
+    for (unsigned int itr = depth; itr > 0; itr--) {
+      if (path[itr - 1].slot == 0)
+        continue;
 
-  /// Greater-equal relation. Based on operator<.
-  inline bool operator>=(const self &other) const {
-    return (tree >= other.tree);
-  }
+      inner_node* inner = path[itr - 1].node;
+      void* child = inner->childid[path[itr - 1].slot - 1];
 
- public:
-  /// *** Fast Copy: Assign Operator and Copy Constructors
+      for (unsigned short level = inner->level; level > 1; level--) {
+        inner_node* in = (inner_node*) child;
+        child = in->childid[in->slotuse];
+      }
 
-  /// Assignment operator. All the key/data pairs are copied
-  inline self& operator=(const self &other) {
-    if (this != &other) {
-      tree = other.tree;
+      prev = (leaf_node*) child;
+      break;
     }
-    return *this;
-  }
-
-  /// Copy constructor. The newly initialized B+ tree object will contain a
-  /// copy of all key/data pairs.
-  inline pbtree(const self &other)
-      : tree(other.tree) {
-  }
 
- public:
-  // *** Public Insertion Functions
+    unlink_leaf(prev, leaf);
 
-  /// Attempt to insert a key/data pair into the B+ tree. Fails if the pair
-  /// is already present.
-  inline std::pair<iterator, bool> insert(const value_type& x) {
-    return tree.insert2(x.first, x.second);
-  }
+    // Remove the child, and inner nodes left without children
+    while (depth > 0) {
+      depth--;
+      inner_node* inner = path[depth].node;
+      unsigned short slot = path[depth].slot;
 
-  /// Attempt to insert a key/data pair into the B+ tree. Beware that if
-  /// key_type == data_type, then the template iterator insert() is called
-  /// instead. Fails if the inserted pair is already present.
-  inline std::pair<iterator, bool> insert(const key_type& key,
-                                          const data_type& data) {
-    return tree.insert2(key, data);
-  }
+      // Never the root, the last leaf stays
+      if (inner->slotuse == 0) {
+        delete inner;
+        continue;
+      }
 
-  /// Attempt to insert a key/data pair into the B+ tree. This function is the
-  /// same as the other insert, however if key_type == data_type then the
-  /// non-template function cannot be called. Fails if the inserted pair is
-  /// already present.
-  inline std::pair<iterator, bool> insert2(const key_type& key,
-                                           const data_type& data) {
-    return tree.insert2(key, data);
-  }
+      unsigned short key_slot = (slot > 0) ? slot - 1 : 0;
+      std::copy(inner->slotkey + key_slot + 1, inner->slotkey + inner->slotuse,
+                inner->slotkey + key_slot);
+      std::copy(inner->childid + slot + 1, inner->childid + inner->slotuse + 1,
+                inner->childid + slot);
+      inner->slotuse--;
+      break;
+    }
 
-  /// Attempt to insert a key/data pair into the B+ tree. The iterator hint
-  /// is currently ignored by the B+ tree insertion routine.
-  inline iterator insert(iterator hint, const value_type &x) {
-    return tree.insert2(hint, x.first, x.second);
+    // Drop roots with a single inner child
+    while (m_root.load()->slotuse == 0 && m_root.load()->level > 1) {
+      inner_node* root = m_root;
+      m_root.store((inner_node*) root->childid[0]);
+      delete root;
+    }
   }
 
-  /// Attempt to insert a key/data pair into the B+ tree. The iterator hint is
-  /// currently ignored by the B+ tree insertion routine.
-  inline iterator insert2(iterator hint, const key_type& key,
-                          const data_type& data) {
-    return tree.insert2(hint, key, data);
-  }
+  /// Unlinks an empty leaf of a shared tree and retires it. Gives up if
+  /// the leaf is the first child of its parent, as the leaf before it in
+  /// the chain then hangs off another parent, or if any of the three nodes
+  /// changed or is locked.
+  void remove_shared_leaf(const key_type& key) {
+    bool restart = false;
+    inner_node* parent;
+    uint64_t parent_v, leaf_v;
+    unsigned short slot;
 
-  /// Returns a reference to the object that is associated with a particular
-  /// key. If the map does not already contain such an object, operator[]
-  /// inserts the default object data_type().
-  inline data_type& operator[](const key_type& key) {
-    iterator i = insert(value_type(key, data_type())).first;
-    return i.data();
-  }
+    leaf_node* leaf = find_leaf(key, leaf_v, restart, &parent, &parent_v,
+                                &slot);
+    if (restart || leaf == NULL || slot == 0 || leaf->bitmap != 0)
+      return;
 
-  /// Attempt to insert the range [first,last) of value_type pairs into the B+
-  /// tree. Each key/data pair is inserted individually.
-  template<typename InputIterator>
-  inline void insert(InputIterator first, InputIterator last) {
-    return tree.insert(first, last);
-  }
+    upgrade_lock(parent->version, parent_v, restart);
+    if (restart)
+      return;
 
-  /// Bulk load a sorted range [first,last). Loads items into leaves and
-  /// constructs a B-tree above them. The tree must be empty when calling
-  /// this function.
-  template<typename Iterator>
-  inline void bulk_load(Iterator first, Iterator last) {
-    return tree.bulk_load(first, last);
-  }
+    upgrade_lock(leaf->version, leaf_v, restart);
+    if (restart) {
+      write_unlock(parent->version);
+      return;
+    }
 
- public:
-  // *** Public Erase Functions
+    // Siblings under one parent are neighbours in the chain
+    leaf_node* prev = (leaf_node*) parent->childid[slot - 1];
+    uint64_t prev_v = prev->version.load(std::memory_order_acquire);
+    if (prev_v & 1)
+      restart = true;
+    else
+      upgrade_lock(prev->version, prev_v, restart);
 
-  /// Erases the key/data pairs associated with the given key. For this
-  /// unique-associative map there is no difference to erase().
-  bool erase_one(const key_type &key) {
-    return tree.erase_one(key);
-  }
+    if (restart) {
+      write_unlock(leaf->version);
+      write_unlock(parent->version);
+      return;
+    }
 
-  /// Erases all the key/data pairs associated with the given key. This is
-  /// implemented using erase_one().
-  size_type erase(const key_type &key) {
-    return tree.erase(key);
-  }
+    PM_EQU((prev->next), (leaf->next));
+    persist_range(&prev->next, sizeof(leaf_node*));
 
-  /// Erase the key/data pair referenced by the iterator.
-  void erase(iterator iter) {
-  }
+    // Keys of the leaf now go to prev
+    std::copy(parent->slotkey + slot, parent->slotkey + parent->slotuse,
+              parent->slotkey + slot - 1);
+    std::copy(parent->childid + slot + 1,
+              parent->childid + parent->slotuse + 1, parent->childid + slot);
+    parent->slotuse--;
 
- public:
-  // *** Verification of B+ Tree Invariants
+    // Readers that still hold the leaf see its version move and restart
+    write_unlock(prev->version);
+    write_unlock(leaf->version);
+    write_unlock(parent->version);
 
-  /// Run a thorough verification of all B+ tree invariants. The program
-  /// aborts via BTREE_ASSERT() if something is wrong.
-  void verify() const {
-    tree.verify();
+    epochs->retire(leaf);
   }
 
- public:
-
-  /// Dump the contents of the B+ tree out onto an ostream as a binary
-  /// image. The image contains memory pointers which will be fixed when the
-  /// image is restored. For this to work your key_type and data_type must be
-  /// integral types and contain no pointers or references.
-  void dump(std::ostream &os) const {
-    tree.dump(os);
-  }
+  /// Take leaf out of the chain and free it
+  void unlink_leaf(leaf_node* prev, leaf_node* leaf) {
+    if (prev != NULL) {
+      PM_EQU((prev->next), (leaf->next));
+      persist_range(&prev->next, sizeof(leaf_node*));
+    } else {
+      PM_EQU(((*m_head)), (leaf->next));
+      persist_range(m_head, sizeof(leaf_node*));
+    }
 
-  /// Restore a binary image of a dumped B+ tree from an istream. The B+ tree
-  /// pointers are fixed using the dump order. For dump and restore to work
-  /// your key_type and data_type must be integral types and contain no
-  /// pointers or references. Returns true if the restore was successful.
-  bool restore(std::istream &is) {
-    return tree.restore(is);
+    delete leaf;
   }
 };
 
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstring>
+#include "libpm.h"
+
+namespace storage {
+
+// Persistent vector for storing pointers
+//
+// Elements live in chunks that double in size, chunk k holding
+// PVECTOR_BASE << k elements. The chunk directory has a fixed size, so
+// chunks never move and at() is O(1). An append persists the element
+// before it persists the new size, so a crash never exposes a torn entry.
+// clear() only resets the size and keeps the chunks for reuse.
+
+#define PVECTOR_BASE 16
+#define PVECTOR_MAX_CHUNKS 32
+
+template<typename V>
+class pvector {
+ public:
+  class iterator {
+   public:
+    iterator(const pvector* _vec, size_t _index)
+        : vec(_vec),
+          index(_index) {
+    }
+
+    V operator*() const {
+      return vec->at(index);
+    }
+
+    iterator& operator++() {
+      index++;
+      return *this;
+    }
+
+    bool operator!=(const iterator& other) const {
+      return index != other.index;
+    }
+
+   private:
+    const pvector* vec;
+    size_t index;
+  };
+
+  V* chunks[PVECTOR_MAX_CHUNKS];
+  size_t _size;
+
+  pvector() {
+    PM_MEMSET((chunks), (0), (sizeof(chunks)));
+    PM_EQU((_size), (0));
+  }
+
+  ~pvector() {
+    for (unsigned int itr = 0; itr < PVECTOR_MAX_CHUNKS; itr++) {
+      if (chunks[itr] != NULL)
+        delete[] chunks[itr];
+    }
+  }
+
+  off_t push_back(V val) {
+    size_t offset;
+    unsigned int chunk_itr = locate(_size, offset);
+
+    if (chunks[chunk_itr] == NULL) {
+      V* chunk = (V*) pmalloc((PVECTOR_BASE << chunk_itr) * sizeof(V));
+      pmemalloc_activate(chunk);
+
+      PM_EQU((chunks[chunk_itr]), (chunk));
+      pmem_persist(&chunks[chunk_itr], sizeof(V*), 0);
+    }
+
+    PM_EQU((chunks[chunk_itr][offset]), (val));
+    pmem_persist(&chunks[chunk_itr][offset], sizeof(V), 0);
+
+    PM_EQU((_size), (_size + 1));
+    pmem_persist(&_size, sizeof(_size), 0);
+
+    return _size - 1;
+  }
+
+  V at(const size_t index) const {
+    size_t offset;
+
+    if (index >= _size)
+      return NULL;
+
+    unsigned int chunk_itr = locate(index, offset);
+    return chunks[chunk_itr][offset];
+  }
+
+  void update(const size_t index, V val) {
+    size_t offset;
+
+    if (index >= _size)
+      return;
+
+    unsigned int chunk_itr = locate(index, offset);
+    PM_EQU((chunks[chunk_itr][offset]), (val));
+    pmem_persist(&chunks[chunk_itr][offset], sizeof(V), 0);
+  }
+
+  void clear(void) {
+    PM_EQU((_size), (0));
+    pmem_persist(&_size, sizeof(_size), 0);
+  }
+
+  iterator begin() const {
+    return iterator(this, 0);
+  }
+
+  iterator end() const {
+    return iterator(this, _size);
+  }
+
+  bool empty() const {
+    return (_size == 0);
+  }
+
+  int size() const {
+    return _size;
+  }
+
+ private:
+  // Chunk k covers [BASE * (2^k - 1), BASE * (2^(k+1) - 1))
+  static unsigned int locate(size_t index, size_t& offset) {
+    size_t slot = index / PVECTOR_BASE + 1;
+    unsigned int chunk_itr = 63 - __builtin_clzl(slot);
+
+    offset = index - PVECTOR_BASE * ((1UL << chunk_itr) - 1);
+    return chunk_itr;
+  }
+};
+
+}
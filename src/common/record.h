@@ -4,6 +4,7 @@
 #include <string>
 #include <cassert>
 #include <climits>
+#include <cstdint>
 #include <thread>
 
 #include "schema.h"
@@ -18,10 +19,13 @@ class record {
       this->is_persistent = is_persistent;
       PM_EQU((sptr), (_sptr));
       PM_EQU((data_len), (_sptr->ser_len));
-	if(this->is_persistent)
+	if(this->is_persistent) {
 		PM_EQU((data), ((char*) pmalloc(data_len*sizeof(char)))); /* sizeof(char) = 1 byte */
+		// Zeroed, so unset inlined varchars read as empty
+		PM_MEMSET((data), (0), (data_len));
+	}
 	else
-		data = new char[data_len];
+		data = new char[data_len]();  // zeroed too
   }
 
   ~record() {
@@ -70,8 +74,7 @@ class record {
         break;
 
       case field_type::VARCHAR: {
-        char* vcval = NULL;
-        memcpy(&vcval, &(data[offset]), sizeof(void*));
+        const char* vcval = get_varchar(field_id);
         if (vcval != NULL) {
           field = std::string(vcval);
         }
@@ -93,6 +96,14 @@ class record {
     return vcval;
   }
 
+  // Chars of a varchar, in its slot if inlined. NULL for a NULL varchar,
+  // inlined ones are never NULL.
+  const char* get_varchar(const int field_id) {
+    if (sptr->columns[field_id].inlined)
+      return &(data[sptr->columns[field_id].offset]);
+    return (const char*) get_pointer(field_id);
+  }
+
   void set_data(const int field_id, record* rec_ptr) {
     char type = sptr->columns[field_id].type;
     size_t offset = sptr->columns[field_id].offset;
@@ -124,7 +135,22 @@ class record {
 
   void set_varchar(const int field_id, std::string vc_str) {
     //assert(sptr->columns[field_id].type == field_type::VARCHAR);
+	field_info finfo = sptr->columns[field_id];
 	char *vc = NULL;
+
+	// Inlined, cut to fit the slot
+	if (finfo.inlined) {
+		if (vc_str.size() >= finfo.ser_len)
+			vc_str.resize(finfo.ser_len - 1);
+
+		vc = &(data[finfo.offset]);
+		if(is_persistent)
+			PM_DMEMCPY((vc), (vc_str.c_str()), (vc_str.size()+1));
+		else
+			memcpy((vc), (vc_str.c_str()), (vc_str.size()+1));
+		return;
+	}
+
 	if(is_persistent) {
 		vc = (char*) pmalloc((vc_str.size()+1)*sizeof(char));
 	    	PM_STRCPY((vc), (vc_str.c_str()), (vc_str.size()+1)); // if dst is not null terminated -> trouble
@@ -156,7 +182,9 @@ class record {
       if (sptr->columns[field_itr].inlined == 0) {
         void* ptr = get_pointer(field_itr);
         //printf("persist data :: %p \n", ptr);
-        pmemalloc_activate(ptr);
+        // Fields left out of a partial record are NULL
+        if (ptr != NULL)
+          pmemalloc_activate(ptr);
       }
     }
   }
@@ -165,6 +193,15 @@ class record {
   char* data;
   size_t data_len;
   int is_persistent = 0;
+
+  // Slot in the tuple heap of the table
+  void* heap_chunk = NULL;
+  unsigned int heap_slot = 0;
+
+  // Versions, see version_manager.h
+  uint64_t version_ts = 0;
+  uint64_t version_seq = 0;
+  record* older = NULL;
 };
 
 }
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <string>
+#include <cstring>
+
+#include "record.h"
+
+namespace storage {
+
+// RECORD VIEW
+//
+// The result of a select: a read-only view of a record with typed
+// accessors that read record::data in place, so nothing is formatted into
+// text and parsed back. Engines that keep records in memory lend the stored
+// record, which stays valid until the transaction changes it or ends.
+// Engines that do not, or that read an older version, hand over a copy
+// that the view frees when it is reset or destroyed.
+
+class record_view {
+ public:
+  record_view()
+      : rec(NULL),
+        owned(false),
+        owns_fields(false) {
+  }
+
+  ~record_view() {
+    reset();
+  }
+
+  record_view(const record_view&) = delete;
+  record_view& operator=(const record_view&) = delete;
+
+  // View of a stored record
+  void borrow(record* stored) {
+    reset();
+    rec = stored;
+  }
+
+  // View of a copy, its varchars too if own_fields
+  void own(record* copy, bool own_fields) {
+    reset();
+    rec = copy;
+    owned = (copy != NULL);
+    owns_fields = own_fields;
+  }
+
+  void reset() {
+    if (owned) {
+      if (owns_fields)
+        rec->clear_data();
+      delete rec;
+    }
+
+    rec = NULL;
+    owned = false;
+    owns_fields = false;
+  }
+
+  bool empty() const {
+    return (rec == NULL);
+  }
+
+  // The record behind the view
+  record* get() const {
+    return rec;
+  }
+
+  int get_int(const int field_id) const {
+    int ival;
+    memcpy(&ival, &(rec->data[rec->sptr->columns[field_id].offset]),
+           sizeof(int));
+    return ival;
+  }
+
+  double get_double(const int field_id) const {
+    double dval;
+    memcpy(&dval, &(rec->data[rec->sptr->columns[field_id].offset]),
+           sizeof(double));
+    return dval;
+  }
+
+  // Characters of a varchar, "" if it is NULL
+  const char* get_varchar_view(const int field_id) const {
+    const char* vc = rec->get_varchar(field_id);
+    return (vc != NULL) ? vc : "";
+  }
+
+  std::string get_varchar(const int field_id) const {
+    return std::string(get_varchar_view(field_id));
+  }
+
+  // Deep copy owned by the caller, to write the tuple back
+  record* copy(int is_persistent = 0) const {
+    schema* sptr = rec->sptr;
+    record* rec_ptr;
+
+    if (is_persistent)
+      rec_ptr = new ((record*) pmalloc(sizeof(record))) record(sptr, 1);
+    else
+      rec_ptr = new record(sptr);
+
+    PM_MEMCPY((rec_ptr->data), (rec->data), (rec->data_len));
+
+    // Varchars out of the record get their own copy
+    for (unsigned int itr = 0; itr < sptr->num_columns; itr++) {
+      if (sptr->columns[itr].type != field_type::VARCHAR
+          || sptr->columns[itr].inlined)
+        continue;
+
+      if (rec->get_pointer(itr) != NULL)
+        rec_ptr->set_varchar(itr, get_varchar_view(itr));
+      else
+        rec_ptr->set_pointer(itr, NULL);
+    }
+
+    return rec_ptr;
+  }
+
+ private:
+  record* rec;
+  bool owned;
+  bool owns_fields;
+};
+
+}
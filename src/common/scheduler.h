@@ -0,0 +1,177 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+#include "benchmark.h"
+
+namespace storage {
+
+// WORK-STEALING SCHEDULER
+//
+// Runs the txns of all partitions on a pool of workers instead of one thread
+// per partition, so a partition that straggles does not set the duration of
+// the run. The txns of each partition are cut into batches, and the deque of
+// worker i starts with the batches of partitions i, i + num_workers, and so
+// on, in order. A worker takes batches from the front of its own deque and,
+// once it finds nothing there, steals from the back of the others. With more
+// partitions than workers, idle workers pick up whole partitions that their
+// owners did not get to.
+//
+// A partition runs on one worker at a time, as its engine and benchmark
+// state are not thread-safe, so workers skip batches of partitions that
+// another worker is running. The partition flag is taken with acquire and
+// dropped with release, which orders the batches of a partition across
+// workers.
+//
+// The duration of a worker is what the timers of the partitions it ran
+// measured during its batches, the same measure a thread per partition
+// reports.
+
+#define SCHEDULER_BATCH_SIZE 64
+
+class scheduler {
+ public:
+  scheduler(benchmark** _partitions, unsigned int _num_partitions,
+            unsigned int _num_workers, unsigned int batch_size, bool _pin)
+      : partitions(_partitions),
+        num_partitions(_num_partitions),
+        num_workers(_num_workers),
+        pin(_pin),
+        num_batches(0),
+        num_steals(0) {
+
+    queues = new worker_queue[num_workers];
+    running = new std::atomic<bool>[num_partitions];
+
+    for (unsigned int itr = 0; itr < num_partitions; itr++) {
+      unsigned int num_txns = partitions[itr]->num_txns;
+
+      running[itr].store(false);
+      for (unsigned int begin = 0; begin < num_txns; begin += batch_size) {
+        unsigned int end = std::min(begin + batch_size, num_txns);
+        queues[itr % num_workers].batches.push_back({itr, begin, end});
+        num_batches++;
+      }
+    }
+  }
+
+  ~scheduler() {
+    delete[] queues;
+    delete[] running;
+  }
+
+  // Runs every batch, the duration of worker i goes to durations[i]
+  void run(std::vector<double>& durations) {
+    std::vector<std::thread> workers;
+
+    durations.assign(num_workers, 0);
+    for (unsigned int itr = 0; itr < num_workers; itr++)
+      workers.push_back(
+          std::thread(&scheduler::work, this, itr, &durations[itr]));
+
+    for (unsigned int itr = 0; itr < num_workers; itr++)
+      workers[itr].join();
+  }
+
+  // Batches run by a worker other than the one of their partition
+  unsigned long steals() const {
+    return num_steals.load();
+  }
+
+  // Binds the calling thread to a core, wrapping around the online cores
+  static void pin_to_core(unsigned int itr) {
+    unsigned int num_cores = std::thread::hardware_concurrency();
+    if (num_cores == 0)
+      return;
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(itr % num_cores, &cpuset);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset))
+      std::cerr << "pinning executor " << itr << " failed" << std::endl;
+  }
+
+ private:
+  struct batch {
+    unsigned int partition;
+    unsigned int begin;
+    unsigned int end;
+  };
+
+  struct worker_queue {
+    std::mutex lock;
+    std::deque<batch> batches;
+    char padding[64];
+  };
+
+  void work(unsigned int worker, double* duration) {
+    if (pin)
+      pin_to_core(worker);
+
+    while (num_batches.load(std::memory_order_acquire) > 0) {
+      batch b;
+
+      if (!take(worker, b)) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      benchmark* bh = partitions[b.partition];
+      double start = bh->tm->duration();
+
+      bh->execute_txns(b.begin, b.end);
+      (*duration) += bh->tm->duration() - start;
+
+      running[b.partition].store(false, std::memory_order_release);
+      num_batches.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  // A batch whose partition no other worker is running, own batches first
+  bool take(unsigned int worker, batch& b) {
+    for (unsigned int offset = 0; offset < num_workers; offset++) {
+      worker_queue& queue = queues[(worker + offset) % num_workers];
+      std::lock_guard<std::mutex> guard(queue.lock);
+      std::deque<batch>& batches = queue.batches;
+
+      // Own batches in order, stolen ones from the back
+      for (size_t itr = 0; itr < batches.size(); itr++) {
+        size_t pos = (offset == 0) ? itr : batches.size() - 1 - itr;
+        unsigned int partition = batches[pos].partition;
+
+        if (running[partition].load(std::memory_order_relaxed)
+            || running[partition].exchange(true, std::memory_order_acquire))
+          continue;
+
+        b = batches[pos];
+        batches.erase(batches.begin() + pos);
+        if (offset > 0)
+          num_steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  benchmark** partitions;
+  unsigned int num_partitions;
+  unsigned int num_workers;
+  bool pin;
+
+  worker_queue* queues;
+  std::atomic<bool>* running;
+
+  std::atomic<unsigned long> num_batches;
+  std::atomic<unsigned long> num_steals;
+};
+
+}
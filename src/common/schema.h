@@ -6,6 +6,7 @@
 #include <iostream>
 #include <vector>
 #include <iomanip>
+#include <cstdint>
 
 namespace storage {
 
@@ -15,6 +16,7 @@ class schema {
       PM_EQU((columns), (NULL));
       PM_EQU((ser_len), (0));
       PM_EQU((deser_len), (0));
+      PM_EQU((codec_len), (0));
 
     num_columns = _columns.size();
     columns = (field_info*) pmalloc(num_columns*(sizeof(field_info)));//new field_info[num_columns];
@@ -26,6 +28,8 @@ class schema {
       PM_EQU((deser_len), (deser_len + columns[itr].deser_len));
     }
 
+    compile_codec();
+
     pmemalloc_activate(columns);
   }
 
@@ -50,9 +54,36 @@ class schema {
     std::cerr << "\n";
   }
 
+  // Binary layout: every column gets a fixed slot in column order, ints and
+  // doubles in place and varchars as the offset of their [length][bytes]
+  // after the fixed part, 0 for NULL. A projection shares the layout of its
+  // table, so its columns read the same slots.
+  void compile_codec() {
+    size_t len = 0;
+
+    for (unsigned int itr = 0; itr < num_columns; itr++) {
+      PM_EQU((columns[itr].codec_offset), (len));
+
+      switch (columns[itr].type) {
+        case field_type::INTEGER:
+          len += sizeof(int);
+          break;
+        case field_type::DOUBLE:
+          len += sizeof(double);
+          break;
+        default:
+          len += sizeof(uint32_t);
+          break;
+      }
+    }
+
+    PM_EQU((codec_len), (len));
+  }
+
   field_info* columns;
   size_t ser_len;
   size_t deser_len;
+  size_t codec_len;
   unsigned int num_columns;
 };
 
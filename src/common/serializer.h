@@ -1,9 +1,123 @@
 #pragma once
 
 #include <sstream>
+#include <cstdint>
+#include <cstdio>
 
 namespace storage {
 
+// BINARY TUPLES
+//
+// A tuple encoded with serializer::encode() follows the layout that its
+// schema compiled: a fixed part with one slot per column, then the bytes of
+// the varchars, each prefixed by its length. Varchars inlined in
+// record::data are encoded the same way, so a tuple does not depend on the
+// inline threshold. A view reads a field straight from its slot without
+// parsing the others.
+
+// Read-only view over an encoded tuple, it does not own the bytes
+class tuple_view {
+ public:
+  tuple_view()
+      : buf(NULL),
+        len(0),
+        sptr(NULL) {
+  }
+
+  tuple_view(const char* _buf, size_t _len, schema* _sptr)
+      : buf(_buf),
+        len(_len),
+        sptr(_sptr) {
+  }
+
+  bool empty() const {
+    return (len == 0);
+  }
+
+  const char* data() const {
+    return buf;
+  }
+
+  size_t size() const {
+    return len;
+  }
+
+  int get_int(const int field_id) const {
+    int ival;
+    memcpy(&ival, buf + sptr->columns[field_id].codec_offset, sizeof(int));
+    return ival;
+  }
+
+  double get_double(const int field_id) const {
+    double dval;
+    memcpy(&dval, buf + sptr->columns[field_id].codec_offset, sizeof(double));
+    return dval;
+  }
+
+  // Bytes of a varchar, not NUL-terminated. NULL for a NULL varchar.
+  const char* get_varchar(const int field_id, uint32_t& vc_len) const {
+    uint32_t vc_offset;
+    memcpy(&vc_offset, buf + sptr->columns[field_id].codec_offset,
+           sizeof(uint32_t));
+
+    vc_len = 0;
+    if (vc_offset == 0)
+      return NULL;
+
+    memcpy(&vc_len, buf + vc_offset, sizeof(uint32_t));
+    return buf + vc_offset + sizeof(uint32_t);
+  }
+
+  // Enabled columns of projection in the text format of serialize()
+  std::string to_string(schema* projection) const {
+    std::string tuple_str;
+    char num_buf[32];
+    uint32_t vc_len;
+
+    if (empty())
+      return tuple_str;
+
+    for (unsigned int itr = 0; itr < projection->num_columns; itr++) {
+      if (!projection->columns[itr].enabled)
+        continue;
+
+      switch (projection->columns[itr].type) {
+        case field_type::INTEGER:
+          tuple_str += std::to_string(get_int(itr));
+          break;
+
+        case field_type::DOUBLE:
+          // Same digits as operator<<
+          snprintf(num_buf, sizeof(num_buf), "%g", get_double(itr));
+          tuple_str += num_buf;
+          break;
+
+        case field_type::VARCHAR: {
+          const char* vc = get_varchar(itr, vc_len);
+          if (vc != NULL)
+            tuple_str.append(vc, vc_len);
+        }
+          break;
+
+        default:
+          std::cerr << "invalid type : " << projection->columns[itr].type
+                    << std::endl;
+          exit(EXIT_FAILURE);
+          break;
+      }
+
+      tuple_str += " ";
+    }
+
+    return tuple_str;
+  }
+
+ private:
+  const char* buf;
+  size_t len;
+  schema* sptr;
+};
+
 class serializer {
  public:
 
@@ -42,8 +156,7 @@ class serializer {
             break;
 
           case field_type::VARCHAR: {
-            char* vcval = NULL;
-            memcpy(&vcval, &(data[offset]), sizeof(char*));
+            const char* vcval = rptr->get_varchar(itr);
             if (vcval != NULL) {
               output << vcval;
             }
@@ -97,6 +210,13 @@ class serializer {
         	    break;
 
 	          case field_type::VARCHAR: {
+	            if (finfo.inlined) {
+	              std::string vc_str;
+	              input >> vc_str;
+	              rec_ptr->set_varchar(itr, vc_str);
+	              break;
+	            }
+
         	    char* vc = new char[finfo.deser_len];
 	            input >> vc;
         	    PM_MEMCPY((&(rec_ptr->data[offset])), (&vc), (sizeof(char*)));
@@ -143,6 +263,13 @@ class serializer {
         	    break;
 
 	          case field_type::VARCHAR: {
+	            if (finfo.inlined) {
+	              std::string vc_str;
+	              input >> vc_str;
+	              rec_ptr->set_varchar(itr, vc_str);
+	              break;
+	            }
+
         	    char* vc = new char[finfo.deser_len];
 	            input >> vc;
         	    memcpy(&(rec_ptr->data[offset]), &vc, sizeof(char*));
@@ -162,6 +289,115 @@ class serializer {
 
   }
 
+  // BINARY ENCODE + DECODE
+
+  // Appends the binary encoding of all columns of rptr to entry
+  void encode(record* rptr, schema* sptr, std::string& entry) {
+    size_t start = entry.size();
+    char* data = rptr->data;
+
+    entry.resize(start + sptr->codec_len);
+
+    for (unsigned int itr = 0; itr < sptr->num_columns; itr++) {
+      field_info finfo = sptr->columns[itr];
+      size_t slot = start + finfo.codec_offset;
+
+      switch (finfo.type) {
+        case field_type::INTEGER:
+          memcpy(&entry[slot], &(data[finfo.offset]), sizeof(int));
+          break;
+
+        case field_type::DOUBLE:
+          memcpy(&entry[slot], &(data[finfo.offset]), sizeof(double));
+          break;
+
+        case field_type::VARCHAR: {
+          const char* vcval = rptr->get_varchar(itr);
+          uint32_t vc_offset = 0;
+
+          if (vcval != NULL) {
+            uint32_t vc_len = strlen(vcval);
+
+            vc_offset = entry.size() - start;
+            entry.append((const char*) &vc_len, sizeof(uint32_t));
+            entry.append(vcval, vc_len);
+          }
+
+          memcpy(&entry[slot], &vc_offset, sizeof(uint32_t));
+        }
+          break;
+
+        default:
+          std::cerr << "invalid type : " << finfo.type << std::endl;
+          exit(EXIT_FAILURE);
+          break;
+      }
+    }
+  }
+
+  std::string encode(record* rptr, schema* sptr) {
+    std::string entry;
+
+    if (rptr != NULL && sptr != NULL)
+      encode(rptr, sptr, entry);
+    return entry;
+  }
+
+  // Record with the fields of an encoded tuple, varchars get their own copy.
+  // Persistent records are activated by the caller with persist_data().
+  record* decode(const tuple_view& view, schema* sptr, int is_persistent = 0) {
+    if (view.empty())
+      return NULL;
+
+    record* rec_ptr;
+    if (is_persistent)
+      rec_ptr = new ((record*) pmalloc(sizeof(record))) record(sptr, 1);
+    else
+      rec_ptr = new record(sptr);
+
+    for (unsigned int itr = 0; itr < sptr->num_columns; itr++) {
+      field_info finfo = sptr->columns[itr];
+
+      switch (finfo.type) {
+        case field_type::INTEGER:
+          rec_ptr->set_int(itr, view.get_int(itr));
+          break;
+
+        case field_type::DOUBLE:
+          rec_ptr->set_double(itr, view.get_double(itr));
+          break;
+
+        case field_type::VARCHAR: {
+          uint32_t vc_len;
+          const char* vcval = view.get_varchar(itr, vc_len);
+          char* vc = NULL;
+
+          if (finfo.inlined) {
+            rec_ptr->set_varchar(itr, (vcval != NULL) ? std::string(vcval, vc_len)
+                                                      : std::string());
+            break;
+          }
+
+          if (vcval != NULL) {
+            vc = is_persistent ? (char*) pmalloc(vc_len + 1) : new char[vc_len + 1];
+            memcpy(vc, vcval, vc_len);
+            vc[vc_len] = '\0';
+          }
+
+          rec_ptr->set_pointer(itr, vc);
+        }
+          break;
+
+        default:
+          std::cerr << "invalid type : " << finfo.type << std::endl;
+          exit(EXIT_FAILURE);
+          break;
+      }
+    }
+
+    return rec_ptr;
+  }
+
   std::string project(std::string entry_str, schema* sptr) {
     if (entry_str.empty())
       return "";
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "libpm.h"
+#include "utils.h"
+#include "io_ring.h"
+
+namespace storage {
+
+// SHARED LOG
+//
+// One log file for all executors. An executor reserves space in a ring
+// buffer with a fetch-add on the tail, copies its entry in, and publishes it
+// once the entries before it are published. A single flusher writes the
+// published range with pwrite and syncs it with fdatasync, or submits both
+// to an io_uring. The LSN of an entry is the file offset of its end.
+// An executor that finds the buffer full waits for the flusher like a
+// committing one.
+
+class shared_logger {
+ public:
+  shared_logger(std::string _name, int _gc_interval, bool _io_uring,
+                size_t _capacity = SHARED_LOG_CAPACITY)
+      : capacity(_capacity),
+        gc_interval(_gc_interval) {
+    log_file_name = _name + ".nvm";
+
+    log_fd = open(log_file_name.c_str(), O_CREAT | O_WRONLY, 0644);
+    if (log_fd < 0) {
+      std::cerr << "Log file not found : " << log_file_name << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    // capacity is a power of two
+    buf = new char[capacity];
+    mask = capacity - 1;
+
+    off_t log_end = lseek(log_fd, 0, SEEK_END);
+    tail = log_end;
+    written = log_end;
+    durable = log_end;
+
+    if (_io_uring && !ring.setup(8)) {
+      std::cerr << "io_uring not available, using pwrite and fdatasync"
+                << std::endl;
+    }
+
+    ready = true;
+    flusher = std::thread(&shared_logger::flush_loop, this);
+  }
+
+  ~shared_logger() {
+    log_mutex.lock();
+    ready = false;
+    flush_cv.notify_all();
+    log_mutex.unlock();
+    flusher.join();
+
+    close(log_fd);
+    delete[] buf;
+  }
+
+  // Append an entry and return its LSN
+  off_t push_back(const char* entry, size_t entry_len) {
+    if (entry_len > capacity) {
+      std::cerr << "Log entry larger than log buffer : " << entry_len
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    if (!can_log)
+      return tail.load();
+
+    off_t start = tail.fetch_add(entry_len);
+    off_t end = start + entry_len;
+
+    // Wait for the flusher to free up space
+    if (end - durable.load(std::memory_order_acquire) > (off_t) capacity) {
+      std::unique_lock<std::mutex> lk(log_mutex);
+      space_waiters++;
+      flush_cv.notify_one();
+      commit_cv.wait(lk, [&] {return end - durable <= (off_t) capacity;});
+      space_waiters--;
+    }
+
+    size_t pos = start & mask;
+    size_t first = std::min(entry_len, capacity - pos);
+    memcpy(buf + pos, entry, first);
+    memcpy(buf, entry + first, entry_len - first);
+
+    // Publish in LSN order
+    while (written.load(std::memory_order_acquire) != start)
+      std::this_thread::yield();
+    written.store(end, std::memory_order_release);
+
+    return end;
+  }
+
+  off_t push_back(const std::string& entry) {
+    return push_back(entry.c_str(), entry.size());
+  }
+
+  // Block until the log is durable up to lsn
+  void commit(off_t lsn) {
+    if (durable.load(std::memory_order_acquire) >= lsn)
+      return;
+
+    std::unique_lock<std::mutex> lk(log_mutex);
+    commit_waiters++;
+    flush_cv.notify_one();
+    commit_cv.wait(lk, [&] {return durable >= lsn;});
+    commit_waiters--;
+  }
+
+  // Block until everything appended so far is durable
+  void flush() {
+    commit(tail.load());
+  }
+
+  // Drop later entries, recovery replays without logging
+  void disable() {
+    can_log = false;
+  }
+
+  // Write and sync everything published so far
+  void sync() {
+    off_t start = durable.load(std::memory_order_relaxed);
+    off_t end = written.load(std::memory_order_acquire);
+
+    if (end == start)
+      return;
+
+    size_t pos = start & mask;
+    size_t len = end - start;
+    size_t first = std::min(len, capacity - pos);
+    size_t written_len = 0;
+
+    // Write and sync in one submission
+    if (ring.enabled()) {
+      struct iovec iov[2] = { { buf + pos, first }, { buf, len - first } };
+      int ret = ring.write_sync(log_fd, iov, (len > first) ? 2 : 1, start);
+
+      if (ret < 0) {
+        errno = -ret;
+        perror("io_uring write failed");
+        exit(EXIT_FAILURE);
+      }
+
+      written_len = ret;
+    }
+
+    if (written_len < len || !ring.enabled()) {
+      if (written_len < first) {
+        write_range(buf + pos + written_len, first - written_len,
+                    start + written_len);
+        write_range(buf, len - first, start + first);
+      } else {
+        write_range(buf + (written_len - first), len - written_len,
+                    start + written_len);
+      }
+
+      if (fdatasync(log_fd) != 0) {
+        perror("fdatasync failed");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    // PCOMMIT
+    pcommit(PCOMMIT_LATENCY);
+
+    num_log_syncs++;
+    durable.store(end, std::memory_order_release);
+  }
+
+  void flush_loop() {
+    std::unique_lock<std::mutex> lk(log_mutex);
+
+    while (ready) {
+      // Commits that arrive during a sync form the next group
+      flush_cv.wait_for(lk, std::chrono::milliseconds(gc_interval),
+                        [&] {
+                          return !ready || commit_waiters > 0
+                              || space_waiters > 0;
+                        });
+
+      lk.unlock();
+      sync();
+      lk.lock();
+
+      commit_cv.notify_all();
+    }
+
+    sync();
+    commit_cv.notify_all();
+  }
+
+  void write_range(const char* src, size_t len, off_t offset) {
+    while (len > 0) {
+      ssize_t ret = pwrite(log_fd, src, len, offset);
+      if (ret < 0) {
+        perror("pwrite failed");
+        exit(EXIT_FAILURE);
+      }
+
+      src += ret;
+      len -= ret;
+      offset += ret;
+    }
+  }
+
+  //private:
+  std::string log_file_name;
+  int log_fd;
+
+  char* buf;
+  size_t capacity;
+  size_t mask;
+
+  std::atomic<off_t> tail;     // end of reserved space
+  std::atomic<off_t> written;  // end of published entries
+  std::atomic<off_t> durable;  // end of synced entries
+
+  std::mutex log_mutex;
+  std::condition_variable flush_cv;   // wakes the flusher
+  std::condition_variable commit_cv;  // wakes committing txns and appends
+  unsigned int commit_waiters = 0;
+  unsigned int space_waiters = 0;     // appends waiting for buffer space
+  std::atomic_bool can_log { true };
+
+  io_ring ring;
+
+  std::thread flusher;
+  std::atomic_bool ready;
+  int gc_interval;
+
+  static constexpr size_t SHARED_LOG_CAPACITY = 64UL * 1024 * 1024;
+};
+
+}
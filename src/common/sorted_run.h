@@ -0,0 +1,291 @@
+#pragma once
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+namespace storage {
+
+// SORTED RUN
+//
+// An immutable file of tuples sorted by key, written once by a memtable
+// flush or a compaction. An entry is the key, the length of the serialized
+// tuple and the tuple; a tombstone has no tuple. Entries are packed into
+// blocks of about RUN_BLOCK_SIZE bytes, and the first key and offset of
+// every block form the block index. A bloom filter over the keys lets a
+// lookup skip the run without touching the file. The index and the filter
+// stay in memory, and the file is mapped read-only once written.
+
+#define RUN_BLOCK_SIZE 4096
+#define BLOOM_BITS_PER_KEY 10
+#define BLOOM_NUM_PROBES 7
+
+class bloom_filter {
+ public:
+  bloom_filter(size_t num_keys = 0)
+      : num_bits(std::max((size_t) 64, num_keys * BLOOM_BITS_PER_KEY)),
+        bits((num_bits + 63) / 64, 0) {
+  }
+
+  void add(unsigned long key) {
+    uint64_t h = hash(key);
+    uint64_t delta = (h >> 33) | (h << 31);
+
+    for (unsigned int probe = 0; probe < BLOOM_NUM_PROBES; probe++) {
+      uint64_t bit = h % num_bits;
+      bits[bit / 64] |= (1UL << (bit % 64));
+      h += delta;
+    }
+  }
+
+  bool may_contain(unsigned long key) const {
+    uint64_t h = hash(key);
+    uint64_t delta = (h >> 33) | (h << 31);
+
+    for (unsigned int probe = 0; probe < BLOOM_NUM_PROBES; probe++) {
+      uint64_t bit = h % num_bits;
+      if ((bits[bit / 64] & (1UL << (bit % 64))) == 0)
+        return false;
+      h += delta;
+    }
+
+    return true;
+  }
+
+ private:
+  static inline uint64_t hash(unsigned long key) {
+    uint64_t h = key * 0x9E3779B97F4A7C15UL;
+    return h ^ (h >> 29);
+  }
+
+  size_t num_bits;
+  std::vector<uint64_t> bits;
+};
+
+class sorted_run {
+ public:
+  enum lookup_status {
+    ABSENT,
+    FOUND,
+    DELETED
+  };
+
+  static const uint32_t TOMBSTONE = UINT32_MAX;
+
+  ~sorted_run() {
+    if (buf != NULL && buf != MAP_FAILED)
+      munmap(buf, file_size);
+
+    // Runs that a compaction replaced are garbage
+    if (obsolete)
+      unlink(file_name.c_str());
+  }
+
+  // False if the run surely does not hold key
+  bool may_contain(unsigned long key) const {
+    return num_entries > 0 && filter.may_contain(key);
+  }
+
+  // Tuple stored for key, or a tombstone
+  lookup_status get(unsigned long key, std::string& tuple) const {
+    if (!may_contain(key))
+      return ABSENT;
+
+    // Last block whose first key is not greater than key
+    auto block = std::upper_bound(
+        block_index.begin(), block_index.end(), key,
+        [](unsigned long k, const std::pair<unsigned long, size_t>& b) {
+          return k < b.first;
+        });
+    if (block == block_index.begin())
+      return ABSENT;
+    --block;
+
+    size_t end = (block + 1 == block_index.end()) ? file_size : (block + 1)->second;
+    for (size_t pos = block->second; pos < end;) {
+      unsigned long entry_key;
+      uint32_t len;
+
+      read_header(pos, entry_key, len);
+      if (entry_key == key) {
+        if (len == TOMBSTONE)
+          return DELETED;
+        tuple.assign(buf + pos + HEADER_SIZE, len);
+        return FOUND;
+      }
+
+      if (entry_key > key)
+        break;
+      pos += entry_size(len);
+    }
+
+    return ABSENT;
+  }
+
+  // Entries in key order
+  class iterator {
+   public:
+    iterator(const sorted_run* _run)
+        : run(_run),
+          pos(0) {
+      load();
+    }
+
+    bool valid() const {
+      return pos < run->file_size;
+    }
+
+    void next() {
+      pos += entry_size(len);
+      load();
+    }
+
+    unsigned long key() const {
+      return cur_key;
+    }
+
+    bool tombstone() const {
+      return len == TOMBSTONE;
+    }
+
+    std::string tuple() const {
+      return std::string(run->buf + pos + HEADER_SIZE, len);
+    }
+
+   private:
+    void load() {
+      if (valid())
+        run->read_header(pos, cur_key, len);
+    }
+
+    const sorted_run* run;
+    size_t pos;
+    unsigned long cur_key = 0;
+    uint32_t len = 0;
+  };
+
+  size_t size() const {
+    return file_size;
+  }
+
+  size_t entries() const {
+    return num_entries;
+  }
+
+  // Unlink the file once the run is destroyed
+  void mark_obsolete() {
+    obsolete = true;
+  }
+
+  std::string file_name;
+
+ private:
+  friend class run_builder;
+
+  static const size_t HEADER_SIZE = sizeof(unsigned long) + sizeof(uint32_t);
+
+  static size_t entry_size(uint32_t len) {
+    return HEADER_SIZE + ((len == TOMBSTONE) ? 0 : len);
+  }
+
+  void read_header(size_t pos, unsigned long& key, uint32_t& len) const {
+    memcpy(&key, buf + pos, sizeof(unsigned long));
+    memcpy(&len, buf + pos + sizeof(unsigned long), sizeof(uint32_t));
+  }
+
+  char* buf = NULL;
+  size_t file_size = 0;
+  size_t num_entries = 0;
+  bool obsolete = false;
+
+  std::vector<std::pair<unsigned long, size_t> > block_index;
+  bloom_filter filter;
+};
+
+// Writes a run from entries added in increasing key order
+class run_builder {
+ public:
+  run_builder(const std::string& _file_name, size_t expected_entries)
+      : run(new sorted_run()),
+        block_start(0) {
+    run->file_name = _file_name;
+    run->filter = bloom_filter(expected_entries);
+  }
+
+  ~run_builder() {
+    delete run;
+  }
+
+  // tuple is NULL for a tombstone
+  void add(unsigned long key, const std::string* tuple) {
+    uint32_t len = (tuple != NULL) ? tuple->size() : sorted_run::TOMBSTONE;
+
+    if (run->num_entries == 0
+        || data.size() - block_start >= RUN_BLOCK_SIZE) {
+      block_start = data.size();
+      run->block_index.push_back(std::make_pair(key, block_start));
+    }
+
+    data.append((const char*) &key, sizeof(unsigned long));
+    data.append((const char*) &len, sizeof(uint32_t));
+    if (tuple != NULL)
+      data.append(*tuple);
+
+    run->filter.add(key);
+    run->num_entries++;
+  }
+
+  // Persists the run and maps it, NULL if it has no entries
+  sorted_run* finish() {
+    if (run->num_entries == 0)
+      return NULL;
+
+    int fd = open(run->file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+      perror("open failed");
+      exit(EXIT_FAILURE);
+    }
+
+    for (size_t written = 0; written < data.size();) {
+      ssize_t ret = write(fd, data.data() + written, data.size() - written);
+      if (ret < 0) {
+        perror("write failed");
+        exit(EXIT_FAILURE);
+      }
+      written += ret;
+    }
+
+    if (fdatasync(fd) != 0) {
+      perror("fdatasync failed");
+      exit(EXIT_FAILURE);
+    }
+
+    run->file_size = data.size();
+    run->buf = (char*) mmap(NULL, run->file_size, PROT_READ, MAP_SHARED, fd,
+                            0);
+    close(fd);
+
+    if (run->buf == MAP_FAILED) {
+      perror("mmap failed");
+      exit(EXIT_FAILURE);
+    }
+
+    sorted_run* done = run;
+    run = NULL;
+    return done;
+  }
+
+ private:
+  sorted_run* run;
+  std::string data;
+  size_t block_start;
+};
+
+}
@@ -23,6 +23,7 @@ class sp_engine : public engine_api {
   sp_engine(const config& _conf, database* _db, bool _read_only, unsigned int _tid);
   ~sp_engine();
 
+  using engine_api::select;
   std::string select(const statement& st);
   int update(const statement& st);
   int insert(const statement& t);
@@ -41,7 +42,6 @@ class sp_engine : public engine_api {
   const config& conf;
   database* db;
 
-  std::hash<std::string> hash_fn;
   std::thread gc;
   pthread_rwlock_t gc_rwlock = PTHREAD_RWLOCK_INITIALIZER;
   std::atomic_bool ready;
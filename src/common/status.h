@@ -9,7 +9,7 @@ namespace storage {
 class status {
  public:
 
-  status(unsigned int _num_txns)
+  status(unsigned int _num_txns = 0)
       : txn_counter(0),
         num_txns(_num_txns) {
 
@@ -2,9 +2,13 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sstream>
 #include <string>
-#include <unistd.h>
+#include <cstring>
+#include <algorithm>
 
 #include "record.h"
 #include "libpm.h"
@@ -12,136 +16,181 @@
 namespace storage {
 
 // FS STORAGE
+//
+// Fixed-size tuple slots in a file that is mapped once with room to grow.
+// The file is extended with ftruncate, so the mapping and views into it
+// never move. sync() msyncs only the range dirtied since the last sync.
+
+#define STORAGE_MAX_SIZE (16UL * 1024 * 1024 * 1024)  // reserved address space
+#define STORAGE_GROW_SIZE (4UL * 1024 * 1024)
 
 class storage {
  public:
   storage() {
-       PM_EQU((storage_file), (NULL));
+       PM_EQU((storage_buf), (NULL));
        PM_EQU((storage_file_fd), (-1));
        PM_EQU((storage_offset), (0));
+       PM_EQU((storage_size), (0));
+       PM_EQU((storage_used), (0));
+       PM_EQU((synced_size), (0));
        PM_EQU((max_tuple_size), (0));
   }
 
   void configure(std::string _name, size_t _tuple_size, bool append) {
+    struct stat storage_stat;
+
     storage_file_name = _name + ".nvm";
     max_tuple_size = _tuple_size;
 
-    // file exists - read/update mode
-    if (access(storage_file_name.c_str(), F_OK) != -1) {
-      if (!append) {
-        PM_EQU((storage_file), (fopen(storage_file_name.c_str(), "r+")));
-      } else {
-        PM_EQU((storage_file), (fopen(storage_file_name.c_str(), "a+")));
-      }
-    } else {
-      // new file - write/update mode
-      PM_EQU((storage_file), (fopen(storage_file_name.c_str(), "w+")));
-    }
-
-    if (storage_file != NULL) {
-      PM_EQU((storage_file_fd), (fileno(storage_file)));
-      PM_EQU((storage_offset), (0));
+    // file exists - read/update mode, else new file
+    PM_EQU((storage_file_fd),
+           (open(storage_file_name.c_str(), O_RDWR | O_CREAT, 0644)));
 
-      //fseek(storage_file, 0, SEEK_END);
-      //size_t sz = ftell(storage_file);
-      //printf("File size :: %s %lu \n", storage_file_name.c_str(), sz);
-    } else {
+    if (storage_file_fd == -1 || fstat(storage_file_fd, &storage_stat) != 0) {
       std::cerr << "File not found : " << storage_file_name << std::endl;
       exit(EXIT_FAILURE);
     }
-  }
 
-  off_t push_back(std::string entry) {
-    int ret;
-    off_t prev_offset;
-
-    if (entry.size() > max_tuple_size) {
-      printf("Entry size exceeds tuple size : %lu  %lu \n", entry.size(),
-             max_tuple_size);
-      exit(EXIT_FAILURE);
+    PM_EQU((storage_size), (storage_stat.st_size));
+    PM_EQU((storage_used), (storage_size));
+    PM_EQU((synced_size), (storage_size));
+    if (append) {
+      PM_EQU((storage_offset), (storage_size));
+    } else {
+      PM_EQU((storage_offset), (0));
     }
 
-    entry.resize(max_tuple_size);
-
-    fseek(storage_file, storage_offset, SEEK_SET);
-    ret = fwrite(entry.c_str(), sizeof(char), max_tuple_size, storage_file);
-    if (ret < 0) {
-      perror("fwrite failed");
+    PM_EQU((storage_buf), ((char*) mmap(NULL, STORAGE_MAX_SIZE,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE,
+        storage_file_fd, 0)));
+    if (storage_buf == MAP_FAILED) {
+      perror("mmap failed");
       exit(EXIT_FAILURE);
     }
 
-    prev_offset = storage_offset;
-    PM_EQU((storage_offset), (storage_offset + ret));
-    return prev_offset;
+    PM_EQU((dirty_begin), (0));
+    PM_EQU((dirty_end), (0));
   }
 
-  off_t update(off_t storage_offset, std::string entry) {
-    int ret;
-
-    if (entry.size() > max_tuple_size) {
-      printf("Entry size exceeds tuple size : %lu  %lu \n", entry.size(),
-             max_tuple_size);
-      exit(EXIT_FAILURE);
-    }
+  off_t push_back(const std::string& entry) {
+    off_t prev_offset = storage_offset;
 
-    entry.resize(max_tuple_size);
+    reserve(storage_offset + max_tuple_size);
+    write_slot(storage_offset, entry);
 
-    fseek(storage_file, storage_offset, SEEK_SET);
-    ret = fwrite(entry.c_str(), sizeof(char), max_tuple_size, storage_file);
-    if (ret < 0) {
-      perror("fwrite failed");
-      exit(EXIT_FAILURE);
-    }
+    PM_EQU((storage_offset), (storage_offset + max_tuple_size));
+    return prev_offset;
+  }
 
+  off_t update(off_t storage_offset, const std::string& entry) {
+    reserve(storage_offset + max_tuple_size);
+    write_slot(storage_offset, entry);
     return storage_offset;
   }
 
   int sync() {
-    int ret;
+    int ret = 0;
 
-    // sync storage
-    ret = fsync(storage_file_fd);
+    // sync dirty pages, and the file size after it grew
+    if (dirty_end != 0) {
+      off_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+      off_t begin = dirty_begin & ~page_mask;
+
+      ret = msync(storage_buf + begin, dirty_end - begin, MS_SYNC);
+      if (ret == 0 && synced_size != storage_size) {
+        ret = fdatasync(storage_file_fd);
+        PM_EQU((synced_size), (storage_size));
+      }
+
+      PM_EQU((dirty_begin), (0));
+      PM_EQU((dirty_end), (0));
+    }
 
     // PCOMMIT
     pcommit(PCOMMIT_LATENCY);
 
     if (ret != 0) {
-      perror("fsync failed");
+      perror("msync failed");
       exit(EXIT_FAILURE);
     }
 
     return ret;
   }
 
+  // Tuple in the slot at storage_offset, valid until close
+  const char* view(off_t storage_offset) const {
+    return storage_buf + storage_offset;
+  }
+
   std::string at(off_t storage_offset) {
-    std::string entry_str;
-    char* buf = new char[max_tuple_size + 1];
-    int rc;
-
-    fseek(storage_file, storage_offset, SEEK_SET);
-    rc = fread(buf, sizeof(char), max_tuple_size, storage_file);
-    if (rc == -1) {
-      perror("fread");
+    const char* entry = view(storage_offset);
+    return std::string(entry, strnlen(entry, max_tuple_size));
+  }
+
+  void close() {
+    munmap(storage_buf, STORAGE_MAX_SIZE);
+
+    // drop the unused tail of the last extension
+    if (ftruncate(storage_file_fd, storage_used) != 0) {
+      perror("ftruncate failed");
+    }
+
+    ::close(storage_file_fd);
+  }
+
+  // Extend the file to hold size bytes
+  void reserve(off_t size) {
+    PM_EQU((storage_used), (std::max(storage_used, size)));
+    if (size <= storage_size)
+      return;
+
+    off_t new_size = std::max(size, (off_t) (storage_size + STORAGE_GROW_SIZE));
+    if ((size_t) new_size > STORAGE_MAX_SIZE) {
+      std::cerr << "Storage file too large : " << storage_file_name
+                << std::endl;
       exit(EXIT_FAILURE);
     }
 
-    entry_str = std::string(buf);
-    delete[] buf;
+    if (ftruncate(storage_file_fd, new_size) != 0) {
+      perror("ftruncate failed");
+      exit(EXIT_FAILURE);
+    }
 
-    return entry_str;
+    PM_EQU((storage_size), (new_size));
   }
 
-  void close() {
-    fclose(storage_file);
+  void write_slot(off_t storage_offset, const std::string& entry) {
+    if (entry.size() > max_tuple_size) {
+      printf("Entry size exceeds tuple size : %lu  %lu \n", entry.size(),
+             max_tuple_size);
+      exit(EXIT_FAILURE);
+    }
+
+    char* slot = storage_buf + storage_offset;
+    memcpy(slot, entry.c_str(), entry.size());
+    memset(slot + entry.size(), 0, max_tuple_size - entry.size());
+
+    off_t slot_end = storage_offset + max_tuple_size;
+    if (dirty_end == 0) {
+      PM_EQU((dirty_begin), (storage_offset));
+      PM_EQU((dirty_end), (slot_end));
+    } else {
+      PM_EQU((dirty_begin), (std::min(dirty_begin, storage_offset)));
+      PM_EQU((dirty_end), (std::max(dirty_end, slot_end)));
+    }
   }
 
 //private:
-  FILE* storage_file;
+  char* storage_buf;
   int storage_file_fd;
   off_t storage_offset;
+  off_t storage_size;  // file size
+  off_t storage_used;  // end of the last slot
+  off_t synced_size;  // file size at the last sync
+  off_t dirty_begin;
+  off_t dirty_end;
   size_t max_tuple_size;
   std::string storage_file_name;
 };
 
 }
-
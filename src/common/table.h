@@ -2,7 +2,8 @@
 
 #include "schema.h"
 #include "table_index.h"
-#include "plist.h"
+#include "pvector.h"
+#include "tuple_heap.h"
 #include "storage.h"
 
 namespace storage {
@@ -23,11 +24,10 @@ class table {
     PM_MEMCPY((table_name), (name_str.c_str()), (len + 1));
     pmemalloc_activate(table_name);
 
-    PM_EQU((pm_data), (new ((plist<record*>*) pmalloc(sizeof(plist<record*>))) plist<record*>(&sp->ptrs[get_next_pp()], &sp->ptrs[get_next_pp()])));
+    PM_EQU((pm_data), (new ((tuple_heap*) pmalloc(sizeof(tuple_heap))) tuple_heap(&sp->ptrs[get_next_pp()], &sp->ptrs[get_next_pp()])));
     pmemalloc_activate(pm_data);
 
-    PM_EQU((indices), (new ((plist<table_index*>*) pmalloc(sizeof(plist<table_index*>))) plist<table_index*>(&sp->ptrs[get_next_pp()],
-                                      					&sp->ptrs[get_next_pp()])));
+    PM_EQU((indices), (new ((pvector<table_index*>*) pmalloc(sizeof(pvector<table_index*>))) pvector<table_index*>()));
     pmemalloc_activate(indices);
 
   }
@@ -38,8 +38,7 @@ class table {
 
     if (indices != NULL) {
       // clean up table indices
-      std::vector<table_index*> index_vec = indices->get_data();
-      for (table_index* index : index_vec)
+      for (table_index* index : *indices)
         delete index;
 
       delete indices;
@@ -52,11 +51,11 @@ class table {
   size_t max_tuple_size;
   unsigned int num_indices;
 
-  plist<table_index*>* indices;
+  pvector<table_index*>* indices;
 
   storage fs_data;
 
-  plist<record*>* pm_data;
+  tuple_heap* pm_data;
 };
 
 }
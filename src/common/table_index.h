@@ -16,6 +16,7 @@ class table_index {
       PM_EQU((num_fields), (_num_fields));
       PM_EQU((pm_map), (NULL));
       PM_EQU((off_map), (NULL));
+      PM_EQU((frozen_map), (NULL));
 
     PM_EQU((pm_map), (new ((pbtree<unsigned long, record*>*) pmalloc(sizeof(pbtree<unsigned long, record*>))) \
 							pbtree<unsigned long, record*>(&sp->ptrs[get_next_pp()])));
@@ -25,23 +26,157 @@ class table_index {
 							pbtree<unsigned long, off_t>(&sp->ptrs[get_next_pp()])));
     pmemalloc_activate(off_map);
 
+    // Immutable mem table that OPT_LSM merges in the background
+    if (conf.etype == engine_type::OPT_LSM) {
+      PM_EQU((frozen_map), (new ((pbtree<unsigned long, record*>*) pmalloc(sizeof(pbtree<unsigned long, record*>))) \
+							pbtree<unsigned long, record*>(&sp->ptrs[get_next_pp()])));
+      pmemalloc_activate(frozen_map);
+    }
+
     if (conf.etype == engine_type::WAL || conf.etype == engine_type::LSM) {
       pm_map->disable_persistence();
       off_map->disable_persistence();
     }
+
+    if (conf.shared_db) {
+      pm_map->enable_sharing();
+      off_map->enable_sharing();
+      if (frozen_map != NULL)
+        frozen_map->enable_sharing();
+    }
+
+    compile_key();
+  }
+
+  // Key of rec in this index, taken from the raw bytes of the key columns
+  unsigned long get_key(record* rec) const {
+    const char* data = rec->data;
+
+    // up to two integers pack into the key as is
+    if (key_packed) {
+      unsigned long key = 0;
+      for (unsigned int itr = 0; itr < num_key_fields; itr++) {
+        unsigned int ival;
+        memcpy(&ival, data + key_fields[itr].offset, sizeof(ival));
+        key = (key << 32) | ival;
+      }
+      return key;
+    }
+
+    unsigned long key = KEY_HASH_SEED;
+    for (unsigned int itr = 0; itr < num_key_fields; itr++) {
+      const key_field& kf = key_fields[itr];
+
+      if (kf.type == field_type::VARCHAR) {
+        const char* vc = data + kf.offset;
+        if (!kf.inlined)
+          memcpy(&vc, data + kf.offset, sizeof(char*));
+        if (vc != NULL)
+          key = key_hash(vc, strlen(vc), key);
+        else
+          key = key_hash(NULL, 0, key);
+      } else {
+        key = key_hash(data + kf.offset, kf.len, key);
+      }
+    }
+
+    return key;
   }
 
   ~table_index() {
     delete sptr;
     delete pm_map;
     delete off_map;
+    delete frozen_map;
   }
 
+  // Offsets and widths of the enabled columns in record::data
+  void compile_key() {
+    PM_EQU((num_key_fields), (0));
+    PM_EQU((key_packed), (true));
+
+    for (unsigned int itr = 0; itr < sptr->num_columns; itr++) {
+      field_info finfo = sptr->columns[itr];
+      if (!finfo.enabled)
+        continue;
+
+      if (num_key_fields == MAX_KEY_FIELDS) {
+        std::cerr << "Too many key fields : " << num_key_fields << std::endl;
+        exit(EXIT_FAILURE);
+      }
+
+      key_field kf;
+      kf.offset = finfo.offset;
+      kf.type = finfo.type;
+      kf.inlined = finfo.inlined;
+      switch (finfo.type) {
+        case field_type::INTEGER:
+          kf.len = sizeof(int);
+          break;
+        case field_type::DOUBLE:
+          kf.len = sizeof(double);
+          break;
+        default:
+          kf.len = sizeof(char*);
+          break;
+      }
+
+      if (finfo.type != field_type::INTEGER)
+        PM_EQU((key_packed), (false));
+
+      PM_EQU((key_fields[num_key_fields]), (kf));
+      PM_EQU((num_key_fields), (num_key_fields + 1));
+    }
+
+    if (num_key_fields > 2)
+      PM_EQU((key_packed), (false));
+  }
+
+  // 64-bit multiply-xorshift hash over len bytes, chained through seed
+  static unsigned long key_hash(const char* buf, size_t len,
+                                unsigned long seed) {
+    const unsigned long mul = 0x9E3779B97F4A7C15UL;
+    unsigned long h = (seed ^ len) * mul;
+
+    for (; len >= sizeof(unsigned long); len -= sizeof(unsigned long)) {
+      unsigned long word;
+      memcpy(&word, buf, sizeof(word));
+      h = (h ^ (word * mul)) * mul;
+      h ^= h >> 29;
+      buf += sizeof(word);
+    }
+
+    if (len > 0) {
+      unsigned long word = 0;
+      memcpy(&word, buf, len);
+      h = (h ^ (word * mul)) * mul;
+      h ^= h >> 29;
+    }
+
+    h ^= h >> 32;
+    return h;
+  }
+
+  struct key_field {
+    off_t offset;
+    size_t len;
+    field_type type;
+    bool inlined;
+  };
+
+  static const unsigned int MAX_KEY_FIELDS = 8;
+  static const unsigned long KEY_HASH_SEED = 0xCBF29CE484222325UL;
+
   schema* sptr;
   unsigned int num_fields;
 
+  key_field key_fields[MAX_KEY_FIELDS];
+  unsigned int num_key_fields;
+  bool key_packed;
+
   pbtree<unsigned long, record*>* pm_map;
   pbtree<unsigned long, off_t>* off_map;
+  pbtree<unsigned long, record*>* frozen_map;
 };
 
 }
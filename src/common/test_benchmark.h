@@ -22,7 +22,9 @@ class test_benchmark : public benchmark {
   test_benchmark(config _conf, unsigned int tid, database* _db, timer* _tm, struct static_info* _sp);
 
   void load();
-  void execute();
+  void execute_begin();
+  void execute_txns(unsigned int begin, unsigned int end);
+  void execute_end();
 
   void sim_crash();
 
@@ -48,7 +50,6 @@ class test_benchmark : public benchmark {
 
   unsigned int txn_id;
   unsigned int num_keys;
-  unsigned int num_txns;
 };
 
 }
@@ -23,7 +23,9 @@ class tpcc_benchmark : public benchmark {
                  struct static_info* _sp);
 
   void load();
-  void execute();
+  void execute_begin();
+  void execute_txns(unsigned int begin, unsigned int end);
+  void execute_end();
   void sim_crash();
 
   table* create_warehouse();
@@ -36,6 +38,7 @@ class tpcc_benchmark : public benchmark {
 
   table* create_history();
   table* create_stock();
+  void create_query_schemas();
   table* create_orders();
   table* create_new_order();
   table* create_order_line();
@@ -48,7 +51,10 @@ class tpcc_benchmark : public benchmark {
   serializer sr;
 
   unsigned int txn_id;
-  unsigned int num_txns;
+
+  // Warehouses this executor loads, every stride-th one from first
+  int first_warehouse = 0;
+  int warehouse_stride = 1;
 
   void do_delivery(engine* ee);
   void do_new_order(engine* ee, bool finish = true);
@@ -67,6 +73,13 @@ class tpcc_benchmark : public benchmark {
   static constexpr int HISTORY_TABLE_ID = 7;
   static constexpr int STOCK_TABLE_ID = 8;
 
+  // Transaction types
+  static constexpr int DELIVERY_TXN = 0;
+  static constexpr int NEW_ORDER_TXN = 1;
+  static constexpr int ORDER_STATUS_TXN = 2;
+  static constexpr int PAYMENT_TXN = 3;
+  static constexpr int STOCK_LEVEL_TXN = 4;
+
   // Schema
   schema* item_table_schema;
   schema* warehouse_table_schema;
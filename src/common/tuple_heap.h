@@ -0,0 +1,235 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <new>
+#include <cstring>
+#include <cstdint>
+
+#include "libpm.h"
+#include "record.h"
+
+namespace storage {
+
+// Persistent tuple heap
+//
+// Records live in fixed-size chunks of slots with a bitmap of used slots.
+// Each record remembers its chunk and slot, so erase is O(1). Chunks with a
+// free slot are kept on a free list, so push_back is O(1) too. Scans walk
+// the chunks and their bitmaps sequentially. push_back and erase hold a
+// mutex, so executors sharing a table can call them.
+//
+// Only the slots and bitmaps are persisted. The used counts, the free list,
+// the size and the position each record remembers are rebuilt from the
+// bitmaps by recover().
+
+#define HEAP_CHUNK_SLOTS 256
+#define HEAP_BITMAP_WORDS (HEAP_CHUNK_SLOTS / 64)
+
+class tuple_heap {
+ public:
+  struct chunk {
+    struct chunk* next;       // all chunks
+    struct chunk* next_free;  // chunks with a free slot
+    unsigned int num_used;
+    bool on_free_list;
+    uint64_t bitmap[HEAP_BITMAP_WORDS];
+    record* slots[HEAP_CHUNK_SLOTS];
+  };
+
+  struct chunk** head;
+  struct chunk** free_head;
+  off_t _size = 0;
+  std::mutex heap_mutex;
+
+  tuple_heap(void** _head, void** _free_head) {
+    PM_EQU((head), ((struct chunk**) _head));
+    PM_EQU((free_head), ((struct chunk**) _free_head));
+
+    if ((*head) != NULL)
+      recover();
+  }
+
+  ~tuple_heap() {
+    clear();
+  }
+
+  off_t push_back(record* rec) {
+    std::lock_guard<std::mutex> lock(heap_mutex);
+
+    struct chunk* cp;
+    unsigned int slot;
+
+    while (true) {
+      if ((*free_head) == NULL)
+        add_chunk();
+
+      cp = (*free_head);
+      slot = find_free_slot(cp);
+      if (slot != HEAP_CHUNK_SLOTS)
+        break;
+
+      // Full chunk left on the free list
+      PM_EQU(((*free_head)), (cp->next_free));
+      PM_EQU((cp->on_free_list), (false));
+    }
+
+    unsigned int word = slot / 64;
+
+    PM_EQU((cp->slots[slot]), (rec));
+    pmem_persist(&cp->slots[slot], sizeof(record*), 0);
+
+    PM_EQU((cp->bitmap[word]), (cp->bitmap[word] | (1UL << (slot % 64))));
+    pmem_persist(&cp->bitmap[word], sizeof(uint64_t), 0);
+
+    PM_EQU((cp->num_used), (cp->num_used + 1));
+
+    // Full chunks leave the free list
+    if (cp->num_used == HEAP_CHUNK_SLOTS) {
+      PM_EQU(((*free_head)), (cp->next_free));
+      PM_EQU((cp->on_free_list), (false));
+    }
+
+    PM_EQU((rec->heap_chunk), (cp));
+    PM_EQU((rec->heap_slot), (slot));
+
+    PM_EQU((_size), (_size + 1));
+    return _size - 1;
+  }
+
+  bool erase(record* rec) {
+    std::lock_guard<std::mutex> lock(heap_mutex);
+    struct chunk* cp = (struct chunk*) rec->heap_chunk;
+    unsigned int slot = rec->heap_slot;
+    unsigned int word = slot / 64;
+
+    if (cp == NULL || cp->slots[slot] != rec)
+      return false;
+
+    PM_EQU((cp->bitmap[word]), (cp->bitmap[word] & ~(1UL << (slot % 64))));
+    pmem_persist(&cp->bitmap[word], sizeof(uint64_t), 0);
+
+    PM_EQU((cp->slots[slot]), (NULL));
+    PM_EQU((cp->num_used), (cp->num_used - 1));
+
+    if (!cp->on_free_list) {
+      PM_EQU((cp->next_free), ((*free_head)));
+      PM_EQU(((*free_head)), (cp));
+      PM_EQU((cp->on_free_list), (true));
+    }
+
+    PM_EQU((rec->heap_chunk), (NULL));
+    PM_EQU((_size), (_size - 1));
+    return true;
+  }
+
+  void clear(void) {
+    struct chunk* cp = (*head);
+    struct chunk* prev = NULL;
+
+    while (cp) {
+      prev = cp;
+      PM_EQU((cp), (cp->next));
+      delete prev;
+    }
+
+    PM_EQU(((*head)), (NULL));
+    PM_EQU(((*free_head)), (NULL));
+    PM_EQU((_size), (0));
+  }
+
+  // Rebuild the used counts, free list, size and record positions from the
+  // bitmaps
+  void recover() {
+    // A crash may have left the mutex locked
+    new (&heap_mutex) std::mutex();
+
+    PM_EQU(((*free_head)), (NULL));
+    PM_EQU((_size), (0));
+
+    for (struct chunk* cp = (*head); cp != NULL; cp = cp->next) {
+      unsigned int num_used = 0;
+
+      for (unsigned int word = 0; word < HEAP_BITMAP_WORDS; word++) {
+        uint64_t bits = cp->bitmap[word];
+        num_used += __builtin_popcountl(bits);
+
+        // erase() needs to find the record where it was pushed
+        while (bits) {
+          unsigned int slot = word * 64 + __builtin_ctzl(bits);
+          record* rec = cp->slots[slot];
+
+          PM_EQU((rec->heap_chunk), (cp));
+          PM_EQU((rec->heap_slot), (slot));
+          pmem_persist(&rec->heap_chunk,
+                       sizeof(rec->heap_chunk) + sizeof(rec->heap_slot), 0);
+          bits &= bits - 1;
+        }
+      }
+
+      PM_EQU((cp->num_used), (num_used));
+      PM_EQU((_size), (_size + num_used));
+
+      if (num_used < HEAP_CHUNK_SLOTS) {
+        PM_EQU((cp->next_free), ((*free_head)));
+        PM_EQU(((*free_head)), (cp));
+        PM_EQU((cp->on_free_list), (true));
+      } else {
+        PM_EQU((cp->next_free), (NULL));
+        PM_EQU((cp->on_free_list), (false));
+      }
+    }
+  }
+
+  std::vector<record*> get_data(void) {
+    std::vector<record*> data;
+
+    for (struct chunk* cp = (*head); cp != NULL; cp = cp->next) {
+      for (unsigned int word = 0; word < HEAP_BITMAP_WORDS; word++) {
+        uint64_t bits = cp->bitmap[word];
+
+        while (bits) {
+          unsigned int bit = __builtin_ctzl(bits);
+          data.push_back(cp->slots[word * 64 + bit]);
+          bits &= bits - 1;
+        }
+      }
+    }
+
+    return data;
+  }
+
+  bool empty() {
+    return (_size == 0);
+  }
+
+  int size() {
+    return _size;
+  }
+
+ private:
+  void add_chunk() {
+    struct chunk* cp = (struct chunk*) pmalloc(sizeof(struct chunk));
+
+    PM_EQU((cp->next), ((*head)));
+    PM_EQU((cp->next_free), (NULL));
+    PM_EQU((cp->num_used), (0));
+    PM_EQU((cp->on_free_list), (true));
+    PM_MEMSET((cp->bitmap), (0), (sizeof(cp->bitmap)));
+    pmemalloc_activate(cp);
+
+    PM_EQU(((*head)), (cp));
+    PM_EQU(((*free_head)), (cp));
+  }
+
+  unsigned int find_free_slot(struct chunk* cp) {
+    for (unsigned int word = 0; word < HEAP_BITMAP_WORDS; word++) {
+      if (~cp->bitmap[word] != 0)
+        return word * 64 + __builtin_ctzl(~cp->bitmap[word]);
+    }
+
+    return HEAP_CHUNK_SLOTS;
+  }
+};
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "engine_api.h"
+#include "config.h"
+#include "record.h"
+#include "database.h"
+#include "lock_manager.h"
+
+namespace storage {
+
+// TWO-PHASE LOCKING
+//
+// Sits between an executor and its engine on a shared database. Every
+// statement locks the index keys it touches in the database lock manager
+// before the engine runs it: selects take a read lock on the key they look
+// up, updates a write lock on the primary key, and inserts and removes a
+// write lock on the key of every index. Locks are held until txn_end, and
+// a read lock becomes a write lock when its transaction is the only reader.
+//
+// Locking is no-wait. A statement that conflicts fails (select returns an
+// empty string, the others a non-zero code) and dooms its transaction: later
+// statements fail at once and txn_end rolls the transaction back through
+// the engine before it releases the locks.
+//
+// Selects through a secondary index lock that index key, against inserts
+// and removes of the key, and then the primary key of the record they find,
+// against updates of it.
+//
+// With a version manager, read-only transactions read a snapshot and take
+// no locks. Their writes fail.
+
+class two_pl_engine : public engine_api {
+ public:
+  two_pl_engine(database* _db, engine_api* _de);
+  ~two_pl_engine();
+
+  std::string select(const statement& st);
+  bool select(const statement& st, record_view& view);
+  int update(const statement& st);
+  int insert(const statement& st);
+  int remove(const statement& st);
+
+  void load(const statement& st);
+
+  void txn_begin();
+  void txn_begin_read_only();
+  void txn_end(bool commit);
+
+  void recovery();
+
+  // The running transaction lost a lock conflict
+  bool conflict() const {
+    return aborted;
+  }
+
+ private:
+  struct held_lock {
+    size_t slot;
+    unsigned long hash;
+    bool exclusive;
+  };
+
+  int lock(unsigned int table_id, unsigned int index_id, unsigned long key,
+           bool exclusive);
+  int lock_all(const statement& st);
+  void release();
+
+  database* db;
+  engine_api* de;
+  lock_manager* locks;
+
+  std::vector<held_lock> held;
+  bool aborted;
+  bool snapshot;
+
+  serializer sr;
+};
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+namespace storage {
+
+// Commits and aborts per transaction type of one executor. The coordinator
+// merges the executors and reports the committed throughput and abort rate
+// of every type.
+
+class txn_stats {
+ public:
+  void set_types(const std::vector<std::string>& _names) {
+    names = _names;
+    commits.assign(names.size(), 0);
+    aborts.assign(names.size(), 0);
+  }
+
+  void record(unsigned int type, bool committed) {
+    if (committed)
+      commits[type]++;
+    else
+      aborts[type]++;
+  }
+
+  void merge(const txn_stats& other) {
+    for (unsigned int type = 0; type < names.size(); type++) {
+      commits[type] += other.commits[type];
+      aborts[type] += other.aborts[type];
+    }
+  }
+
+  void display(double duration) const {
+    unsigned long total_commits = 0, total_aborts = 0;
+
+    std::cerr << std::fixed << std::setprecision(2);
+
+    for (unsigned int type = 0; type < names.size(); type++) {
+      display(names[type], commits[type], aborts[type], duration);
+      total_commits += commits[type];
+      total_aborts += aborts[type];
+    }
+
+    display("total", total_commits, total_aborts, duration);
+  }
+
+  bool empty() const {
+    return names.empty();
+  }
+
+ private:
+  static void display(const std::string& name, unsigned long num_commits,
+                      unsigned long num_aborts, double duration) {
+    unsigned long num_txns = num_commits + num_aborts;
+    double abort_rate = num_txns ? (num_aborts * 100.0) / num_txns : 0;
+
+    std::cerr << std::setw(12) << name << " :: Commits : " << num_commits
+              << " Aborts : " << num_aborts << " Abort rate(%) : "
+              << abort_rate << " Commits/s : "
+              << (num_commits * 1000.0) / duration << std::endl;
+  }
+
+  std::vector<std::string> names;
+  std::vector<unsigned long> commits;
+  std::vector<unsigned long> aborts;
+};
+
+}
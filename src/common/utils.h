@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
 #include <ctime>
 #include <sstream>
 #include "pm_instr.h"
@@ -8,6 +9,7 @@
 
 void* pmalloc(size_t sz);
 void pfree(void *p);
+void pfree_batch(void **ptrs, size_t num);
 #define PSEGMENT_RESERVED_REGION_START 0x0000100000000000
 #define PSEGMENT_RESERVED_REGION_SIZE (1UL * 1024 * 1024 * 1024)
 #define PSEGMENT_RESERVED_REGION_END     (PSEGMENT_RESERVED_REGION_START +    \
@@ -38,6 +40,9 @@ int get_rand_int_excluding(int i_min, int i_max, int excl);
 
 std::string get_tuple(std::stringstream& entry, schema* sptr);
 
+// Log syncs across all executors
+extern std::atomic<unsigned long> num_log_syncs;
+
 // szudzik hasher
 inline unsigned long hasher(unsigned long a, unsigned long b) {
   if (a >= b)
@@ -52,11 +57,12 @@ inline unsigned long hasher(unsigned long a, unsigned long b, unsigned long c) {
   return ret;
 }
 
-void simple_skew(std::vector<int>& simple_dist, double alpha, int n, int num_values);
+void simple_skew(std::vector<int>& simple_dist, double alpha, int n, int num_values,
+                 int seed = 0);
 
 void zipf(std::vector<int>& zipf_dist, double alpha, int n, int num_values);
 
-void uniform(std::vector<double>& uniform_dist, int num_values);
+void uniform(std::vector<double>& uniform_dist, int num_values, int seed = 0);
 
 void display_stats(engine_type etype, double duration, int num_txns);
 
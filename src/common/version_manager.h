@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "record.h"
+
+namespace storage {
+
+// VERSION MANAGER
+//
+// Snapshot reads for read-only transactions on a shared database. Writers
+// still update records in place under write locks. Before a writer first
+// changes a record it puts a volatile copy of the committed version at the
+// head of the record's older list and makes the record's sequence number
+// odd. At commit it takes the next timestamp, stamps its records with it
+// and makes their sequence numbers even again, then publishes the
+// timestamp in commit order.
+//
+// A read-only transaction reads at the last published timestamp and takes
+// no locks. It copies a record whose sequence number is even and whose
+// timestamp it can see, and keeps the copy if the sequence number did not
+// change meanwhile. Otherwise it uses the newest older version it can see.
+//
+// Superseded versions and freed records and fields go to the limbo list of
+// their executor, tagged with the commit timestamp. They are freed once
+// every running snapshot is at least that new, as no such snapshot looks
+// past the newer version. Removed records leave the indices at once, so a
+// snapshot may miss a record that was deleted after it was taken.
+
+#define VERSION_GC_BATCH 64
+#define VERSION_SPINS 128
+
+class version_manager {
+ public:
+  version_manager(unsigned int _num_executors)
+      : num_executors(_num_executors),
+        next_ts(0),
+        visible_ts(0) {
+    executors = new executor_state[num_executors];
+    for (unsigned int itr = 0; itr < num_executors; itr++)
+      executors[itr].snapshot.store(NO_SNAPSHOT);
+  }
+
+  ~version_manager() {
+    for (unsigned int itr = 0; itr < num_executors; itr++) {
+      for (retired& item : executors[itr].limbo)
+        release(item);
+    }
+
+    delete[] executors;
+  }
+
+  // SNAPSHOTS
+
+  uint64_t begin_snapshot(unsigned int tid) {
+    std::atomic<uint64_t>& snapshot = state(tid).snapshot;
+    uint64_t ts;
+
+    // Publish before use, so collect() keeps what the snapshot sees
+    do {
+      ts = visible_ts.load();
+      snapshot.store(ts);
+    } while (visible_ts.load() != ts);
+
+    return ts;
+  }
+
+  void end_snapshot(unsigned int tid) {
+    state(tid).snapshot.store(NO_SNAPSHOT, std::memory_order_release);
+  }
+
+  // COMMITS
+
+  uint64_t commit_begin() {
+    return next_ts.fetch_add(1) + 1;
+  }
+
+  // Timestamps become visible in order
+  void commit_end(uint64_t commit_ts) {
+    for (unsigned int spin = 0; visible_ts.load() != commit_ts - 1; spin++) {
+      if (spin < VERSION_SPINS) {
+#if defined(__x86_64__)
+        _mm_pause();
+#endif
+      } else {
+        std::this_thread::yield();
+      }
+    }
+
+    visible_ts.store(commit_ts);
+  }
+
+  // Tag for objects that no timestamp superseded, like those of an aborted
+  // transaction
+  uint64_t current_tag() {
+    return visible_ts.load() + 1;
+  }
+
+  // RECORDS
+
+  // Saves the committed version before the first change of a writer.
+  // Returns false if the writer already owns the record.
+  bool install(record* rec) {
+    uint64_t seq = __atomic_load_n(&rec->version_seq, __ATOMIC_RELAXED);
+    if (seq % 2 == 1)
+      return false;
+
+    record* version = new record(rec->sptr);
+    memcpy(version->data, rec->data, rec->data_len);
+    version->version_ts = rec->version_ts;
+    version->older = rec->older;
+
+    __atomic_store_n(&rec->older, version, __ATOMIC_RELEASE);
+    __atomic_store_n(&rec->version_seq, seq + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return true;
+  }
+
+  // A new record stays invisible until its writer commits
+  void install_new(record* rec) {
+    rec->version_ts = 0;
+    rec->older = NULL;
+    __atomic_store_n(&rec->version_seq, 1, __ATOMIC_RELEASE);
+  }
+
+  void publish(record* rec, uint64_t commit_ts) {
+    __atomic_store_n(&rec->version_ts, commit_ts, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->version_seq, rec->version_seq + 1,
+                     __ATOMIC_RELEASE);
+  }
+
+  // Drops the saved version once an aborted writer restored the record
+  void revert(unsigned int tid, record* rec) {
+    record* version = rec->older;
+
+    __atomic_store_n(&rec->older, version->older, __ATOMIC_RELEASE);
+    __atomic_store_n(&rec->version_seq, rec->version_seq + 1,
+                     __ATOMIC_RELEASE);
+
+    retire(tid, version, true, current_tag());
+  }
+
+  // The version of rec a snapshot sees: rec copied into scratch, an older
+  // version, or NULL if the record is newer than the snapshot
+  record* read(record* rec, uint64_t snapshot_ts, record* scratch) {
+    for (;;) {
+      uint64_t seq = __atomic_load_n(&rec->version_seq, __ATOMIC_ACQUIRE);
+      uint64_t ts = __atomic_load_n(&rec->version_ts, __ATOMIC_RELAXED);
+
+      if (seq % 2 == 0 && ts <= snapshot_ts) {
+        memcpy(scratch->data, rec->data, rec->data_len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&rec->version_seq, __ATOMIC_RELAXED) == seq)
+          return scratch;
+        continue;
+      }
+
+      record* version = __atomic_load_n(&rec->older, __ATOMIC_ACQUIRE);
+      while (version != NULL && version->version_ts > snapshot_ts)
+        version = version->older;
+
+      return version;
+    }
+  }
+
+  // GARBAGE COLLECTION
+
+  void retire(unsigned int tid, void* ptr, bool is_record, uint64_t tag) {
+    state(tid).limbo.push_back({ptr, is_record, tag});
+  }
+
+  // Frees what no running snapshot can see
+  void collect(unsigned int tid) {
+    std::deque<retired>& limbo = state(tid).limbo;
+    if (limbo.size() < VERSION_GC_BATCH)
+      return;
+
+    uint64_t min_ts = visible_ts.load();
+    for (unsigned int itr = 0; itr < num_executors; itr++)
+      min_ts = std::min(min_ts, executors[itr].snapshot.load());
+
+    while (!limbo.empty() && limbo.front().tag <= min_ts) {
+      release(limbo.front());
+      limbo.pop_front();
+    }
+  }
+
+ private:
+  static const uint64_t NO_SNAPSHOT = UINT64_MAX;
+
+  struct retired {
+    void* ptr;
+    bool is_record;
+    uint64_t tag;
+  };
+
+  struct executor_state {
+    std::atomic<uint64_t> snapshot;
+    std::deque<retired> limbo;
+    char padding[64];
+  };
+
+  executor_state& state(unsigned int tid) {
+    return executors[tid % num_executors];
+  }
+
+  static void release(const retired& item) {
+    if (item.is_record)
+      delete (record*) item.ptr;
+    else
+      delete (char*) item.ptr;
+  }
+
+  unsigned int num_executors;
+  executor_state* executors;
+
+  std::atomic<uint64_t> next_ts;
+  std::atomic<uint64_t> visible_ts;
+};
+
+}
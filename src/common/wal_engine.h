@@ -5,6 +5,10 @@
 #include <atomic>
 #include <thread>
 #include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <iomanip>
+#include <algorithm>
 
 #include "engine_api.h"
 #include "config.h"
@@ -14,8 +18,10 @@
 #include "database.h"
 #include "pthread.h"
 #include "logger.h"
+#include "shared_logger.h"
 #include "timer.h"
 #include "serializer.h"
+#include "wal_record.h"
 
 namespace storage {
 
@@ -25,12 +31,14 @@ class wal_engine : public engine_api {
   ~wal_engine();
 
   std::string select(const statement& st);
+  bool select(const statement& st, record_view& view);
   int update(const statement& st);
   int insert(const statement& t);
   int remove(const statement& t);
 
   void load(const statement& t);
 
+  void append_log(const std::string& entry);
   void group_commit();
   void txn_begin();
   void txn_end(bool commit);
@@ -41,13 +49,22 @@ class wal_engine : public engine_api {
   database* db;
 
   logger fs_log;
-  std::hash<std::string> hash_fn;
-  std::stringstream entry_stream;
   std::string entry_str;
 
   std::thread gc;
   std::atomic_bool ready;
 
+  // Group commit : a txn is durable once durable_lsn passes its last entry
+  std::mutex gc_mutex;
+  std::condition_variable gc_cv;  // wakes the flusher
+  std::condition_variable commit_cv;  // wakes committing txns
+  off_t requested_lsn = 0;
+  off_t durable_lsn = 0;
+  unsigned int commit_waiters = 0;
+  off_t txn_lsn = 0;  // end of the last entry in the shared log
+  std::vector<double> commit_latencies;  // us
+  bool loading = false;  // loads tables, latencies are not reported
+
   bool read_only = false;
   unsigned int tid;
   serializer sr;
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "record.h"
+
+namespace storage {
+
+// BINARY WAL RECORDS
+//
+// | header | tuple image | tuple image ... |
+//
+// A tuple image holds, for each column in schema order, either the raw bytes
+// of an inlined field taken from record::data, or a 4B length and the bytes
+// of a non-inlined varchar.
+
+#define WAL_NULL_FIELD UINT32_MAX  // length of a NULL varchar
+
+struct wal_record_header {
+  uint32_t crc;  // crc32 of the rest of the header and the payload
+  uint32_t len;  // payload bytes after the header
+  uint64_t txn_id;
+  uint32_t tid;  // executor, the shared log interleaves all of them
+  uint16_t op_type;
+  uint16_t table_id;
+};
+
+// CRC32C, with the sse4.2 crc32 instruction when the cpu has it
+struct wal_crc32_table {
+  wal_crc32_table() {
+    for (uint32_t itr = 0; itr < 256; itr++) {
+      uint32_t crc = itr;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : (crc >> 1);
+      entries[itr] = crc;
+    }
+  }
+
+  uint32_t entries[256];
+};
+
+__attribute__((target("sse4.2")))
+static inline uint32_t wal_crc32_hw(uint32_t crc, const char* buf, size_t len) {
+  uint64_t crc64 = crc;
+
+  for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, buf, sizeof(word));
+    crc64 = __builtin_ia32_crc32di(crc64, word);
+    buf += sizeof(word);
+  }
+
+  crc = crc64;
+  for (; len > 0; len--)
+    crc = __builtin_ia32_crc32qi(crc, *buf++);
+
+  return crc;
+}
+
+static inline uint32_t wal_crc32(const char* buf, size_t len) {
+  static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+  static const wal_crc32_table table;
+  uint32_t crc = 0xFFFFFFFF;
+
+  if (has_sse42)
+    return wal_crc32_hw(crc, buf, len) ^ 0xFFFFFFFF;
+
+  for (size_t itr = 0; itr < len; itr++)
+    crc = table.entries[(crc ^ (uint8_t) buf[itr]) & 0xFF] ^ (crc >> 8);
+
+  return crc ^ 0xFFFFFFFF;
+}
+
+// ENCODE
+
+// Start a new record in buf, the header is filled in by wal_encode_end
+static inline void wal_encode_begin(std::string& buf) {
+  buf.assign(sizeof(wal_record_header), '\0');
+}
+
+static inline void wal_encode_tuple(std::string& buf, record* rec_ptr) {
+  schema* sptr = rec_ptr->sptr;
+
+  for (unsigned int field_itr = 0; field_itr < sptr->num_columns;
+      field_itr++) {
+    field_info finfo = sptr->columns[field_itr];
+
+    if (finfo.inlined) {
+      buf.append(&(rec_ptr->data[finfo.offset]), finfo.ser_len);
+    } else {
+      char* vc = (char*) rec_ptr->get_pointer(field_itr);
+      uint32_t vc_len = (vc != NULL) ? strlen(vc) : WAL_NULL_FIELD;
+
+      buf.append((char*) &vc_len, sizeof(vc_len));
+      if (vc != NULL)
+        buf.append(vc, vc_len);
+    }
+  }
+}
+
+static inline void wal_encode_end(std::string& buf, uint64_t txn_id,
+                                  unsigned int tid, int op_type,
+                                  int table_id) {
+  wal_record_header* hdr = (wal_record_header*) &buf[0];
+
+  hdr->len = buf.size() - sizeof(wal_record_header);
+  hdr->txn_id = txn_id;
+  hdr->tid = tid;
+  hdr->op_type = op_type;
+  hdr->table_id = table_id;
+  hdr->crc = wal_crc32(&buf[sizeof(hdr->crc)], buf.size() - sizeof(hdr->crc));
+}
+
+// DECODE
+
+// Header of the record at buf, NULL if it is torn or corrupt
+static inline const wal_record_header* wal_decode_header(const char* buf,
+                                                         size_t avail) {
+  const wal_record_header* hdr = (const wal_record_header*) buf;
+
+  if (avail < sizeof(wal_record_header))
+    return NULL;
+  if (hdr->len > avail - sizeof(wal_record_header))
+    return NULL;
+
+  size_t crc_len = sizeof(wal_record_header) - sizeof(hdr->crc) + hdr->len;
+  if (wal_crc32(buf + sizeof(hdr->crc), crc_len) != hdr->crc)
+    return NULL;
+
+  return hdr;
+}
+
+// Build a volatile record from the tuple image at cursor, and move past it
+static inline record* wal_decode_tuple(const char*& cursor, schema* sptr) {
+  record* rec_ptr = new record(sptr);
+
+  for (unsigned int field_itr = 0; field_itr < sptr->num_columns;
+      field_itr++) {
+    field_info finfo = sptr->columns[field_itr];
+
+    if (finfo.inlined) {
+      memcpy(&(rec_ptr->data[finfo.offset]), cursor, finfo.ser_len);
+      cursor += finfo.ser_len;
+    } else {
+      uint32_t vc_len;
+      char* vc = NULL;
+
+      memcpy(&vc_len, cursor, sizeof(vc_len));
+      cursor += sizeof(vc_len);
+
+      if (vc_len != WAL_NULL_FIELD) {
+        vc = new char[vc_len + 1];
+        memcpy(vc, cursor, vc_len);
+        vc[vc_len] = '\0';
+        cursor += vc_len;
+      }
+
+      rec_ptr->set_pointer(field_itr, vc);
+    }
+  }
+
+  return rec_ptr;
+}
+
+}
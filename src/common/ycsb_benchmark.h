@@ -22,7 +22,9 @@ class ycsb_benchmark : public benchmark {
   ycsb_benchmark(config _conf, unsigned int tid, database* _db, timer* _tm, struct static_info* _sp);
 
   void load();
-  void execute();
+  void execute_begin();
+  void execute_txns(unsigned int begin, unsigned int end);
+  void execute_end();
 
   void sim_crash();
 
@@ -32,6 +34,10 @@ class ycsb_benchmark : public benchmark {
   // Table Ids
   static constexpr int USER_TABLE_ID = 0;
 
+  // Transaction types
+  static constexpr int UPDATE_TXN = 0;
+  static constexpr int READ_TXN = 1;
+
   // Schema
   schema* user_table_schema;
 
@@ -46,7 +52,9 @@ class ycsb_benchmark : public benchmark {
 
   unsigned int txn_id;
   unsigned int num_keys;
-  unsigned int num_txns;
+
+  // First key this executor loads
+  unsigned int first_key;
 };
 
 }
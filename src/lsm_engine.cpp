@@ -2,6 +2,7 @@
 
 #include "lsm_engine.h"
 #include <fstream>
+#include <algorithm>
 
 namespace storage {
 
@@ -9,6 +10,11 @@ lsm_engine::lsm_engine(const config& _conf, database* _db, bool _read_only,
                        unsigned int _tid)
     : conf(_conf),
       db(_db),
+      runs(_db->tables->size()),
+      run_seq(0),
+      ready(true),
+      num_flushes(0),
+      num_compactions(0),
       tid(_tid) {
 
   etype = engine_type::LSM;
@@ -16,26 +22,19 @@ lsm_engine::lsm_engine(const config& _conf, database* _db, bool _read_only,
   fs_log.configure(conf.fs_path + std::to_string(_tid) + "_" + "log");
   merge_looper = 0;
 
-  std::vector<table*> tables = db->tables->get_data();
-  for (table* tab : tables) {
-    std::string table_file_name = conf.fs_path + std::to_string(_tid) + "_"
-        + std::string(tab->table_name);
-    tab->fs_data.configure(table_file_name, tab->max_tuple_size, false);
-  }
-
-  // GC start
+  // GC and compaction start
   if (!read_only) {
     gc = std::thread(&lsm_engine::group_commit, this);
+    compactor = std::thread(&lsm_engine::compaction, this);
   }
 }
 
 lsm_engine::~lsm_engine() {
-  // GC end
+  // GC and compaction end
   if (!read_only) {
     ready = false;
     gc.join();
-
-    merge(true);
+    compactor.join();
 
     if (!conf.recovery) {
       fs_log.sync();
@@ -44,82 +43,166 @@ lsm_engine::~lsm_engine() {
       //if(conf.storage_stats)
       //  fs_log.truncate_chunk();
     }
+  }
 
-    std::vector<table*> tables = db->tables->get_data();
-    for (table* tab : tables) {
-      tab->fs_data.sync();
-      tab->fs_data.close();
+  // Runs are rebuilt from the log, so their files go too
+  for (table_runs& table_runs : runs) {
+    for (sorted_run* run : table_runs.l0) {
+      run->mark_obsolete();
+      delete run;
+    }
+
+    for (sorted_run* run : table_runs.levels) {
+      if (run != NULL) {
+        run->mark_obsolete();
+        delete run;
+      }
     }
   }
+
+  if (conf.verbose)
+    std::cerr << "LSM :: flushes : " << num_flushes << " compactions : "
+              << num_compactions << " bloom skips : " << num_bloom_skips
+              << std::endl;
 }
 
-std::string lsm_engine::select(const statement& st) {
-  LOG_INFO("Select");
-  std::string val;
+// Newest version of a tuple, from the mem table or a run
+sorted_run::lookup_status lsm_engine::lookup(unsigned int table_id,
+                                             unsigned long key,
+                                             record*& mem_rec,
+                                             std::string& tuple) {
+  table_index* p_index = db->tables->at(table_id)->indices->at(0);
+  sorted_run::lookup_status status = sorted_run::ABSENT;
+
+  mem_rec = NULL;
+  if (p_index->pm_map->at(key, &mem_rec))
+    return (mem_rec != NULL) ? sorted_run::FOUND : sorted_run::DELETED;
+
+  pthread_rwlock_rdlock(&merge_rwlock);
+  table_runs& table_runs = runs[table_id];
+
+  // Level 0 runs overlap, the newest one wins
+  for (auto itr = table_runs.l0.rbegin(); itr != table_runs.l0.rend(); itr++) {
+    if (!(*itr)->may_contain(key)) {
+      num_bloom_skips++;
+      continue;
+    }
+
+    status = (*itr)->get(key, tuple);
+    if (status != sorted_run::ABSENT)
+      break;
+  }
+
+  for (size_t level = 0;
+      status == sorted_run::ABSENT && level < table_runs.levels.size();
+      level++) {
+    sorted_run* run = table_runs.levels[level];
+    if (run == NULL)
+      continue;
+
+    if (!run->may_contain(key)) {
+      num_bloom_skips++;
+      continue;
+    }
 
-  record*rec_ptr = st.rec_ptr;
-  record *pm_rec = NULL, *fs_rec = NULL;
+    status = run->get(key, tuple);
+  }
+
+  pthread_rwlock_unlock(&merge_rwlock);
+  return status;
+}
+
+// Sets the mem table entry of key, rec is NULL for a tombstone
+void lsm_engine::memtable_put(table_index* index, unsigned long key,
+                              record* rec) {
+  if (index->pm_map->insert(key, rec).second == false)
+    index->pm_map->update(key, rec);
+}
+
+// Tuple a select looks for, through any index
+sorted_run::lookup_status lsm_engine::select_lookup(const statement& st,
+                                                    record*& mem_rec,
+                                                    std::string& tuple) {
   table* tab = db->tables->at(st.table_id);
   table_index* table_index = tab->indices->at(st.table_index_id);
-  std::string key_str = sr.serialize(rec_ptr, table_index->sptr);
 
-  unsigned long key = hash_fn(key_str);
-  bool fs_storage = false;
-  off_t storage_offset = 0;
+  unsigned long key = table_index->get_key(st.rec_ptr);
+  sorted_run::lookup_status status = sorted_run::ABSENT;
+  off_t primary_key;
 
-  // Check if key exists in mem
-  table_index->pm_map->at(key, &pm_rec);
+  mem_rec = NULL;
 
-  // Check if key exists in fs
-  fs_storage = table_index->off_map->at(key, &storage_offset);
-
-  if (fs_storage) {
-    val = tab->fs_data.at(storage_offset);
-    if (!val.empty())
-      fs_rec = sr.deserialize(val, tab->sptr);
+  if (st.table_index_id == 0) {
+    status = lookup(st.table_id, key, mem_rec, tuple);
+  } else if (table_index->pm_map->at(key, &mem_rec)) {
+    status = sorted_run::FOUND;
+  } else if (table_index->off_map->at(key, &primary_key)) {
+    // Flushed tuples are found through the primary key
+    status = lookup(st.table_id, primary_key, mem_rec, tuple);
   }
 
-  if (pm_rec != NULL && fs_rec == NULL) {
-    val = sr.serialize(pm_rec, st.projection);
-  } else if (pm_rec == NULL && fs_rec != NULL) {
-    val = sr.serialize(fs_rec, st.projection);
-
-    fs_rec->clear_data();
-    delete fs_rec;
-  } else if (pm_rec != NULL && fs_rec != NULL) {
-    // Merge
-    int num_cols = pm_rec->sptr->num_columns;
-    for (int field_itr = 0; field_itr < num_cols; field_itr++) {
-      if (pm_rec->sptr->columns[field_itr].enabled)
-        fs_rec->set_data(field_itr, pm_rec);
-    }
+  return status;
+}
 
-    val = sr.serialize(fs_rec, st.projection);
-    delete fs_rec;
+std::string lsm_engine::select(const statement& st) {
+  LOG_INFO("Select");
+  std::string val, tuple;
+
+  record* mem_rec = NULL;
+  table* tab = db->tables->at(st.table_id);
+
+  if (select_lookup(st, mem_rec, tuple) == sorted_run::FOUND) {
+    if (mem_rec != NULL) {
+      val = sr.serialize(mem_rec, st.projection);
+    } else {
+      // Projected straight from the encoded tuple
+      tuple_view view(tuple.data(), tuple.size(), tab->sptr);
+      val = view.to_string(st.projection);
+    }
   }
 
   LOG_INFO("val : %s", val.c_str());
   //std::cerr << "val : " << val << std::endl;
 
-  delete rec_ptr;
+  delete st.rec_ptr;
   return val;
 }
 
+bool lsm_engine::select(const statement& st, record_view& view) {
+  LOG_INFO("Select");
+  std::string tuple;
+
+  record* mem_rec = NULL;
+  table* tab = db->tables->at(st.table_id);
+
+  view.reset();
+  if (select_lookup(st, mem_rec, tuple) == sorted_run::FOUND) {
+    if (mem_rec != NULL)
+      view.borrow(mem_rec);
+    else
+      view.own(sr.decode(tuple_view(tuple.data(), tuple.size(), tab->sptr),
+                         tab->sptr), true);
+  }
+
+  delete st.rec_ptr;
+  return !view.empty();
+}
+
 int lsm_engine::insert(const statement& st) {
   LOG_INFO("Insert");
   record* after_rec = st.rec_ptr;
+  record* mem_rec = NULL;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
+  std::string tuple;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(after_rec);
 
   // Check if key exists
-  if (indices->at(0)->pm_map->exists(key)
-      || indices->at(0)->off_map->exists(key)) {
+  if (lookup(st.table_id, key, mem_rec, tuple) == sorted_run::FOUND) {
     after_rec->clear_data();
     delete after_rec;
     return EXIT_SUCCESS;
@@ -134,12 +217,11 @@ int lsm_engine::insert(const statement& st) {
   // Add log entry
   fs_log.push_back(entry_str);
 
-  // Add entry in indices
+  // Add entry in indices, over a tombstone if any
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(after_rec);
 
-    indices->at(index_itr)->pm_map->insert(key, after_rec);
+    memtable_put(indices->at(index_itr), key, after_rec);
   }
 
   return EXIT_SUCCESS;
@@ -148,26 +230,25 @@ int lsm_engine::insert(const statement& st) {
 int lsm_engine::remove(const statement& st) {
   LOG_INFO("Remove");
   record* rec_ptr = st.rec_ptr;
+  record* before_rec = NULL;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
-  std::string val;
+  std::string tuple;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  //LOG_INFO("Key_str :: --%s-- ", key_str.c_str());
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(rec_ptr);
 
   // Check if key does not exist
-  if (indices->at(0)->pm_map->exists(key) == 0
-      && indices->at(0)->off_map->exists(key) == 0) {
+  if (lookup(st.table_id, key, before_rec, tuple) != sorted_run::FOUND) {
     delete rec_ptr;
     return EXIT_SUCCESS;
   }
 
-  record* before_rec = NULL;
-  indices->at(0)->pm_map->at(key, &before_rec);
+  if (before_rec == NULL)
+    before_rec = sr.decode(tuple_view(tuple.data(), tuple.size(), tab->sptr),
+                           tab->sptr);
 
   // Add log entry
   entry_stream.str("");
@@ -177,16 +258,21 @@ int lsm_engine::remove(const statement& st) {
   entry_str = entry_stream.str();
   fs_log.push_back(entry_str);
 
-  // Remove entry in indices
-  for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(rec_ptr, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+  // Remove secondary entries by the keys of the stored tuple
+  for (index_itr = 1; index_itr < num_indices; index_itr++) {
+    key = indices->at(index_itr)->get_key(before_rec);
 
     indices->at(index_itr)->pm_map->erase(key);
     indices->at(index_itr)->off_map->erase(key);
   }
 
+  // Tombstone hides older versions in the runs
+  key = indices->at(0)->get_key(before_rec);
+  memtable_put(indices->at(0), key, NULL);
+
+  before_rec->clear_data();
   delete before_rec;
+  delete rec_ptr;
   return EXIT_SUCCESS;
 }
 
@@ -194,21 +280,23 @@ int lsm_engine::update(const statement& st) {
   LOG_INFO("Update");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = db->tables->at(st.table_id)->indices;
+  pvector<table_index*>* indices = db->tables->at(st.table_id)->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
-  std::string val;
+  unsigned long key = indices->at(0)->get_key(rec_ptr);
+  std::string tuple;
   record* before_rec = NULL;
   void *before_field;
 
   entry_stream.str("");
 
+  sorted_run::lookup_status status = lookup(st.table_id, key, before_rec,
+                                            tuple);
+
   // Check if key does not exist
-  if (indices->at(0)->pm_map->at(key, &before_rec) == false) {
+  if (status != sorted_run::FOUND) {
     before_rec = rec_ptr;
 
     entry_stream << st.transaction_id << " " << st.op_type << " " << st.table_id
@@ -218,12 +306,17 @@ int lsm_engine::update(const statement& st) {
     entry_str = entry_stream.str();
 
     for (index_itr = 0; index_itr < num_indices; index_itr++) {
-      key_str = sr.serialize(before_rec, indices->at(index_itr)->sptr);
-      key = hash_fn(key_str);
+      key = indices->at(index_itr)->get_key(before_rec);
 
-      indices->at(index_itr)->pm_map->insert(key, before_rec);
+      memtable_put(indices->at(index_itr), key, before_rec);
     }
   } else {
+    // Flushed tuples come back to the mem table
+    bool flushed = (before_rec == NULL);
+    if (flushed)
+      before_rec = sr.decode(tuple_view(tuple.data(), tuple.size(), tab->sptr),
+                             tab->sptr);
+
     entry_stream << st.transaction_id << " " << st.op_type << " " << st.table_id
                  << " " << sr.serialize(before_rec, before_rec->sptr) << " ";
 
@@ -239,6 +332,12 @@ int lsm_engine::update(const statement& st) {
 
     entry_stream << sr.serialize(before_rec, before_rec->sptr) << "\n";
     entry_str = entry_stream.str();
+
+    if (flushed)
+      memtable_put(indices->at(0), key, before_rec);
+
+    // Fields moved to before_rec
+    delete rec_ptr;
   }
 
   // Add log entry
@@ -251,13 +350,12 @@ void lsm_engine::load(const statement& st) {
   //LOG_INFO("Load");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(after_rec);
 
   if (!conf.recovery) {
     // Add log entry
@@ -272,8 +370,7 @@ void lsm_engine::load(const statement& st) {
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(after_rec);
 
     indices->at(index_itr)->pm_map->insert(key, after_rec);
   }
@@ -291,85 +388,220 @@ void lsm_engine::group_commit() {
 
 void lsm_engine::merge_check() {
   if (++merge_looper % conf.merge_interval == 0) {
-    merge(false);
+    for (unsigned int table_id = 0; table_id < runs.size(); table_id++)
+      flush(table_id);
     merge_looper = 0;
   }
 }
 
-void lsm_engine::merge(bool force) {
+std::string lsm_engine::run_file_name(unsigned int table_id) {
+  return conf.fs_path + std::to_string(tid) + "_"
+      + std::string(db->tables->at(table_id)->table_name) + "_run"
+      + std::to_string(run_seq++);
+}
 
-  std::vector<table*> tables = db->tables->get_data();
-  for (table* tab : tables) {
-    table_index *p_index = tab->indices->at(0);
-    std::vector<table_index*> indices = tab->indices->get_data();
+// Writes the mem table of a table as a new level 0 run
+void lsm_engine::flush(unsigned int table_id) {
+  table* tab = db->tables->at(table_id);
+  pvector<table_index*>& indices = *tab->indices;
+  pbtree<unsigned long, record*>* pm_map = indices.at(0)->pm_map;
 
-    pbtree<unsigned long, record*>* pm_map = p_index->pm_map;
+  unsigned int num_indices = tab->num_indices;
+  unsigned int index_itr;
+  unsigned long key;
+  std::string val;
 
-    size_t compact_threshold = conf.merge_ratio * p_index->off_map->size();
-    bool compact = (pm_map->size() > compact_threshold);
+  if (pm_map->size() == 0)
+    return;
 
-    // Check if need to merge
-    if (force || compact) {
-      //std::std::cerr << "Merging ! " << std::endl;
-      pbtree<unsigned long, record*>::const_iterator itr;
-      record *pm_rec, *fs_rec;
-      unsigned long key;
-      off_t storage_offset;
-      std::string val;
+  // Entries are not sorted within a leaf
+  std::vector<std::pair<unsigned long, record*> > entries;
+  pbtree<unsigned long, record*>::const_iterator itr;
+
+  entries.reserve(pm_map->size());
+  for (itr = pm_map->begin(); itr != pm_map->end(); itr++)
+    entries.push_back(std::make_pair((*itr).first, (*itr).second));
+
+  std::sort(
+      entries.begin(), entries.end(),
+      [](const std::pair<unsigned long, record*>& a,
+         const std::pair<unsigned long, record*>& b) {
+        return a.first < b.first;
+      });
+
+  run_builder builder(run_file_name(table_id), entries.size());
+  for (auto& entry : entries) {
+    if (entry.second == NULL) {
+      builder.add(entry.first, NULL);
+      continue;
+    }
 
-      // All tuples in table
-      for (itr = pm_map->begin(); itr != pm_map->end(); itr++) {
-        key = (*itr).first;
-        pm_rec = (*itr).second;
+    val.clear();
+    sr.encode(entry.second, tab->sptr, val);
+    builder.add(entry.first, &val);
+  }
 
-        fs_rec = NULL;
+  sorted_run* run = builder.finish();
 
-        // Check if we need to merge
-        if (p_index->off_map->at(key, &storage_offset)) {
-          val = tab->fs_data.at(storage_offset);
+  pthread_rwlock_wrlock(&merge_rwlock);
+  runs[table_id].l0.push_back(run);
+  pthread_rwlock_unlock(&merge_rwlock);
 
-          if (!val.empty()) {
-            fs_rec = sr.deserialize(val, tab->sptr);
+  // Secondary keys now lead to the primary key
+  for (auto& entry : entries) {
+    record* pm_rec = entry.second;
+    if (pm_rec == NULL)
+      continue;
 
-            int num_cols = pm_rec->sptr->num_columns;
-            for (int field_itr = 0; field_itr < num_cols; field_itr++) {
-              fs_rec->set_data(field_itr, pm_rec);
-            }
+    for (index_itr = 1; index_itr < num_indices; index_itr++) {
+      pbtree<unsigned long, off_t>* off_map = indices.at(index_itr)->off_map;
+      key = indices.at(index_itr)->get_key(pm_rec);
 
-            val = sr.serialize(fs_rec, tab->sptr);
-            //LOG_INFO("Merge :: update :: val :: %s ", val.c_str());
+      if (off_map->insert(key, entry.first).second == false)
+        off_map->update(key, entry.first);
+    }
 
-            tab->fs_data.update(storage_offset, val);
-            fs_rec->clear_data();
-            delete fs_rec;
-          }
-        } else {
-          // Insert tuple
-          val = sr.serialize(pm_rec, tab->sptr);
-          //LOG_INFO("Merge :: insert new :: val :: %s ", val.c_str());
+    pm_rec->clear_data();
+    delete pm_rec;
+  }
 
-          storage_offset = tab->fs_data.push_back(val);
+  // Clear mem table
+  for (table_index* index : indices)
+    index->pm_map->clear();
 
-          for (table_index* index : indices) {
-            std::string key_str = sr.serialize(pm_rec, index->sptr);
-            key = hash_fn(key_str);
-            index->off_map->insert(key, storage_offset);
-          }
-        }
+  num_flushes++;
+}
 
-        //pm_rec->clear_data();
-        delete pm_rec;
-      }
+// Merges runs, inputs are ordered newest first. Tombstones are dropped when
+// the output is the deepest level holding data.
+sorted_run* lsm_engine::merge_runs(const std::vector<sorted_run*>& inputs,
+                                   bool bottom, const std::string& file_name,
+                                   size_t num_entries) {
+  std::vector<sorted_run::iterator> itrs;
+  run_builder builder(file_name, num_entries);
+  std::string val;
+
+  for (sorted_run* run : inputs)
+    itrs.push_back(sorted_run::iterator(run));
+
+  while (true) {
+    int next = -1;
+
+    // Smallest key, the newest input on ties
+    for (unsigned int itr = 0; itr < itrs.size(); itr++) {
+      if (itrs[itr].valid()
+          && (next < 0 || itrs[itr].key() < itrs[next].key()))
+        next = itr;
+    }
+
+    if (next < 0)
+      break;
+
+    unsigned long key = itrs[next].key();
+    if (!itrs[next].tombstone()) {
+      val = itrs[next].tuple();
+      builder.add(key, &val);
+    } else if (!bottom) {
+      builder.add(key, NULL);
+    }
+
+    // Older versions of key are gone
+    for (sorted_run::iterator& itr : itrs) {
+      if (itr.valid() && itr.key() == key)
+        itr.next();
+    }
+  }
+
+  return builder.finish();
+}
 
-      // Clear mem table
-      for (table_index* index : indices)
-        index->pm_map->clear();
+// One compaction step for a table, false if none is due
+bool lsm_engine::compact(unsigned int table_id) {
+  table_runs& table_runs = runs[table_id];
+  std::vector<sorted_run*> inputs;
+  size_t num_l0_inputs = 0;
+  size_t target = 0;
+  size_t num_entries = 0;
+  bool bottom = true;
+
+  pthread_rwlock_rdlock(&merge_rwlock);
+
+  if (table_runs.l0.size() >= LSM_L0_RUNS) {
+    // All of level 0 into level 1
+    num_l0_inputs = table_runs.l0.size();
+    inputs.assign(table_runs.l0.rbegin(), table_runs.l0.rend());
+    target = 0;
+  } else {
+    // A level over capacity into the next one
+    size_t capacity = LSM_LEVEL_BASE;
+    for (size_t level = 0; level < table_runs.levels.size(); level++) {
+      sorted_run* run = table_runs.levels[level];
+      if (run != NULL && run->size() > capacity) {
+        inputs.push_back(run);
+        target = level + 1;
+        break;
+      }
+      capacity *= LSM_LEVEL_RATIO;
     }
   }
 
-  // Truncate log
-  //if (force)
-  //  fs_log.truncate();
+  if (inputs.empty()) {
+    pthread_rwlock_unlock(&merge_rwlock);
+    return false;
+  }
+
+  if (target < table_runs.levels.size() && table_runs.levels[target] != NULL)
+    inputs.push_back(table_runs.levels[target]);
+
+  for (size_t level = target + 1; level < table_runs.levels.size(); level++)
+    bottom = bottom && (table_runs.levels[level] == NULL);
+
+  pthread_rwlock_unlock(&merge_rwlock);
+
+  // Only this thread replaces runs, so the inputs stay put while merging
+  for (sorted_run* run : inputs)
+    num_entries += run->entries();
+
+  sorted_run* merged = merge_runs(inputs, bottom, run_file_name(table_id),
+                                  num_entries);
+
+  pthread_rwlock_wrlock(&merge_rwlock);
+
+  // Flushes only append to level 0
+  if (num_l0_inputs > 0)
+    table_runs.l0.erase(table_runs.l0.begin(),
+                        table_runs.l0.begin() + num_l0_inputs);
+  else
+    table_runs.levels[target - 1] = NULL;
+
+  if (target >= table_runs.levels.size())
+    table_runs.levels.resize(target + 1, NULL);
+  table_runs.levels[target] = merged;
+
+  pthread_rwlock_unlock(&merge_rwlock);
+
+  // No lookup can reach the inputs anymore
+  for (sorted_run* run : inputs) {
+    run->mark_obsolete();
+    delete run;
+  }
+
+  num_compactions++;
+  return true;
+}
+
+void lsm_engine::compaction() {
+
+  while (ready) {
+    bool busy = false;
+
+    for (unsigned int table_id = 0; table_id < runs.size(); table_id++)
+      busy = compact(table_id) || busy;
+
+    if (!busy)
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(conf.gc_interval));
+  }
 }
 
 void lsm_engine::txn_begin() {
@@ -390,12 +622,11 @@ void lsm_engine::recovery() {
   fs_log.sync();
   fs_log.disable();
 
-  // Clear pm map and rebuild it
-  std::vector<table*> tables = db->tables->get_data();
-  for (table* tab : tables) {
-    std::vector<table_index*> indices = tab->indices->get_data();
-    for (table_index* index : indices) {
+  // Clear pm map and rebuild it, the runs are derived from the log
+  for (table* tab : *db->tables) {
+    for (table_index* index : *tab->indices) {
       index->pm_map->clear();
+      index->off_map->clear();
     }
   }
 
@@ -35,10 +35,21 @@ namespace storage {
             "   -q --ycsb_zipf_skew    :  Zipf Skew \n"
             "   -z --storage_stats     :  Collect storage stats \n"
             "   -o --tpcc_stock-level  :  TPCC stock level only \n"
+            "   -W --tpcc-warehouses   :  TPCC warehouses per executor \n"
             "   -r --recovery          :  Recovery mode \n"
             "   -b --load-batch-size   :  Load batch size \n"
             "   -j --test_b_mode       :  Test benchmark mode \n"
             "   -i --multi-executors   :  Multiple executors \n"
+            "   -L --shared-log        :  One log and flusher for all executors \n"
+            "   -U --io-uring          :  Shared log writes through io_uring (implies -L) \n"
+            "   -S --shared-db         :  One database shared by all executors (OPT WAL) \n"
+            "   -C --two-pl            :  Two-phase locking on the shared database (implies -S) \n"
+            "   -M --mvcc              :  Snapshot reads for read-only txns, else as -C \n"
+            "   -T --workers           :  Worker threads stealing batches of the executors' txns \n"
+            "   -B --steal-batch       :  Txns per stolen batch [default: 64] \n"
+            "   -P --pin-executors     :  Pin executor threads to cores \n"
+            "   -F --flush-mode        :  Flush (0: clflush, 1: clflushopt, 2: clwb) [default: auto]\n"
+            "   -I --inline-threshold  :  Max bytes of a varchar inlined in its record [default: 128] \n"
             "   -n --enable-trace      :  E[n]able trace [default:0]\n");
     exit(EXIT_FAILURE);
   }
@@ -65,6 +76,17 @@ namespace storage {
     { "help", no_argument, NULL, 'h' },
     { "test-mode", optional_argument, NULL, 'j' },
     { "ycsb-update-one", no_argument, NULL, 'u' },
+    { "flush-mode", optional_argument, NULL, 'F' },
+    { "shared-log", no_argument, NULL, 'L' },
+    { "io-uring", no_argument, NULL, 'U' },
+    { "shared-db", no_argument, NULL, 'S' },
+    { "two-pl", no_argument, NULL, 'C' },
+    { "mvcc", no_argument, NULL, 'M' },
+    { "tpcc-warehouses", optional_argument, NULL, 'W' },
+    { "workers", optional_argument, NULL, 'T' },
+    { "steal-batch", optional_argument, NULL, 'B' },
+    { "pin-executors", no_argument, NULL, 'P' },
+    { "inline-threshold", optional_argument, NULL, 'I' },
     { NULL, 0, NULL, 0 } };
 
   static void parse_arguments(int argc, char* argv[], config& state) {
@@ -80,6 +102,10 @@ namespace storage {
     state.single = false;
     state.num_executors = 8;
 
+    state.num_workers = 0;
+    state.steal_batch_size = SCHEDULER_BATCH_SIZE;
+    state.pin_executors = false;
+
     state.verbose = false;
 
     state.gc_interval = 5;
@@ -109,11 +135,21 @@ namespace storage {
 
     state.test_benchmark_mode = 0;
 
+    state.flush_mode = PMEM_FLUSH_AUTO;
+
+    state.inline_threshold = VARCHAR_INLINE_THRESHOLD;
+
+    state.shared_log = false;
+    state.shared_db = false;
+    state.cc = cc_type::CC_NONE;
+    state.io_uring = false;
+    state.slog = NULL;
+
     // Parse args
     int debug_fd = -1, ret = 0;
     while (1) {
       int idx = 0;
-      int c = getopt_long(argc, argv, "n:f:x:k:e:p:g:q:b:j:svwascmhludytzori", opts,
+      int c = getopt_long(argc, argv, "n:f:x:k:e:p:g:q:b:j:F:W:B:T:I:svwascmhludytzoriLUSCMP", opts,
                           &idx);
 
       if (c == -1)
@@ -252,6 +288,11 @@ fail:
         state.tpcc_stock_level_only = true;
         std::cerr << "tpcc_stock_level " << std::endl;
         break;
+      case 'W':
+        state.tpcc_num_warehouses = atoi(optarg);
+        std::cerr << "tpcc_num_warehouses: " << state.tpcc_num_warehouses
+                  << std::endl;
+        break;
       case 'r':
         state.recovery = true;
         std::cerr << "recovery " << std::endl;
@@ -265,6 +306,58 @@ fail:
         state.num_executors = 2;
         std::cerr << "multiple executors " << std::endl;
         break;
+      case 'F':
+        state.flush_mode = atoi(optarg);
+        if (!pmem_set_flush_mode(state.flush_mode)) {
+          fprintf(stderr, "flush mode %d not supported by this cpu\n",
+                  state.flush_mode);
+          exit(EXIT_FAILURE);
+        }
+        std::cerr << "flush_mode: " << state.flush_mode << std::endl;
+        break;
+      case 'I':
+        state.inline_threshold = atoi(optarg);
+        std::cerr << "inline_threshold: " << state.inline_threshold
+                  << std::endl;
+        break;
+      case 'L':
+        state.shared_log = true;
+        std::cerr << "shared_log " << std::endl;
+        break;
+      case 'U':
+        state.shared_log = true;
+        state.io_uring = true;
+        std::cerr << "io_uring " << std::endl;
+        break;
+      case 'S':
+        state.shared_db = true;
+        std::cerr << "shared_db " << std::endl;
+        break;
+      case 'C':
+        state.shared_db = true;
+        state.cc = cc_type::CC_2PL;
+        std::cerr << "two_pl " << std::endl;
+        break;
+      case 'M':
+        state.shared_db = true;
+        state.cc = cc_type::CC_MVCC;
+        std::cerr << "mvcc " << std::endl;
+        break;
+      case 'T':
+        state.num_workers = atoi(optarg);
+        assert(state.num_workers > 0);
+        std::cerr << "num_workers: " << state.num_workers << std::endl;
+        break;
+      case 'B':
+        state.steal_batch_size = atoi(optarg);
+        assert(state.steal_batch_size > 0);
+        std::cerr << "steal_batch_size: " << state.steal_batch_size
+                  << std::endl;
+        break;
+      case 'P':
+        state.pin_executors = true;
+        std::cerr << "pin_executors " << std::endl;
+        break;
       case 'h':
         usage_exit(stderr);
         break;
@@ -273,6 +366,12 @@ fail:
         usage_exit(stderr);
       }
     }
+
+    // The other engines keep per-executor files next to the tables
+    if (state.shared_db && state.etype != engine_type::OPT_WAL) {
+      fprintf(stderr, "shared database needs the OPT WAL engine (-w)\n");
+      exit(EXIT_FAILURE);
+    }
   }
 
 }
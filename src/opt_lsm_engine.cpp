@@ -9,30 +9,42 @@ bool _read_only,
                                unsigned int _tid)
     : conf(_conf),
       db(_db),
+      ready(true),
+      merge_pending(false),
       tid(_tid) {
 
   etype = engine_type::OPT_LSM;
   read_only = _read_only;
   merge_looper = 0;
-  pm_log = db->log;
+  pm_log = db->get_log(tid);
 
-  std::vector<table*> tables = db->tables->get_data();
-  for (table* tab : tables) {
+  for (table* tab : *db->tables) {
     std::string table_file_name = conf.fs_path + std::to_string(_tid) + "_"
         + std::string(tab->table_name);
     // Storing pointer only
     tab->fs_data.configure(table_file_name, 15, false);
   }
 
+  // Merge start
+  if (!read_only)
+    merge_thread = std::thread(&opt_lsm_engine::merger, this);
+
 }
 
 opt_lsm_engine::~opt_lsm_engine() {
 
   if (!read_only) {
-    merge(true);
+    // Merge end, then merge what is left
+    ready = false;
+    merge_thread.join();
+
+    freeze(true);
+    merge();
 
-    std::vector<table*> tables = db->tables->get_data();
-    for (table* tab : tables) {
+    // Truncate log
+    pm_log->clear();
+
+    for (table* tab : *db->tables) {
       tab->fs_data.sync();
       tab->fs_data.close();
     }
@@ -41,6 +53,17 @@ opt_lsm_engine::~opt_lsm_engine() {
 }
 
 std::string opt_lsm_engine::select(const statement& st) {
+  record_view view;
+  std::string val;
+
+  if (select(st, view))
+    val = sr.serialize(view.get(), st.projection);
+  LOG_INFO("val : %s", val.c_str());
+
+  return val;
+}
+
+bool opt_lsm_engine::select(const statement& st, record_view& view) {
   LOG_INFO("Select");
   std::string val;
 
@@ -48,13 +71,15 @@ std::string opt_lsm_engine::select(const statement& st) {
   record *pm_rec = NULL, *fs_rec = NULL;
   table *tab = db->tables->at(st.table_id);
   table_index *table_index = tab->indices->at(st.table_index_id);
-  std::string key_str = sr.serialize(rec_ptr, table_index->sptr);
 
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = table_index->get_key(rec_ptr);
   off_t storage_offset = -1;
 
+  std::lock_guard<std::mutex> merge_guard(merge_mutex);
+
   // Check if key exists in mem
-  table_index->pm_map->at(key, &pm_rec);
+  if (!table_index->pm_map->at(key, &pm_rec))
+    pm_rec = frozen_at(table_index, key);
 
   // Check if key exists in fs
   table_index->off_map->at(key, &storage_offset);
@@ -66,10 +91,10 @@ std::string opt_lsm_engine::select(const statement& st) {
 
   if (pm_rec != NULL && fs_rec == NULL) {
     // From Memtable
-    val = sr.serialize(pm_rec, st.projection);
+    view.borrow(pm_rec);
   } else if (pm_rec == NULL && fs_rec != NULL) {
     // From SSTable
-    val = sr.serialize(fs_rec, st.projection);
+    view.borrow(fs_rec);
 
   } else if (pm_rec != NULL && fs_rec != NULL) {
     // Merge
@@ -79,29 +104,31 @@ std::string opt_lsm_engine::select(const statement& st) {
         fs_rec->set_data(field_itr, pm_rec);
     }
 
-    val = sr.serialize(fs_rec, st.projection);
+    view.borrow(fs_rec);
+  } else {
+    view.reset();
   }
 
-  LOG_INFO("val : %s", val.c_str());
-
-  return val;
+  delete rec_ptr;
+  return !view.empty();
 }
 
 int opt_lsm_engine::insert(const statement& st) {
   LOG_INFO("Insert");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  //LOG_INFO("Key_str :: --%s-- ", key_str.c_str());
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(after_rec);
+
+  std::lock_guard<std::mutex> merge_guard(merge_mutex);
 
   // Check if key exists
   if (indices->at(0)->pm_map->exists(key)
+      || frozen_at(indices->at(0), key) != NULL
       || indices->at(0)->off_map->exists(key)) {
     after_rec->clear_data();
     delete after_rec;
@@ -115,11 +142,10 @@ int opt_lsm_engine::insert(const statement& st) {
 
   entry_str = entry_stream.str();
   size_t entry_str_sz = entry_str.size() + 1;
-  char* entry = new char[entry_str_sz];
-  memcpy(entry, entry_str.c_str(), entry_str_sz);
+  char* entry = (char*) pmalloc(entry_str_sz*sizeof(char));
+  PM_MEMCPY((entry), (entry_str.c_str()), (entry_str_sz));
 
-  // Activate new record
-  pmemalloc_activate(after_rec);
+  // Activate data of new record
   after_rec->persist_data();
 
   // Add log entry
@@ -128,8 +154,7 @@ int opt_lsm_engine::insert(const statement& st) {
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(after_rec);
 
     indices->at(index_itr)->pm_map->insert(key, after_rec);
   }
@@ -141,17 +166,19 @@ int opt_lsm_engine::remove(const statement& st) {
   LOG_INFO("Remove");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   std::string val;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(rec_ptr);
+
+  std::lock_guard<std::mutex> merge_guard(merge_mutex);
 
   // Check if key does not exist
   if (indices->at(0)->pm_map->exists(key) == 0
+      && frozen_at(indices->at(0), key) == NULL
       && indices->at(0)->off_map->exists(key) == 0) {
     delete rec_ptr;
     return EXIT_SUCCESS;
@@ -164,8 +191,8 @@ int opt_lsm_engine::remove(const statement& st) {
 
   entry_str = entry_stream.str();
   size_t entry_str_sz = entry_str.size() + 1;
-  char* entry = new char[entry_str_sz];
-  memcpy(entry, entry_str.c_str(), entry_str_sz);
+  char* entry = (char*) pmalloc(entry_str_sz*sizeof(char));
+  PM_MEMCPY((entry), (entry_str.c_str()), (entry_str_sz));
 
   // Add log entry
   pmemalloc_activate(entry);
@@ -178,11 +205,14 @@ int opt_lsm_engine::remove(const statement& st) {
 
   // Remove entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(rec_ptr, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(rec_ptr);
 
     indices->at(index_itr)->pm_map->erase(key);
     indices->at(index_itr)->off_map->erase(key);
+
+    // The merge skips null entries
+    if (frozen_at(indices->at(index_itr), key) != NULL)
+      indices->at(index_itr)->frozen_map->update(key, NULL);
   }
 
   return EXIT_SUCCESS;
@@ -192,20 +222,33 @@ int opt_lsm_engine::update(const statement& st) {
   LOG_INFO("Update");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = db->tables->at(st.table_id)->indices;
+  pvector<table_index*>* indices = db->tables->at(st.table_id)->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(rec_ptr);
   std::string val;
   record* before_rec;
   void *before_field, *after_field;
   bool update_rec = false;
+  off_t storage_offset;
 
-  // Check if key does not exist
+  std::lock_guard<std::mutex> merge_guard(merge_mutex);
+
+  // Newest version, in mem, frozen or in storage
   if (indices->at(0)->pm_map->at(key, &before_rec) == false) {
+    before_rec = frozen_at(indices->at(0), key);
+
+    if (before_rec == NULL
+        && indices->at(0)->off_map->at(key, &storage_offset)) {
+      val = tab->fs_data.at(storage_offset);
+      std::sscanf((char*) val.c_str(), "%p", &before_rec);
+    }
+  }
+
+  // Check if key does not exist
+  if (before_rec == NULL) {
     before_rec = rec_ptr;
 
     entry_stream.str("");
@@ -227,6 +270,13 @@ int opt_lsm_engine::update(const statement& st) {
         after_field = rec_ptr->get_pointer(field_itr);
         entry_stream << field_itr << " " << before_field << " ";
       }
+      // Inlined varchar, its length first as it may hold spaces
+      else if (rec_ptr->sptr->columns[field_itr].type == field_type::VARCHAR) {
+        const char* before_vc = before_rec->get_varchar(field_itr);
+
+        entry_stream << field_itr << " " << strlen(before_vc) << " "
+                     << before_vc << " ";
+      }
       // Data field
       else {
         std::string before_data = before_rec->get_data(field_itr);
@@ -238,8 +288,8 @@ int opt_lsm_engine::update(const statement& st) {
 
   entry_str = entry_stream.str();
   size_t entry_str_sz = entry_str.size() + 1;
-  char* entry = new char[entry_str_sz];
-  memcpy(entry, entry_str.c_str(), entry_str_sz);
+  char* entry = (char*) pmalloc(entry_str_sz*sizeof(char));
+  PM_MEMCPY((entry), (entry_str.c_str()), (entry_str_sz));
 
   // Add log entry
   pmemalloc_activate(entry);
@@ -260,14 +310,12 @@ int opt_lsm_engine::update(const statement& st) {
       before_rec->set_data(field_itr, rec_ptr);
     }
   } else {
-    // Activate new record
-    pmemalloc_activate(before_rec);
+    // Activate data of new record
     before_rec->persist_data();
 
     // Add entry in indices
     for (index_itr = 0; index_itr < num_indices; index_itr++) {
-      key_str = sr.serialize(before_rec, indices->at(index_itr)->sptr);
-      key = hash_fn(key_str);
+      key = indices->at(index_itr)->get_key(before_rec);
 
       indices->at(index_itr)->pm_map->insert(key, before_rec);
     }
@@ -280,13 +328,12 @@ void opt_lsm_engine::load(const statement& st) {
   //LOG_INFO("Load");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(after_rec);
 
   // Add log entry
   entry_stream.str("");
@@ -295,11 +342,10 @@ void opt_lsm_engine::load(const statement& st) {
 
   entry_str = entry_stream.str();
   size_t entry_str_sz = entry_str.size() + 1;
-  char* entry = new char[entry_str_sz];
-  memcpy(entry, entry_str.c_str(), entry_str_sz);
+  char* entry = (char*) pmalloc(entry_str_sz*sizeof(char));
+  PM_MEMCPY((entry), (entry_str.c_str()), (entry_str_sz));
 
-  // Activate new record
-  pmemalloc_activate(after_rec);
+  // Activate data of new record
   after_rec->persist_data();
 
   // Add log entry
@@ -308,8 +354,7 @@ void opt_lsm_engine::load(const statement& st) {
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(after_rec);
 
     indices->at(index_itr)->pm_map->insert(key, after_rec);
   }
@@ -317,38 +362,91 @@ void opt_lsm_engine::load(const statement& st) {
 
 void opt_lsm_engine::merge_check() {
   if (++merge_looper % conf.merge_interval == 0) {
-    merge(false);
+    // The merge thread is still busy with the last frozen mem tables
+    if (!merge_pending)
+      freeze(false);
     merge_looper = 0;
   }
 }
 
-void opt_lsm_engine::merge(bool force) {
-  //std::std::cerr << "Merging ! " << merge_looper << std::endl;
+// Live entry of key in the frozen mem table of an index, or NULL
+record* opt_lsm_engine::frozen_at(table_index* index, unsigned long key) {
+  record* rec = NULL;
 
-  std::vector<table*> tables = db->tables->get_data();
-  for (table* tab : tables) {
-    table_index *p_index = tab->indices->at(0);
-    std::vector<table_index*> indices = tab->indices->get_data();
+  index->frozen_map->at(key, &rec);
+  return rec;
+}
 
+// Hands the mem tables due for a merge to the merge thread
+void opt_lsm_engine::freeze(bool force) {
+  std::lock_guard<std::mutex> merge_guard(merge_mutex);
+  bool frozen = false;
+
+  for (table* tab : *db->tables) {
+    table_index *p_index = tab->indices->at(0);
     pbtree<unsigned long, record*>* pm_map = p_index->pm_map;
 
     size_t compact_threshold = conf.merge_ratio * p_index->off_map->size();
     bool compact = (pm_map->size() > compact_threshold);
 
-    // Check if need to merge
-    if (force || compact) {
-      pbtree<unsigned long, record*>::const_iterator itr;
-      record *pm_rec, *fs_rec;
-      unsigned long key;
-      off_t storage_offset;
-      std::string val;
-      char ptr_buf[32];
-
-      // All tuples in table
-      for (itr = pm_map->begin(); itr != pm_map->end(); itr++) {
+    if (pm_map->empty() || !(force || compact))
+      continue;
+
+    // The empty frozen map becomes the mem table
+    for (table_index* index : *tab->indices) {
+      pbtree<unsigned long, record*>* frozen_map = index->frozen_map;
+      PM_EQU((index->frozen_map), (index->pm_map));
+      PM_EQU((index->pm_map), (frozen_map));
+    }
+    frozen = true;
+  }
+
+  if (frozen)
+    merge_pending = true;
+}
+
+// Merges the frozen mem tables into storage
+void opt_lsm_engine::merge() {
+  std::chrono::microseconds batch_budget(
+      1000000L * OPT_LSM_MERGE_BATCH / OPT_LSM_MERGE_RATE);
+
+  for (table* tab : *db->tables) {
+    table_index *p_index = tab->indices->at(0);
+    pvector<table_index*>& indices = *tab->indices;
+
+    pbtree<unsigned long, record*>* frozen_map = p_index->frozen_map;
+    if (frozen_map->empty())
+      continue;
+
+    pbtree<unsigned long, record*>::const_iterator itr;
+    record *pm_rec, *fs_rec;
+    unsigned long key;
+    off_t storage_offset;
+    std::string val;
+    char ptr_buf[32];
+
+    unsigned long num_tuples = 0, num_bytes = 0;
+    timer merge_t;
+    merge_t.start();
+
+    std::unique_lock<std::mutex> merge_guard(merge_mutex);
+
+    // Executors only null out entries, so the iterator stays valid while
+    // the mutex is released between batches
+    itr = frozen_map->begin();
+    while (itr != frozen_map->end()) {
+      auto batch_start = std::chrono::steady_clock::now();
+
+      for (int batch_itr = 0;
+          batch_itr < OPT_LSM_MERGE_BATCH && itr != frozen_map->end();
+          batch_itr++, itr++) {
         key = (*itr).first;
         pm_rec = (*itr).second;
 
+        // Removed after the freeze
+        if (pm_rec == NULL)
+          continue;
+
         fs_rec = NULL;
 
         // Check if we need to merge
@@ -364,6 +462,14 @@ void opt_lsm_engine::merge(bool force) {
           for (int field_itr = 0; field_itr < num_cols; field_itr++) {
             fs_rec->set_data(field_itr, pm_rec);
           }
+          num_bytes += pm_rec->data_len;
+
+          // Later updates go to storage
+          for (table_index* index : indices) {
+            unsigned long index_key = index->get_key(pm_rec);
+            if (frozen_at(index, index_key) == pm_rec)
+              index->frozen_map->update(index_key, fs_rec);
+          }
 
         } else {
           // Insert tuple
@@ -372,28 +478,58 @@ void opt_lsm_engine::merge(bool force) {
           //LOG_INFO("Merge :: insert new :: val :: %s ", val.c_str());
 
           storage_offset = tab->fs_data.push_back(val);
+          num_bytes += val.size();
 
           for (table_index* index : indices) {
-            std::string key_str = sr.serialize(pm_rec, index->sptr);
-            key = hash_fn(key_str);
+            key = index->get_key(pm_rec);
             index->off_map->insert(key, storage_offset);
           }
         }
+
+        num_tuples++;
       }
 
-      // Clear mem table
-      for (table_index* index : indices)
-        index->pm_map->clear();
+      // Pace the merge, executors take the mutex meanwhile
+      merge_guard.unlock();
+      auto batch_time = std::chrono::steady_clock::now() - batch_start;
+      if (batch_time < batch_budget)
+        std::this_thread::sleep_for(batch_budget - batch_time);
+      merge_guard.lock();
     }
+
+    // Clear frozen mem table
+    for (table_index* index : indices)
+      index->frozen_map->clear();
+
+    merge_guard.unlock();
+    merge_t.end();
+
+    if (conf.verbose)
+      std::cerr << "OPT_LSM :: Merge duration (ms) : " << merge_t.duration()
+                << " tuples : " << num_tuples << " bytes : " << num_bytes
+                << std::endl;
   }
+}
 
-  // Truncate log
-  if (force)
-    pm_log->clear();
+void opt_lsm_engine::merger() {
 
+  while (true) {
+    if (merge_pending) {
+      merge();
+      merge_pending = false;
+      continue;
+    }
+
+    if (!ready)
+      break;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(conf.gc_interval));
+  }
 }
 
 void opt_lsm_engine::txn_begin() {
+  if (!read_only)
+    pmemalloc_batch_begin();
 }
 
 void opt_lsm_engine::txn_end(__attribute__((unused)) bool commit) {
@@ -401,10 +537,11 @@ void opt_lsm_engine::txn_end(__attribute__((unused)) bool commit) {
   if (read_only)
     return;
 
+  // Activate objects of this txn
+  pmemalloc_batch_end();
+
   // Clear commit_free list
-  for (void* ptr : commit_free_list) {
-    delete  (char*) ptr;
-  }
+  pfree_batch(commit_free_list.data(), commit_free_list.size());
   commit_free_list.clear();
 
   merge_check();
@@ -414,12 +551,12 @@ void opt_lsm_engine::recovery() {
 
   LOG_INFO("OPT LSM recovery");
 
-  std::vector<char*> undo_log = pm_log->get_data();
+  pvector<char*>& undo_log = *pm_log;
 
   int op_type, txn_id, table_id;
   unsigned int num_indices, index_itr;
   table *tab;
-  plist<table_index*>* indices;
+  pvector<table_index*>* indices;
 
   std::string ptr_str;
 
@@ -457,9 +594,7 @@ void opt_lsm_engine::recovery() {
 
         // Remove entry in indices
         for (index_itr = 0; index_itr < num_indices; index_itr++) {
-          std::string key_str = sr.serialize(after_rec,
-                                             indices->at(index_itr)->sptr);
-          unsigned long key = hash_fn(key_str);
+          unsigned long key = indices->at(index_itr)->get_key(after_rec);
 
           indices->at(index_itr)->pm_map->erase(key);
         }
@@ -484,13 +619,11 @@ void opt_lsm_engine::recovery() {
         indices = tab->indices;
         num_indices = tab->num_indices;
 
-        tab->pm_data->push_back(after_rec);
+        tab->pm_data->push_back(before_rec);
 
         // Fix entry in indices to point to before_rec
         for (index_itr = 0; index_itr < num_indices; index_itr++) {
-          std::string key_str = sr.serialize(before_rec,
-                                             indices->at(index_itr)->sptr);
-          unsigned long key = hash_fn(key_str);
+          unsigned long key = indices->at(index_itr)->get_key(before_rec);
 
           indices->at(index_itr)->pm_map->insert(key, before_rec);
         }
@@ -499,13 +632,13 @@ void opt_lsm_engine::recovery() {
       case operation_type::Update:
         LOG_INFO("Undo Update");
         int num_fields;
-        int field_itr;
+        int field_itr, num_itr;
 
         entry >> num_fields >> ptr_str;
         std::sscanf(ptr_str.c_str(), "%p", &before_rec);
         //printf("before rec :: --%p-- \n", before_rec);
 
-        for (field_itr = 0; field_itr < num_fields; field_itr++) {
+        for (num_itr = 0; num_itr < num_fields; num_itr++) {
           entry >> field_itr;
 
           tab = db->tables->at(table_id);
@@ -540,7 +673,18 @@ void opt_lsm_engine::recovery() {
               case field_type::DOUBLE:
                 double dval;
                 entry >> dval;
-                before_rec->set_int(field_itr, dval);
+                before_rec->set_double(field_itr, dval);
+                break;
+
+              case field_type::VARCHAR: {
+                size_t vc_len;
+                entry >> vc_len;
+                entry.get();
+
+                std::string vc_str(vc_len, '\0');
+                entry.read(&vc_str[0], vc_len);
+                before_rec->set_varchar(field_itr, vc_str);
+              }
                 break;
 
               default:
@@ -59,47 +59,53 @@ opt_sp_engine::~opt_sp_engine() {
 }
 
 std::string opt_sp_engine::select(const statement& st) {
+  record_view view;
+  std::string value;
+
+  if (select(st, view))
+    value = sr.serialize(view.get(), st.projection);
+  LOG_INFO("val : %s", value.c_str());
+
+  return value;
+}
+
+bool opt_sp_engine::select(const statement& st, record_view& view) {
   LOG_INFO("Select");
   record* rec_ptr = st.rec_ptr;
-  record* select_ptr;
+  record* select_ptr = NULL;
   struct cow_btval key, val;
 
   table* tab = db->tables->at(st.table_id);
   table_index* table_index = tab->indices->at(st.table_index_id);
-  std::string key_str = sr.serialize(rec_ptr, table_index->sptr);
 
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id,
+  unsigned long key_id = hasher(table_index->get_key(rec_ptr), st.table_id,
                                 st.table_index_id);
   std::string comp_key_str = std::to_string(key_id);
   key.data = (void*) comp_key_str.c_str();
   key.size = comp_key_str.size();
-  std::string value;
 
   // Read from latest clean version
-  if (bt->at(txn_ptr, &key, &val) != BT_FAIL) {
+  if (bt->at(txn_ptr, &key, &val) != BT_FAIL)
     memcpy(&select_ptr, val.data, sizeof(record*));
-    value = sr.serialize(select_ptr, st.projection);
-  }
-
-  LOG_INFO("val : %s", value.c_str());
+  view.borrow(select_ptr);
 
   delete rec_ptr;
-  return value;
+  return !view.empty();
 }
 
 int opt_sp_engine::insert(const statement& st) {
   LOG_INFO("Insert");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   struct cow_btval key, val;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id, 0);
-  key_str = std::to_string(key_id);
+  unsigned long key_id = hasher(indices->at(0)->get_key(after_rec),
+                                st.table_id, 0);
+  std::string key_str = std::to_string(key_id);
   key.data = (void*) key_str.c_str();
   key.size = key_str.size();
 
@@ -120,8 +126,8 @@ int opt_sp_engine::insert(const statement& st) {
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key_id = hasher(hash_fn(key_str), st.table_id, index_itr);
+    key_id = hasher(indices->at(index_itr)->get_key(after_rec),
+                    st.table_id, index_itr);
     key_str = std::to_string(key_id);
 
     key.data = (void*) key_str.c_str();
@@ -138,15 +144,15 @@ int opt_sp_engine::remove(const statement& st) {
   LOG_INFO("Remove");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   struct cow_btval key, val;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id, 0);
-  key_str = std::to_string(key_id);
+  unsigned long key_id = hasher(indices->at(0)->get_key(rec_ptr),
+                                st.table_id, 0);
+  std::string key_str = std::to_string(key_id);
 
   key.data = (void*) key_str.c_str();
   key.size = key_str.size();
@@ -163,8 +169,8 @@ int opt_sp_engine::remove(const statement& st) {
 
   // Remove entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(rec_ptr, indices->at(index_itr)->sptr);
-    key_id = hasher(hash_fn(key_str), st.table_id, index_itr);
+    key_id = hasher(indices->at(index_itr)->get_key(rec_ptr),
+                    st.table_id, index_itr);
     key_str = std::to_string(key_id);
 
     key.data = (void*) key_str.c_str();
@@ -183,15 +189,15 @@ int opt_sp_engine::update(const statement& st) {
   LOG_INFO("Update");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   struct cow_btval key, val, update_val;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id, 0);
-  key_str = std::to_string(key_id);
+  unsigned long key_id = hasher(indices->at(0)->get_key(rec_ptr),
+                                st.table_id, 0);
+  std::string key_str = std::to_string(key_id);
   key.data = (void*) key_str.c_str();
   key.size = key_str.size();
 
@@ -233,8 +239,8 @@ int opt_sp_engine::update(const statement& st) {
 
   // Update entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key_id = hasher(hash_fn(key_str), st.table_id, index_itr);
+    key_id = hasher(indices->at(index_itr)->get_key(after_rec),
+                    st.table_id, index_itr);
     key_str = std::to_string(key_id);
 
     key.data = (void*) key_str.c_str();
@@ -255,15 +261,15 @@ void opt_sp_engine::load(const statement& st) {
   //LOG_INFO("Load");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   struct cow_btval key, val;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id, 0);
-  key_str = std::to_string(key_id);
+  unsigned long key_id = hasher(indices->at(0)->get_key(after_rec),
+                                st.table_id, 0);
+  std::string key_str = std::to_string(key_id);
 
   // Activate new record
   pmemalloc_activate(after_rec);
@@ -275,8 +281,8 @@ void opt_sp_engine::load(const statement& st) {
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key_id = hasher(hash_fn(key_str), st.table_id, index_itr);
+    key_id = hasher(indices->at(index_itr)->get_key(after_rec),
+                    st.table_id, index_itr);
     key_str = std::to_string(key_id);
 
     key.data = (void*) key_str.c_str();
@@ -9,11 +9,13 @@ bool _read_only,
                                unsigned int _tid)
     : conf(_conf),
       db(_db),
+      versions(_db->versions),
+      epochs(_db->epochs),
       tid(_tid) {
 
   etype = engine_type::OPT_WAL;
   read_only = _read_only;
-  pm_log = db->log;
+  pm_log = db->get_log(tid);
 
 }
 
@@ -22,36 +24,57 @@ opt_wal_engine::~opt_wal_engine() {
 }
 
 std::string opt_wal_engine::select(const statement& st) {
+  record_view view;
+  std::string val;
+
+  if (select(st, view))
+    val = sr.serialize(view.get(), st.projection);
+  LOG_INFO("val : %s", val.c_str());
+
+  return val;
+}
+
+bool opt_wal_engine::select(const statement& st, record_view& view) {
   LOG_INFO("Select");
   record* rec_ptr = st.rec_ptr;
   record* select_ptr = NULL;
   table* tab = db->tables->at(st.table_id);
   table_index* table_index = tab->indices->at(st.table_index_id);
-  std::string key_str = sr.serialize(rec_ptr, table_index->sptr);
 
-  unsigned long key = hash_fn(key_str);
-  std::string val;
+  unsigned long key = table_index->get_key(rec_ptr);
 
   table_index->pm_map->at(key, &select_ptr);
-  if (select_ptr)
-    val = sr.serialize(select_ptr, st.projection);
-  LOG_INFO("val : %s", val.c_str());
+
+  if (select_ptr && snapshot) {
+    // Copy of the current version, or an older one
+    record* scratch = new record(select_ptr->sptr);
+    select_ptr = versions->read(select_ptr, snapshot_ts, scratch);
+
+    if (select_ptr == scratch) {
+      view.own(scratch, false);
+    } else {
+      delete scratch;
+      view.borrow(select_ptr);
+    }
+  } else {
+    view.borrow(select_ptr);
+  }
 
   delete rec_ptr;
-  return val;
+  return !view.empty();
 }
 
 int opt_wal_engine::insert(const statement& st) {
   //LOG_INFO("Insert");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(after_rec);
+  latch_guard latch(db->latches, st.table_id, key);
 
   // Check if key exists
   if (indices->at(0)->pm_map->exists(key) != 0) {
@@ -77,12 +100,16 @@ int opt_wal_engine::insert(const statement& st) {
   pmemalloc_activate(after_rec);
   after_rec->persist_data();
 
+  if (versions != NULL) {
+    versions->install_new(after_rec);
+    inserted.push_back(after_rec);
+  }
+
   tab->pm_data->push_back(after_rec);
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(after_rec);
 
     indices->at(index_itr)->pm_map->insert(key, after_rec);
   }
@@ -94,13 +121,13 @@ int opt_wal_engine::remove(const statement& st) {
   LOG_INFO("Remove");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(rec_ptr);
+  latch_guard latch(db->latches, st.table_id, key);
   record* before_rec = NULL;
 
   // Check if key does not exist
@@ -136,8 +163,7 @@ int opt_wal_engine::remove(const statement& st) {
 
   // Remove entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(rec_ptr, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(rec_ptr);
 
     indices->at(index_itr)->pm_map->erase(key);
   }
@@ -149,10 +175,10 @@ int opt_wal_engine::remove(const statement& st) {
 int opt_wal_engine::update(const statement& st) {
   LOG_INFO("Update");
   record* rec_ptr = st.rec_ptr;
-  plist<table_index*>* indices = db->tables->at(st.table_id)->indices;
+  pvector<table_index*>* indices = db->tables->at(st.table_id)->indices;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(rec_ptr);
+  latch_guard latch(db->latches, st.table_id, key);
   record* before_rec;
 
   // Check if key exists. If not, return. There is nothing to update.
@@ -176,6 +202,13 @@ int opt_wal_engine::update(const statement& st) {
 
       entry_stream << field_itr << " " << before_field << " ";
     }
+    // Inlined varchar, its length first as it may hold spaces
+    else if (rec_ptr->sptr->columns[field_itr].type == field_type::VARCHAR) {
+      const char* before_vc = before_rec->get_varchar(field_itr);
+
+      entry_stream << field_itr << " " << strlen(before_vc) << " "
+                   << before_vc << " ";
+    }
     // Data field
     else {
       std::string before_data = before_rec->get_data(field_itr);
@@ -194,6 +227,10 @@ int opt_wal_engine::update(const statement& st) {
   pmemalloc_activate(entry);
   pm_log->push_back(entry);
 
+  // Keep the committed version for snapshots
+  if (versions != NULL && versions->install(before_rec))
+    versioned.push_back(before_rec);
+
   for (int field_itr : st.field_ids) {
     // Garbage collect previous field
     if (rec_ptr->sptr->columns[field_itr].inlined == 0) {
@@ -213,12 +250,11 @@ void opt_wal_engine::load(const statement& st) {
   //LOG_INFO("Load");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(after_rec);
 
   // Add log entry
   entry_stream.str("");
@@ -238,8 +274,7 @@ void opt_wal_engine::load(const statement& st) {
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(after_rec);
 
     indices->at(index_itr)->pm_map->insert(key, after_rec);
   }
@@ -248,173 +283,275 @@ void opt_wal_engine::load(const statement& st) {
 
 void opt_wal_engine::txn_begin() {
 	PM_START_TX();
+
+  // Records and index nodes stay allocated until txn_end
+  if (epochs != NULL)
+    epochs->enter();
+
+  if (!read_only)
+    pmemalloc_batch_begin();
+}
+
+void opt_wal_engine::txn_begin_read_only() {
+  if (versions == NULL) {
+    txn_begin();
+    return;
+  }
+
+  PM_START_TX();
+  if (epochs != NULL)
+    epochs->enter();
+
+  snapshot = true;
+  snapshot_ts = versions->begin_snapshot(tid);
 }
 
-void opt_wal_engine::txn_end(__attribute__((unused)) bool commit) {
+void opt_wal_engine::txn_end(bool commit) {
+
+  if (snapshot) {
+    versions->end_snapshot(tid);
+    snapshot = false;
+    if (epochs != NULL)
+      epochs->exit();
+    PM_END_TX();
+    return;
+  }
 
   if (read_only)
   {
+    if (epochs != NULL)
+      epochs->exit();
 	PM_END_TX();
 	return;
   }
 
-  // Clear commit_free list
-  for (void* ptr : commit_free_list) {
-    delete (char*) ptr;
+  // Roll back an aborted txn, newest change first
+  if (!commit)
+    rollback();
+
+  // Activate objects of this txn before the undo log goes away
+  pmemalloc_batch_end();
+
+  // Clear commit_free list, an aborted txn keeps the old versions
+  if (versions != NULL) {
+    end_versions(commit);
+  } else if (commit && epochs != NULL) {
+    for (void* ptr : commit_free_list)
+      epochs->retire(ptr);
+  } else if (commit) {
+    pfree_batch(commit_free_list.data(), commit_free_list.size());
   }
   commit_free_list.clear(); // STL Vector, not plist
 
   // Clear log
-  std::vector<char*> undo_log = pm_log->get_data();
+  pvector<char*>& undo_log = *pm_log;
   for (char* ptr : undo_log)
     delete ptr;
   pm_log->clear(); // This gives non-volatile accesses
   PM_FENCE();
+
+  if (epochs != NULL)
+    epochs->exit();
   PM_END_TX();
 
 }
 
+// Stamps the records of a committed txn, or drops the versions an aborted
+// one saved. Old versions and freed objects wait for the snapshots that may
+// still read them.
+void opt_wal_engine::end_versions(bool commit) {
+
+  if (commit && !(inserted.empty() && versioned.empty()
+      && commit_free_list.empty())) {
+    uint64_t commit_ts = versions->commit_begin();
+
+    for (record* rec : inserted)
+      versions->publish(rec, commit_ts);
+    for (record* rec : versioned)
+      versions->publish(rec, commit_ts);
+    versions->commit_end(commit_ts);
+
+    for (record* rec : versioned)
+      versions->retire(tid, rec->older, true, commit_ts);
+    for (void* ptr : commit_free_list)
+      versions->retire(tid, ptr, false, commit_ts);
+  } else if (!commit) {
+    for (record* rec : versioned)
+      versions->revert(tid, rec);
+  }
+
+  inserted.clear();
+  versioned.clear();
+  versions->collect(tid);
+
+}
+
 void opt_wal_engine::recovery() {
 
   LOG_INFO("OPT WAL recovery");
 
-  std::vector<char*> undo_log = pm_log->get_data();
+  timer rec_t;
+  rec_t.start();
+
+  rollback();
+
+  // Clear log
+  pvector<char*>& undo_log = *pm_log;
+  for (char* ptr : undo_log)
+    delete ptr;
+  pm_log->clear();
+
+  rec_t.end();
+  std::cerr << "OPT_WAL :: Recovery duration (ms) : " << rec_t.duration() << std::endl;
+
+}
+
+// Undo the log newest entry first, so a field changed twice gets its oldest
+// value back
+void opt_wal_engine::rollback() {
+
+  for (int entry_itr = pm_log->size() - 1; entry_itr >= 0; entry_itr--)
+    undo(pm_log->at(entry_itr));
+
+}
+
+void opt_wal_engine::undo(char* ptr) {
 
   int op_type, txn_id, table_id;
   unsigned int num_indices, index_itr;
   table *tab;
-  plist<table_index*>* indices;
+  pvector<table_index*>* indices;
 
   std::string ptr_str;
   record *before_rec, *after_rec;
   field_info finfo;
 
-  timer rec_t;
-  rec_t.start();
+  std::stringstream entry(ptr);
 
-  for (char* ptr : undo_log) {
-    //std::cerr << "entry : --" << ptr << "-- " << std::endl;
-    std::stringstream entry(ptr);
+  entry >> txn_id >> op_type >> table_id;
 
-    entry >> txn_id >> op_type >> table_id;
+  switch (op_type) {
+    case operation_type::Insert:
+      LOG_INFO("Undo Insert");
+      entry >> ptr_str;
+      std::sscanf(ptr_str.c_str(), "%p", &after_rec);
 
-    switch (op_type) {
-      case operation_type::Insert:
-        LOG_INFO("Undo Insert");
-        entry >> ptr_str;
-        std::sscanf(ptr_str.c_str(), "%p", &after_rec);
+      tab = db->tables->at(table_id);
+      indices = tab->indices;
+      num_indices = tab->num_indices;
 
-        tab = db->tables->at(table_id);
-        indices = tab->indices;
-        num_indices = tab->num_indices;
+      tab->pm_data->erase(after_rec);
 
-        tab->pm_data->erase(after_rec);
+      // Remove entry in indices
+      for (index_itr = 0; index_itr < num_indices; index_itr++) {
+        unsigned long key = indices->at(index_itr)->get_key(after_rec);
 
-        // Remove entry in indices
-        for (index_itr = 0; index_itr < num_indices; index_itr++) {
-          std::string key_str = sr.serialize(after_rec,
-                                             indices->at(index_itr)->sptr);
-          unsigned long key = hash_fn(key_str);
+        indices->at(index_itr)->pm_map->erase(key);
+      }
 
-          indices->at(index_itr)->pm_map->erase(key);
-        }
-
-        // Free after_rec
-        after_rec->clear_data();
+      // Free after_rec, snapshots may still look at it
+      after_rec->clear_data();
+      if (versions != NULL) {
+        versions->retire(tid, after_rec, true, versions->current_tag());
+      } else if (epochs != NULL) {
+        epochs->retire(after_rec->data);
+        epochs->retire(after_rec);
+      } else {
         delete after_rec;
-        break;
+      }
+      break;
 
-      case operation_type::Delete:
-        LOG_INFO("Undo Delete");
-        entry >> ptr_str;
-        std::sscanf(ptr_str.c_str(), "%p", &before_rec);
+    case operation_type::Delete:
+      LOG_INFO("Undo Delete");
+      entry >> ptr_str;
+      std::sscanf(ptr_str.c_str(), "%p", &before_rec);
 
-        tab = db->tables->at(table_id);
-        indices = tab->indices;
-        num_indices = tab->num_indices;
+      tab = db->tables->at(table_id);
+      indices = tab->indices;
+      num_indices = tab->num_indices;
 
-        tab->pm_data->push_back(after_rec);
+      tab->pm_data->push_back(before_rec);
 
-        // Fix entry in indices to point to before_rec
-        for (index_itr = 0; index_itr < num_indices; index_itr++) {
-          std::string key_str = sr.serialize(before_rec,
-                                             indices->at(index_itr)->sptr);
-          unsigned long key = hash_fn(key_str);
+      // Fix entry in indices to point to before_rec
+      for (index_itr = 0; index_itr < num_indices; index_itr++) {
+        unsigned long key = indices->at(index_itr)->get_key(before_rec);
 
-          indices->at(index_itr)->pm_map->insert(key, before_rec);
-        }
-        break;
+        indices->at(index_itr)->pm_map->insert(key, before_rec);
+      }
+      break;
 
-      case operation_type::Update:
-        LOG_INFO("Undo Update");
-        int num_fields;
-        int field_itr;
+    case operation_type::Update:
+      LOG_INFO("Undo Update");
+      int num_fields;
+      int field_itr, num_itr;
 
-        entry >> num_fields >> ptr_str;
-        std::sscanf(ptr_str.c_str(), "%p", &before_rec);
-        //printf("before rec :: --%p-- \n", before_rec);
+      entry >> num_fields >> ptr_str;
+      std::sscanf(ptr_str.c_str(), "%p", &before_rec);
+      //printf("before rec :: --%p-- \n", before_rec);
 
-        for (field_itr = 0; field_itr < num_fields; field_itr++) {
-          entry >> field_itr;
+      for (num_itr = 0; num_itr < num_fields; num_itr++) {
+        entry >> field_itr;
 
-          tab = db->tables->at(table_id);
-          indices = tab->indices;
-          finfo = before_rec->sptr->columns[field_itr];
+        tab = db->tables->at(table_id);
+        indices = tab->indices;
+        finfo = before_rec->sptr->columns[field_itr];
 
-          // Pointer
-          if (finfo.inlined == 0) {
-            LOG_INFO("Pointer ");
-            void *before_field, *after_field;
+        // Pointer
+        if (finfo.inlined == 0) {
+          LOG_INFO("Pointer ");
+          void *before_field, *after_field;
 
-            entry >> ptr_str;
-            std::sscanf(ptr_str.c_str(), "%p", &before_field);
+          entry >> ptr_str;
+          std::sscanf(ptr_str.c_str(), "%p", &before_field);
 
-            after_field = before_rec->get_pointer(field_itr);
-            before_rec->set_pointer(field_itr, before_field);
+          after_field = before_rec->get_pointer(field_itr);
+          before_rec->set_pointer(field_itr, before_field);
 
-            // Free after_field
-            delete ((char*) after_field);
-          }
-          // Data
-          else {
-            LOG_INFO("Inlined ");
-            field_type type = finfo.type;
-
-            switch (type) {
-              case field_type::INTEGER:
-                int ival;
-                entry >> ival;
-                before_rec->set_int(field_itr, ival);
-                break;
-
-              case field_type::DOUBLE:
-                double dval;
-                entry >> dval;
-                before_rec->set_int(field_itr, dval);
-                break;
-
-              default:
-                std::cerr << "Invalid field type : " << op_type << std::endl;
-                break;
+          // Free after_field
+          delete ((char*) after_field);
+        }
+        // Data
+        else {
+          LOG_INFO("Inlined ");
+          field_type type = finfo.type;
+
+          switch (type) {
+            case field_type::INTEGER:
+              int ival;
+              entry >> ival;
+              before_rec->set_int(field_itr, ival);
+              break;
+
+            case field_type::DOUBLE:
+              double dval;
+              entry >> dval;
+              before_rec->set_double(field_itr, dval);
+              break;
+
+            case field_type::VARCHAR: {
+              size_t vc_len;
+              entry >> vc_len;
+              entry.get();
+
+              std::string vc_str(vc_len, '\0');
+              entry.read(&vc_str[0], vc_len);
+              before_rec->set_varchar(field_itr, vc_str);
             }
+              break;
+
+            default:
+              std::cerr << "Invalid field type : " << op_type << std::endl;
+              break;
           }
         }
-        break;
+      }
+      break;
 
-      default:
-        std::cerr << "Invalid operation type" << op_type << std::endl;
-        break;
-    }
-
-    delete ptr;
+    default:
+      std::cerr << "Invalid operation type" << op_type << std::endl;
+      break;
   }
 
-  // Clear log
-  pm_log->clear();
-
-  rec_t.end();
-  std::cerr << "OPT_WAL :: Recovery duration (ms) : " << rec_t.duration() << std::endl;
-
 }
 
 }
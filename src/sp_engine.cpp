@@ -51,9 +51,8 @@ std::string sp_engine::select(const statement& st) {
   struct cow_btval key, val;
   table* tab = db->tables->at(st.table_id);
   table_index* table_index = tab->indices->at(st.table_index_id);
-  std::string key_str = sr.serialize(rec_ptr, table_index->sptr);
 
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id,
+  unsigned long key_id = hasher(table_index->get_key(rec_ptr), st.table_id,
                                 st.table_index_id);
   std::string comp_key_str = std::to_string(key_id);
   key.data = (void*) comp_key_str.c_str();
@@ -75,15 +74,15 @@ int sp_engine::insert(const statement& st) {
   LOG_INFO("Insert");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   struct cow_btval key, val;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id, 0);
-  key_str = std::to_string(key_id);
+  unsigned long key_id = hasher(indices->at(0)->get_key(after_rec),
+                                st.table_id, 0);
+  std::string key_str = std::to_string(key_id);
 
   key.data = (void*) key_str.c_str();
   key.size = key_str.size();
@@ -101,8 +100,8 @@ int sp_engine::insert(const statement& st) {
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key_id = hasher(hash_fn(key_str), st.table_id, index_itr);
+    key_id = hasher(indices->at(index_itr)->get_key(after_rec),
+                    st.table_id, index_itr);
     key_str = std::to_string(key_id);
 
     key.data = (void*) key_str.c_str();
@@ -120,15 +119,15 @@ int sp_engine::remove(const statement& st) {
   LOG_INFO("Remove");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   struct cow_btval key, val;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id, 0);
-  key_str = std::to_string(key_id);
+  unsigned long key_id = hasher(indices->at(0)->get_key(rec_ptr),
+                                st.table_id, 0);
+  std::string key_str = std::to_string(key_id);
   key.data = (void*) key_str.c_str();
   key.size = key_str.size();
 
@@ -140,8 +139,8 @@ int sp_engine::remove(const statement& st) {
 
   // Remove entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(rec_ptr, indices->at(index_itr)->sptr);
-    key_id = hasher(hash_fn(key_str), st.table_id, index_itr);
+    key_id = hasher(indices->at(index_itr)->get_key(rec_ptr),
+                    st.table_id, index_itr);
     key_str = std::to_string(key_id);
 
     key.data = (void*) key_str.c_str();
@@ -158,14 +157,15 @@ int sp_engine::update(const statement& st) {
   LOG_INFO("Update");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   struct cow_btval key, val, update_val;
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
+  std::string key_str;
 
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id, 0);
+  unsigned long key_id = hasher(indices->at(0)->get_key(rec_ptr),
+                                st.table_id, 0);
   key_str = std::to_string(key_id);
   key.data = (void*) key_str.c_str();
   key.size = key_str.size();
@@ -195,8 +195,8 @@ int sp_engine::update(const statement& st) {
 
   // Update entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(before_rec, indices->at(index_itr)->sptr);
-    key_id = hasher(hash_fn(key_str), st.table_id, index_itr);
+    key_id = hasher(indices->at(index_itr)->get_key(before_rec),
+                    st.table_id, index_itr);
     key_str = std::to_string(key_id);
 
     key.data = (void*) key_str.c_str();
@@ -217,15 +217,15 @@ void sp_engine::load(const statement& st) {
   //LOG_INFO("Load");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   struct cow_btval key, val;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key_id = hasher(hash_fn(key_str), st.table_id, 0);
-  key_str = std::to_string(key_id);
+  unsigned long key_id = hasher(indices->at(0)->get_key(after_rec),
+                                st.table_id, 0);
+  std::string key_str = std::to_string(key_id);
 
   std::string after_tuple = sr.serialize(after_rec, after_rec->sptr);
 
@@ -234,8 +234,8 @@ void sp_engine::load(const statement& st) {
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key_id = hasher(hash_fn(key_str), st.table_id, index_itr);
+    key_id = hasher(indices->at(index_itr)->get_key(after_rec),
+                    st.table_id, index_itr);
     key_str = std::to_string(key_id);
 
     key.data = (void*) key_str.c_str();
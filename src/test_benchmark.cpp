@@ -38,7 +38,8 @@ table* create_testtable(config& conf) {
 
 	for (int itr = 1; itr <= conf.ycsb_num_val_fields; itr++) {
 		field_info val = field_info(offset, 12, conf.ycsb_field_size,
-				field_type::VARCHAR, 0, 1);
+				field_type::VARCHAR,
+				varchar_inlined(conf.ycsb_field_size, conf.inline_threshold), 1);
 		offset += val.ser_len;
 		cols.push_back(val);
 	}
@@ -335,14 +336,17 @@ void test_benchmark::sim_crash() {
 	delete ee;
 }
 
-void test_benchmark::execute() {
-	engine* ee = new engine(conf, tid, db, conf.read_only);
-	unsigned int txn_itr;
-        status ss(num_txns);
+void test_benchmark::execute_begin() {
+	ee = new engine(conf, tid, db, conf.read_only);
+	progress = status(num_txns);
 
 	std::cerr << "num_txns :: " << num_txns << std::endl;
+}
 
-	for (txn_itr = 0; txn_itr < num_txns; txn_itr++) {
+void test_benchmark::execute_txns(unsigned int begin, unsigned int end) {
+	unsigned int txn_itr;
+
+	for (txn_itr = begin; txn_itr < end; txn_itr++) {
 		switch(conf.test_benchmark_mode) {
 		case 0:
 			do_read(ee);
@@ -367,9 +371,11 @@ void test_benchmark::execute() {
 
 
                 if (tid == 0)
-                    ss.display();
+                    progress.display();
 	}
+}
 
+void test_benchmark::execute_end() {
 	if(tid == 0)
 	{
 		std::cerr <<"---------------------------------------------------"<<std::endl;
@@ -403,6 +409,7 @@ void test_benchmark::execute() {
 	}
 
 	delete ee;
+	ee = NULL;
 }
 
 }
@@ -27,30 +27,36 @@ tpcc_benchmark::tpcc_benchmark(config _conf, unsigned int tid, database* _db,
   // Partition workload
   num_txns = conf.num_txns / conf.num_executors;
 
+  stats.set_types({"delivery", "new_order", "order_status", "payment",
+                   "stock_level"});
+
   // Initialization mode
   if (sp->init == 0) {
     //cerr << "Initialization Mode" << endl;
 
     sp->ptrs[0] = db;
 
-    table* item_table = create_item();
-    db->tables->push_back(item_table);
-    table* warehouse_table = create_warehouse();
-    db->tables->push_back(warehouse_table);
-    table* district_table = create_district();
-    db->tables->push_back(district_table);
-    table* customer_table = create_customer();
-    db->tables->push_back(customer_table);
-    table* orders_table = create_orders();
-    db->tables->push_back(orders_table);
-    table* order_line_table = create_order_line();
-    db->tables->push_back(order_line_table);
-    table* new_order_table = create_new_order();
-    db->tables->push_back(new_order_table);
-    table* history_table = create_history();
-    db->tables->push_back(history_table);
-    table* stock_table = create_stock();
-    db->tables->push_back(stock_table);
+    // The first executor creates the tables of a shared database
+    if (db->tables->empty()) {
+      table* item_table = create_item();
+      db->tables->push_back(item_table);
+      table* warehouse_table = create_warehouse();
+      db->tables->push_back(warehouse_table);
+      table* district_table = create_district();
+      db->tables->push_back(district_table);
+      table* customer_table = create_customer();
+      db->tables->push_back(customer_table);
+      table* orders_table = create_orders();
+      db->tables->push_back(orders_table);
+      table* order_line_table = create_order_line();
+      db->tables->push_back(order_line_table);
+      table* new_order_table = create_new_order();
+      db->tables->push_back(new_order_table);
+      table* history_table = create_history();
+      db->tables->push_back(history_table);
+      table* stock_table = create_stock();
+      db->tables->push_back(stock_table);
+    }
 
     sp->init = 1;
   } else {
@@ -69,7 +75,19 @@ tpcc_benchmark::tpcc_benchmark(config _conf, unsigned int tid, database* _db,
   history_table_schema = db->tables->at(HISTORY_TABLE_ID)->sptr;
   stock_table_schema = db->tables->at(STOCK_TABLE_ID)->sptr;
 
-  uniform(uniform_dist, num_txns);
+  create_query_schemas();
+
+  uniform(uniform_dist, num_txns, conf.shared_db ? tid : 0);
+
+  warehouse_count = conf.tpcc_num_warehouses;
+
+  // A shared database holds the warehouses of all executors, and a
+  // transaction picks any of them
+  if (conf.shared_db) {
+    warehouse_count = conf.tpcc_num_warehouses * conf.num_executors;
+    first_warehouse = tid;
+    warehouse_stride = conf.num_executors;
+  }
 
   if (conf.recovery) {
     num_txns = conf.num_txns;
@@ -133,15 +151,18 @@ table* tpcc_benchmark::create_warehouse() {
   cols.push_back(field);
 
   for (int f_itr = 1; f_itr <= 4; f_itr++) {
-    field = field_info(offset, 12, name_len, field_type::VARCHAR, 0, 1);
+    field = field_info(offset, 12, name_len, field_type::VARCHAR,
+                       varchar_inlined(name_len, conf.inline_threshold), 1);
     offset += field.ser_len;
     cols.push_back(field);
   }
 
-  field = field_info(offset, 12, zip_len, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, zip_len, field_type::VARCHAR,
+                     varchar_inlined(zip_len, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
-  field = field_info(offset, 12, state_len, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, state_len, field_type::VARCHAR,
+                     varchar_inlined(state_len, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
 
@@ -232,12 +253,14 @@ table* tpcc_benchmark::create_district() {
   cols.push_back(field);
 
   for (int f_itr = 2; f_itr <= 5; f_itr++) {
-    field = field_info(offset, 12, name_len, field_type::VARCHAR, 0, 1);
+    field = field_info(offset, 12, name_len, field_type::VARCHAR,
+                       varchar_inlined(name_len, conf.inline_threshold), 1);
     offset += field.ser_len;
     cols.push_back(field);
   }
   for (int f_itr = 6; f_itr <= 7; f_itr++) {
-    field = field_info(offset, 12, name_len, field_type::VARCHAR, 0, 1);
+    field = field_info(offset, 12, name_len, field_type::VARCHAR,
+                       varchar_inlined(name_len, conf.inline_threshold), 1);
     offset += field.ser_len;
     cols.push_back(field);
   }
@@ -316,13 +339,15 @@ table* tpcc_benchmark::create_item() {
   field = field_info(offset, 10, 10, field_type::INTEGER, 1, 1);
   offset += field.ser_len;
   cols.push_back(field);
-  field = field_info(offset, 12, name_len, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, name_len, field_type::VARCHAR,
+                     varchar_inlined(name_len, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
   field = field_info(offset, 15, 15, field_type::DOUBLE, 1, 1);
   offset += field.ser_len;
   cols.push_back(field);
-  field = field_info(offset, 12, 64, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, 64, field_type::VARCHAR,
+                     varchar_inlined(64, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
 
@@ -434,24 +459,29 @@ table* tpcc_benchmark::create_customer() {
   }
 
   for (int f_itr = 3; f_itr <= 8; f_itr++) {
-    field = field_info(offset, 12, name_len, field_type::VARCHAR, 0, 1);
+    field = field_info(offset, 12, name_len, field_type::VARCHAR,
+                       varchar_inlined(name_len, conf.inline_threshold), 1);
     offset += field.ser_len;
     cols.push_back(field);
   }
 
-  field = field_info(offset, 12, zip_len, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, zip_len, field_type::VARCHAR,
+                     varchar_inlined(zip_len, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
-  field = field_info(offset, 12, state_len, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, state_len, field_type::VARCHAR,
+                     varchar_inlined(state_len, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
-  field = field_info(offset, 12, 32, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, 32, field_type::VARCHAR,
+                     varchar_inlined(32, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
   field = field_info(offset, 15, 15, field_type::DOUBLE, 1, 1);
   offset += field.ser_len;
   cols.push_back(field);
-  field = field_info(offset, 12, 2, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, 2, field_type::VARCHAR,
+                     varchar_inlined(2, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
 
@@ -465,7 +495,8 @@ table* tpcc_benchmark::create_customer() {
     offset += field.ser_len;
     cols.push_back(field);
   }
-  field = field_info(offset, 12, 500, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, 500, field_type::VARCHAR,
+                     varchar_inlined(500, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
 
@@ -501,15 +532,6 @@ table* tpcc_benchmark::create_customer() {
   pmemalloc_activate(s_index);
   customer->indices->push_back(s_index);
 
-  // QUERY SCHEMAS
-  for (unsigned int itr = 0; itr < cols.size(); itr++)
-    cols[itr].enabled = 0;
-  cols[3].enabled = 1;
-  cols[13].enabled = 1;
-  cols[15].enabled = 1;
-
-  customer_do_new_order_schema = new schema(cols);
-
   return customer;
 }
 
@@ -568,7 +590,8 @@ table* tpcc_benchmark::create_history() {
     offset += field.ser_len;
     cols.push_back(field);
   }
-  field = field_info(offset, 12, 32, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, 32, field_type::VARCHAR,
+                     varchar_inlined(32, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
 
@@ -587,7 +610,7 @@ table* tpcc_benchmark::create_history() {
   schema* history_index_schema = new ((schema*) pmalloc(sizeof(schema))) schema(cols);
   pmemalloc_activate(history_index_schema);
 
-  table_index* p_index = new ((table_index*) pmalloc(sizeof(table_index*))) table_index(history_index_schema, cols.size(),
+  table_index* p_index = new ((table_index*) pmalloc(sizeof(table_index))) table_index(history_index_schema, cols.size(),
                                          conf, sp);
   pmemalloc_activate(p_index);
   history->indices->push_back(p_index);
@@ -621,6 +644,33 @@ class stock_record : public record {
 
 };
 
+// Built by every executor, as the tables may come from another executor or
+// from before a crash
+void tpcc_benchmark::create_query_schemas() {
+  std::vector<field_info> cols;
+
+  // CUSTOMER
+  cols.assign(customer_table_schema->columns,
+              customer_table_schema->columns
+                  + customer_table_schema->num_columns);
+  for (unsigned int itr = 0; itr < cols.size(); itr++)
+    cols[itr].enabled = 0;
+  cols[3].enabled = 1;
+  cols[13].enabled = 1;
+  cols[15].enabled = 1;
+
+  customer_do_new_order_schema = new schema(cols);
+
+  // STOCK
+  cols.assign(stock_table_schema->columns,
+              stock_table_schema->columns + stock_table_schema->num_columns);
+  for (unsigned int itr = 0; itr < cols.size(); itr++)
+    cols[itr].enabled = 0;
+  cols[2].enabled = 1;
+
+  stock_table_do_stock_level_schema = new schema(cols);
+}
+
 table* tpcc_benchmark::create_stock() {
 
   std::vector<field_info> cols;
@@ -658,7 +708,8 @@ table* tpcc_benchmark::create_stock() {
     cols.push_back(field);
   }
   for (int f_itr = 3; f_itr <= 12; f_itr++) {
-    field = field_info(offset, 12, 32, field_type::VARCHAR, 0, 1);
+    field = field_info(offset, 12, 32, field_type::VARCHAR,
+                       varchar_inlined(32, conf.inline_threshold), 1);
     offset += field.ser_len;
     cols.push_back(field);
   }
@@ -667,7 +718,8 @@ table* tpcc_benchmark::create_stock() {
     offset += field.ser_len;
     cols.push_back(field);
   }
-  field = field_info(offset, 12, 64, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, 64, field_type::VARCHAR,
+                     varchar_inlined(64, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
 
@@ -691,13 +743,6 @@ table* tpcc_benchmark::create_stock() {
   pmemalloc_activate(p_index);
   stock->indices->push_back(p_index);
 
-  // QUERY SCHEMA
-  for (unsigned int itr = 0; itr < cols.size(); itr++)
-    cols[itr].enabled = 0;
-  cols[2].enabled = 1;
-
-  stock_table_do_stock_level_schema = new schema(cols);
-
   return stock;
 }
 
@@ -929,7 +974,8 @@ table* tpcc_benchmark::create_order_line() {
   field = field_info(offset, 15, 15, field_type::DOUBLE, 1, 1);
   offset += field.ser_len;
   cols.push_back(field);
-  field = field_info(offset, 12, 32, field_type::VARCHAR, 0, 1);
+  field = field_info(offset, 12, 32, field_type::VARCHAR,
+                     varchar_inlined(32, conf.inline_threshold), 1);
   offset += field.ser_len;
   cols.push_back(field);
 
@@ -988,9 +1034,6 @@ void tpcc_benchmark::load_items(engine* ee) {
     record* rec_ptr = new ((record*) pmalloc(sizeof(item_record))) item_record(item_table_schema, i_itr, i_im_id, name,
                                       price, 1);
 
-    std::string key_str = sr.serialize(rec_ptr, item_table_schema);
-    //LOG_INFO("item :: %s ", key_str.c_str());
-
     statement st(txn_id, operation_type::Insert, ITEM_TABLE_ID, rec_ptr);
 
     ee->load(st);
@@ -1018,7 +1061,8 @@ void tpcc_benchmark::load_warehouses(engine* ee) {
   status ss(num_warehouses * districts_per_warehouse);
 
   // WAREHOUSE
-  for (w_itr = 0; w_itr < num_warehouses; w_itr++) {
+  for (w_itr = first_warehouse; w_itr < num_warehouses;
+      w_itr += warehouse_stride) {
     txn_id++;
     ee->txn_begin();
 
@@ -1169,7 +1213,6 @@ void tpcc_benchmark::load_warehouses(engine* ee) {
               new_order_table_schema, o_itr, d_itr, w_itr, 1);
 
           log_str = sr.serialize(new_order_rec_ptr, new_order_table_schema);
-          LOG_INFO("new_order ::%s", log_str.c_str());
 
           st = statement(txn_id, operation_type::Insert, NEW_ORDER_TABLE_ID,
                          new_order_rec_ptr);
@@ -1260,8 +1303,11 @@ void tpcc_benchmark::load_warehouses(engine* ee) {
 void tpcc_benchmark::load() {
   engine* ee = new engine(conf, tid, db, false);
 
-  LOG_INFO("Load items ");
-  load_items(ee);
+  // Items are shared by all warehouses
+  if (!conf.shared_db || tid == 0) {
+    LOG_INFO("Load items ");
+    load_items(ee);
+  }
 
   LOG_INFO("Load warehouses ");
   load_warehouses(ee);
@@ -1283,6 +1329,7 @@ void tpcc_benchmark::do_delivery(engine* ee) {
 
   record* rec_ptr;
   statement st;
+  int rc;
   std::vector<int> field_ids;
   std::string empty('x',3);
 
@@ -1294,7 +1341,7 @@ void tpcc_benchmark::do_delivery(engine* ee) {
   int w_id = get_rand_int(0, warehouse_count);
   int o_carrier_id = get_rand_int(orders_min_carrier_id, orders_max_carrier_id);
   double ol_delivery_ts = static_cast<double>(time(NULL));
-  std::string new_order_str, orders_str, order_line_str, customer_str;
+  record_view new_order_view, orders_view, order_line_view, customer_view;
 
   for (d_itr = 0; d_itr < districts_per_warehouse; d_itr++) {
     LOG_INFO("d_itr :: %d  w_id :: %d ", d_itr, w_id);
@@ -1305,23 +1352,25 @@ void tpcc_benchmark::do_delivery(engine* ee) {
     st = statement(txn_id, operation_type::Select, NEW_ORDER_TABLE_ID, rec_ptr,
                    0, new_order_table_schema);
 
-    TIMER(new_order_str = ee->select(st))
+    TIMER(ee->select(st, new_order_view))
 
-    if (new_order_str.empty()) {
+    if (new_order_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("new_order :: %s", new_order_str.c_str());
 
     // deleteNewOrder
-    rec_ptr = sr.deserialize(new_order_str, new_order_table_schema);
-
-    int o_id = std::stoi(rec_ptr->get_data(0));
+    int o_id = new_order_view.get_int(0);
+    rec_ptr = new_order_view.copy();
     LOG_INFO("o_id :: %d ", o_id);
 
     st = statement(txn_id, operation_type::Delete, NEW_ORDER_TABLE_ID, rec_ptr);
 
-    ee->remove(st);
+    TIMER(rc = ee->remove(st));
+    if (rc != 0) {
+      TIMER(ee->txn_end(false));
+      return;
+    }
 
     // getCId
     rec_ptr = new orders_record(orders_table_schema, o_id, 0, d_itr, w_id, 0, 0,
@@ -1330,18 +1379,15 @@ void tpcc_benchmark::do_delivery(engine* ee) {
     st = statement(txn_id, operation_type::Select, ORDERS_TABLE_ID, rec_ptr, 0,
                    orders_table_schema);
 
-    TIMER(orders_str = ee->select(st))
+    TIMER(ee->select(st, orders_view))
 
-    if (orders_str.empty()) {
+    if (orders_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("orders :: %s ", orders_str.c_str());
-    // Get a persistent record since we are going to insert it 
-    rec_ptr = sr.deserialize(orders_str, orders_table_schema); // freud : no need of persistence since all fields
-								// in orders_are inlined
-
-    int c_id = std::stoi(rec_ptr->get_data(1));
+    // No need of persistence since all fields in orders are inlined
+    int c_id = orders_view.get_int(1);
+    rec_ptr = orders_view.copy();
 
     LOG_INFO("c_id :: %d ", c_id);
 
@@ -1353,7 +1399,11 @@ void tpcc_benchmark::do_delivery(engine* ee) {
     st = statement(txn_id, operation_type::Update, ORDERS_TABLE_ID, rec_ptr,
                    field_ids);
 
-    TIMER(ee->update(st));
+    TIMER(rc = ee->update(st));
+    if (rc != 0) {
+      TIMER(ee->txn_end(false));
+      return;
+    }
 
     // updateOrderLine
     double ol_ts = static_cast<double>(time(NULL));
@@ -1367,7 +1417,11 @@ void tpcc_benchmark::do_delivery(engine* ee) {
     st = statement(txn_id, operation_type::Update, ORDER_LINE_TABLE_ID, rec_ptr,
                    field_ids);
 
-    TIMER(ee->update(st));
+    TIMER(rc = ee->update(st));
+    if (rc != 0) {
+      TIMER(ee->txn_end(false));
+      return;
+    }
 
     //sumOLAmount
     rec_ptr = new order_line_record(order_line_table_schema, o_id, d_itr, w_id,
@@ -1376,17 +1430,14 @@ void tpcc_benchmark::do_delivery(engine* ee) {
     st = statement(txn_id, operation_type::Select, ORDER_LINE_TABLE_ID, rec_ptr,
                    0, order_line_table_schema);
 
-    TIMER(order_line_str = ee->select(st))
+    TIMER(ee->select(st, order_line_view))
 
-    if (order_line_str.empty()) {
+    if (order_line_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("order_line :: %s ", order_line_str.c_str());
-
-    rec_ptr = sr.deserialize(order_line_str, order_line_table_schema);
 
-    double ol_amount = std::stod(rec_ptr->get_data(8));
+    double ol_amount = order_line_view.get_double(8);
     LOG_INFO("ol_amount :: %.2lf ", ol_amount);
 
     // updateCustomer
@@ -1398,17 +1449,16 @@ void tpcc_benchmark::do_delivery(engine* ee) {
     st = statement(txn_id, operation_type::Update, CUSTOMER_TABLE_ID, rec_ptr,
                    0, customer_table_schema);
 
-    TIMER(customer_str = ee->select(st))
+    TIMER(ee->select(st, customer_view))
 
-    if (customer_str.empty()) {
+    if (customer_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("customer :: %s ", customer_str.c_str());
-    // Get a persistent record since we are going to insert it into the DB
-    rec_ptr = sr.deserialize(customer_str, customer_table_schema, 1);
+    double orig_balance = customer_view.get_double(16);  // balance
 
-    double orig_balance = std::stod(rec_ptr->get_data(16));  // balance
+    // Get a persistent record since we are going to insert it into the DB
+    rec_ptr = customer_view.copy(1);
     LOG_INFO("orig_balance :: %.2lf ", orig_balance);
 
     field_ids = {16};  // ol_ts
@@ -1418,7 +1468,11 @@ void tpcc_benchmark::do_delivery(engine* ee) {
     st = statement(txn_id, operation_type::Update, CUSTOMER_TABLE_ID, rec_ptr,
                    field_ids);
 
-    TIMER(ee->update(st));
+    TIMER(rc = ee->update(st));
+    if (rc != 0) {
+      TIMER(ee->txn_end(false));
+      return;
+    }
   }
 
   TIMER(ee->txn_end(true));
@@ -1445,6 +1499,7 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
 
   record* rec_ptr;
   statement st;
+  int rc;
   std::vector<int> field_ids;
   std::string empty('x',3);
   std::vector<std::string> empty_v(10);
@@ -1456,11 +1511,12 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
   double o_entry_ts = static_cast<double>(time(NULL));
   std::vector<int> i_ids, i_w_ids, i_qtys;
   int o_all_local = 1;
-  std::string warehouse_str, district_str, customer_str, item_str, stock_str;
+  record_view warehouse_view, district_view, customer_view, item_view,
+      stock_view;
 
   for (int ol_itr = 0; ol_itr < o_ol_cnt; ol_itr++) {
     i_ids.push_back(get_rand_int(0, item_count));
-    bool remote = get_rand_bool(0.01);
+    bool remote = get_rand_bool(0.01) && warehouse_count > 1;
     i_w_ids.push_back(w_id);
 
     if (remote) {
@@ -1486,17 +1542,14 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
   st = statement(txn_id, operation_type::Select, WAREHOUSE_TABLE_ID, rec_ptr, 0,
                  warehouse_table_schema);
 
-  TIMER(warehouse_str = ee->select(st))
+  TIMER(ee->select(st, warehouse_view))
 
-  if (warehouse_str.empty()) {
+  if (warehouse_view.empty()) {
     TIMER(ee->txn_end(false));
     return;
   }
-  LOG_INFO("warehouse ::  %s", warehouse_str.c_str());
 
-  rec_ptr = sr.deserialize(warehouse_str, warehouse_table_schema);
-
-  double w_tax = std::stod(rec_ptr->get_data(7));
+  double w_tax = warehouse_view.get_double(7);
 
   LOG_INFO("w_tax :: %.2lf ", w_tax);
 
@@ -1507,18 +1560,15 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
   st = statement(txn_id, operation_type::Select, DISTRICT_TABLE_ID, rec_ptr, 0,
                  district_table_schema);
 
-  TIMER(district_str = ee->select(st))
+  TIMER(ee->select(st, district_view))
 
-  if (district_str.empty()) {
+  if (district_view.empty()) {
     TIMER(ee->txn_end(false));
     return;
   }
-  LOG_INFO("district :: %s ", district_str.c_str());
-
-  rec_ptr = sr.deserialize(district_str, district_table_schema, 1);
 
-  double d_tax = std::stod(rec_ptr->get_data(8));
-  int d_next_o_id = std::stoi(rec_ptr->get_data(10));
+  double d_tax = district_view.get_double(8);
+  int d_next_o_id = district_view.get_int(10);
   int o_id = d_next_o_id;
 
   LOG_INFO("d_tax :: %.2lf ", d_tax);
@@ -1530,6 +1580,7 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
 
   // incrementNextOrderId
 
+  rec_ptr = district_view.copy(1);
   rec_ptr->set_int(10, d_next_o_id + 1);
 
   field_ids = {10};
@@ -1537,7 +1588,11 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
   st = statement(txn_id, operation_type::Update, DISTRICT_TABLE_ID, rec_ptr,
                  field_ids);
 
-  TIMER(ee->update(st));
+  TIMER(rc = ee->update(st));
+  if (rc != 0) {
+    TIMER(ee->txn_end(false));
+    return;
+  }
 
   // getCustomer
   rec_ptr = new customer_record(customer_table_schema, c_id, d_id, w_id, empty,
@@ -1547,17 +1602,14 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
   st = statement(txn_id, operation_type::Select, CUSTOMER_TABLE_ID, rec_ptr, 0,
                  customer_do_new_order_schema);
 
-  TIMER(customer_str = ee->select(st))
+  TIMER(ee->select(st, customer_view))
 
-  if (customer_str.empty()) {
+  if (customer_view.empty()) {
     TIMER(ee->txn_end(false));
     return;
   }
-  LOG_INFO("customer :: %s ", customer_str.c_str());
-
-  rec_ptr = sr.deserialize(customer_str, customer_table_schema);
 
-  double c_discount = std::stod(rec_ptr->get_data(15));
+  double c_discount = customer_view.get_double(15);
   LOG_INFO("c_discount :: %.2lf ", c_discount);
 
   // createOrder
@@ -1569,7 +1621,11 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
 
   st = statement(txn_id, operation_type::Insert, ORDERS_TABLE_ID, rec_ptr);
 
-  TIMER(ee->insert(st));
+  TIMER(rc = ee->insert(st));
+  if (rc != 0) {
+    TIMER(ee->txn_end(false));
+    return;
+  }
 
   // createNewOrder
 
@@ -1577,7 +1633,11 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
 
   st = statement(txn_id, operation_type::Insert, NEW_ORDER_TABLE_ID, rec_ptr);
 
-  TIMER(ee->insert(st));
+  TIMER(rc = ee->insert(st));
+  if (rc != 0) {
+    TIMER(ee->txn_end(false));
+    return;
+  }
 
   // ----------------
   // Insert Order Item Information
@@ -1597,18 +1657,15 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
     st = statement(txn_id, operation_type::Select, ITEM_TABLE_ID, rec_ptr, 0,
                    item_table_schema);
 
-    TIMER(item_str = ee->select(st))
+    TIMER(ee->select(st, item_view))
 
-    if (item_str.empty()) {
+    if (item_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("item :: %s ", item_str.c_str());
-
-    rec_ptr = sr.deserialize(item_str, item_table_schema);
 
-    std::string i_name = rec_ptr->get_data(2);
-    double i_price = std::stod(rec_ptr->get_data(3));
+    std::string i_name = item_view.get_varchar(2);
+    double i_price = item_view.get_double(3);
 
     // getStockInfo
 
@@ -1618,21 +1675,18 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
     st = statement(txn_id, operation_type::Select, STOCK_TABLE_ID, rec_ptr, 0,
                    stock_table_schema);
 
-    TIMER(stock_str = ee->select(st))
+    TIMER(ee->select(st, stock_view))
 
-    if (stock_str.empty()) {
+    if (stock_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("stock :: %s", stock_str.c_str());
-
-    rec_ptr = sr.deserialize(stock_str, stock_table_schema, 1);
 
-    int s_quantity = std::stoi(rec_ptr->get_data(2));
-    int s_ytd = std::stoi(rec_ptr->get_data(13));
-    int s_order_cnt = std::stoi(rec_ptr->get_data(14));
-    int s_remote_cnt = std::stoi(rec_ptr->get_data(15));
-    std::string s_ol_data = rec_ptr->get_data(16);
+    int s_quantity = stock_view.get_int(2);
+    int s_ytd = stock_view.get_int(13);
+    int s_order_cnt = stock_view.get_int(14);
+    int s_remote_cnt = stock_view.get_int(15);
+    std::string s_ol_data = stock_view.get_varchar(16);
 
     // updateStock
     s_ytd += ol_quantity;
@@ -1645,6 +1699,7 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
     if (ol_supply_w_id != w_id)
       s_remote_cnt += 1;
 
+    rec_ptr = stock_view.copy(1);
     rec_ptr->set_int(2, s_quantity);
     rec_ptr->set_int(13, s_ytd);
     rec_ptr->set_int(14, s_order_cnt);
@@ -1655,7 +1710,11 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
     st = statement(txn_id, operation_type::Update, STOCK_TABLE_ID, rec_ptr,
                    field_ids);
 
-    TIMER(ee->update(st));
+    TIMER(rc = ee->update(st));
+    if (rc != 0) {
+      TIMER(ee->txn_end(false));
+      return;
+    }
 
     // createOrderLine
 
@@ -1669,7 +1728,11 @@ void tpcc_benchmark::do_new_order(engine* ee, bool finish) {
     st = statement(txn_id, operation_type::Insert, ORDER_LINE_TABLE_ID,
                    rec_ptr);
 
-    TIMER(ee->insert(st));
+    TIMER(rc = ee->insert(st));
+    if (rc != 0) {
+      TIMER(ee->txn_end(false));
+      return;
+    }
 
     ol_total += ol_amount;
   }
@@ -1704,7 +1767,7 @@ void tpcc_benchmark::do_order_status(engine* ee) {
   std::vector<std::string> empty_v(10);
 
   txn_id++;
-  TIMER(ee->txn_begin());
+  TIMER(ee->txn_begin_read_only());
 
   unsigned int d_itr = 0;
 
@@ -1713,7 +1776,7 @@ void tpcc_benchmark::do_order_status(engine* ee) {
   int c_id = get_rand_int(0, customers_per_district);
   std::string c_name = get_rand_astring(name_len);
   bool lookup_by_name = get_rand_bool(0.8);
-  std::string customer_str, orders_str, order_line_str;
+  record_view customer_view, orders_view, order_line_view;
 
   if (lookup_by_name) {
     // getCustomerByCustomerId
@@ -1724,13 +1787,12 @@ void tpcc_benchmark::do_order_status(engine* ee) {
     st = statement(txn_id, operation_type::Select, CUSTOMER_TABLE_ID, rec_ptr,
                    0, customer_table_schema);
 
-    TIMER(customer_str = ee->select(st))
+    TIMER(ee->select(st, customer_view))
 
-    if (customer_str.empty()) {
+    if (customer_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("customer :: %s ", customer_str.c_str());
   } else {
 // getCustomerByLastName
     rec_ptr = new customer_record(customer_table_schema, 0, d_id, w_id, c_name,
@@ -1740,17 +1802,14 @@ void tpcc_benchmark::do_order_status(engine* ee) {
     st = statement(txn_id, operation_type::Select, CUSTOMER_TABLE_ID, rec_ptr,
                    1, customer_table_schema);
 
-    TIMER(customer_str = ee->select(st))
+    TIMER(ee->select(st, customer_view))
 
-    if (customer_str.empty()) {
+    if (customer_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("customer by name :: %s ", customer_str.c_str());
 
-    rec_ptr = sr.deserialize(customer_str, customer_table_schema);
-
-    c_id = std::stoi(rec_ptr->get_data(0));
+    c_id = customer_view.get_int(0);
 
     LOG_INFO("c_id :: %d", c_id);
   }
@@ -1762,20 +1821,17 @@ void tpcc_benchmark::do_order_status(engine* ee) {
   st = statement(txn_id, operation_type::Select, ORDERS_TABLE_ID, rec_ptr, 1,
                  orders_table_schema);
 
-  TIMER(orders_str = ee->select(st)
+  TIMER(ee->select(st, orders_view)
   ;
   )
 
-  if (orders_str.empty()) {
+  if (orders_view.empty()) {
     TIMER(ee->txn_end(false));
     return;
   }
 
-  LOG_INFO("orders :: %s ", orders_str.c_str());
-
-  rec_ptr = sr.deserialize(orders_str, orders_table_schema);
 
-  c_id = std::stoi(rec_ptr->get_data(0));
+  c_id = orders_view.get_int(0);
 
   LOG_INFO("c_id :: %d ", c_id);
 
@@ -1786,15 +1842,14 @@ void tpcc_benchmark::do_order_status(engine* ee) {
   st = statement(txn_id, operation_type::Select, ORDER_LINE_TABLE_ID, rec_ptr,
                  1, order_line_table_schema);
 
-  TIMER(order_line_str = ee->select(st);
+  TIMER(ee->select(st, order_line_view);
   )
 
-  if (order_line_str.empty()) {
+  if (order_line_view.empty()) {
     TIMER(ee->txn_end(false));
     return;
   }
 
-  LOG_INFO("order_line :: %s", order_line_str.c_str());
 
   TIMER(ee->txn_end(true));
 
@@ -1818,6 +1873,7 @@ void tpcc_benchmark::do_payment(engine* ee) {
 
   record* rec_ptr;
   statement st;
+  int rc;
   std::vector<int> field_ids;
   std::string empty('x',3);
 
@@ -1829,9 +1885,10 @@ void tpcc_benchmark::do_payment(engine* ee) {
   double h_ts = static_cast<double>(time(NULL));
   int c_w_id, c_d_id, c_id = 0;
   std::string c_name;
-  std::string customer_str;
+  record_view customer_view;
 
-  if (pay_local) {
+  // A remote customer needs another warehouse
+  if (pay_local || warehouse_count == 1) {
     c_w_id = w_id;
     c_d_id = d_id;
   } else {
@@ -1849,52 +1906,46 @@ void tpcc_benchmark::do_payment(engine* ee) {
 
   if (!pay_by_name) {
 // getCustomerByCustomerId
-    rec_ptr = new customer_record(customer_table_schema, c_id, d_id, w_id,
+    rec_ptr = new customer_record(customer_table_schema, c_id, c_d_id, c_w_id,
                                   empty, empty, empty, empty, 0, 0, 0, 0, 0, 0,
                                   0, empty);
 
     st = statement(txn_id, operation_type::Select, CUSTOMER_TABLE_ID, rec_ptr,
                    0, customer_table_schema);
 
-    TIMER(customer_str = ee->select(st))
+    TIMER(ee->select(st, customer_view))
 
-    if (customer_str.empty()) {
+    if (customer_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("customer :: %s ", customer_str.c_str());
   } else {
 // getCustomerByLastName
-    rec_ptr = new customer_record(customer_table_schema, 0, d_id, w_id, c_name,
-                                  empty, empty, empty, 0, 0, 0, 0, 0, 0, 0,
-                                  empty);
+    rec_ptr = new customer_record(customer_table_schema, 0, c_d_id, c_w_id,
+                                  c_name, empty, empty, empty, 0, 0, 0, 0, 0,
+                                  0, 0, empty);
 
     st = statement(txn_id, operation_type::Select, CUSTOMER_TABLE_ID, rec_ptr,
                    1, customer_table_schema);
 
-    TIMER(customer_str = ee->select(st))
+    TIMER(ee->select(st, customer_view))
 
-    if (customer_str.empty()) {
+    if (customer_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("customer by name :: %s", customer_str.c_str());
-
-    rec_ptr = sr.deserialize(customer_str, customer_table_schema);
 
-    c_id = std::stoi(rec_ptr->get_data(0));
+    c_id = customer_view.get_int(0);
 
     LOG_INFO("c_id :: %d ", c_id);
   }
 
-  rec_ptr = sr.deserialize(customer_str, customer_table_schema);
-
-  int c_balance = std::stoi(rec_ptr->get_data(16));
-  int c_ytd_payment = std::stoi(rec_ptr->get_data(17));
-  int c_payment_cnt = std::stoi(rec_ptr->get_data(18));
-  std::string c_data = rec_ptr->get_data(20);
-  std::string c_credit = rec_ptr->get_data(13);
-  std::string warehouse_str, district_str;
+  int c_balance = customer_view.get_double(16);
+  int c_ytd_payment = customer_view.get_double(17);
+  int c_payment_cnt = customer_view.get_int(18);
+  std::string c_data = customer_view.get_varchar(20);
+  std::string c_credit = customer_view.get_varchar(13);
+  record_view warehouse_view, district_view;
 
   c_balance -= h_amount;
   c_ytd_payment += h_amount;
@@ -1909,17 +1960,14 @@ void tpcc_benchmark::do_payment(engine* ee) {
   st = statement(txn_id, operation_type::Select, WAREHOUSE_TABLE_ID, rec_ptr, 0,
                  warehouse_table_schema);
 
-  TIMER(warehouse_str = ee->select(st))
+  TIMER(ee->select(st, warehouse_view))
 
-  if (warehouse_str.empty()) {
+  if (warehouse_view.empty()) {
     TIMER(ee->txn_end(false));
     return;
   }
-  LOG_INFO("warehouse :: %s ", warehouse_str.c_str());
-
-  rec_ptr = sr.deserialize(warehouse_str, warehouse_table_schema, 1);
 
-  double w_ytd = std::stod(rec_ptr->get_data(8));
+  double w_ytd = warehouse_view.get_double(8);
 
   LOG_INFO("w_ytd :: %.2lf ", w_ytd);
 
@@ -1927,6 +1975,7 @@ void tpcc_benchmark::do_payment(engine* ee) {
 
   w_ytd += h_amount;
 
+  rec_ptr = warehouse_view.copy(1);
   rec_ptr->set_double(8, w_ytd);
 
   field_ids = {8};  // w_ytd
@@ -1934,7 +1983,11 @@ void tpcc_benchmark::do_payment(engine* ee) {
   st = statement(txn_id, operation_type::Update, WAREHOUSE_TABLE_ID, rec_ptr,
                  field_ids);
 
-  TIMER(ee->update(st));
+  TIMER(rc = ee->update(st));
+  if (rc != 0) {
+    TIMER(ee->txn_end(false));
+    return;
+  }
 
 // getDistrict
   rec_ptr = new district_record(district_table_schema, d_id, w_id, empty, empty,
@@ -1943,18 +1996,15 @@ void tpcc_benchmark::do_payment(engine* ee) {
   st = statement(txn_id, operation_type::Select, DISTRICT_TABLE_ID, rec_ptr, 0,
                  district_table_schema);
 
-  TIMER(district_str = ee->select(st))
+  TIMER(ee->select(st, district_view))
 
-  if (district_str.empty()) {
+  if (district_view.empty()) {
     TIMER(ee->txn_end(false));
     return;
   }
 
-  LOG_INFO("district :: %s ", district_str.c_str());
-
-  rec_ptr = sr.deserialize(district_str, district_table_schema, 1);
 
-  double d_ytd = std::stod(rec_ptr->get_data(9));
+  double d_ytd = district_view.get_double(9);
 
   LOG_INFO("d_ytd :: %.2lf ", d_ytd);
 
@@ -1962,6 +2012,7 @@ void tpcc_benchmark::do_payment(engine* ee) {
 
   d_ytd += h_amount;
 
+  rec_ptr = district_view.copy(1);
   rec_ptr->set_double(9, d_ytd);
 
   field_ids = {9};  // w_ytd
@@ -1969,7 +2020,11 @@ void tpcc_benchmark::do_payment(engine* ee) {
   st = statement(txn_id, operation_type::Update, DISTRICT_TABLE_ID, rec_ptr,
                  field_ids);
 
-  TIMER(ee->update(st));
+  TIMER(rc = ee->update(st));
+  if (rc != 0) {
+    TIMER(ee->txn_end(false));
+    return;
+  }
 
   // Customer Credit Information
   LOG_INFO("c_credit :: %s ", c_credit.c_str());
@@ -1982,7 +2037,7 @@ void tpcc_benchmark::do_payment(engine* ee) {
             + std::to_string(w_id) + " " + std::to_string(c_d_id) + " "
             + std::to_string(c_w_id) + " " + std::to_string(h_amount));
 
-    rec_ptr = new ((record*) pmalloc(sizeof(customer_record))) customer_record(customer_table_schema, c_id, d_id, w_id,
+    rec_ptr = new ((record*) pmalloc(sizeof(customer_record))) customer_record(customer_table_schema, c_id, c_d_id, c_w_id,
                                   empty, empty, empty, empty, 0, 0, 0,
                                   c_balance, c_ytd_payment, c_payment_cnt, 0,
                                   c_data, 1);
@@ -1992,13 +2047,17 @@ void tpcc_benchmark::do_payment(engine* ee) {
     st = statement(txn_id, operation_type::Update, CUSTOMER_TABLE_ID, rec_ptr,
                    field_ids);
 
-    TIMER(ee->update(st));
+    TIMER(rc = ee->update(st));
+    if (rc != 0) {
+      TIMER(ee->txn_end(false));
+      return;
+    }
 
   } else {
 
 // updateGCCustomer
 
-    rec_ptr = new ((record*) pmalloc(sizeof(customer_record))) customer_record(customer_table_schema, c_id, d_id, w_id,
+    rec_ptr = new ((record*) pmalloc(sizeof(customer_record))) customer_record(customer_table_schema, c_id, c_d_id, c_w_id,
                                   empty, empty, empty, empty, 0, 0, 0,
                                   c_balance, c_ytd_payment, c_payment_cnt, 0,
                                   empty, 1);
@@ -2008,7 +2067,11 @@ void tpcc_benchmark::do_payment(engine* ee) {
     st = statement(txn_id, operation_type::Update, CUSTOMER_TABLE_ID, rec_ptr,
                    field_ids);
 
-    TIMER(ee->update(st));
+    TIMER(rc = ee->update(st));
+    if (rc != 0) {
+      TIMER(ee->txn_end(false));
+      return;
+    }
 
   }
 
@@ -2021,7 +2084,11 @@ void tpcc_benchmark::do_payment(engine* ee) {
 
   st = statement(txn_id, operation_type::Insert, HISTORY_TABLE_ID, rec_ptr);
 
-  TIMER(ee->insert(st));
+  TIMER(rc = ee->insert(st));
+  if (rc != 0) {
+    TIMER(ee->txn_end(false));
+    return;
+  }
 
   /* TPC-C 2.5.3.3: Must display the following fields:
    W_ID, D_ID, C_ID, C_D_ID, C_W_ID, W_STREET_1, W_STREET_2, W_CITY, W_STATE, W_ZIP,
@@ -2031,8 +2098,7 @@ void tpcc_benchmark::do_payment(engine* ee) {
    H_AMOUNT, and H_DATE.
    */
 
-  // Hand back all the warehouse, district, and customer data
-  std::string payment_str = warehouse_str + district_str + customer_str;
+  // The views hand back all the warehouse, district, and customer data
 
   TIMER(ee->txn_end(true));
 
@@ -2056,10 +2122,10 @@ void tpcc_benchmark::do_stock_level(engine* ee) {
   int w_id = get_rand_int(0, warehouse_count);
   int d_id = get_rand_int(0, districts_per_warehouse);
   int threshold = get_rand_int(stock_min_threshold, stock_max_threshold);
-  std::string district_str, order_line_str, stock_str;
+  record_view district_view, order_line_view, stock_view;
 
   txn_id++;
-  TIMER(ee->txn_begin());
+  TIMER(ee->txn_begin_read_only());
 
 // getOId
   rec_ptr = new district_record(district_table_schema, d_id, w_id, empty, empty,
@@ -2068,17 +2134,14 @@ void tpcc_benchmark::do_stock_level(engine* ee) {
   st = statement(txn_id, operation_type::Select, DISTRICT_TABLE_ID, rec_ptr, 0,
                  district_table_schema);
 
-  TIMER(district_str = ee->select(st))
+  TIMER(ee->select(st, district_view))
 
-  if (district_str.empty()) {
+  if (district_view.empty()) {
     TIMER(ee->txn_end(false));
     return;
   }
-  LOG_INFO("district :: %s ", district_str.c_str());
-
-  rec_ptr = sr.deserialize(district_str, district_table_schema);
 
-  int d_next_o_id = std::stoi(rec_ptr->get_data(10));
+  int d_next_o_id = district_view.get_int(10);
 
   LOG_INFO("d_next_o_id :: %d ", d_next_o_id);
 
@@ -2095,36 +2158,30 @@ void tpcc_benchmark::do_stock_level(engine* ee) {
     st = statement(txn_id, operation_type::Select, ORDER_LINE_TABLE_ID, rec_ptr,
                    1, order_line_table_schema);
 
-    TIMER(order_line_str = ee->select(st))
+    TIMER(ee->select(st, order_line_view))
 
-    if (order_line_str.empty())
+    if (order_line_view.empty())
       break;
 
-    LOG_INFO("order_line :: %s ", order_line_str.c_str());
-
-    rec_ptr = sr.deserialize(order_line_str, order_line_table_schema);
 
-    int s_i_id = std::stoi(rec_ptr->get_data(4));
+    int s_i_id = order_line_view.get_int(4);
 
     LOG_INFO("s_i_id :: %d ", s_i_id);
 
-    rec_ptr = new stock_record(stock_table_schema, o_id, w_id, 0, empty_v, 0, 0,
+    rec_ptr = new stock_record(stock_table_schema, s_i_id, w_id, 0, empty_v, 0, 0,
                                0, empty);
 
     st = statement(txn_id, operation_type::Select, STOCK_TABLE_ID, rec_ptr, 0,
                    stock_table_do_stock_level_schema);
 
-    TIMER(stock_str = ee->select(st))
+    TIMER(ee->select(st, stock_view))
 
-    if (stock_str.empty()) {
+    if (stock_view.empty()) {
       TIMER(ee->txn_end(false));
       return;
     }
-    LOG_INFO("stock :: %s ", stock_str.c_str());
 
-    rec_ptr = sr.deserialize(stock_str, stock_table_schema);
-
-    int s_quantity = std::stoi(rec_ptr->get_data(2));
+    int s_quantity = stock_view.get_int(2);
 
     LOG_INFO("s_quantity :: %d ", s_quantity);
 
@@ -2162,41 +2219,56 @@ void tpcc_benchmark::sim_crash() {
   delete ee;
 }
 
-void tpcc_benchmark::execute() {
-  engine* ee = new engine(conf, tid, db, false);
+void tpcc_benchmark::execute_begin() {
+  ee = new engine(conf, tid, db, false);
+  progress = status(num_txns);
+}
+
+void tpcc_benchmark::execute_txns(unsigned int begin, unsigned int end) {
   unsigned int txn_itr;
-  status ss(num_txns);
 
-  for (txn_itr = 0; txn_itr < num_txns; txn_itr++) {
+  for (txn_itr = begin; txn_itr < end; txn_itr++) {
     double u = uniform_dist[txn_itr];
+    int txn_type;
 
     if (conf.tpcc_stock_level_only) {
+      txn_type = STOCK_LEVEL_TXN;
       do_stock_level(ee);
     } else {
 
       if (u <= 0.04) {
         //std::cerr << "stock_level " << std::endl;
+        txn_type = STOCK_LEVEL_TXN;
         do_stock_level(ee);
       } else if (u <= 0.08) {
         //std::cerr << "delivery " << std::endl;
+        txn_type = DELIVERY_TXN;
         do_delivery(ee);
       } else if (u <= 0.12) {
         //std::cerr << "order_status " << std::endl;
+        txn_type = ORDER_STATUS_TXN;
         do_order_status(ee);
       } else if (u <= 0.55) {
         //std::cerr << "payment " << std::endl;
+        txn_type = PAYMENT_TXN;
         do_payment(ee);
       } else {
         //std::cerr << "new_order " << std::endl;
+        txn_type = NEW_ORDER_TXN;
         do_new_order(ee);
       }
     }
 
+    stats.record(txn_type, ee->committed);
+
     if (tid == 0)
-      ss.display();
+      progress.display();
   }
+}
 
+void tpcc_benchmark::execute_end() {
   delete ee;
+  ee = NULL;
 }
 
 }
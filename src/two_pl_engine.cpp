@@ -0,0 +1,199 @@
+// TWO-PHASE LOCKING
+
+#include "two_pl_engine.h"
+
+namespace storage {
+
+two_pl_engine::two_pl_engine(database* _db, engine_api* _de)
+    : db(_db),
+      de(_de),
+      locks(_db->locks),
+      aborted(false),
+      snapshot(false) {
+
+  etype = de->etype;
+
+}
+
+two_pl_engine::~two_pl_engine() {
+  release();
+  delete de;
+}
+
+int two_pl_engine::lock(unsigned int table_id, unsigned int index_id,
+                        unsigned long key, bool exclusive) {
+  unsigned long hash = key ^ ((unsigned long) table_id << 56)
+      ^ ((unsigned long) index_id << 48);
+  size_t slot = locks->slot_id(hash);
+  int rc;
+
+  // Locks are per slot, so a txn never conflicts with itself
+  for (held_lock& hl : held) {
+    if (hl.slot != slot)
+      continue;
+
+    if (hl.exclusive || !exclusive)
+      return 0;
+
+    rc = locks->tuple_upgrade(hl.hash);
+    if (rc == 0)
+      hl.exclusive = true;
+    return rc;
+  }
+
+  if (exclusive)
+    rc = locks->tuple_wrlock(hash);
+  else
+    rc = locks->tuple_rdlock(hash);
+
+  if (rc == 0)
+    held.push_back({slot, hash, exclusive});
+  return rc;
+}
+
+// Write locks on the keys of a record in every index
+int two_pl_engine::lock_all(const statement& st) {
+  table* tab = db->tables->at(st.table_id);
+  pvector<table_index*>* indices = tab->indices;
+  unsigned int num_indices = tab->num_indices;
+
+  for (unsigned int index_itr = 0; index_itr < num_indices; index_itr++) {
+    unsigned long key = indices->at(index_itr)->get_key(st.rec_ptr);
+
+    if (lock(st.table_id, index_itr, key, true) != 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+void two_pl_engine::release() {
+  for (held_lock& hl : held)
+    locks->tuple_unlock(hl.hash);
+
+  held.clear();
+}
+
+std::string two_pl_engine::select(const statement& st) {
+  // Snapshot reads take no locks
+  if (snapshot)
+    return de->select(st);
+
+  // A secondary select locks the record it finds, which needs its view
+  if (st.table_index_id != 0) {
+    record_view view;
+    std::string val;
+
+    if (select(st, view))
+      val = sr.serialize(view.get(), st.projection);
+
+    return val;
+  }
+
+  table_index* table_index = db->tables->at(st.table_id)->indices->at(
+      st.table_index_id);
+  unsigned long key = table_index->get_key(st.rec_ptr);
+
+  if (aborted || lock(st.table_id, st.table_index_id, key, false) != 0) {
+    aborted = true;
+    delete st.rec_ptr;
+    return std::string();
+  }
+
+  return de->select(st);
+}
+
+bool two_pl_engine::select(const statement& st, record_view& view) {
+  if (snapshot)
+    return de->select(st, view);
+
+  table_index* table_index = db->tables->at(st.table_id)->indices->at(
+      st.table_index_id);
+  unsigned long key = table_index->get_key(st.rec_ptr);
+
+  if (aborted || lock(st.table_id, st.table_index_id, key, false) != 0) {
+    aborted = true;
+    delete st.rec_ptr;
+    view.reset();
+    return false;
+  }
+
+  if (!de->select(st, view))
+    return false;
+
+  // The secondary key does not cover updates, lock the primary key too
+  if (st.table_index_id != 0) {
+    key = db->tables->at(st.table_id)->indices->at(0)->get_key(view.get());
+
+    if (lock(st.table_id, 0, key, false) != 0) {
+      aborted = true;
+      view.reset();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int two_pl_engine::update(const statement& st) {
+  table_index* table_index = db->tables->at(st.table_id)->indices->at(0);
+  unsigned long key = table_index->get_key(st.rec_ptr);
+
+  if (snapshot || aborted || lock(st.table_id, 0, key, true) != 0) {
+    aborted = true;
+    st.rec_ptr->clear_data();
+    delete st.rec_ptr;
+    return EXIT_FAILURE;
+  }
+
+  return de->update(st);
+}
+
+int two_pl_engine::insert(const statement& st) {
+  if (snapshot || aborted || lock_all(st) != 0) {
+    aborted = true;
+    st.rec_ptr->clear_data();
+    delete st.rec_ptr;
+    return EXIT_FAILURE;
+  }
+
+  return de->insert(st);
+}
+
+int two_pl_engine::remove(const statement& st) {
+  if (snapshot || aborted || lock_all(st) != 0) {
+    aborted = true;
+    delete st.rec_ptr;
+    return EXIT_FAILURE;
+  }
+
+  return de->remove(st);
+}
+
+void two_pl_engine::load(const statement& st) {
+  de->load(st);
+}
+
+void two_pl_engine::txn_begin() {
+  de->txn_begin();
+}
+
+void two_pl_engine::txn_begin_read_only() {
+  snapshot = (db->versions != NULL);
+  de->txn_begin_read_only();
+}
+
+void two_pl_engine::txn_end(bool commit) {
+  // Roll back while the locks still keep others out
+  de->txn_end(commit && !aborted);
+
+  release();
+  aborted = false;
+  snapshot = false;
+}
+
+void two_pl_engine::recovery() {
+  de->recovery();
+}
+
+}
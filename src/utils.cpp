@@ -152,6 +152,8 @@ namespace storage {
 
     // TIMER
 
+    std::atomic<unsigned long> num_log_syncs(0);
+
     void display_stats(engine_type etype, double duration, int num_txns) {
         double throughput;
 
@@ -240,8 +242,7 @@ namespace storage {
 
     // Simple skew generator
     void simple_skew(std::vector<int>& simple_dist, double alpha, int n,
-            int num_values) {
-        int seed = 0;
+            int num_values, int seed) {
         std::mt19937 gen(seed);
         std::uniform_real_distribution<> dis(0, 1);
         double i, z;
@@ -263,8 +264,7 @@ namespace storage {
         }
     }
 
-    void uniform(std::vector<double>& uniform_dist, int num_values) {
-        int seed = 0;
+    void uniform(std::vector<double>& uniform_dist, int num_values, int seed) {
         std::mt19937 gen(seed);
         std::uniform_real_distribution<> dis(0, 1);
         double i;
@@ -11,17 +11,19 @@ wal_engine::wal_engine(const config& _conf, database* _db, bool _read_only,
       tid(_tid) {
   etype = engine_type::WAL;
   read_only = _read_only;
-  fs_log.configure(conf.fs_path + std::to_string(_tid) + "_" + "log");
+  if (conf.slog == NULL) {
+    fs_log.configure(conf.fs_path + std::to_string(_tid) + "_" + "log");
+    requested_lsn = durable_lsn = fs_log.log_offset;
+  }
 
-  std::vector<table*> tables = db->tables->get_data();
-  for (table* tab : tables) {
+  for (table* tab : *db->tables) {
 	std::string table_file_name = conf.fs_path + std::to_string(_tid) + "_"
 			+ std::string(tab->table_name);
 	tab->fs_data.configure(table_file_name, tab->max_tuple_size, false);
   }
 
   // Logger start
-  if (!read_only) {
+  if (!read_only && conf.slog == NULL) {
     gc = std::thread(&wal_engine::group_commit, this);
     ready = true;
   }
@@ -31,55 +33,79 @@ wal_engine::~wal_engine() {
 
   // Logger end
   if (!read_only) {
-    ready = false;
-    gc.join();
+    if (gc.joinable()) {
+      gc_mutex.lock();
+      ready = false;
+      gc_cv.notify_all();
+      gc_mutex.unlock();
+      gc.join();
+    }
 
-    if (!conf.recovery) {
+    if (!conf.recovery && conf.slog == NULL) {
       fs_log.sync();
       fs_log.close();
     }
 
-    std::vector<table*> tables = db->tables->get_data();
-    for (table* tab : tables) {
+    for (table* tab : *db->tables) {
       tab->fs_data.sync();
       tab->fs_data.close();
     }
   }
 
+  // Commit latency percentiles of the execute phase
+  if (!loading && !commit_latencies.empty()) {
+    std::sort(commit_latencies.begin(), commit_latencies.end());
+    size_t num_commits = commit_latencies.size();
+
+    std::stringstream latency_str;
+    latency_str << std::fixed << std::setprecision(1);
+    latency_str << "WAL :: " << tid << " :: Commit latency (us) : ";
+    latency_str << "p50 " << commit_latencies[num_commits * 50 / 100] << " ";
+    latency_str << "p95 " << commit_latencies[num_commits * 95 / 100] << " ";
+    latency_str << "p99 " << commit_latencies[num_commits * 99 / 100] << " ";
+    latency_str << "max " << commit_latencies[num_commits - 1] << "\n";
+    std::cerr << latency_str.str();
+  }
+
 }
 
 std::string wal_engine::select(const statement& st) {
+  record_view view;
+  std::string val;
+
+  if (select(st, view))
+    val = sr.serialize(view.get(), st.projection);
+  LOG_INFO("val : %s", val.c_str());
+
+  return val;
+}
+
+bool wal_engine::select(const statement& st, record_view& view) {
   LOG_INFO("Select");
   record* rec_ptr = st.rec_ptr;
   record* select_ptr = NULL;
   table* tab = db->tables->at(st.table_id);
   table_index* table_index = tab->indices->at(st.table_index_id);
-  std::string key_str = sr.serialize(rec_ptr, table_index->sptr);
 
-  unsigned long key = hash_fn(key_str);
-  std::string val;
+  unsigned long key = table_index->get_key(rec_ptr);
 
   table_index->pm_map->at(key, &select_ptr);
-  if (select_ptr)
-    val = sr.serialize(select_ptr, st.projection);
-  LOG_INFO("val : %s", val.c_str());
+  view.borrow(select_ptr);
 
   delete rec_ptr;
-  return val;
+  return !view.empty();
 }
 
 int wal_engine::insert(const statement& st) {
   LOG_INFO("Insert");
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  LOG_INFO("key_str :: %s", key_str.c_str());
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(after_rec);
 
   // Check if key present
   if (indices->at(0)->pm_map->exists(key) != 0) {
@@ -89,23 +115,22 @@ int wal_engine::insert(const statement& st) {
   }
 
   // Add log entry
-  std::string after_tuple = sr.serialize(after_rec, after_rec->sptr);
-  entry_stream.str("");
-  entry_stream << st.transaction_id << " " << st.op_type << " " << st.table_id
-               << " " << after_tuple << "\n";
-  entry_str = entry_stream.str();
-  fs_log.push_back(entry_str);
+  wal_encode_begin(entry_str);
+  wal_encode_tuple(entry_str, after_rec);
+  wal_encode_end(entry_str, st.transaction_id, tid, st.op_type,
+                 st.table_id);
+  append_log(entry_str);
 
   // Add to table
   tab->pm_data->push_back(after_rec);
 
+  std::string after_tuple = sr.serialize(after_rec, after_rec->sptr);
   off_t storage_offset;
   storage_offset = tab->fs_data.push_back(after_tuple);
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(after_rec);
 
     indices->at(index_itr)->pm_map->insert(key, after_rec);
     indices->at(index_itr)->off_map->insert(key, storage_offset);
@@ -118,14 +143,13 @@ int wal_engine::remove(const statement& st) {
   LOG_INFO("Remove");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
   record* before_rec = NULL;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(rec_ptr);
 
   // Check if key does not exist
   if (indices->at(0)->pm_map->at(key, &before_rec) == false) {
@@ -134,19 +158,17 @@ int wal_engine::remove(const statement& st) {
   }
 
   // Add log entry
-  entry_stream.str("");
-  entry_stream << st.transaction_id << " " << st.op_type << " " << st.table_id
-               << " " << sr.serialize(before_rec, before_rec->sptr) << "\n";
-
-  entry_str = entry_stream.str();
-  fs_log.push_back(entry_str);
+  wal_encode_begin(entry_str);
+  wal_encode_tuple(entry_str, before_rec);
+  wal_encode_end(entry_str, st.transaction_id, tid, st.op_type,
+                 st.table_id);
+  append_log(entry_str);
 
   tab->pm_data->erase(before_rec);
 
   // Remove entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(rec_ptr, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(rec_ptr);
 
     indices->at(index_itr)->pm_map->erase(key);
     indices->at(index_itr)->off_map->erase(key);
@@ -163,10 +185,9 @@ int wal_engine::update(const statement& st) {
   LOG_INFO("Update");
   record* rec_ptr = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = db->tables->at(st.table_id)->indices;
+  pvector<table_index*>* indices = db->tables->at(st.table_id)->indices;
 
-  std::string key_str = sr.serialize(rec_ptr, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(rec_ptr);
   record* before_rec;
 
   // Check if key does not exist
@@ -176,10 +197,9 @@ int wal_engine::update(const statement& st) {
     return EXIT_SUCCESS;
   }
 
-  entry_stream.str("");
-  entry_stream << st.transaction_id << " " << st.op_type << " " << st.table_id
-               << " ";
-  entry_stream << sr.serialize(before_rec, tab->sptr) << " ";
+  // Before image
+  wal_encode_begin(entry_str);
+  wal_encode_tuple(entry_str, before_rec);
 
   // Update existing record
   for (int field_itr : st.field_ids) {
@@ -191,13 +211,16 @@ int wal_engine::update(const statement& st) {
     before_rec->set_data(field_itr, rec_ptr);
   }
 
-  std::string before_tuple;
-  before_tuple = sr.serialize(before_rec, tab->sptr);
-  entry_stream << before_tuple  << "\n";
+  // After image
+  wal_encode_tuple(entry_str, before_rec);
+  wal_encode_end(entry_str, st.transaction_id, tid, st.op_type,
+                 st.table_id);
 
   // Add log entry
-  entry_str = entry_stream.str();
-  fs_log.push_back(entry_str);
+  append_log(entry_str);
+
+  std::string before_tuple;
+  before_tuple = sr.serialize(before_rec, tab->sptr);
 
   off_t storage_offset = 0;
   indices->at(0)->off_map->at(key, &storage_offset);
@@ -207,33 +230,66 @@ int wal_engine::update(const statement& st) {
   return EXIT_SUCCESS;
 }
 
+// Append entry to the shared log, or to the log of this executor
+void wal_engine::append_log(const std::string& entry) {
+  if (conf.slog != NULL) {
+    txn_lsn = conf.slog->push_back(entry);
+  } else {
+    fs_log.push_back(entry);
+  }
+}
+
 void wal_engine::txn_begin() {
 }
 
-void wal_engine::txn_end(__attribute__((unused)) bool commit) {
+// Block until the flusher has synced past the last entry of this txn
+void wal_engine::txn_end(bool commit) {
+  if (read_only || !commit)
+    return;
+
+  auto start = std::chrono::steady_clock::now();
+
+  if (conf.slog != NULL) {
+    conf.slog->commit(txn_lsn);
+  } else {
+    off_t lsn = fs_log.log_offset;
+    std::unique_lock<std::mutex> lk(gc_mutex);
+    if (durable_lsn < lsn) {
+      requested_lsn = std::max(requested_lsn, lsn);
+      commit_waiters++;
+      gc_cv.notify_one();
+
+      commit_cv.wait(lk, [&] {return durable_lsn >= lsn;});
+      commit_waiters--;
+    }
+  }
+
+  std::chrono::duration<double, std::micro> latency =
+      std::chrono::steady_clock::now() - start;
+  commit_latencies.push_back(latency.count());
 }
 
 void wal_engine::load(const statement& st) {
   //LOG_INFO("Load");
+  loading = true;
   record* after_rec = st.rec_ptr;
   table* tab = db->tables->at(st.table_id);
-  plist<table_index*>* indices = tab->indices;
+  pvector<table_index*>* indices = tab->indices;
 
   unsigned int num_indices = tab->num_indices;
   unsigned int index_itr;
 
-  std::string key_str = sr.serialize(after_rec, indices->at(0)->sptr);
-  unsigned long key = hash_fn(key_str);
+  unsigned long key = indices->at(0)->get_key(after_rec);
 
   std::string after_tuple = sr.serialize(after_rec, after_rec->sptr);
 
   // Add log entry
   if (!conf.recovery) {
-    entry_stream.str("");
-    entry_stream << st.transaction_id << " " << st.op_type << " " << st.table_id
-                 << " " << after_tuple << "\n";
-    entry_str = entry_stream.str();
-    fs_log.push_back(entry_str);
+    wal_encode_begin(entry_str);
+    wal_encode_tuple(entry_str, after_rec);
+    wal_encode_end(entry_str, st.transaction_id, tid, st.op_type,
+                   st.table_id);
+    append_log(entry_str);
   }
 
   tab->pm_data->push_back(after_rec);
@@ -243,8 +299,7 @@ void wal_engine::load(const statement& st) {
 
   // Add entry in indices
   for (index_itr = 0; index_itr < num_indices; index_itr++) {
-    key_str = sr.serialize(after_rec, indices->at(index_itr)->sptr);
-    key = hash_fn(key_str);
+    key = indices->at(index_itr)->get_key(after_rec);
 
     indices->at(index_itr)->pm_map->insert(key, after_rec);
     indices->at(index_itr)->off_map->insert(key, storage_offset);
@@ -252,13 +307,53 @@ void wal_engine::load(const statement& st) {
 
 }
 
+// Flusher : syncs the log when txns wait to commit, at least every
+// gc_interval ms. When several txns commit per sync, it lingers a little
+// for the rest of the expected batch; the linger grows while batches fill
+// up and shrinks when they do not.
 void wal_engine::group_commit() {
+  std::chrono::microseconds max_linger(conf.gc_interval * 1000);
+  std::chrono::microseconds linger(0);
+  unsigned int batch_size = 1;  // expected commits per sync
+  unsigned int num_waiters;
+  off_t lsn;
+
+  std::unique_lock<std::mutex> lk(gc_mutex);
 
   while (ready) {
+    gc_cv.wait_for(lk, std::chrono::milliseconds(conf.gc_interval),
+                   [&] {return !ready || requested_lsn > durable_lsn;});
+
+    if (batch_size > 1 && linger.count() > 0) {
+      bool filled = gc_cv.wait_for(lk, linger, [&] {
+        return !ready || commit_waiters >= batch_size;});
+
+      if (filled)
+        linger = std::min(max_linger, linger * 2);
+      else
+        linger = linger / 2;
+    }
+
+    num_waiters = commit_waiters;
+    lk.unlock();
+
     // sync
-    fs_log.sync();
+    lsn = fs_log.log_offset;
+    if (lsn > durable_lsn) {
+      fs_log.flush();
+      fs_log.sync();
+    }
+
+    lk.lock();
+    durable_lsn = std::max(durable_lsn, lsn);
+    commit_cv.notify_all();
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(conf.gc_interval));
+    // adapt to the number of concurrent committers
+    batch_size = std::max(1U, (batch_size + num_waiters + 1) / 2);
+    if (batch_size > 1 && linger.count() == 0)
+      linger = std::chrono::microseconds(10);
+    else if (batch_size == 1)
+      linger = std::chrono::microseconds(0);
   }
 }
 
@@ -267,21 +362,26 @@ void wal_engine::recovery() {
   LOG_INFO("WAL recovery");
 
   // Setup recovery
-  fs_log.sync();
+  std::string log_file_name;
+  if (conf.slog != NULL) {
+    conf.slog->flush();
+    conf.slog->disable();
+    log_file_name = conf.slog->log_file_name;
+  } else {
+    fs_log.flush();
+    fs_log.sync();
+    log_file_name = fs_log.log_file_name;
+  }
   fs_log.disable();
 
   // Clear off_map and rebuild it
-  std::vector<table*> tables = db->tables->get_data();
-  for (table* tab : tables) {
-    std::vector<table_index*> indices = tab->indices->get_data();
-
-    for (table_index* index : indices) {
+  for (table* tab : *db->tables) {
+    for (table_index* index : *tab->indices) {
       index->off_map->clear();
     }
   }
 
   int op_type, txn_id, table_id;
-  std::string entry_str, tuple_str;
   table* tab;
   statement st;
   bool undo_mode = false;
@@ -289,19 +389,51 @@ void wal_engine::recovery() {
   timer rec_t;
   rec_t.start();
 
-  std::ifstream log_file(fs_log.log_file_name);
-  int total_txns = std::count(std::istreambuf_iterator<char>(log_file),
-                              std::istreambuf_iterator<char>(), '\n');
-  log_file.clear();
-  log_file.seekg(0, std::ios::beg);
+  // Map the log and decode the records in place
+  int log_fd = open(log_file_name.c_str(), O_RDONLY);
+  struct stat log_stat;
+  if (log_fd < 0 || fstat(log_fd, &log_stat) < 0) {
+    perror("open log");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t log_len = log_stat.st_size;
+  char* log_buf = NULL;
+  if (log_len > 0) {
+    log_buf = (char*) mmap(NULL, log_len, PROT_READ, MAP_PRIVATE, log_fd, 0);
+    if (log_buf == MAP_FAILED) {
+      perror("mmap log");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Count complete entries, a torn tail ends the log
+  const wal_record_header* hdr;
+  size_t log_offset = 0;
+  int total_txns = 0;
+  while ((hdr = wal_decode_header(log_buf + log_offset, log_len - log_offset))
+      != NULL) {
+    log_offset += sizeof(wal_record_header) + hdr->len;
+    if (hdr->tid == tid)
+      total_txns++;
+  }
+  size_t log_end = log_offset;
 
   int entry_itr = 0;
-  while (std::getline(log_file, entry_str)) {
+  log_offset = 0;
+  while (log_offset < log_end) {
+    hdr = (const wal_record_header*) (log_buf + log_offset);
+    const char* cursor = log_buf + log_offset + sizeof(wal_record_header);
+    log_offset += sizeof(wal_record_header) + hdr->len;
+
+    // Entries of other executors in the shared log
+    if (hdr->tid != tid)
+      continue;
     entry_itr++;
-    //std::cerr << "entry :  " << entry_str.c_str() << std::endl;
-    std::stringstream entry(entry_str);
 
-    entry >> txn_id >> op_type >> table_id;
+    txn_id = hdr->txn_id;
+    op_type = hdr->op_type;
+    table_id = hdr->table_id;
 
     if (undo_mode || (total_txns - txn_id < conf.active_txn_threshold)) {
       undo_mode = true;
@@ -327,8 +459,7 @@ void wal_engine::recovery() {
         tab = db->tables->at(table_id);
         schema* sptr = tab->sptr;
 
-        tuple_str = get_tuple(entry, sptr);
-        record* after_rec = sr.deserialize(tuple_str, sptr);
+        record* after_rec = wal_decode_tuple(cursor, sptr);
         st = statement(0, operation_type::Insert, table_id, after_rec);
         insert(st);
       }
@@ -344,8 +475,7 @@ void wal_engine::recovery() {
         tab = db->tables->at(table_id);
         schema* sptr = tab->sptr;
 
-        tuple_str = get_tuple(entry, sptr);
-        record* before_rec = sr.deserialize(tuple_str, sptr);
+        record* before_rec = wal_decode_tuple(cursor, sptr);
         st = statement(0, operation_type::Delete, table_id, before_rec);
         remove(st);
       }
@@ -360,10 +490,8 @@ void wal_engine::recovery() {
 
         tab = db->tables->at(table_id);
         schema* sptr = tab->sptr;
-        tuple_str = get_tuple(entry, sptr);
-        record* before_rec = sr.deserialize(tuple_str, sptr);
-        tuple_str = get_tuple(entry, sptr);
-        record* after_rec = sr.deserialize(tuple_str, sptr);
+        record* before_rec = wal_decode_tuple(cursor, sptr);
+        record* after_rec = wal_decode_tuple(cursor, sptr);
 
         if (!undo_mode) {
           st = statement(0, operation_type::Delete, table_id, before_rec);
@@ -387,6 +515,10 @@ void wal_engine::recovery() {
 
   }
 
+  if (log_buf != NULL)
+    munmap(log_buf, log_len);
+  close(log_fd);
+
   rec_t.end();
   std::cerr << "WAL :: Recovery duration (ms) : " << rec_t.duration()
             << std::endl;
@@ -32,8 +32,9 @@ table* create_usertable(config& conf) {
   cols.push_back(key);
 
   for (int itr = 1; itr <= conf.ycsb_num_val_fields; itr++) {
-    field_info val = field_info(offset, 12, conf.ycsb_field_size,
-                                field_type::VARCHAR, 0, 1);
+    field_info val = field_info(
+        offset, 12, conf.ycsb_field_size, field_type::VARCHAR,
+        varchar_inlined(conf.ycsb_field_size, conf.inline_threshold), 1);
     offset += val.ser_len;
     cols.push_back(val);
   }
@@ -66,24 +67,40 @@ ycsb_benchmark::ycsb_benchmark(config _conf, unsigned int tid, database* _db,
                                timer* _tm, struct static_info* _sp)
     : benchmark(tid, _db, _tm, _sp),
       conf(_conf),
-      txn_id(0) {
+      txn_id(0),
+      first_key(0) {
 
   btype = benchmark_type::YCSB;
 
   // Partition workload
   num_keys = conf.num_keys / conf.num_executors;
   num_txns = conf.num_txns / conf.num_executors;
+
+  // A shared database gets every executor's keys, and any executor
+  // accesses any of them
+  unsigned int key_range = num_keys;
+  int seed = 0;
+  if (conf.shared_db) {
+    first_key = tid * num_keys;
+    key_range = num_keys * conf.num_executors;
+    seed = tid;
+  }
   std::cerr << "num_keys :: " << num_keys << std::endl;
   std::cerr << "num_txns :: " << num_txns << std::endl;
   std::cerr << "num_exec :: " << conf.num_executors << std::endl;
 
+  stats.set_types({"update", "read"});
+
   // Initialization mode
   if (sp->init == 0) {
     std::cerr << "Initialization Mode" << std::endl << std::flush;
     sp->ptrs[0] = _db;
 
-    table* usertable = create_usertable(conf);
-    db->tables->push_back(usertable);
+    // The first executor creates the tables of a shared database
+    if (db->tables->empty()) {
+      table* usertable = create_usertable(conf);
+      db->tables->push_back(usertable);
+    }
 
     sp->init = 1;
   } else {
@@ -96,7 +113,7 @@ ycsb_benchmark::ycsb_benchmark(config _conf, unsigned int tid, database* _db,
 
   if (conf.recovery) {
     num_txns = conf.num_txns;
-    num_keys = 1000;
+    num_keys = key_range = 1000;
     conf.ycsb_per_writes = 0.5;
     conf.ycsb_tuples_per_txn = 20;
   }
@@ -110,9 +127,9 @@ ycsb_benchmark::ycsb_benchmark(config _conf, unsigned int tid, database* _db,
   }
 
   // Generate skewed dist
-  simple_skew(zipf_dist, conf.ycsb_skew, num_keys,
-              num_txns * conf.ycsb_tuples_per_txn);
-  uniform(uniform_dist, num_txns);
+  simple_skew(zipf_dist, conf.ycsb_skew, key_range,
+              num_txns * conf.ycsb_tuples_per_txn, seed);
+  uniform(uniform_dist, num_txns, seed);
 
 }
 
@@ -134,7 +151,7 @@ void ycsb_benchmark::load() {
     }
 
     // LOAD
-    int key = txn_itr;
+    int key = first_key + txn_itr;
     int is_persistent = 1;
     std::string value = get_rand_astring(conf.ycsb_field_size);
 
@@ -195,9 +212,9 @@ void ycsb_benchmark::do_read(engine* ee) {
   int zipf_dist_offset = txn_id * conf.ycsb_tuples_per_txn;
   txn_id++;
   std::string empty;
-  std::string rc;
+  record_view view;
 
-  TIMER(ee->txn_begin())
+  TIMER(ee->txn_begin_read_only())
 
   for (int stmt_itr = 0; stmt_itr < conf.ycsb_tuples_per_txn; stmt_itr++) {
 
@@ -209,7 +226,11 @@ void ycsb_benchmark::do_read(engine* ee) {
     statement st(txn_id, operation_type::Select, USER_TABLE_ID, rec_ptr, 0,
                  user_table_schema);
 
-    TIMER(ee->select(st))
+    TIMER(ee->select(st, view))
+    if (view.empty()) {
+      TIMER(ee->txn_end(false))
+      return;
+    }
   }
 
   TIMER(ee->txn_end(true))
@@ -261,29 +282,37 @@ void ycsb_benchmark::sim_crash() {
   delete ee;
 }
 
-void ycsb_benchmark::execute() {
-  engine* ee = new engine(conf, tid, db, conf.read_only);
-  unsigned int txn_itr;
-  status ss(num_txns);
+void ycsb_benchmark::execute_begin() {
+  ee = new engine(conf, tid, db, conf.read_only);
+  progress = status(num_txns);
 
   std::cerr << "num_txns :: " << num_txns << std::endl;
+}
 
-  for (txn_itr = 0; txn_itr < num_txns; txn_itr++) {
+void ycsb_benchmark::execute_txns(unsigned int begin, unsigned int end) {
+  unsigned int txn_itr;
+
+  for (txn_itr = begin; txn_itr < end; txn_itr++) {
     double u = uniform_dist[txn_itr];
 
     if (u < conf.ycsb_per_writes) {
       do_update(ee);
+      stats.record(UPDATE_TXN, ee->committed);
     } else {
       do_read(ee);
+      stats.record(READ_TXN, ee->committed);
     }
 
     if (tid == 0)
-      ss.display();
+      progress.display();
   }
+}
 
+void ycsb_benchmark::execute_end() {
   std::cerr << "duration :: " << tm->duration() << std::endl;
 
   delete ee;
+  ee = NULL;
 }
 
 }
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+#include "lock_manager.h"
+
+namespace storage {
+
+void test_lock_manager() {
+  lock_manager lm;
+
+  // readers share, writers exclude
+  assert(lm.tuple_rdlock(1) == 0);
+  assert(lm.tuple_rdlock(1) == 0);
+  assert(lm.tuple_wrlock(1) == -1);
+  assert(lm.tuple_unlock(1) == 0);
+  assert(lm.tuple_unlock(1) == 0);
+  assert(lm.tuple_unlock(1) == -1);
+
+  assert(lm.tuple_wrlock(2) == 0);
+  assert(lm.tuple_rdlock(2) == -1);
+  assert(lm.tuple_wrlock(2) == -1);
+  assert(lm.tuple_unlock(2) == 0);
+  assert(lm.tuple_rdlock(2) == 0);
+  assert(lm.tuple_unlock(2) == 0);
+
+  // only a single reader upgrades
+  assert(lm.tuple_rdlock(3) == 0);
+  assert(lm.tuple_rdlock(3) == 0);
+  assert(lm.tuple_upgrade(3) == -1);
+  assert(lm.tuple_unlock(3) == 0);
+  assert(lm.tuple_upgrade(3) == 0);
+  assert(lm.tuple_rdlock(3) == -1);
+  assert(lm.tuple_unlock(3) == 0);
+  assert(lm.tuple_upgrade(3) == -1);
+
+  assert(lm.num_aborts() == 6);
+
+  // a write lock is held by one thread at a time
+  int num_threads = 4;
+  int ops = 100000;
+  long counter = 0;
+  std::vector<std::thread> threads;
+
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([&]() {
+      for (int itr = 0; itr < ops; itr++) {
+        while (lm.tuple_wrlock(42) != 0)
+          std::this_thread::yield();
+        counter++;
+        lm.tuple_unlock(42);
+      }
+    }));
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+
+  assert(counter == (long) num_threads * ops);
+}
+
+}
+
+int main() {
+  storage::test_lock_manager();
+  return 0;
+}
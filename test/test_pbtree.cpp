@@ -1,5 +1,7 @@
 #include <iostream>
 #include <cassert>
+#include <thread>
+#include <vector>
 #include <unistd.h>
 
 #include "pbtree.h"
@@ -21,19 +23,114 @@ void test_pbtree() {
   pbtree<int, int>* tree = new pbtree<int, int>(&sp->ptrs[0]);
 
   int key;
-  int ops = 10;
+  int val;
+  int ops = 10000;
 
+  // enough keys to split leaves and inner nodes
   for (int i = 0; i < ops; i++) {
-    key = i;
-    tree->insert(key, 0);
+    key = (i * 7919) % ops;
+    tree->insert(key, i);
   }
 
   assert(tree->size() == ops);
+  assert(tree->insert(0, 0).second == false);
+
+  for (int i = 0; i < ops; i++) {
+    assert(tree->at((i * 7919) % ops, &val));
+    assert(val == i);
+  }
 
   tree->erase(0);
   assert(tree->size() == ops - 1);
+  assert(tree->exists(0) == false);
+
+  // empty out whole leaves
+  for (key = 1; key < ops / 2; key++)
+    tree->erase(key);
+  assert(tree->size() == ops / 2);
+
+  // inner nodes are rebuilt from the leaves
+  tree->recover();
+  assert(tree->size() == ops / 2);
+
+  int num_keys = 0;
+  for (auto itr = tree->begin(); itr != tree->end(); itr++) {
+    assert(itr->first >= ops / 2);
+    num_keys++;
+  }
+  assert(num_keys == ops / 2);
+
+  for (key = ops / 2; key < ops; key++)
+    assert(tree->exists(key));
 
   delete tree;
+
+  // executors sharing one tree, each inserting and reading its own keys
+  // while the others split the same leaves
+  pbtree<int, int>* shared = new pbtree<int, int>(&sp->ptrs[1]);
+  shared->enable_sharing();
+
+  int num_threads = 4;
+  std::vector<std::thread> threads;
+
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([=]() {
+      int v;
+      for (int i = tid; i < ops; i += num_threads) {
+        assert(shared->insert(i, i).second);
+        assert(shared->at(i, &v) && v == i);
+      }
+      for (int i = tid; i < ops; i += 2 * num_threads)
+        assert(shared->erase(i) == 1);
+    }));
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+
+  assert(shared->size() == (size_t) (ops / 2));
+  for (key = 0; key < ops; key++)
+    assert(shared->exists(key) == ((key % (2 * num_threads)) >= num_threads));
+
+  // executors emptying whole leaves of the lower half while another one
+  // reads the upper half, the empty leaves go to the epoch manager
+  threads.clear();
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([=]() {
+      int range = ops / 2 / num_threads;
+      for (int i = tid * range; i < (tid + 1) * range; i++) {
+        if ((i % (2 * num_threads)) >= num_threads)
+          assert(shared->erase(i) == 1);
+      }
+    }));
+  }
+
+  threads.push_back(std::thread([=]() {
+    int v;
+    for (int round = 0; round < 4; round++) {
+      for (int i = ops / 2; i < ops; i++)
+        assert(shared->at(i, &v) == ((i % (2 * num_threads)) >= num_threads));
+    }
+  }));
+
+  for (auto& thread : threads)
+    thread.join();
+
+  assert(shared->size() == (size_t) (ops / 4));
+  num_keys = 0;
+  for (auto itr = shared->begin(); itr != shared->end(); itr++) {
+    assert(itr->first >= ops / 2);
+    num_keys++;
+  }
+  assert(num_keys == ops / 4);
+
+  // the lower half still takes inserts
+  for (key = 0; key < ops / 2; key++)
+    assert(shared->insert(key, key).second);
+  assert(shared->size() == (size_t) (ops / 2 + ops / 4));
+
+  global_epochs()->drain();
+  delete shared;
 }
 
 }
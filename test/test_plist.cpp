@@ -31,14 +31,14 @@ int test_plist() {
     key = rand() % 10;
 
     std::string str(2, 'a' + key);
-    char* data = new char[3];
+    char* data = (char*) pmalloc(3);
     pmemalloc_activate(data);
     strcpy(data, str.c_str());
 
     list->push_back(data);
   }
 
-  char* updated_val = new char[3];
+  char* updated_val = (char*) pmalloc(3);
   pmemalloc_activate(updated_val);
   strcpy(updated_val, "ab");
 
@@ -47,7 +47,7 @@ int test_plist() {
 
   assert(list->at(2) == updated_val);
 
-  updated_val = new char[3];
+  updated_val = (char*) pmalloc(3);
   pmemalloc_activate(updated_val);
   strcpy(updated_val, "cd");
 
@@ -2,6 +2,8 @@
 #include <cstring>
 #include <string>
 #include <cassert>
+#include <thread>
+#include <vector>
 #include <unistd.h>
 
 #include "libpm.h"
@@ -27,7 +29,7 @@ void test_pmem() {
   for (int i = 0; i < ops; i++) {
     sz = rand() % 1024;
 
-    char* vc = new char[sz];
+    char* vc = (char*) pmalloc(sz);
     if (sz % 4 == 0)
       pmemalloc_activate(vc);
 
@@ -36,12 +38,52 @@ void test_pmem() {
   }
 }
 
+// Executors allocating and freeing through their thread arenas
+void test_pmem_arena(const char* path) {
+  int num_threads = 4;
+  int ops = 4096;
+  std::vector<std::thread> executors;
+
+  for (int tid = 0; tid < num_threads; tid++) {
+    executors.push_back(std::thread([ops, tid]() {
+      std::vector<char*> live;
+      unsigned int seed = tid;
+
+      for (int i = 0; i < ops; i++) {
+        size_t sz = 1 + rand_r(&seed) % 2048;
+        char* vc = (char*) pmalloc(sz);
+        memset(vc, 'a' + tid, sz);
+        pmemalloc_activate(vc);
+        live.push_back(vc);
+
+        // free every other allocation, possibly on a different class
+        if (i % 2 == 1) {
+          size_t victim = rand_r(&seed) % live.size();
+          pfree(live[victim]);
+          live[victim] = live.back();
+          live.pop_back();
+        }
+      }
+
+      for (char* vc : live)
+        pfree(vc);
+    }));
+  }
+
+  for (std::thread& executor : executors)
+    executor.join();
+
+  // clump chain must still be intact
+  pmemalloc_check(path);
+}
+
 }
 
 extern struct static_info *sp;
 
 int main(int argc, char *argv[]) {
   storage::test_pmem();
+  storage::test_pmem_arena("./zfile");
   return 0;
 }
 
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <cassert>
+#include <vector>
+#include <unistd.h>
+
+#include "libpm.h"
+#include "pvector.h"
+
+namespace storage {
+
+int test_pvector() {
+  const char* path = "./zfile";
+
+// cleanup
+  unlink(path);
+
+  long pmp_size = 10 * 1024 * 1024;
+  if ((pmp = pmemalloc_init(path, pmp_size)) == NULL)
+    std::cerr << "pmemalloc_init on :" << path << std::endl;
+
+  sp = (struct static_info *) pmemalloc_static_area();
+
+  pvector<char*>* vec = new ((pvector<char*>*) pmalloc(sizeof(pvector<char*>)))
+      pvector<char*>();
+  pmemalloc_activate(vec);
+
+  // span several chunks
+  int ops = 1000;
+  std::vector<char*> vals;
+
+  for (int i = 0; i < ops; i++) {
+    char* data = (char*) pmalloc(8);
+    pmemalloc_activate(data);
+    sprintf(data, "%d", i);
+
+    assert(vec->push_back(data) == i);
+    vals.push_back(data);
+  }
+
+  assert(vec->size() == ops);
+  for (int i = 0; i < ops; i++)
+    assert(vec->at(i) == vals[i]);
+  assert(vec->at(ops) == NULL);
+
+  int itr = 0;
+  for (char* data : *vec)
+    assert(data == vals[itr++]);
+  assert(itr == ops);
+
+  char* updated_val = (char*) pmalloc(3);
+  pmemalloc_activate(updated_val);
+  strcpy(updated_val, "ab");
+
+  vec->update(500, updated_val);
+  assert(vec->at(500) == updated_val);
+
+  // clear keeps the chunks for reuse
+  vec->clear();
+  assert(vec->empty());
+
+  vec->push_back(updated_val);
+  assert(vec->size() == 1 && vec->at(0) == updated_val);
+
+  for (char* data : vals)
+    pfree(data);
+
+  delete vec;
+
+  int ret = std::remove(path);
+
+  return ret;
+}
+
+}
+
+extern struct static_info *sp;
+
+int main(int argc, char *argv[]) {
+  storage::test_pvector();
+
+  return 0;
+}